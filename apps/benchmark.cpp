@@ -37,9 +37,14 @@
 #include <mrpt/utils.h>
 #include <mrpt/system/os.h>
 
+#include "CTaskScheduler.hpp"
+
 #include <numeric>
 #include <iostream>
+#include <iomanip>
 #include <fstream>
+#include <map>
+#include <set>
 
 using namespace mrpt;
 using namespace mrpt::utils;
@@ -49,21 +54,113 @@ using namespace mrpt::obs;
 
 using namespace std;
 
+typedef CObservation3DRangeScan::TPixelLabelInfoPtr TLabelsPtr;
+typedef pair<TTimeStamp,string> TObsKey; // Timestamp and sensor label
+typedef multimap<TObsKey,TLabelsPtr> TPendingLabels; // Duplicated keys are kept
+
 CFileGZInputStream gtRawlog;    // Rawlog with ground truth information
 CFileGZInputStream labeledRawlog; // Labeled rawlog to be compared
 
 string gtRawlogFilename;
 string labeledRawlogFilename;
 
+bool   instancesAsClasses = false; // Compare e.g. table_1 and table_2 as different classes
+string confusionFilename;   // Where to save the confusion matrix, if any
+
+const size_t MAX_PENDING = 500; // Observations waiting for their pair, per rawlog
+
+// Pair of observations to compare, with the class of each label index.
+// Labeled observations without labels have null labels, and all their
+// ground truth pixels are false negatives.
+
+struct TObsPair
+{
+    TLabelsPtr  gt, labeled;
+    vector<int> gtClasses, labeledClasses; // -1 if the index isn't used
+};
+
+// Pixel counts of a pair, for the classes appearing in it
+
+struct TPairResult
+{
+    bool             sizeMismatch;
+    vector<int>      classes;   // Global index of each local class
+    vector<uint64_t> confusion; // (N_classes+1)^2, row-major, 0 is no class
+    vector<uint64_t> TP, FP, FN;
+    bool             hasLabels;
+    double           success;   // Fraction of ground truth labels appearing
+
+    TPairResult() : sizeMismatch(false), hasLabels(false), success(0)
+    {}
+};
+
+struct TResults
+{
+    vector<string>           classNames;    // 0 is no class
+    map<string,int>          classIndices;
+    vector<vector<uint64_t> > confusion;    // [ground truth][labeled]
+    vector<uint64_t>         TP, FP, FN;
+    vector<double>           v_success;
+    size_t                   N_pairs;
+    size_t                   N_sizeMismatches;
+    size_t                   N_gtUnmatched;
+    size_t                   N_labeledUnmatched;
+    size_t                   N_gtDuplicates;     // Keys already read in the rawlog
+    size_t                   N_labeledDuplicates;
+    size_t                   N_withoutLabels;    // Pairs without labeled labels
+
+    TResults() : N_pairs(0), N_sizeMismatches(0), N_gtUnmatched(0),
+        N_labeledUnmatched(0), N_gtDuplicates(0), N_labeledDuplicates(0),
+        N_withoutLabels(0)
+    {
+        getClassIndex("none");
+    }
+
+    int getClassIndex( const string &className )
+    {
+        map<string,int>::iterator it = classIndices.find(className);
+
+        if ( it != classIndices.end() )
+            return it->second;
+
+        const int index = classNames.size();
+
+        classNames.push_back(className);
+        classIndices[className] = index;
+
+        for ( size_t row = 0; row < confusion.size(); row++ )
+            confusion[row].push_back(0);
+
+        confusion.push_back( vector<uint64_t>(index+1,0) );
+        TP.push_back(0); FP.push_back(0); FN.push_back(0);
+
+        return index;
+    }
+};
+
+TResults results;
+
+
 //-----------------------------------------------------------
 //
-//                      loadConfig
+//                      getClassName
 //
 //-----------------------------------------------------------
 
-void loadConfig()
+// Class of an instance label, removing its "_<id>" suffix (table_1 -> table).
+
+string getClassName( const string &label )
 {
+    if ( instancesAsClasses )
+        return label;
+
+    const size_t pos = label.find_last_of('_');
+
+    if ( ( pos == string::npos ) || ( pos+1 == label.size() )
+         || ( label.find_first_not_of("0123456789",pos+1) != string::npos ) )
+        return label;
 
+    return label.substr(0,pos);
 }
 
 
@@ -79,7 +176,10 @@ void showUsageInformation()
             "    (1) Rawlog file with ground truth information." << endl <<
             "    (2) Rawlog file with annotated labels." << endl;
    cout << "Then, optional parameters:" << endl <<
-            "    -h                         : Shows this help." << endl;
+            "    -h                         : Shows this help." << endl <<
+            "    -instances                 : Compare instance labels (e.g. table_1) instead of classes." << endl <<
+            "    -confusion <file>          : Save the pixel confusion matrix to a file." << endl <<
+            "    -threads <num>             : Number of threads to use (all the cores by default)." << endl;
 
 }
 
@@ -104,6 +204,20 @@ int loadParameters(int argc, char* argv[])
                 showUsageInformation();
                 return -1;
             }
+            else if ( !strcmp(argv[arg],"-instances") )
+            {
+                instancesAsClasses = true;
+            }
+            else if ( !strcmp(argv[arg],"-confusion") && ( arg+1 < argc ) )
+            {
+                confusionFilename = argv[arg+1];
+                arg++;
+            }
+            else if ( !strcmp(argv[arg],"-threads") && ( arg+1 < argc ) )
+            {
+                OLT::CTaskScheduler::setNumThreads( atoi(argv[arg+1]) );
+                arg++;
+            }
             else
             {
                 cout << "  [ERROR] Unknown option " << argv[arg] << endl;
@@ -124,12 +238,497 @@ int loadParameters(int argc, char* argv[])
 }
 
 
+//-----------------------------------------------------------
+//
+//                     readNextLabels
+//
+//-----------------------------------------------------------
+
+// Pixel labels of the next 3D observation with labels in a rawlog. Depth and
+// intensity images are dropped at once, only the labels are kept. If
+// keepUnlabeled is set, observations without labels are also returned, with
+// null labels.
+
+bool readNextLabels( CFileGZInputStream &rawlog, size_t &obsIndex,
+                     TObsKey &key, TLabelsPtr &labels, bool keepUnlabeled )
+{
+    CActionCollectionPtr action;
+    CSensoryFramePtr observations;
+    CObservationPtr obs;
+
+    while ( CRawlog::getActionObservationPairOrObservation(rawlog,action,observations,obs,obsIndex) )
+    {
+        if ( !(obsIndex % 200) )
+        {
+            if ( !(obsIndex % 1000) ) cout << "+ "; else cout << ". ";
+            cout.flush();
+        }
+
+        if ( obs.null() || !IS_CLASS(obs, CObservation3DRangeScan) )
+            continue;
+
+        CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
+
+        if ( !obs3D->hasPixelLabels() && !keepUnlabeled )
+            continue;
+
+        key = TObsKey( obs3D->timestamp, obs3D->sensorLabel );
+        labels = ( obs3D->hasPixelLabels() ) ? obs3D->pixelLabels : TLabelsPtr();
+
+        return true;
+    }
+
+    return false;
+}
+
+
+//-----------------------------------------------------------
+//
+//                    Parallel evaluation
+//
+//-----------------------------------------------------------
+
+// Bitplanes with a bit per pixel for each class appearing in a pair, so the
+// counts are popcounts of ANDs of 64 pixels at a time.
+struct TEvaluatePairs
+{
+    const vector<TObsPair>  &pairs;
+    vector<TPairResult>     &pairResults;
+
+    TEvaluatePairs( const vector<TObsPair> &p, vector<TPairResult> &r ) :
+        pairs(p), pairResults(r)
+    {}
+
+    static void fillPlanes( TLabelsPtr labels, const vector<int> &labelClasses,
+                            const vector<int> &localClasses, size_t N_words,
+                            vector<uint64_t> &planes, vector<uint64_t> &any )
+    {
+        if ( labels.null() )
+            return;
+
+        int N_rows, N_cols;
+        labels->getSize(N_rows,N_cols);
+
+        for ( int row = 0; row < N_rows; row++ )
+            for ( int col = 0; col < N_cols; col++ )
+            {
+                uint64_t pixelLabels;
+                labels->getLabels(row,col,pixelLabels);
+
+                if ( !pixelLabels )
+                    continue;
+
+                const size_t pixel = row*N_cols + col;
+                const uint64_t bit = uint64_t(1) << (pixel%64);
+
+                any[pixel/64] |= bit;
+
+                while ( pixelLabels )
+                {
+                    const int labelIndex = __builtin_ctzll(pixelLabels);
+                    pixelLabels &= pixelLabels-1;
+
+                    if ( labelClasses[labelIndex] < 0 )
+                        continue;
+
+                    const int local = localClasses[labelClasses[labelIndex]];
+                    planes[local*N_words + pixel/64] |= bit;
+                }
+            }
+    }
+
+    void operator()( size_t pair_index ) const
+    {
+        const TObsPair &obsPair = pairs[pair_index];
+        TPairResult &result = pairResults[pair_index];
+
+        TLabelsPtr gtLabels = obsPair.gt;
+        TLabelsPtr labeledLabels = obsPair.labeled;
+
+        int N_rows, N_cols, N_labeledRows, N_labeledCols;
+        gtLabels->getSize(N_rows,N_cols);
+
+        if ( labeledLabels.null() )
+        {
+            N_labeledRows = N_rows;
+            N_labeledCols = N_cols;
+        }
+        else
+            labeledLabels->getSize(N_labeledRows,N_labeledCols);
+
+        if ( ( N_rows != N_labeledRows ) || ( N_cols != N_labeledCols ) )
+        {
+            result.sizeMismatch = true;
+            return;
+        }
+
+        // Label names based success, as previous versions of the benchmark
+
+        size_t labelsAppearing = 0;
+        size_t N_labeledNames = 0;
+
+        if ( !labeledLabels.null() )
+        {
+            std::map<uint32_t,std::string>::const_iterator labelsIt;
+
+            for ( labelsIt = gtLabels->pixelLabelNames.begin();
+                  labelsIt != gtLabels->pixelLabelNames.end();
+                  labelsIt++ )
+                if ( labeledLabels->checkLabelNameExistence(labelsIt->second) >= 0 )
+                    labelsAppearing++;
+
+            N_labeledNames = labeledLabels->pixelLabelNames.size();
+        }
+
+        const size_t maxNumOfLabels = std::max( gtLabels->pixelLabelNames.size(),
+                                                N_labeledNames );
+
+        result.hasLabels = ( maxNumOfLabels > 0 );
+        result.success = ( maxNumOfLabels ) ? labelsAppearing / (double)maxNumOfLabels : 0;
+
+        // Local index of the classes appearing in the pair, 0 is no class
+
+        int maxClass = 0;
+
+        for ( size_t i = 0; i < 64; i++ )
+            maxClass = std::max( maxClass, std::max( obsPair.gtClasses[i], obsPair.labeledClasses[i] ) );
+
+        vector<int> localClasses( maxClass+1, -1 );
+        result.classes.assign( 1, 0 );
+
+        for ( size_t i = 0; i < 64; i++ )
+        {
+            const int classes[2] = { obsPair.gtClasses[i], obsPair.labeledClasses[i] };
+
+            for ( size_t j = 0; j < 2; j++ )
+                if ( ( classes[j] > 0 ) && ( localClasses[classes[j]] < 0 ) )
+                {
+                    localClasses[classes[j]] = result.classes.size();
+                    result.classes.push_back( classes[j] );
+                }
+        }
+
+        const size_t N_classes = result.classes.size();
+        const size_t N_pixels = N_rows*N_cols;
+        const size_t N_words = ( N_pixels + 63 ) / 64;
+
+        vector<uint64_t> gtPlanes( N_classes*N_words, 0 ), labeledPlanes( N_classes*N_words, 0 );
+        vector<uint64_t> gtAny( N_words, 0 ), labeledAny( N_words, 0 );
+
+        fillPlanes( gtLabels, obsPair.gtClasses, localClasses, N_words, gtPlanes, gtAny );
+        fillPlanes( labeledLabels, obsPair.labeledClasses, localClasses, N_words, labeledPlanes, labeledAny );
+
+        // Plane 0 are the pixels without labels
+
+        for ( size_t w = 0; w < N_words; w++ )
+        {
+            const uint64_t valid = ( ( w+1 < N_words ) || !( N_pixels % 64 ) ) ?
+                        ~uint64_t(0) : ( uint64_t(1) << (N_pixels%64) ) - 1;
+
+            gtPlanes[w] = ~gtAny[w] & valid;
+            labeledPlanes[w] = ~labeledAny[w] & valid;
+        }
+
+        result.confusion.assign( N_classes*N_classes, 0 );
+        result.TP.assign( N_classes, 0 );
+        result.FP.assign( N_classes, 0 );
+        result.FN.assign( N_classes, 0 );
+
+        for ( size_t gtClass = 0; gtClass < N_classes; gtClass++ )
+        {
+            const uint64_t *gt = &gtPlanes[gtClass*N_words];
+
+            for ( size_t labeledClass = 0; labeledClass < N_classes; labeledClass++ )
+            {
+                const uint64_t *labeled = &labeledPlanes[labeledClass*N_words];
+                uint64_t count = 0;
+
+                for ( size_t w = 0; w < N_words; w++ )
+                    count += __builtin_popcountll( gt[w] & labeled[w] );
+
+                result.confusion[gtClass*N_classes + labeledClass] = count;
+            }
+
+            const uint64_t *labeled = &labeledPlanes[gtClass*N_words];
+            uint64_t FP = 0, FN = 0;
+
+            for ( size_t w = 0; w < N_words; w++ )
+            {
+                FP += __builtin_popcountll( labeled[w] & ~gt[w] );
+                FN += __builtin_popcountll( gt[w] & ~labeled[w] );
+            }
+
+            result.TP[gtClass] = result.confusion[gtClass*N_classes + gtClass];
+            result.FP[gtClass] = FP;
+            result.FN[gtClass] = FN;
+        }
+    }
+};
+
+
+//-----------------------------------------------------------
+//
+//                      processPairs
+//
+//-----------------------------------------------------------
+
+void processPairs( vector<TObsPair> &pairs )
+{
+    vector<TPairResult> pairResults( pairs.size() );
+
+    TEvaluatePairs evaluatePairs( pairs, pairResults );
+    OLT::parallelFor( 0, pairs.size(), evaluatePairs );
+
+    // Accumulate the results in order, so they don't depend on the threads
+
+    for ( size_t pair_index = 0; pair_index < pairs.size(); pair_index++ )
+    {
+        const TPairResult &result = pairResults[pair_index];
+
+        if ( result.sizeMismatch )
+        {
+            results.N_sizeMismatches++;
+            continue;
+        }
+
+        results.N_pairs++;
+
+        if ( pairs[pair_index].labeled.null() )
+            results.N_withoutLabels++;
+
+        if ( result.hasLabels )
+            results.v_success.push_back( result.success );
+
+        const size_t N_classes = result.classes.size();
+
+        for ( size_t i = 0; i < N_classes; i++ )
+        {
+            const int gtClass = result.classes[i];
+
+            for ( size_t j = 0; j < N_classes; j++ )
+                results.confusion[gtClass][result.classes[j]] += result.confusion[i*N_classes + j];
+
+            results.TP[gtClass] += result.TP[i];
+            results.FP[gtClass] += result.FP[i];
+            results.FN[gtClass] += result.FN[i];
+        }
+    }
+
+    pairs.clear();
+}
+
+
+//-----------------------------------------------------------
+//
+//                        addPending
+//
+//-----------------------------------------------------------
+
+// Keep the labels of an observation until its pair shows up in the other
+// rawlog. If too many are waiting, the oldest ones are given up. Labeled
+// observations without labels only matter if they have ground truth, so
+// they aren't counted as unmatched.
+
+void addPending( TPendingLabels &pending, const TObsKey &key,
+                 const TLabelsPtr &labels, size_t &N_unmatched )
+{
+    pending.insert( make_pair(key,labels) );
+
+    while ( pending.size() > MAX_PENDING )
+    {
+        if ( !pending.begin()->second.null() )
+            N_unmatched++;
+
+        pending.erase( pending.begin() );
+    }
+}
+
+size_t countUnmatched( const TPendingLabels &pending )
+{
+    size_t N_unmatched = 0;
+
+    for ( TPendingLabels::const_iterator it = pending.begin(); it != pending.end(); it++ )
+        if ( !it->second.null() )
+            N_unmatched++;
+
+    return N_unmatched;
+}
+
+
+//-----------------------------------------------------------
+//
+//                     pairObservation
+//
+//-----------------------------------------------------------
+
+// Pair the labels of an observation read from a rawlog with the ones waiting
+// in the other rawlog with the same timestamp and sensor, or make them wait.
+// Observations with a key already read in their rawlog are counted, and
+// paired in the order they appear.
+
+void pairObservation( const TObsKey &key, const TLabelsPtr &labels, bool fromGt,
+                      TPendingLabels &gtPending,
+                      TPendingLabels &labeledPending,
+                      set<TObsKey> &readKeys,
+                      vector<TObsPair> &pairs )
+{
+    if ( !readKeys.insert(key).second )
+    {
+        if ( fromGt )
+            results.N_gtDuplicates++;
+        else
+            results.N_labeledDuplicates++;
+    }
+
+    TPendingLabels &others = ( fromGt ) ? labeledPending : gtPending;
+    TPendingLabels::iterator it = others.find(key);
+
+    if ( it == others.end() )
+    {
+        if ( fromGt )
+            addPending( gtPending, key, labels, results.N_gtUnmatched );
+        else
+            addPending( labeledPending, key, labels, results.N_labeledUnmatched );
+
+        return;
+    }
+
+    TObsPair obsPair;
+    obsPair.gt = ( fromGt ) ? labels : it->second;
+    obsPair.labeled = ( fromGt ) ? it->second : labels;
+    pairs.push_back(obsPair);
+
+    others.erase(it);
+}
+
+
+//-----------------------------------------------------------
+//
+//                      getLabelClasses
+//
+//-----------------------------------------------------------
+
+void getLabelClasses( const TLabelsPtr &labels, vector<int> &labelClasses )
+{
+    labelClasses.assign( 64, -1 );
+
+    if ( labels.null() )
+        return;
+
+    std::map<uint32_t,std::string>::const_iterator it;
+
+    for ( it = labels->pixelLabelNames.begin(); it != labels->pixelLabelNames.end(); it++ )
+        if ( it->first < 64 )
+            labelClasses[it->first] = results.getClassIndex( getClassName(it->second) );
+}
+
+
+//-----------------------------------------------------------
+//
+//                      showResults
+//
+//-----------------------------------------------------------
+
+void showResults()
+{
+    const size_t N_classes = results.classNames.size();
+
+    cout << "  [INFO] Results: " << endl;
+    cout << "           - Pairs of observations compared: " << results.N_pairs << endl;
+
+    if ( results.N_sizeMismatches )
+        cout << "           - Pairs with different image sizes: " << results.N_sizeMismatches << endl;
+
+    cout << "           - Observations without pair: " << results.N_gtUnmatched
+         << " (ground truth) " << results.N_labeledUnmatched << " (labeled)" << endl;
+
+    if ( results.N_withoutLabels )
+        cout << "           - Labeled observations without labels (false negatives): "
+             << results.N_withoutLabels << endl;
+
+    if ( results.N_gtDuplicates || results.N_labeledDuplicates )
+        cout << "           - Observations with a repeated timestamp and sensor: "
+             << results.N_gtDuplicates << " (ground truth) "
+             << results.N_labeledDuplicates << " (labeled)" << endl;
+
+    if ( !results.v_success.empty() )
+    {
+        double sumSuccess = std::accumulate(results.v_success.begin(), results.v_success.end(), 0.0);
+        cout << "           - Mean success: " << 100*sumSuccess / results.v_success.size() << "%" << endl;
+    }
+
+    cout << endl << setw(20) << left << "    Class" << right
+         << setw(12) << "GT pixels" << setw(12) << "Precision"
+         << setw(12) << "Recall" << setw(12) << "IoU" << endl;
+
+    double sumIoU = 0;
+    size_t N_evaluated = 0;
+
+    for ( size_t i = 1; i < N_classes; i++ )
+    {
+        const double TP = results.TP[i];
+        const double FP = results.FP[i];
+        const double FN = results.FN[i];
+
+        const double precision = ( TP+FP ) ? TP/(TP+FP) : 0;
+        const double recall    = ( TP+FN ) ? TP/(TP+FN) : 0;
+        const double IoU       = ( TP+FP+FN ) ? TP/(TP+FP+FN) : 0;
+
+        if ( TP+FN )
+        {
+            sumIoU += IoU;
+            N_evaluated++;
+        }
+
+        cout << "    " << setw(16) << left << results.classNames[i] << right
+             << setw(12) << (unsigned long)(TP+FN) << fixed << setprecision(3)
+             << setw(12) << precision << setw(12) << recall << setw(12) << IoU << endl;
+        cout.unsetf(ios::fixed);
+        cout << setprecision(6);
+    }
+
+    if ( N_evaluated )
+        cout << endl << "           - Mean IoU: " << 100*sumIoU/N_evaluated
+             << "% (" << N_evaluated << " classes in the ground truth)" << endl;
+
+    cout << endl;
+
+    if ( confusionFilename.empty() )
+        return;
+
+    ofstream file( confusionFilename.c_str() );
+
+    if ( !file.is_open() )
+    {
+        cerr << "  [ERROR] Couldn't open " << confusionFilename << endl;
+        return;
+    }
+
+    // A row per ground truth class, a column per labeled class
+
+    file << N_classes << endl;
+
+    for ( size_t i = 0; i < N_classes; i++ )
+        file << results.classNames[i] << ( ( i+1 < N_classes ) ? " " : "\n" );
+
+    for ( size_t i = 0; i < N_classes; i++ )
+        for ( size_t j = 0; j < N_classes; j++ )
+            file << results.confusion[i][j] << ( ( j+1 < N_classes ) ? " " : "\n" );
+
+    cout << "  [INFO] Confusion matrix saved to " << confusionFilename << endl << endl;
+}
+
+
 //-----------------------------------------------------------
 //
 //                        benchmark
 //
 //-----------------------------------------------------------
 
+// Observations are paired by timestamp and sensor label, so the rawlogs
+// don't need to have the same sequence of observations. Pairs are evaluated
+// in parallel batches while the rawlogs are read.
+
 void benchmark()
 {
     //
@@ -157,71 +756,61 @@ void benchmark()
     cout << "  [INFO] Working with ground truth rawlog " << gtRawlogFilename << endl;
     cout << "         and labeled rawlog " << labeledRawlogFilename << endl;
 
-    // TODO: Add tests to ensure that they are the same rawlog sequence
-
-    vector<double> v_success;
+    const size_t batchSize = 4*OLT::CTaskScheduler::getNumThreads();
 
-    // Get pairs of observations and compare their labels
+    TPendingLabels gtPending, labeledPending;
+    set<TObsKey> gtReadKeys, labeledReadKeys;
+    vector<TObsPair> pairs;
 
-    CActionCollectionPtr action;
-    CSensoryFramePtr observations;
-    CObservationPtr gtObs,labeledObs;
     size_t gtObsIndex = 0, labeledObsIndex = 0;
+    bool gtEnded = false, labeledEnded = false;
 
     cout << "    Process: ";
     cout.flush();
 
-    while ( ( CRawlog::getActionObservationPairOrObservation(gtRawlog,action,observations,gtObs,gtObsIndex) )&&
-            ( CRawlog::getActionObservationPairOrObservation(labeledRawlog,action,observations,labeledObs,labeledObsIndex) ) )
+    while ( !gtEnded || !labeledEnded )
     {
-        // TODO: Check that the obss are 3D scans
-        CObservation3DRangeScanPtr gt3DObs = CObservation3DRangeScanPtr(gtObs);
-        CObservation3DRangeScanPtr labeled3DObs = CObservation3DRangeScanPtr(labeledObs);
+        TObsKey key;
+        TLabelsPtr labels;
 
-        if ( !(gtObsIndex % 200) )
-        {
-            if ( !(gtObsIndex % 1000) ) cout << "+ "; else cout << ". ";
-            cout.flush();
-        }
+        // Read both rawlogs at the same pace
 
-        // Check that both observations have labels
-        if ( !gt3DObs->hasPixelLabels() || !labeled3DObs->hasPixelLabels() )
-             continue;
-
-        std::map<uint32_t,std::string>::iterator labelsIt;
-        size_t labelsAppearing = 0;
-
-        for ( labelsIt = gt3DObs->pixelLabels->pixelLabelNames.begin();
-              labelsIt != gt3DObs->pixelLabels->pixelLabelNames.end();
-              labelsIt++ )
+        if ( !gtEnded )
         {
-            // Get label name from the ground truth obs
-            string label = labelsIt->second;
+            gtEnded = !readNextLabels( gtRawlog, gtObsIndex, key, labels, false );
 
-            // Check if it appears in the labeled obs
-            if ( labeled3DObs->pixelLabels->checkLabelNameExistence(label) >= 0 )
-                labelsAppearing++;
+            if ( !gtEnded )
+                pairObservation( key, labels, true, gtPending, labeledPending,
+                                 gtReadKeys, pairs );
         }
 
-        size_t N_labelsGt = gt3DObs->pixelLabels->pixelLabelNames.size();
-        size_t N_labelsLabeled = labeled3DObs->pixelLabels->pixelLabelNames.size();
+        if ( !labeledEnded )
+        {
+            labeledEnded = !readNextLabels( labeledRawlog, labeledObsIndex, key, labels, true );
 
-        size_t maxNumOfLabels = ( (N_labelsGt > N_labelsLabeled) ? N_labelsGt : N_labelsLabeled );
+            if ( !labeledEnded )
+                pairObservation( key, labels, false, gtPending, labeledPending,
+                                 labeledReadKeys, pairs );
+        }
 
-        if (!maxNumOfLabels) // Are there labels?
-            continue;
+        if ( ( pairs.size() >= batchSize ) || ( gtEnded && labeledEnded ) )
+        {
+            for ( size_t i = 0; i < pairs.size(); i++ )
+            {
+                getLabelClasses( pairs[i].gt, pairs[i].gtClasses );
+                getLabelClasses( pairs[i].labeled, pairs[i].labeledClasses );
+            }
 
-        double success = labelsAppearing / (double)maxNumOfLabels;
-        v_success.push_back(success);
+            processPairs( pairs );
+        }
     }
 
-    double sumSuccess = std::accumulate(v_success.begin(), v_success.end(), 0.0);
-    double meanSuccess = sumSuccess / (double)v_success.size();
+    results.N_gtUnmatched += countUnmatched( gtPending );
+    results.N_labeledUnmatched += countUnmatched( labeledPending );
 
     cout << endl;
-    cout << "  [INFO] Results: " << endl;
-    cout << "           - Mean success: " << meanSuccess*100 << "%";
-    cout << endl << endl;
+
+    showResults();
 }
 
 //-----------------------------------------------------------
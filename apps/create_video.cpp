@@ -39,6 +39,8 @@
 
 #include <numeric> // std::accumulate
 
+#include "CSensorRegistry.hpp"
+
 using namespace mrpt;
 using namespace mrpt::utils;
 using namespace mrpt::vision;
@@ -49,8 +51,9 @@ using namespace mrpt::math;
 using namespace std;
 
 
-vector<bool> v_sensorsToUse;
-bool         useDepthImg = false;
+vector<string>       v_sensorsToUse; // Labels of the sensors to use, in drawing order
+OLT::CSensorRegistry sensorRegistry;
+bool                 useDepthImg = false;
 
 
 //-----------------------------------------------------------
@@ -68,8 +71,8 @@ void getImages( CVideoFileWriter &vid, string &i_rawlogFileName,
     cout.flush();
 
     CImage lastImg;
-    vector<CObservation3DRangeScanPtr> v_obs(4);
-    vector<bool>   v_imagesLoaded(4,false);
+    vector<CObservation3DRangeScanPtr> v_obs(N_sensors);
+    vector<bool>   v_imagesLoaded(N_sensors,false);
 
     // Insert a few frames to show the
     CImage preImage(width,height,N_channels);
@@ -90,39 +93,19 @@ void getImages( CVideoFileWriter &vid, string &i_rawlogFileName,
         if ( IS_CLASS(obs, CObservation3DRangeScan) )
         {
             CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
-            obs3D->load();
 
-            size_t inserted;
+            size_t inserted = find(v_sensorsToUse.begin(),v_sensorsToUse.end(),obs3D->sensorLabel)
+                    - v_sensorsToUse.begin();
 
-            if ( obs3D->sensorLabel == "RGBD_1" )
-            {
-                v_obs[0] = obs3D;
-                v_imagesLoaded[0] = true;
-                inserted = 0;
-            }
-            else if ( obs3D->sensorLabel == "RGBD_2" )
-            {
-                v_obs[1] = obs3D;
-                v_imagesLoaded[1] = true;
-                inserted = 1;
-            }
-            else if ( obs3D->sensorLabel == "RGBD_3" )
-            {
-                v_obs[2] = obs3D;
-                v_imagesLoaded[2] = true;
-                inserted = 2;
-            }
-            else if ( obs3D->sensorLabel == "RGBD_4" )
-            {
-                v_obs[3] = obs3D;
-                v_imagesLoaded[3] = true;
-                inserted = 3;
-            }
+            if ( inserted == N_sensors )
+                continue;
 
-            double sum = v_imagesLoaded[0] + v_imagesLoaded[1]
-                    + v_imagesLoaded[2] + v_imagesLoaded[3];
+            obs3D->load();
 
-            for ( size_t i = 0; i < 4; i++ )
+            v_obs[inserted] = obs3D;
+            v_imagesLoaded[inserted] = true;
+
+            for ( size_t i = 0; i < N_sensors; i++ )
             {
                 if (( i == inserted ) || (v_obs[i].null()))
                     continue;
@@ -135,45 +118,30 @@ void getImages( CVideoFileWriter &vid, string &i_rawlogFileName,
 
             }
 
-            if ( sum == 4 )
+            size_t sum = std::accumulate(v_imagesLoaded.begin(),v_imagesLoaded.end(),0);
+
+            if ( sum == N_sensors )
             {
 
                 CImage img(height,width,N_channels);
 
-                size_t imagesDrawn = 0;
-
-                vector<size_t> v_imgsOrder(4);
-                /*v_imgsOrder[0] = 2;
-                v_imgsOrder[1] = 0;
-                v_imgsOrder[2] = 1;
-                v_imgsOrder[3] = 3;*/
-
-                v_imgsOrder[0] = 2;
-                v_imgsOrder[1] = 3;
-                v_imgsOrder[2] = 0;
-                v_imgsOrder[3] = 1;
-
-                for ( size_t i = 0; i < 4; i++ )
+                for ( size_t i = 0; i < N_sensors; i++ )
                 {
-                    if ( v_sensorsToUse[i] )
+                    if ( useDepthImg )
                     {
-                        if ( useDepthImg )
-                        {
-                            CImage imgDepth;
-                            imgDepth.setFromMatrix(v_obs[v_imgsOrder[i]]->rangeImage);
+                        CImage imgDepth;
+                        imgDepth.setFromMatrix(v_obs[i]->rangeImage);
 
-                            img.drawImage(0,imgWidth*imagesDrawn,imgDepth);
-                        }
-                        else
-                            img.drawImage(0,imgWidth*imagesDrawn,v_obs[v_imgsOrder[i]]->intensityImage);
-                        imagesDrawn++;
+                        img.drawImage(0,imgWidth*i,imgDepth);
                     }
+                    else
+                        img.drawImage(0,imgWidth*i,v_obs[i]->intensityImage);
                 }
 
 
                 CImage rotatedImg(width,height,N_channels);
 
-                for ( size_t row = 0; row < 320; row++ )
+                for ( size_t row = 0; row < height; row++ )
                     for ( size_t col = 0; col < imgWidth*N_sensors; col++ )
                     {
                         u_int8_t r, g,b;
@@ -191,7 +159,7 @@ void getImages( CVideoFileWriter &vid, string &i_rawlogFileName,
 
                         TColor color(r,g,b);
 
-                        rotatedImg.setPixel(col,320-row,color);
+                        rotatedImg.setPixel(col,height-1-row,color);
 
                      }
 
@@ -200,7 +168,7 @@ void getImages( CVideoFileWriter &vid, string &i_rawlogFileName,
                 lastImg = rotatedImg;
 
                 v_imagesLoaded.clear();
-                v_imagesLoaded.resize(4,0);
+                v_imagesLoaded.resize(N_sensors,0);
 
             }
         }
@@ -255,14 +223,10 @@ int main(int argc, char **argv)
 
         vector<string> v_sequences;
 
-        v_sensorsToUse.resize(4,true);
-
         //
         // Load parameters
         //
 
-        bool sensorsReset = false;
-
         if ( argc >= 3 )
         {
             i_rawlogFile = argv[1];
@@ -288,29 +252,7 @@ int main(int argc, char **argv)
                 }
                 else if ( !strcmp(argv[arg],"-sensor") )
                 {
-                    if ( !sensorsReset )
-                    {
-                        v_sensorsToUse.clear();
-                        v_sensorsToUse.resize(4,false);
-                    }
-
-                    sensorsReset = true;
-
-                    string sensorLabel(argv[arg+1]);
-
-                    if ( sensorLabel == "RGBD_1" )
-                        v_sensorsToUse[0] = true;
-                    else if ( sensorLabel == "RGBD_2" )
-                        v_sensorsToUse[1] = true;
-                    else if ( sensorLabel == "RGBD_3" )
-                        v_sensorsToUse[2] = true;
-                    else if ( sensorLabel == "RGBD_4" )
-                        v_sensorsToUse[3] = true;
-                    else
-                    {
-                        cout << "[Error] " << argv[arg+1] << "unknown sensor label" << endl;
-                        return -1;
-                    }
+                    v_sensorsToUse.push_back(argv[arg+1]);
 
                     arg++;
                 }
@@ -376,15 +318,59 @@ int main(int argc, char **argv)
             }
         }
 
-        size_t N_sensors = v_sensorsToUse[0] + v_sensorsToUse[1]
-                            + v_sensorsToUse[2] + v_sensorsToUse[3];
+        //
+        // Get the RGBD sensors and the size of their images
+        //
 
-        CVideoFileWriter  vid;
+        string firstRawlog = i_rawlogFile;
+
+        if ( batchMode && !v_sequences.empty() )
+            firstRawlog = datasetPath+"/"+v_sessions[0]+"/"+v_sequences[0]+"/1.rawlog";
+
+        if ( !sensorRegistry.discoverSensors(firstRawlog,v_sensorsToUse) )
+        {
+            cout << "  [ERROR] No RGBD sensors found in " << firstRawlog << endl;
+            return -1;
+        }
+
+        if ( v_sensorsToUse.empty() )
+        {
+            // Drawing order of the robot used to collect the Robot@Home
+            // dataset if its sensors are the ones in the rawlog, the order of
+            // appearance otherwise
+            const char* defaultOrder[] = { "RGBD_3", "RGBD_4", "RGBD_1", "RGBD_2" };
 
-        size_t imgWidth = ( useDepthImg ) ? 244 : 240;
+            for ( size_t i = 0; i < 4; i++ )
+                if ( sensorRegistry.hasSensor(defaultOrder[i]) )
+                    v_sensorsToUse.push_back(defaultOrder[i]);
+
+            if ( v_sensorsToUse.size() != sensorRegistry.size() )
+                v_sensorsToUse = sensorRegistry.getSensorLabels();
+        }
+
+        size_t imgWidth = 0;
+        size_t height = 0;
+
+        for ( size_t i = 0; i < v_sensorsToUse.size(); i++ )
+        {
+            const OLT::TRGBDCameraModel *model = sensorRegistry.getModel(v_sensorsToUse[i]);
+
+            if ( !model )
+            {
+                cout << "[Error] " << v_sensorsToUse[i] << " unknown sensor label" << endl;
+                return -1;
+            }
+
+            // Images are drawn rotated, so their rows set the width of the video
+            imgWidth = max(imgWidth, ( useDepthImg ) ? model->depthRows : model->intensityRows);
+            height = max(height, ( useDepthImg ) ? model->depthCols : model->intensityCols);
+        }
+
+        size_t N_sensors = v_sensorsToUse.size();
+
+        CVideoFileWriter  vid;
 
         size_t width = imgWidth*N_sensors;
-        size_t height = 320;
 
         size_t N_channels = ( useDepthImg ) ? 1 : 3;
 
@@ -20,7 +20,9 @@
  |                                                                           |
  *---------------------------------------------------------------------------*/
 
-#include "CAnalyzer.hpp"
+#include "CAnalyzerEngine.hpp"
+#include "CRawlogStatistics.hpp"
+#include "CTaskScheduler.hpp"
 
 #include <mrpt/math.h>
 #include <mrpt/obs/CObservation3DRangeScan.h>
@@ -40,8 +42,10 @@ using namespace std;
 //
 
 vector<string> sensors_to_use;
-CRawlog rawlog;
 bool analyzeDepthInfo = false;
+bool analyzeAll = false; // Run all the analyzers
+vector<string> sceneFiles;  // Scenes to analyze instead of the rawlogs
+bool useCache = true;   // Use the statistics cached next to the rawlogs
 
 struct TConfiguration
 {
@@ -56,9 +60,14 @@ struct TStatistics
 {
     map<string,size_t> labelOccurrences; // Map with <label,n_occurrences>
     map<string,size_t> labelNumOfPixels; // Map with <label,n_pixels>
+    map<string,size_t> sensorObservations; // Map with <sensor,n_observations>
+    map<string,OLT::TLabelDistributions> labelDistributions; // Distance, area and extent of each label
     size_t             N_observations;   // Total number of observations processed
+    size_t             N_depthPixels;    // Pixels with a valid depth
+    double             minDepth, maxDepth, sumDepth;
 
-    TStatistics() : N_observations(0)
+    TStatistics() : N_observations(0), N_depthPixels(0),
+        minDepth(std::numeric_limits<double>::max()), maxDepth(0), sumDepth(0)
     {}
 };
 
@@ -82,7 +91,11 @@ void showUsageInformation()
     cout << "Then, optional parameters:" << endl <<
             " \t -h      : This help." << endl <<
             " \t -sensor : Use obs from this sensor (all by default)." << endl <<
-            " \t -analyzeDepthInfo : Analyze depth info." << endl << endl;
+            " \t -analyzeDepthInfo : Analyze depth info." << endl <<
+            " \t -analyze : Analyze depth info, labels, quality, timing gaps and sensor rates." << endl <<
+            " \t -scene <file> : Analyze the points and labelled boxes of a scene (can be repeated)." << endl <<
+            " \t -threads <num> : Number of threads to use (all the cores by default)." << endl <<
+            " \t -noCache : Recompute the statistics of every rawlog, ignoring the cached ones." << endl << endl;
 
 }
 
@@ -162,42 +175,102 @@ void initializeStats()
 
 //-----------------------------------------------------------
 //
-//                   updateStatsFromObs
+//                      addToStats
 //
 //-----------------------------------------------------------
 
-void updateStatsFromObs(CObservation3DRangeScanPtr obs,
-                        size_t N_rows, size_t N_cols )
-{
-    // Increment the number of processed observations
-    stats.N_observations++;
+// Merge the statistics of a rawlog into the report, only with the sensors
+// being used and with the labels to consider.
 
-    std::map<uint32_t,std::string>::iterator it;
+void addToStats( const OLT::CRawlogStatistics &rawlogStats )
+{
+    map<string,OLT::TSensorStatistics>::const_iterator sensor_it;
 
-    for ( it = obs->pixelLabels->pixelLabelNames.begin();
-          it != obs->pixelLabels->pixelLabelNames.end();
-          it++ )
+    for ( sensor_it = rawlogStats.sensors.begin(); sensor_it != rawlogStats.sensors.end(); sensor_it++ )
     {
-        string label = ( conf.instancesLabeled ) ?
-                    getInstanceLabel(it->second) :
-                    label = it->second;
+        // Check if the sensor is being used
+        if ( !sensors_to_use.empty()
+             && find(sensors_to_use.begin(), sensors_to_use.end(),sensor_it->first)
+             == sensors_to_use.end() )
+            continue;
 
-        //cout << "Cheking label " << label << endl;
+        const OLT::TSensorStatistics &sensorStats = sensor_it->second;
 
-        // Update occurrences
-        if ( !label.empty() )
-            stats.labelOccurrences[label] = stats.labelOccurrences[label] + 1;
+        stats.N_observations += sensorStats.N_observations;
+        stats.sensorObservations[sensor_it->first] += sensorStats.N_observations;
 
-        // Update num of pixels
-        for ( size_t row = 0; row < N_rows; row++ )
-            for ( size_t col = 0; col < N_cols; col++ )
-                if ( obs->pixelLabels->checkLabel(row,col,it->first) )
-                    stats.labelNumOfPixels[label] = stats.labelNumOfPixels[label] + 1;
+        stats.N_depthPixels += sensorStats.N_depthPixels;
+        stats.minDepth = std::min( stats.minDepth, sensorStats.minDepth );
+        stats.maxDepth = std::max( stats.maxDepth, sensorStats.maxDepth );
+        stats.sumDepth += sensorStats.sumDepth;
 
-    }
+        map<string,size_t>::const_iterator it;
+
+        for ( it = sensorStats.labelOccurrences.begin(); it != sensorStats.labelOccurrences.end(); it++ )
+        {
+            string label = ( conf.instancesLabeled ) ?
+                        getInstanceLabel(it->first) :
+                        it->first;
+
+            // Update occurrences
+            if ( !label.empty() )
+                stats.labelOccurrences[label] += it->second;
+        }
+
+        for ( it = sensorStats.labelNumOfPixels.begin(); it != sensorStats.labelNumOfPixels.end(); it++ )
+        {
+            string label = ( conf.instancesLabeled ) ?
+                        getInstanceLabel(it->first) :
+                        it->first;
+
+            // Update num of pixels
+            stats.labelNumOfPixels[label] += it->second;
+        }
+
+        map<string,OLT::TLabelDistributions>::const_iterator dist_it;
+
+        for ( dist_it = sensorStats.labelDistributions.begin(); dist_it != sensorStats.labelDistributions.end(); dist_it++ )
+        {
+            string label = ( conf.instancesLabeled ) ?
+                        getInstanceLabel(dist_it->first) :
+                        dist_it->first;
 
+            if ( !label.empty() )
+                stats.labelDistributions[label].merge( dist_it->second );
+        }
+    }
 }
 
+
+//-----------------------------------------------------------
+//
+//                      TRawlogsStats
+//
+//-----------------------------------------------------------
+
+// Each rawlog is processed by a task of the scheduler into its own stats,
+// or they are loaded from its sidecar if the rawlog didn't change.
+struct TRawlogsStats
+{
+    vector<OLT::CRawlogStatistics> &v_stats;
+    vector<int>                    &v_results;
+    vector<char>                   &v_fromCache;
+
+    TRawlogsStats( vector<OLT::CRawlogStatistics> &s, vector<int> &r, vector<char> &c ) :
+        v_stats(s), v_results(r), v_fromCache(c)
+    {}
+
+    void operator()( size_t rawlog_index ) const
+    {
+        bool fromCache;
+
+        v_results[rawlog_index] = v_stats[rawlog_index].computeOrLoad(
+                    conf.rawlogFiles[rawlog_index], fromCache, useCache );
+
+        v_fromCache[rawlog_index] = fromCache;
+    }
+};
+
 bool compareLabels( pair<string,size_t> l1, pair<string,size_t> l2 )
 {
     return ( l1.second > l2.second );
@@ -232,6 +305,21 @@ void saveStatsToFile(ostream &statsFile, vector<string> &v_sensorsUsed )
     statsFile << "Number of observations processed: ";
     statsFile << stats.N_observations << endl;
 
+    statsFile << "Observations per sensor:" << endl;
+
+    map<string,size_t>::iterator sensor_it;
+
+    for ( sensor_it = stats.sensorObservations.begin();
+          sensor_it != stats.sensorObservations.end();
+          sensor_it++ )
+        statsFile << sensor_it->first << " " << sensor_it->second << endl;
+
+    if ( stats.N_depthPixels )
+    {
+        statsFile << "Depth (min/max/mean): " << stats.minDepth << " "
+                  << stats.maxDepth << " " << stats.sumDepth / stats.N_depthPixels << endl;
+    }
+
     //
     // Occurrences
     //
@@ -273,6 +361,32 @@ void saveStatsToFile(ostream &statsFile, vector<string> &v_sensorsUsed )
     for ( size_t i = 0; i < sorted_labels.size(); i++ )
         statsFile << sorted_labels[i].first << " " << sorted_labels[i].second << endl;
 
+    //
+    // Distributions
+    //
+
+    statsFile << "Distributions per object label (5th/50th/95th percentiles):" << endl;
+    statsFile << "label distance(m) area(pixels) extent(m)" << endl;
+
+    map<string,OLT::TLabelDistributions>::iterator dist_it;
+
+    for ( dist_it = stats.labelDistributions.begin();
+          dist_it != stats.labelDistributions.end();
+          dist_it++ )
+    {
+        const OLT::CQuantileSketch *sketches[3] = { &dist_it->second.distance,
+                                                    &dist_it->second.area,
+                                                    &dist_it->second.extent };
+        statsFile << dist_it->first;
+
+        for ( size_t i = 0; i < 3; i++ )
+            statsFile << " " << sketches[i]->getQuantile(0.05) << "/"
+                      << sketches[i]->getQuantile(0.5) << "/"
+                      << sketches[i]->getQuantile(0.95);
+
+        statsFile << endl;
+    }
+
 }
 
 int loadParamters(int argc, char* argv[])
@@ -311,6 +425,26 @@ int loadParamters(int argc, char* argv[])
                     analyzeDepthInfo = true;
                     arg ++;
                 }
+                else if ( !strcmp(argv[arg],"-analyze") )
+                {
+                    analyzeAll = true;
+                    arg ++;
+                }
+                else if ( !strcmp(argv[arg],"-scene") )
+                {
+                    sceneFiles.push_back( argv[arg+1] );
+                    arg += 2;
+                }
+                else if ( !strcmp(argv[arg],"-noCache") )
+                {
+                    useCache = false;
+                    arg++;
+                }
+                else if ( !strcmp(argv[arg],"-threads") )
+                {
+                    OLT::CTaskScheduler::setNumThreads( atoi(argv[arg+1]) );
+                    arg += 2;
+                }
 
                 else
                 {
@@ -334,42 +468,27 @@ void generateStats()
     const size_t N_rawlogs = conf.rawlogFiles.size();
     cout << "[INFO] a total of " << N_rawlogs << " to process." << endl;
 
-    for ( size_t rawlog_index = 0; rawlog_index < N_rawlogs; rawlog_index++ )
-    {
-        rawlog.loadFromRawLogFile( conf.rawlogFiles[rawlog_index] );
-
-        cout << "[INFO] Processing rawlog file : " << conf.rawlogFiles[rawlog_index];
-        cout << " with " << rawlog.size() << " obs and index " << rawlog_index << endl;
-
-        //
-        // Iterate over the obs into the rawlog updating the stats
-        //
-
-        for ( size_t obs_index = 0; obs_index < rawlog.size(); obs_index++ )
-        {
-            CObservationPtr obs = rawlog.getAsObservation(obs_index);
-
-            // Check that it is a 3D observation
-            if ( !IS_CLASS(obs, CObservation3DRangeScan) )
-                continue;
+    //
+    // Process the rawlogs in parallel, then merge their stats in order
+    //
 
-            // Check if the sensor is being used
-            if ( !sensors_to_use.empty()
-                 && find(sensors_to_use.begin(), sensors_to_use.end(),obs->sensorLabel)
-                 == sensors_to_use.end() )
-                continue;
+    vector<OLT::CRawlogStatistics> v_stats( N_rawlogs );
+    vector<int> v_results( N_rawlogs, 0 );
+    vector<char> v_fromCache( N_rawlogs, 0 );
 
-            // Get obs pose
-            CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
-            obs3D->load();
+    TRawlogsStats rawlogsStats( v_stats, v_results, v_fromCache );
+    OLT::parallelFor( 0, N_rawlogs, rawlogsStats );
 
-            size_t rows = obs3D->cameraParams.nrows;
-            size_t cols = obs3D->cameraParams.ncols;
+    for ( size_t rawlog_index = 0; rawlog_index < N_rawlogs; rawlog_index++ )
+    {
+        if ( v_results[rawlog_index] < 0 )
+            continue;
 
-            // Update statistics with information from this observations
-            updateStatsFromObs( obs3D, rows, cols );
+        cout << "[INFO] " << ( v_fromCache[rawlog_index] ? "Loaded stats of" : "Processed" )
+             << " rawlog file : " << conf.rawlogFiles[rawlog_index]
+             << " with index " << rawlog_index << endl;
 
-        }
+        addToStats( v_stats[rawlog_index] );
     }
 
     //
@@ -395,39 +514,64 @@ void generateStats()
     cout << "[INFO] Done!" << endl;
 }
 
-void analyzeDepths()
+void analyze()
 {
     const size_t N_rawlogs = conf.rawlogFiles.size();
     cout << "[INFO] a total of " << N_rawlogs << " to process." << endl;
 
-    double maxDepth = 0;
-    double minDepth = std::numeric_limits<double>::max();
-    double meanDepth = 0;
+    // All the analyzers go through the rawlogs in a single pass
 
-    for ( size_t rawlog_index = 0; rawlog_index < N_rawlogs; rawlog_index++ )
+    OLT::CAnalyzerEngine engine;
+
+    OLT::CDepthInfoAnalyzer     depthAnalyzer;
+    OLT::CLabelAnalyzer         labelAnalyzer;
+    OLT::CQualityAnalyzer       qualityAnalyzer;
+    OLT::CTimingGapsAnalyzer    timingGapsAnalyzer;
+    OLT::CSensorRatesAnalyzer   sensorRatesAnalyzer;
+
+    engine.addAnalyzer( &depthAnalyzer );
+
+    if ( analyzeAll )
     {
-        OLT::CDepthInfoAnalyzer analyzer;
+        engine.addAnalyzer( &labelAnalyzer );
+        engine.addAnalyzer( &qualityAnalyzer );
+        engine.addAnalyzer( &timingGapsAnalyzer );
+        engine.addAnalyzer( &sensorRatesAnalyzer );
+    }
+
+    engine.setSensors( sensors_to_use );
+
+    for ( size_t rawlog_index = 0; rawlog_index < N_rawlogs; rawlog_index++ )
+        if ( engine.processRawlog( conf.rawlogFiles[rawlog_index] ) )
+            cerr << "  [ERROR] Skipping rawlog " << conf.rawlogFiles[rawlog_index] << endl;
 
-        analyzer.setInputRawlog( conf.rawlogFiles[rawlog_index] );
+    engine.report( cout );
 
-        vector<double> results;
+    cout << "[INFO] Done!" << endl;
+}
 
-        analyzer.process(results);
+void analyzeScenes()
+{
+    const size_t N_scenes = sceneFiles.size();
+    cout << "[INFO] a total of " << N_scenes << " scenes to process." << endl;
 
-        if ( results[0] > maxDepth )
-            maxDepth = results[0];
+    // Points of the scenes are indexed once, and all the analyzers query it
 
-        if ( results[1] < minDepth )
-            minDepth = results[1];
+    OLT::CAnalyzerEngine engine;
 
-        meanDepth = results[2];
+    OLT::CDepthInfoAnalyzer     depthAnalyzer;
+    OLT::CLabelAnalyzer         labelAnalyzer;
+    OLT::CSceneDensityAnalyzer  densityAnalyzer;
 
-    }
+    engine.addAnalyzer( &depthAnalyzer );
+    engine.addAnalyzer( &labelAnalyzer );
+    engine.addAnalyzer( &densityAnalyzer );
+
+    for ( size_t scene_index = 0; scene_index < N_scenes; scene_index++ )
+        if ( engine.processScene( sceneFiles[scene_index] ) )
+            cerr << "  [ERROR] Skipping scene " << sceneFiles[scene_index] << endl;
 
-    cout << "  [INFO] Results: " << endl;
-    cout << "         Max depth  = " << maxDepth << endl;
-    cout << "         Min depth  = " << minDepth << endl;
-    cout << "         Mean depth = " << meanDepth / static_cast<double>(N_rawlogs) << endl;
+    engine.report( cout );
 
     cout << "[INFO] Done!" << endl;
 }
@@ -457,8 +601,10 @@ int main(int argc, char* argv[])
             cout << endl;
         }
 
-        if ( analyzeDepthInfo )
-            analyzeDepths();
+        if ( !sceneFiles.empty() )
+            analyzeScenes();
+        else if ( analyzeDepthInfo || analyzeAll )
+            analyze();
         else
             generateStats();
 
@@ -48,6 +48,7 @@
 #include <pcl/filters/fast_bilateral.h>
 #include <pcl/common/transforms.h>
 #include <pcl/common/common.h>
+#include <pcl/common/io.h>
 
 #include <pcl/visualization/pcl_visualizer.h>
 
@@ -60,6 +61,11 @@
 
 #include <pcl/filters/voxel_grid.h>
 
+#include "CSensorRegistry.hpp"
+#include "CDepthProjector.hpp"
+#include "CTaskScheduler.hpp"
+#include "CBoxAnnotations.hpp"
+
 using namespace mrpt::utils;
 using namespace mrpt::math;
 using namespace mrpt::opengl;
@@ -75,8 +81,7 @@ using namespace std;
 
 struct TLabelledBox
 {
-    // Loaded from .scene file
-    CBoxPtr box;   // object containing the corners of the object's bounding box
+    // Loaded from the .scene (or its .boxes) file
     string  label; // e.g. scourer, bowl, or scourer_1, bowl_3 if working with instances
     // Computed
     pcl::PointCloud<pcl::PointXYZ>::Ptr convexHullCloud;
@@ -102,6 +107,7 @@ struct TConfiguration
 TConfiguration          configuration;
 
 vector<string> sensors_to_use;
+OLT::CSensorRegistry sensorRegistry;
 CFileGZInputStream i_rawlog;
 CFileGZOutputStream o_rawlog;
 
@@ -128,7 +134,8 @@ void showUsageInformation()
             " \t -config <file>         : Configuration file to be loaded." << endl <<
             " \t -i <rawlog_file>       : Rawlog file to process." << endl <<
             " \t -sensor <sensor_label> : Use obs. from this sensor (all used by default)." << endl <<
-            " \t -step                  : Enable step by step execution." << endl;
+            " \t -step                  : Enable step by step execution." << endl <<
+            " \t -threads <num>         : Number of threads to use (all the cores by default)." << endl;
 }
 
 
@@ -210,93 +217,73 @@ void loadConfig( string const configFile )
 
 void  loadLabelledScene()
 {
+    vector<OLT::TBoxAnnotation> v_boxes;
 
-    mrpt::opengl::COpenGLScenePtr   labelledScene;
-
-    labelledScene = mrpt::opengl::COpenGLScene::Create();
-    if ( labelledScene->loadFromFile( configuration.labelledScene ) )
+    if ( !OLT::CBoxAnnotations::loadSceneBoxes( configuration.labelledScene, v_boxes ) )
     {
-        // Load previously inserted boxes
-        bool keepLoading = true;
-        size_t boxes_inserted = 0;
-
-        while ( keepLoading )
+        for ( size_t box_index = 0; box_index < v_boxes.size(); box_index++ )
         {
-            CBoxPtr box = labelledScene->getByClass<CBox>(boxes_inserted);
-
-            if ( box.null() )
-                keepLoading = false;
+            const OLT::TBoxAnnotation &box = v_boxes[box_index];
+
+            TLabelledBox labelled_box;
+
+            labelled_box.label = box.label;
+
+            const TPose3D &pose = box.pose;
+            const TPoint3D &c1 = box.corner1;
+            const TPoint3D &c2 = box.corner2;
+
+            TPoint3D C111 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c1.y,c1.z)) );
+            TPoint3D C112 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c1.y,c2.z)) );
+            TPoint3D C121 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c2.y,c1.z)) );
+            TPoint3D C122 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c2.y,c2.z)) );
+            TPoint3D C211 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c1.y,c1.z)) );
+            TPoint3D C212 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c1.y,c2.z)) );
+            TPoint3D C221 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c2.y,c1.z)) );
+            TPoint3D C222 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c2.y,c2.z)) );
+
+            pcl::PointCloud<pcl::PointXYZ>::Ptr pointCloud ( new pcl::PointCloud<pcl::PointXYZ>());
+            pointCloud->push_back( pcl::PointXYZ( C111.x, C111.y, C111.z ));
+            pointCloud->push_back( pcl::PointXYZ( C112.x, C112.y, C112.z ));
+            pointCloud->push_back( pcl::PointXYZ( C121.x, C121.y, C121.z ));
+            pointCloud->push_back( pcl::PointXYZ( C122.x, C122.y, C122.z ));
+            pointCloud->push_back( pcl::PointXYZ( C211.x, C211.y, C211.z ));
+            pointCloud->push_back( pcl::PointXYZ( C212.x, C212.y, C212.z ));
+            pointCloud->push_back( pcl::PointXYZ( C221.x, C221.y, C221.z ));
+            pointCloud->push_back( pcl::PointXYZ( C222.x, C222.y, C222.z ));
+
+            pcl::ConvexHull<pcl::PointXYZ> convex_hull;
+            convex_hull.setInputCloud(pointCloud);
+            convex_hull.setDimension(3);
+            convex_hull.reconstruct(*labelled_box.convexHullCloud,
+                                    labelled_box.polygons);
+
+            Eigen::Matrix4f transMat = OLT::CDepthProjector::getAxisPermutation();
+
+            pcl::transformPointCloud( *labelled_box.convexHullCloud,
+                                      *labelled_box.convexHullCloud,
+                                      transMat );
+
+            v_labelled_boxes.push_back( labelled_box );
+
+            if ( !configuration.instancesLabeled )
+            {
+                if ( !m_consideredLabels.count(labelled_box.label) )
+                    cout << "  [CAUTION] label " << labelled_box.label << " does not appear in the label list." << endl;
+            }
             else
             {
-                TLabelledBox labelled_box;
-
-                labelled_box.box = box;
-                labelled_box.label = box->getName();
-
-                TPose3D pose = box->getPose();
-
-                TPoint3D c1,c2;
-                box->getBoxCorners(c1,c2);
-
-                TPoint3D C111 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c1.y,c1.z)) );
-                TPoint3D C112 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c1.y,c2.z)) );
-                TPoint3D C121 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c2.y,c1.z)) );
-                TPoint3D C122 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c2.y,c2.z)) );
-                TPoint3D C211 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c1.y,c1.z)) );
-                TPoint3D C212 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c1.y,c2.z)) );
-                TPoint3D C221 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c2.y,c1.z)) );
-                TPoint3D C222 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c2.y,c2.z)) );
-
-                pcl::PointCloud<pcl::PointXYZ>::Ptr pointCloud ( new pcl::PointCloud<pcl::PointXYZ>());
-                pointCloud->push_back( pcl::PointXYZ( C111.x, C111.y, C111.z ));
-                pointCloud->push_back( pcl::PointXYZ( C112.x, C112.y, C112.z ));
-                pointCloud->push_back( pcl::PointXYZ( C121.x, C121.y, C121.z ));
-                pointCloud->push_back( pcl::PointXYZ( C122.x, C122.y, C122.z ));
-                pointCloud->push_back( pcl::PointXYZ( C211.x, C211.y, C211.z ));
-                pointCloud->push_back( pcl::PointXYZ( C212.x, C212.y, C212.z ));
-                pointCloud->push_back( pcl::PointXYZ( C221.x, C221.y, C221.z ));
-                pointCloud->push_back( pcl::PointXYZ( C222.x, C222.y, C222.z ));
-
-                pcl::ConvexHull<pcl::PointXYZ> convex_hull;
-                convex_hull.setInputCloud(pointCloud);
-                convex_hull.setDimension(3);
-                convex_hull.reconstruct(*labelled_box.convexHullCloud,
-                                        labelled_box.polygons);
-
-                Eigen::Matrix4f transMat;
-
-                transMat(0,0)=0;    transMat(0,1)=-1;     transMat(0,2)=0;    transMat(0,3)=0;
-                transMat(1,0)=0;    transMat(1,1)=0;      transMat(1,2)=+1;   transMat(1,3)=0;
-                transMat(2,0)=1;    transMat(2,1)=0;      transMat(2,2)=0;    transMat(2,3)=0;
-                transMat(3,0)=0;    transMat(3,1)=0;      transMat(3,2)=0;    transMat(3,3)=1;
-
-                pcl::transformPointCloud( *labelled_box.convexHullCloud,
-                                          *labelled_box.convexHullCloud,
-                                          transMat );
-
-                v_labelled_boxes.push_back( labelled_box );
-
-                if ( !configuration.instancesLabeled )
-                {
-                    if ( !m_consideredLabels.count(labelled_box.label) )
-                        cout << "  [CAUTION] label " << labelled_box.label << " does not appear in the label list." << endl;
-                }
-                else
-                {
-                    string label = getInstanceLabel(labelled_box.label);
-                    if ( label.empty() )
-                        cout << "  [CAUTION] label of instance " << labelled_box.label << " does not appear in the label list." << endl;
-                }
-
-
-                // Check if the label has been already inserted
-                if ( find(v_appearingLabels.begin(),
-                          v_appearingLabels.end(),
-                          labelled_box.label) == v_appearingLabels.end() )
-                    v_appearingLabels.push_back(labelled_box.label);
+                string label = getInstanceLabel(labelled_box.label);
+                if ( label.empty() )
+                    cout << "  [CAUTION] label of instance " << labelled_box.label << " does not appear in the label list." << endl;
             }
 
-            boxes_inserted++;
+
+            // Check if the label has been already inserted
+            if ( find(v_appearingLabels.begin(),
+                      v_appearingLabels.end(),
+                      labelled_box.label) == v_appearingLabels.end() )
+                v_appearingLabels.push_back(labelled_box.label);
         }
 
         cout << "  [INFO] " << v_labelled_boxes.size() <<  " labelled boxes loaded." << endl;
@@ -308,6 +295,40 @@ void  loadLabelledScene()
 }
 
 
+//-----------------------------------------------------------
+//
+//                      TCropBoxes
+//
+//-----------------------------------------------------------
+
+// Get the indices of the points of a cloud within each labelled box. Boxes
+// are independent, so each one is processed by a different task.
+
+struct TCropBoxes
+{
+    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
+    vector< vector<int> >               &v_boxIndices;
+
+    TCropBoxes( pcl::PointCloud<pcl::PointXYZ>::Ptr cloud,
+                vector< vector<int> > &v_boxIndices ) :
+        cloud(cloud), v_boxIndices(v_boxIndices)
+    {}
+
+    void operator()( size_t box_index ) const
+    {
+        const TLabelledBox &box = v_labelled_boxes[box_index];
+
+        pcl::CropHull<pcl::PointXYZ> cropHull;
+        cropHull.setInputCloud( cloud );
+        cropHull.setHullIndices(box.polygons);
+        cropHull.setHullCloud(box.convexHullCloud);
+        cropHull.setDim(3);
+
+        cropHull.filter(v_boxIndices[box_index]);
+    }
+};
+
+
 //-----------------------------------------------------------
 //
 //                      labelObs
@@ -343,7 +364,14 @@ void labelObs(CObservation3DRangeScanPtr obs,
                 img.setPixel(row, col, 0);
     }
 
-    for ( size_t box_index = 0; box_index < v_labelled_boxes.size(); box_index++ )
+    // Points within each box
+
+    vector< vector<int> > v_boxIndices(N_boxes);
+
+    TCropBoxes cropBoxes(cloud,v_boxIndices);
+    OLT::parallelFor( 0, N_boxes, cropBoxes );
+
+    for ( size_t box_index = 0; box_index < N_boxes; box_index++ )
     {
 
         TLabelledBox &box = v_labelled_boxes[box_index];
@@ -351,24 +379,8 @@ void labelObs(CObservation3DRangeScanPtr obs,
         //cout << "Evaluating " << box.label;
 
         pcl::PointCloud<pcl::PointXYZ>::Ptr outputCloud(new pcl::PointCloud<pcl::PointXYZ>());
-        pcl::CropHull<pcl::PointXYZ> cropHull;
-        cropHull.setInputCloud( cloud );
-        //cropHull.setIndices( boost::make_shared<const pcl::PointIndices> (indices) );
-        cropHull.setHullIndices(box.polygons);
-        cropHull.setHullCloud(box.convexHullCloud);
-        cropHull.setDim(3);
-
-
-        //        viewer->removeAllPointClouds();
-        //        viewer->addPointCloud( cloud );
-        //        viewer->resetStoppedFlag();
-        //        while (!viewer->wasStopped())
-        //            viewer->spinOnce(100);
 
-        vector<int>     v_indices;
-
-        cropHull.filter(v_indices);
-        //cout << "Size of indices: " << v_indices[box_index].size() << endl;
+        vector<int>     &v_indices = v_boxIndices[box_index];
 
         if ( !v_indices.empty() )
         {
@@ -379,7 +391,7 @@ void labelObs(CObservation3DRangeScanPtr obs,
 
             if ( configuration.visualizeLabels || configuration.saveLabeledImgsToFile )
             {
-                cropHull.filter(*outputCloud);
+                pcl::copyPointCloud( *cloud, v_indices, *outputCloud );
 
                 pcl::PointCloud<pcl::PointXYZRGB>::Ptr coloredOutputCloud(new pcl::PointCloud<pcl::PointXYZRGB>());
 
@@ -549,6 +561,11 @@ int loadParameters(int argc, char* argv[])
                 stepByStepExecution = true;
                 arg++;
             }
+            else if ( !strcmp(argv[arg], "-threads") )
+            {
+                OLT::CTaskScheduler::setNumThreads( atoi(argv[arg+1]) );
+                arg += 2;
+            }
             else
             {
                 cout << "  [Error] " << argv[arg] << " unknown paramter" << endl;
@@ -650,8 +667,10 @@ void labelRawlog()
         obs3D->getSensorPose( pose );
         //cout << "Pose [" << obs_index << "]: " << pose << endl;
 
-        size_t rows = obs3D->cameraParams.nrows;
-        size_t cols = obs3D->cameraParams.ncols;
+        const OLT::TRGBDCameraModel &model = sensorRegistry[sensorRegistry.registerFromObs(*obs3D)];
+
+        size_t rows = model.depthRows;
+        size_t cols = model.depthCols;
 
         // Create per pixel labeling
         // Label size (0=8 bits, 1=16 bits, 2=32 bits, 3=32 bits, 8=64 bits
@@ -659,21 +678,11 @@ void labelRawlog()
         obs3D->pixelLabels =  CObservation3DRangeScan::TPixelLabelInfoPtr( new CObservation3DRangeScan::TPixelLabelInfo< LABEL_SIZE >() );
         obs3D->pixelLabels->setSize(rows,cols);
 
+        // Organized point cloud in the robot frame, with PCL axes
         pcl::PointCloud<pcl::PointXYZ>::Ptr pcl_cloud( new pcl::PointCloud<pcl::PointXYZ>() );
 
-        obs3D->project3DPointsFromDepthImageInto( *pcl_cloud, true );
-
-        Eigen::Matrix4f transMat;
-
-        transMat(0,0)=0;    transMat(0,1)=-1;     transMat(0,2)=0;    transMat(0,3)=0;
-        transMat(1,0)=0;    transMat(1,1)=0;      transMat(1,2)=+1;   transMat(1,3)=0;
-        transMat(2,0)=1;    transMat(2,1)=0;      transMat(2,2)=0;    transMat(2,3)=0;
-        transMat(3,0)=0;    transMat(3,1)=0;      transMat(3,2)=0;    transMat(3,3)=1;
-
-        pcl::transformPointCloud( *pcl_cloud, *pcl_cloud, transMat );
-
-        pcl_cloud->height = 240;
-        pcl_cloud->width = 320;
+        OLT::CDepthProjector projector;
+        projector.project( *obs3D, model, *pcl_cloud );
 
         //
         // Label observation
@@ -23,17 +23,25 @@
 #include <mrpt/gui.h>
 #include <mrpt/maps/CColouredPointsMap.h>
 #include <mrpt/utils/CConfigFile.h>
+#include <mrpt/utils/CTicTac.h>
 #include <mrpt/math.h>
 #include <mrpt/obs/CObservation3DRangeScan.h>
 #include <mrpt/opengl.h>
 #include <mrpt/obs/CRawlog.h>
 #include <mrpt/system/threads.h>
+#include <mrpt/system/filesystem.h>
+
+#include <limits>
 
-#include <pcl/visualization/pcl_visualizer.h>
-#include <pcl/filters/extract_indices.h>
-#include <pcl/segmentation/planar_region.h>
-#include <pcl/segmentation/sac_segmentation.h>
 #include <pcl/point_types.h>
+#include <pcl/ModelCoefficients.h>
+
+#include "CPointBuffer.hpp"
+#include "COctreeScene.hpp"
+#include "CBoxAnnotations.hpp"
+#include "CMultiPlaneExtractor.hpp"
+#include "CPointGridIndex.hpp"
+#include "CVoxelClustering.hpp"
 
 using namespace pcl;
 
@@ -58,9 +66,28 @@ struct TConfiguration
 
     bool showOnlyLabels;
 
+    bool useOctree;         // Draw the points through a level of detail octree
+    size_t octreeMaxPoints; // Points drawn at most when using the octree
+
+    bool segmentPlanes;     // Extract and show the main planes of the scene
+    double planesDistanceThreshold;
+    size_t planesMaxIterations;
+    size_t planesMinInliers;
+    size_t planesMaxNumber;
+
+    double proposalsVoxelSize;  // Clustering of the points out of the planes
+    double proposalsPlanesDistanceThreshold;
+    size_t proposalsMinPoints;
+    size_t proposalsMaxPoints;
+    double proposalsMaxSize;    // Longest side of a proposed box
+
 
     TConfiguration() : OFFSET(0.02), OFFSET_ANGLES(0.02), showOnlyLabels(false),
-        autoLabelInstances(true)
+        autoLabelInstances(true), useOctree(false), octreeMaxPoints(1000000),
+        segmentPlanes(false), planesDistanceThreshold(0.10), planesMaxIterations(1000),
+        planesMinInliers(1000), planesMaxNumber(20), proposalsVoxelSize(0.03),
+        proposalsPlanesDistanceThreshold(0.03), proposalsMinPoints(200),
+        proposalsMaxPoints(500000), proposalsMaxSize(2.5)
     {}
 };
 
@@ -90,6 +117,17 @@ size_t box_editing; // Box currently editing
 mrpt::gui::CDisplayWindow3D  win3D; // Window to visually perform the labeling
 mrpt::opengl::COpenGLScenePtr scene; // OpenGL scene showed in the window
 
+OLT::COctreeScene octree;   // Level of detail representation of the scene points
+string openOctreeFile;      // File of the octree currently open
+CPointCloudColouredPtr lodCloud; // Points of the octree currently drawn
+TPoint3D lodViewpoint;      // Camera position when lodCloud was selected
+
+bool scenePointsSaved = false; // Are the points in sceneFileToSave already?
+
+CPointCloudColouredPtr planesCloud; // Planes extracted by segmentPointCloud
+
+OLT::CPointGridIndex pointIndex; // Scene points, to query the ones within boxes
+
 
 //-----------------------------------------------------------
 //
@@ -104,7 +142,10 @@ void showUsageInformation()
     cout << "Then, optional parameters:" << endl <<
             " \t -h                     : This help." << endl <<
             " \t -scene <scene_file>    : Scene file to be labeled/edited." << endl <<
-            " \t -showOnlyLabels        : Show only labels (boxes)." << endl;
+            " \t -showOnlyLabels        : Show only labels (boxes)." << endl <<
+            " \t -octree [max_points]   : Draw the scene points through a level of detail octree," << endl <<
+            " \t                          stored next to the scene, with at most max_points." << endl <<
+            " \t -segmentPlanes         : Extract and show the main planes of the scene." << endl;
 }
 
 
@@ -126,6 +167,25 @@ void loadConfig( string const configFile )
     configuration.OFFSET         = config.read_float("GENERAL","OFFSET",0,true);
     configuration.OFFSET_ANGLES  = config.read_float("GENERAL","OFFSET_ANGLES",0,true);
 
+    configuration.useOctree      = config.read_bool("GENERAL","useOctree",configuration.useOctree,false);
+    configuration.octreeMaxPoints= config.read_int("GENERAL","octreeMaxPoints",configuration.octreeMaxPoints,false);
+
+    // Load plane segmentation configuration
+
+    configuration.segmentPlanes  = config.read_bool("PLANE_SEGMENTATION","segmentPlanes",configuration.segmentPlanes,false);
+    configuration.planesDistanceThreshold = config.read_double("PLANE_SEGMENTATION","distanceThreshold",configuration.planesDistanceThreshold,false);
+    configuration.planesMaxIterations     = config.read_int("PLANE_SEGMENTATION","maxIterations",configuration.planesMaxIterations,false);
+    configuration.planesMinInliers        = config.read_int("PLANE_SEGMENTATION","minInliers",configuration.planesMinInliers,false);
+    configuration.planesMaxNumber         = config.read_int("PLANE_SEGMENTATION","maxPlanes",configuration.planesMaxNumber,false);
+
+    // Load box proposals configuration
+
+    configuration.proposalsVoxelSize = config.read_double("BOX_PROPOSALS","voxelSize",configuration.proposalsVoxelSize,false);
+    configuration.proposalsPlanesDistanceThreshold = config.read_double("BOX_PROPOSALS","planesDistanceThreshold",configuration.proposalsPlanesDistanceThreshold,false);
+    configuration.proposalsMinPoints = config.read_int("BOX_PROPOSALS","minPoints",configuration.proposalsMinPoints,false);
+    configuration.proposalsMaxPoints = config.read_int("BOX_PROPOSALS","maxPoints",configuration.proposalsMaxPoints,false);
+    configuration.proposalsMaxSize   = config.read_double("BOX_PROPOSALS","maxSize",configuration.proposalsMaxSize,false);
+
 
     // Load object labels (classes) to be considered
 
@@ -198,6 +258,22 @@ int loadParameters(int argc, char* argv[])
                 configuration.sceneFile = argv[arg+1];
                 arg = arg+2;
             }
+            else if ( !strcmp(argv[arg],"-segmentPlanes") )
+            {
+                configuration.segmentPlanes = true;
+                arg++;
+            }
+            else if ( !strcmp(argv[arg],"-octree") )
+            {
+                configuration.useOctree = true;
+                arg++;
+
+                if ( ( arg < argc ) && ( argv[arg][0] != '-' ) )
+                {
+                    configuration.octreeMaxPoints = atoi(argv[arg]);
+                    arg++;
+                }
+            }
             else
             {
                 cout << "[Error] " << argv[arg] << " unknown paramter" << endl;
@@ -224,144 +300,120 @@ int loadParameters(int argc, char* argv[])
 
 //-----------------------------------------------------------
 //
-//                   segmentPointCloud
+//                     getScenePoints
 //
 //-----------------------------------------------------------
 
-void segmentPointCloud()
+bool getScenePoints( PointCloud<PointXYZ> &cloud )
 {
-    // Experimental method!
-
-    size_t N_inliers;	// Number of inliers of the fitted plane in each iteration
-    std::vector<int> indices;
-
-
-    CPointCloudColouredPtr opengl_cloud = scene->getByClass<CPointCloudColoured>(0);
-
-    size_t N_points = opengl_cloud->size();
-    PointCloud<PointXYZ>::Ptr cloud   (new PointCloud<PointXYZ>());
+    cloud.clear();
 
-    for (size_t i = 0; i < N_points; i++)
+    if ( octree.isOpen() )
     {
-        TPoint3Df point = opengl_cloud->getPointf(i);
+        // The drawn cloud is decimated, take all the points of the octree
 
-        cloud->push_back(PointXYZ(point.x,point.y,point.z));
-    }
-
-    do {
-        // Create the segmentation object
-        pcl::SACSegmentation<pcl::PointXYZ> seg;
-        pcl::PointIndices::Ptr				inliers ( new pcl::PointIndices() );
-        pcl::ModelCoefficients::Ptr			coeffs( new pcl::ModelCoefficients() );
+        const OLT::COctreeScene::TPoint *points = octree.getPoints();
+        cloud.resize( octree.getNumberOfPoints() );
 
-        // Optional
-        //seg.setOptimizeCoefficients (true);
-
-        // Mandatory
-        seg.setInputCloud( cloud );
+        for ( size_t i = 0; i < octree.getNumberOfPoints(); i++ )
+            cloud.points[i] = PointXYZ( points[i].x, points[i].y, points[i].z );
+    }
+    else
+    {
+        CPointCloudColouredPtr opengl_cloud = scene->getByClass<CPointCloudColoured>(0);
 
-        if ( indices.size() )
+        if ( opengl_cloud.null() || ( opengl_cloud == planesCloud ) )
         {
-            vector<int>							indicesInverse;
-
-            // Create the filtering object
-            pcl::ExtractIndices<pcl::PointXYZ> extract;
+            cout << "  [ERROR] The scene has no point cloud." << endl;
+            return false;
+        }
 
-            // Extract the inliers
-            extract.setInputCloud ( cloud );
-            extract.setIndices( pcl::IndicesPtr( new vector<int>(indices) ) );
-            extract.setNegative ( true );
-            extract.filter ( indicesInverse );
+        OLT::appendToPCL( OLT::TPointsView::fromOpenGL(*opengl_cloud), cloud );
+    }
 
-            seg.setIndices( pcl::IndicesPtr( new vector<int>(indicesInverse) ) );
+    return true;
+}
 
-            cout << "Num of indices to take into accout: " << indicesInverse.size() << endl;
 
-        }
+//-----------------------------------------------------------
+//
+//                   segmentPointCloud
+//
+//-----------------------------------------------------------
 
-        seg.setMethodType ( pcl::SAC_RANSAC );
-        seg.setModelType ( pcl::SACMODEL_PLANE );
-        seg.setMaxIterations ( 1000 );
-        seg.setDistanceThreshold ( 0.10 );
-        seg.setEpsAngle ( 0.17 ); // ~10 degrees
+// Extract the dominant planes of the scene (floor, walls, tables...). The
+// extraction itself needs no window, and the planes are only drawn, painted
+// with different colours, if visualize is set.
 
-        // Detect!
-        seg.segment( *inliers, *coeffs );
+void segmentPointCloud( bool visualize )
+{
+    PointCloud<PointXYZ>::Ptr cloud (new PointCloud<PointXYZ>());
 
-        N_inliers = inliers->indices.size();
+    if ( !getScenePoints( *cloud ) )
+        return;
 
-        //////////////////// VISUALIZATION ///////////////////////
-        boost::shared_ptr<pcl::visualization::PCLVisualizer> viewer (new pcl::visualization::PCLVisualizer ("Detection step"));
+    OLT::CMultiPlaneExtractor extractor;
 
-        pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloudOriginal( new pcl::PointCloud<pcl::PointXYZRGBA>() );
-        pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloudPlaneDetected( new pcl::PointCloud<pcl::PointXYZRGBA>() );
+    extractor.setDistanceThreshold( configuration.planesDistanceThreshold );
+    extractor.setMaxIterations( configuration.planesMaxIterations );
+    extractor.setMinInliers( configuration.planesMinInliers );
+    extractor.setMaxPlanes( configuration.planesMaxNumber );
 
-        pcl::PointCloud<pcl::PointXYZ>::Ptr cloudOriginalAux( new pcl::PointCloud<pcl::PointXYZ>() );
-        pcl::PointCloud<pcl::PointXYZ>::Ptr cloudPlaneDetectedAux( new pcl::PointCloud<pcl::PointXYZ>() );
+    vector<PointIndices> v_planes;
+    vector<ModelCoefficients> v_coefficients;
 
-        // Create the filtering object
-        pcl::ExtractIndices<pcl::PointXYZ> extract;
-        /////////////////// END VISUALIZATION /////////////////////
+    CTicTac clock;
+    clock.Tic();
 
-        if ( N_inliers > 1000 )
-        {
-            //////////////////// VISUALIZATION ///////////////////////
-            if ( indices.size() )
-            {
-                extract.setInputCloud ( cloud );
-                extract.setIndices ( pcl::IndicesPtr( new vector<int>(indices) ) );
-                extract.setNegative ( true );
-                extract.filter ( *cloudOriginalAux );
+    extractor.segment( *cloud, v_planes, v_coefficients );
 
-                cout << "Size of original aux: " << cloudOriginalAux->size() << endl;
+    cout << "  [INFO] " << v_planes.size() << " planes extracted from " << cloud->size()
+         << " points in " << clock.Tac() << " s, " << extractor.getNumberOfRemainingPoints()
+         << " points left." << endl;
 
-                pcl::copyPointCloud(*cloudOriginalAux,*cloudOriginal);
-            }
-            else
-            {
-                pcl::copyPointCloud(*cloud,*cloudOriginal);
+    for ( size_t plane_index = 0; plane_index < v_planes.size(); plane_index++ )
+    {
+        const vector<float> &coeffs = v_coefficients[plane_index].values;
 
-                cout << "Size of original aux (cloud): " << cloud->size() << endl;
-            }
-            /////////////////// END VISUALIZATION /////////////////////
+        cout << "         Plane " << plane_index << ": " << v_planes[plane_index].indices.size()
+             << " points, coefficients " << coeffs[0] << " " << coeffs[1] << " "
+             << coeffs[2] << " " << coeffs[3] << endl;
+    }
 
-            pcl::PointCloud<pcl::PointXYZ>::Ptr cloudPlaneDetectedAux( new pcl::PointCloud<pcl::PointXYZ>() );
+    if ( !visualize || v_planes.empty() )
+        return;
 
-            //CPlane plane( inliers, coeffs, type );
-            //cout << plane << endl;
-            //planes.push_back( plane );
-            indices.insert( indices.end(), inliers->indices.begin(), inliers->indices.end() );
-        }
+    //
+    // Show the planes over the scene
 
-        // Extract the inliers
-        pcl::ExtractIndices<pcl::PointXYZ> extract2;
-        extract2.setInputCloud ( cloud );
-        extract2.setIndices ( inliers );
-        extract2.setNegative ( false );
-        extract2.filter ( *cloudPlaneDetectedAux );
+    CPointCloudColouredPtr gl_planes = CPointCloudColoured::Create();
+    gl_planes->setPointSize(3);
 
-        cout << "Size of plane detected aux: " << cloudPlaneDetectedAux->size() << endl;
+    for ( size_t plane_index = 0; plane_index < v_planes.size(); plane_index++ )
+    {
+        const vector<int> &indices = v_planes[plane_index].indices;
 
-        pcl::copyPointCloud(*cloudPlaneDetectedAux,*cloudPlaneDetected);
+        const float R = ( ( plane_index*67 ) % 256 ) / 255.f;
+        const float G = ( ( plane_index*151 + 85 ) % 256 ) / 255.f;
+        const float B = ( ( plane_index*211 + 170 ) % 256 ) / 255.f;
 
-        pcl::visualization::PointCloudColorHandlerCustom<pcl::PointXYZRGBA> blue(cloudPlaneDetected,0,0,255);
-        pcl::visualization::PointCloudColorHandlerCustom<pcl::PointXYZRGBA> red(cloudOriginal,255,0,0);
+        for ( size_t i = 0; i < indices.size(); i++ )
+        {
+            const PointXYZ &point = cloud->points[indices[i]];
+            gl_planes->push_back( point.x, point.y, point.z, R, G, B );
+        }
+    }
 
-        viewer->addPointCloud<pcl::PointXYZRGBA> (cloudOriginal,red,"cloud1");
-        viewer->addPointCloud<pcl::PointXYZRGBA> (cloudPlaneDetected,blue,"cloud2");
+    scene = win3D.get3DSceneAndLock();
 
-        viewer->setBackgroundColor (0.5, 0.5, 0.5);
-        viewer->addCoordinateSystem (1.0);
-        viewer->initCameraParameters ();
+    if ( !planesCloud.null() )
+        scene->removeObject( planesCloud );
 
-        while (!viewer->wasStopped ())
-        {
-            viewer->spinOnce (100);
-            mrpt::system::sleep(100);
-        }
+    planesCloud = gl_planes;
+    scene->insert( planesCloud );
 
-    }
-    while( N_inliers > 1000 );
+    win3D.unlockAccess3DScene();
+    win3D.repaint();
 }
 
 
@@ -597,6 +649,358 @@ void sortCorners( const vector<TPoint3D> &toSort, vector<TPoint3D> &sorted, cons
 }
 
 
+//-----------------------------------------------------------
+//
+//                     getOctreeFile
+//
+//-----------------------------------------------------------
+
+string getOctreeFile( const string &sceneFile )
+{
+    return mrpt::system::fileNameChangeExtension(sceneFile,"octree");
+}
+
+bool isOctreeUpToDate( const string &sceneFile )
+{
+    const string octreeFile = getOctreeFile(sceneFile);
+
+    return mrpt::system::fileExists(octreeFile) &&
+            ( mrpt::system::getFileModificationTime(octreeFile) >=
+              mrpt::system::getFileModificationTime(sceneFile) );
+}
+
+
+//-----------------------------------------------------------
+//
+//                     buildOctree
+//
+//-----------------------------------------------------------
+
+int buildOctree( CPointCloudColouredPtr cloud, const string &octreeFile )
+{
+    cout << "  [INFO] Building the octree of " << cloud->size() << " points ... ";
+    cout.flush();
+
+    vector<OLT::COctreeScene::TPoint> v_points( cloud->size() );
+
+    for ( size_t i = 0; i < cloud->size(); i++ )
+    {
+        const CPointCloudColoured::TPointColour &point = cloud->getPoint(i);
+        OLT::COctreeScene::TPoint &octreePoint = v_points[i];
+
+        octreePoint.x = point.x;
+        octreePoint.y = point.y;
+        octreePoint.z = point.z;
+        octreePoint.R = (uint8_t)( 255*std::min(std::max(point.R,0.f),1.f) );
+        octreePoint.G = (uint8_t)( 255*std::min(std::max(point.G,0.f),1.f) );
+        octreePoint.B = (uint8_t)( 255*std::min(std::max(point.B,0.f),1.f) );
+        octreePoint.A = 255;
+    }
+
+    int res = OLT::COctreeScene::build( v_points, octreeFile, cloud->getPointSize() );
+
+    cout << ( res ? "error" : "done" ) << endl;
+
+    return res;
+}
+
+
+//-----------------------------------------------------------
+//
+//                   getOctreePoints
+//
+//-----------------------------------------------------------
+
+CPointCloudColouredPtr getOctreePoints( const vector<size_t> &v_nodes, size_t N_points )
+{
+    CPointCloudColouredPtr cloud = CPointCloudColoured::Create();
+    cloud->setPointSize( octree.getPointSize() );
+    cloud->reserve( N_points );
+
+    if ( !N_points )
+        return cloud;
+
+    const OLT::COctreeScene::TPoint *points = octree.getPoints();
+
+    // The nodes only have more points than N_points if the root alone
+    // exceeded the budget, then they are subsampled with a stride
+
+    size_t N_nodesPoints = 0;
+
+    for ( size_t i = 0; i < v_nodes.size(); i++ )
+        N_nodesPoints += octree.getNode(v_nodes[i]).N_points;
+
+    const size_t stride = ( N_nodesPoints + N_points - 1 ) / N_points;
+
+    for ( size_t i = 0; i < v_nodes.size(); i++ )
+    {
+        const OLT::COctreeScene::TNode &node = octree.getNode(v_nodes[i]);
+
+        for ( size_t index = node.firstPoint; index < node.firstPoint + node.N_points; index += stride )
+        {
+            const OLT::COctreeScene::TPoint &point = points[index];
+            cloud->push_back( point.x, point.y, point.z,
+                              point.R/255.f, point.G/255.f, point.B/255.f );
+        }
+    }
+
+    return cloud;
+}
+
+
+//-----------------------------------------------------------
+//
+//                    updateLODCloud
+//
+//-----------------------------------------------------------
+
+// Select the points of the octree to draw from the current camera position.
+// Nothing is done if the camera barely moved since the last selection,
+// unless forced.
+
+void updateLODCloud( bool force = false )
+{
+    if ( !octree.isOpen() )
+        return;
+
+    float x, y, z;
+    win3D.getCameraPointingToPoint(x,y,z);
+
+    const double azimuth   = DEG2RAD(win3D.getCameraAzimuthDeg());
+    const double elevation = DEG2RAD(win3D.getCameraElevationDeg());
+    const double zoom      = std::max(0.01f,win3D.getCameraZoom());
+
+    TPoint3D viewpoint( x + zoom*cos(azimuth)*cos(elevation),
+                        y + zoom*sin(azimuth)*cos(elevation),
+                        z + zoom*sin(elevation) );
+
+    if ( !force && ( lodViewpoint.distanceTo(viewpoint) < 0.05*zoom ) )
+        return;
+
+    lodViewpoint = viewpoint;
+
+    vector<size_t> v_nodes;
+    size_t N_points = octree.selectNodes( viewpoint.x, viewpoint.y, viewpoint.z,
+                                          configuration.octreeMaxPoints, v_nodes );
+
+    CPointCloudColouredPtr cloud = getOctreePoints( v_nodes, N_points );
+
+    scene = win3D.get3DSceneAndLock();
+
+    if ( !lodCloud.null() )
+        scene->removeObject( lodCloud );
+
+    lodCloud = cloud;
+    scene->insert( lodCloud );
+
+    win3D.unlockAccess3DScene();
+    win3D.repaint();
+}
+
+
+//-----------------------------------------------------------
+//
+//                      loadScene
+//
+//-----------------------------------------------------------
+
+// Load a scene into the (locked) scene of the window. When using the octree,
+// the point cloud of the scene is replaced by the level of detail one, and
+// scenes with an up to date octree aren't even deserialized if their boxes
+// (if any) are in a .boxes file, since they have nothing else to edit.
+
+bool loadScene( const string &sceneFile )
+{
+    octree.close();
+    openOctreeFile.clear();
+    lodCloud.clear();
+    planesCloud.clear();
+    pointIndex.reset( pointIndex.getCellSize() );
+
+    const bool labelled = !sceneFile.compare(sceneFile.size()-15,15,"_labelled.scene");
+    const string octreeFile = getOctreeFile(sceneFile);
+
+    if ( configuration.useOctree && isOctreeUpToDate(sceneFile)
+         && ( !labelled || OLT::CBoxAnnotations::exists(sceneFile) )
+         && !octree.open(octreeFile) )
+    {
+        openOctreeFile = octreeFile;
+        scene->clear();
+        cout << "  [INFO] Using the octree " << octreeFile << " with "
+             << octree.getNumberOfPoints() << " points" << endl;
+
+        return true;
+    }
+
+    if ( !scene->loadFromFile(sceneFile) )
+        return false;
+
+    if ( configuration.useOctree )
+    {
+        CPointCloudColouredPtr cloud = scene->getByClass<CPointCloudColoured>(0);
+
+        if ( !cloud.null() &&
+             ( isOctreeUpToDate(sceneFile) || !buildOctree(cloud,octreeFile) ) &&
+             !octree.open(octreeFile) )
+        {
+            openOctreeFile = octreeFile;
+            scene->removeObject( cloud );
+            cout << "  [INFO] Using the octree " << octreeFile << " with "
+                 << octree.getNumberOfPoints() << " points" << endl;
+        }
+        else
+            cout << "  [INFO] Unable to use an octree, drawing all the points." << endl;
+    }
+
+    return true;
+}
+
+
+//-----------------------------------------------------------
+//
+//                    saveScenePoints
+//
+//-----------------------------------------------------------
+
+// Save the whole scene. The level of detail cloud is swapped by all the
+// points of the octree, so the saved scene is complete for the rest of the
+// apps, and the octree is stored next to it.
+
+bool saveScenePoints( const string &sceneFile )
+{
+    CPointCloudColouredPtr cloud;
+
+    if ( octree.isOpen() )
+    {
+        vector<size_t> v_nodes( octree.getNumberOfNodes() );
+
+        for ( size_t i = 0; i < v_nodes.size(); i++ )
+            v_nodes[i] = i;
+
+        cloud = getOctreePoints( v_nodes, octree.getNumberOfPoints() );
+    }
+
+    scene = win3D.get3DSceneAndLock();
+
+    // The segmented planes are not part of the scene
+    if ( !planesCloud.null() )
+        scene->removeObject( planesCloud );
+
+    if ( octree.isOpen() )
+    {
+        scene->removeObject( lodCloud );
+        scene->insert( cloud );
+    }
+
+    bool saved = scene->saveToFile(sceneFile);
+
+    if ( octree.isOpen() )
+    {
+        scene->removeObject( cloud );
+        scene->insert( lodCloud );
+    }
+
+    if ( !planesCloud.null() )
+        scene->insert( planesCloud );
+
+    win3D.unlockAccess3DScene();
+
+    if ( !octree.isOpen() )
+        return saved;
+
+    // Copy the octree in use after saving the scene, so it's up to date
+
+    const string octreeFile = getOctreeFile(sceneFile);
+    const string tmpFile = octreeFile + ".tmp";
+
+    if ( saved && ( octreeFile != openOctreeFile )
+         && ( !mrpt::system::copyFile(openOctreeFile,tmpFile,NULL,false)
+              || rename(tmpFile.c_str(),octreeFile.c_str()) ) )
+        cout << "  [ERROR] Couldn't store the octree " << octreeFile << endl;
+
+    return saved;
+}
+
+
+//-----------------------------------------------------------
+//
+//                      saveScene
+//
+//-----------------------------------------------------------
+
+// The points of the scene only have to be saved the first time, later saves
+// just store the boxes in the .boxes file of the scene.
+
+bool saveScene( const string &sceneFile )
+{
+    if ( !scenePointsSaved )
+    {
+        if ( !saveScenePoints(sceneFile) )
+            return false;
+
+        scenePointsSaved = true;
+    }
+
+    vector<OLT::TBoxAnnotation> v_annotations( v_boxes.size() );
+
+    for ( size_t box_index = 0; box_index < v_boxes.size(); box_index++ )
+    {
+        OLT::TBoxAnnotation &annotation = v_annotations[box_index];
+
+        annotation.label = v_boxes[box_index]->getName();
+        annotation.pose  = v_boxes[box_index]->getPose();
+        v_boxes[box_index]->getBoxCorners( annotation.corner1, annotation.corner2 );
+    }
+
+    return !OLT::CBoxAnnotations::save( sceneFile, v_annotations );
+}
+
+
+//-----------------------------------------------------------
+//
+//                   loadBoxAnnotations
+//
+//-----------------------------------------------------------
+
+// Replace the boxes stored within the (locked) scene, which are outdated if
+// it has a .boxes file, by the ones in that file.
+
+void loadBoxAnnotations( const string &sceneFile )
+{
+    vector<OLT::TBoxAnnotation> v_annotations;
+
+    if ( OLT::CBoxAnnotations::load( sceneFile, v_annotations ) )
+        return;
+
+    for ( CBoxPtr box = scene->getByClass<CBox>(0); !box.null(); box = scene->getByClass<CBox>(0) )
+        scene->removeObject( box );
+
+    for ( CText3DPtr text = scene->getByClass<CText3D>(0); !text.null(); text = scene->getByClass<CText3D>(0) )
+        scene->removeObject( text );
+
+    for ( size_t box_index = 0; box_index < v_annotations.size(); box_index++ )
+    {
+        const OLT::TBoxAnnotation &annotation = v_annotations[box_index];
+
+        CBoxPtr box = CBox::Create( annotation.corner1, annotation.corner2 );
+        box->setName( annotation.label );
+        box->setPose( annotation.pose );
+        box->setLineWidth(5);
+
+        CText3DPtr text = CText3D::Create();
+        text->setString( annotation.label );
+        text->setScale(0.06);
+
+        const TPoint3D &c1 = annotation.corner1;
+        const TPoint3D &c2 = annotation.corner2;
+        text->setPose( TPose3D( TPoint3D( CPose3D(annotation.pose) + TPose3D(TPoint3D(c1.x,c1.y,c2.z)) ) ) );
+
+        scene->insert( box );
+        scene->insert( text );
+    }
+}
+
+
 //-----------------------------------------------------------
 //
 //                changeUnderlyingPointCloud
@@ -630,6 +1034,7 @@ void changeUnderlyingPointCloud()
             cout << " valid :)" << endl;
             sceneFile = newSceneFile;
             sceneFileToSave = sceneFile.substr(0,sceneFile.size()-6) + "_labelled.scene";
+            scenePointsSaved = false;
         }
         else
         {
@@ -649,7 +1054,7 @@ void changeUnderlyingPointCloud()
     // Load new scene!
     //
 
-    scene->loadFromFile( sceneFile );
+    loadScene( sceneFile );
 
     for ( size_t box_index = 0;
           box_index < v_boxes.size();
@@ -665,6 +1070,8 @@ void changeUnderlyingPointCloud()
     win3D.unlockAccess3DScene();
     win3D.forceRepaint();
 
+    updateLODCloud(true);
+
     cout << "  [INFO] New scene successfully loaded" << endl;
 
 }
@@ -678,11 +1085,12 @@ void changeUnderlyingPointCloud()
 
 void showIDLEMenu()
 {
-    win3D.addTextMessage(0.02,0.06+0.03*1, "[Actions] 'l': show/hide list boxes 'n': new box 'e': edit box 'd': delete box", TColorf(1,1,0),10,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
+    win3D.addTextMessage(0.02,0.06+0.03*1, "[Actions] 'l': show/hide list boxes 'n': new box 'p': propose boxes 'e': edit box 'd': delete box", TColorf(1,1,0),10,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
     win3D.addTextMessage(0.02,0.06+0.03*0, "          'c': change underlying scene 's': save scene 'v': change visualization 'esc': exit", TColorf(1,1,0),11,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
     win3D.addTextMessage(0.02,0.06+0.03*2, "", TColorf(1,1,1),12,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
     win3D.addTextMessage(0.02,0.06+0.03*3, "", TColorf(1,1,1),13,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
     win3D.addTextMessage(0.02,0.06+0.03*4, "", TColorf(1,1,1),14,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
+    win3D.addTextMessage(0.02,0.04, "", TColorf(1,1,1),1,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
 }
 
 
@@ -697,11 +1105,74 @@ void showEDITINGMenu()
     win3D.addTextMessage(0.02,0.06+0.03*0, "[Rot]   'Ins': +yaw 'Del': -yaw 'Home': +pitch 'End': -pitch 'Pag-up': +roll 'Pag-down': -roll", TColorf(1,1,0),10,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
     win3D.addTextMessage(0.02,0.06+0.03*1, "[Moves] 'up': +x 'down': -x 'left': +y 'right': -y '1': +z '0': -z", TColorf(1,1,0),11,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
     win3D.addTextMessage(0.02,0.06+0.03*2, "[Size]  '7': +x '4': -x '8': +y '5': -y '9': +z '6': -z", TColorf(1,1,0),12,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
-    win3D.addTextMessage(0.02,0.06+0.03*3, "[Misc]  'l': label 'r': reset 'enter': finish editing", TColorf(1,1,0),13,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
+    win3D.addTextMessage(0.02,0.06+0.03*3, "[Misc]  'l': label 'r': reset 'f': fit to the points within 'enter': finish editing", TColorf(1,1,0),13,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
     win3D.addTextMessage(0.02,0.06+0.03*4, "", TColorf(1,1,1),14,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
 }
 
 
+//-----------------------------------------------------------
+//
+//                    buildPointIndex
+//
+//-----------------------------------------------------------
+
+// Index the points of the scene, if not done yet, to give feedback about the
+// points within the box being edited.
+
+void buildPointIndex()
+{
+    if ( !pointIndex.empty() )
+        return;
+
+    if ( octree.isOpen() )
+    {
+        const OLT::COctreeScene::TPoint *points = octree.getPoints();
+        pointIndex.reserve( octree.getNumberOfPoints() );
+
+        for ( size_t i = 0; i < octree.getNumberOfPoints(); i++ )
+            pointIndex.addPoint( points[i].x, points[i].y, points[i].z );
+    }
+    else
+    {
+        scene = win3D.get3DSceneAndLock();
+        CPointCloudColouredPtr cloud = scene->getByClass<CPointCloudColoured>(0);
+        win3D.unlockAccess3DScene();
+
+        if ( cloud.null() || cloud == planesCloud )
+            return;
+
+        pointIndex.reserve( cloud->size() );
+
+        for ( size_t i = 0; i < cloud->size(); i++ )
+        {
+            const CPointCloudColoured::TPointColour &point = cloud->getPoint(i);
+            pointIndex.addPoint( point.x, point.y, point.z );
+        }
+    }
+
+    pointIndex.finalize();
+
+    cout << "  [INFO] " << pointIndex.size() << " scene points indexed." << endl;
+}
+
+
+//-----------------------------------------------------------
+//
+//                   showEnclosedPoints
+//
+//-----------------------------------------------------------
+
+void showEnclosedPoints( CBoxPtr box )
+{
+    TPoint3D c1,c2;
+    box->getBoxCorners(c1,c2);
+
+    size_t N_points = pointIndex.countPointsInBox( CPose3D(box->getPose()), c1, c2 );
+
+    win3D.addTextMessage(0.02,0.04, format("Points within the box: %lu",(unsigned long)N_points), TColorf(1,1,1),1,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
+}
+
+
 //-----------------------------------------------------------
 //
 //                      changeState
@@ -719,6 +1190,9 @@ void changeState(const TState newState)
     {
         STATE = EDITING;
         showEDITINGMenu();
+
+        buildPointIndex();
+        showEnclosedPoints( v_boxes[box_editing] );
     }
 
     win3D.forceRepaint();
@@ -750,7 +1224,7 @@ void initializeVisualization()
     obj->setLocation(0,0,0);
     scene->insert( obj );
 
-    if (scene->loadFromFile(configuration.sceneFile))
+    if (loadScene(configuration.sceneFile))
         cout << "  [INFO] Scene " << configuration.sceneFile << " loaded" << endl;
     else
         cout << "  [INFO] Error while loading scene " << configuration.sceneFile << endl;
@@ -758,6 +1232,8 @@ void initializeVisualization()
     win3D.unlockAccess3DScene();
     win3D.repaint();
 
+    updateLODCloud(true);
+
     //
     // Already labelled scene?
     //
@@ -766,6 +1242,15 @@ void initializeVisualization()
     {
         cout << "  [INFO] Scene previously labelled. Loading labels... ";
 
+        // Boxes saved apart from the scene?
+        if ( OLT::CBoxAnnotations::exists(configuration.sceneFile) )
+        {
+            scene = win3D.get3DSceneAndLock();
+            loadBoxAnnotations( configuration.sceneFile );
+            win3D.unlockAccess3DScene();
+            win3D.repaint();
+        }
+
         // Load previously inserted boxes
         bool keepLoading = true;
         size_t boxes_inserted = 0;
@@ -788,6 +1273,7 @@ void initializeVisualization()
 
         cout << v_boxes.size() <<  " boxes loaded " << endl;
         sceneFileToSave = configuration.sceneFile;
+        scenePointsSaved = true;
     }
     else
     {
@@ -802,6 +1288,9 @@ void initializeVisualization()
 
     if ( configuration.showOnlyLabels )
     {
+        octree.close();
+        openOctreeFile.clear();
+
         scene = win3D.get3DSceneAndLock();
         scene->clear();
 
@@ -938,6 +1427,38 @@ void updateVisualListOfBoxes(bool changeState=true)
 }
 
 
+//-----------------------------------------------------------
+//
+//                     getInstanceLabel
+//
+//-----------------------------------------------------------
+
+// First <category>_<id> label not used by any box of the scene.
+
+string getInstanceLabel( const string &cat )
+{
+    size_t id = 0;
+    bool alreadyExists = true;
+
+    while ( alreadyExists )
+    {
+        alreadyExists = false;
+
+        for ( size_t i_box = 0; i_box < v_boxes.size(); i_box++)
+        {
+            if (!(format("%s_%lu",cat.c_str(),id).compare(v_boxes[i_box]->getName())))
+            {
+                alreadyExists = true;
+                id++;
+                break;
+            }
+        }
+    }
+
+    return format("%s_%lu",cat.c_str(),id);
+}
+
+
 //-----------------------------------------------------------
 //
 //                         addNewBox
@@ -973,30 +1494,13 @@ void addNewBox(string &objectCategory)
 
         objectCategory = cat;
 
-        //getInstanceLabel(cat);
-
         if ( configuration.autoLabelInstances )
         {
-            size_t id = 0;
-            bool alreadyExists = true;
-
-            while ( alreadyExists )
-            {
-                alreadyExists = false;
+            string instanceLabel = getInstanceLabel(cat);
 
-                for ( size_t i_box = 0; i_box < v_boxes.size(); i_box++)
-                {
-                    if (!(format("%s_%lu",cat.c_str(),id).compare(v_boxes[i_box]->getName())))
-                    {
-                        alreadyExists = true;
-                        id++;
-                        break;
-                    }
-                }
-            }
-            text->setString( format("%s_%lu",cat.c_str(),id) );
+            text->setString( instanceLabel );
             text->setScale(0.06);
-            box->setName( format("%s_%lu",cat.c_str(),id) );
+            box->setName( instanceLabel );
         }
     }
     else
@@ -1094,10 +1598,262 @@ void addNewBox(string &objectCategory)
     // Update visualization
     changeBoxesVisualization(true);
 
-    changeState(EDITING);
     box_editing = v_boxes.size()-1;
+    changeState(EDITING);
+
+    updateVisualListOfBoxes(false);
+}
+
+
+//-----------------------------------------------------------
+//
+//                   isWithinLabelledBox
+//
+//-----------------------------------------------------------
+
+bool isWithinLabelledBox( const TPoint3D &point )
+{
+    for ( size_t box_index = 0; box_index < v_boxes.size(); box_index++ )
+    {
+        TPoint3D c1,c2, local;
+        v_boxes[box_index]->getBoxCorners(c1,c2);
+
+        CPose3D(v_boxes[box_index]->getPose()).inverseComposePoint(
+                    point.x, point.y, point.z, local.x, local.y, local.z );
+
+        if ( ( local.x >= std::min(c1.x,c2.x) ) && ( local.x <= std::max(c1.x,c2.x) )
+             && ( local.y >= std::min(c1.y,c2.y) ) && ( local.y <= std::max(c1.y,c2.y) )
+             && ( local.z >= std::min(c1.z,c2.z) ) && ( local.z <= std::max(c1.z,c2.z) ) )
+            return true;
+    }
+
+    return false;
+}
+
+
+//-----------------------------------------------------------
+//
+//                     fitProposalBox
+//
+//-----------------------------------------------------------
+
+// Box enclosing a cluster, upright and with the yaw of the principal axis of
+// its points in the XY plane, as the boxes are usually edited.
+
+void fitProposalBox( const PointCloud<PointXYZ> &cloud, const vector<int> &indices,
+                     TPose3D &pose, TPoint3D &c1, TPoint3D &c2 )
+{
+    const size_t N_points = indices.size();
+
+    double mean_x = 0, mean_y = 0;
+
+    for ( size_t i = 0; i < N_points; i++ )
+    {
+        mean_x += cloud.points[indices[i]].x;
+        mean_y += cloud.points[indices[i]].y;
+    }
+
+    mean_x /= N_points;
+    mean_y /= N_points;
+
+    double cov_xx = 0, cov_xy = 0, cov_yy = 0;
+
+    for ( size_t i = 0; i < N_points; i++ )
+    {
+        const double dx = cloud.points[indices[i]].x - mean_x;
+        const double dy = cloud.points[indices[i]].y - mean_y;
+
+        cov_xx += dx*dx;
+        cov_xy += dx*dy;
+        cov_yy += dy*dy;
+    }
+
+    const double yaw = 0.5*atan2( 2*cov_xy, cov_xx - cov_yy );
+    const double cos_yaw = cos(yaw);
+    const double sin_yaw = sin(yaw);
+
+    // Bounds of the points along the axes of the box
+
+    TPoint3D min( std::numeric_limits<double>::max(),
+                  std::numeric_limits<double>::max(),
+                  std::numeric_limits<double>::max() );
+    TPoint3D max( -min.x, -min.y, -min.z );
+
+    for ( size_t i = 0; i < N_points; i++ )
+    {
+        const PointXYZ &point = cloud.points[indices[i]];
+        const double dx = point.x - mean_x;
+        const double dy = point.y - mean_y;
+
+        const double u =  cos_yaw*dx + sin_yaw*dy;
+        const double v = -sin_yaw*dx + cos_yaw*dy;
+
+        min.x = std::min(min.x,u); max.x = std::max(max.x,u);
+        min.y = std::min(min.y,v); max.y = std::max(max.y,v);
+        min.z = std::min(min.z,(double)point.z); max.z = std::max(max.z,(double)point.z);
+    }
+
+    const double center_u = ( min.x + max.x ) / 2;
+    const double center_v = ( min.y + max.y ) / 2;
+
+    pose = TPose3D( mean_x + cos_yaw*center_u - sin_yaw*center_v,
+                    mean_y + sin_yaw*center_u + cos_yaw*center_v,
+                    ( min.z + max.z ) / 2, yaw, 0, 0 );
+
+    c2 = TPoint3D( ( max.x - min.x ) / 2, ( max.y - min.y ) / 2, ( max.z - min.z ) / 2 );
+    c1 = TPoint3D( -c2.x, -c2.y, -c2.z );
+}
+
+
+//-----------------------------------------------------------
+//
+//                       proposeBoxes
+//
+//-----------------------------------------------------------
+
+// Propose a box for each object-like cluster of the scene: the dominant
+// planes are removed, the remaining points are clustered, and the clusters
+// not too big and not labelled yet are shown as candidate boxes. Then the
+// annotator goes through them, only naming the ones to keep.
+
+void proposeBoxes()
+{
+    PointCloud<PointXYZ>::Ptr cloud (new PointCloud<PointXYZ>());
+
+    if ( !getScenePoints( *cloud ) )
+        return;
+
+    showStatusMessage("Proposing boxes...");
+
+    CTicTac clock;
+    clock.Tic();
+
+    // Remove the dominant planes
+
+    OLT::CMultiPlaneExtractor extractor;
+
+    extractor.setDistanceThreshold( configuration.proposalsPlanesDistanceThreshold );
+    extractor.setMaxIterations( configuration.planesMaxIterations );
+    extractor.setMinInliers( configuration.planesMinInliers );
+    extractor.setMaxPlanes( configuration.planesMaxNumber );
+
+    vector<PointIndices> v_planes;
+    vector<ModelCoefficients> v_coefficients;
+
+    extractor.segment( *cloud, v_planes, v_coefficients );
+
+    vector<bool> v_inPlane( cloud->size() );
+
+    for ( size_t i = 0; i < cloud->size(); i++ )
+        v_inPlane[i] = !extractor.isRemaining(i);
+
+    // Cluster the rest of points
+
+    OLT::CVoxelClustering clustering;
+
+    clustering.setVoxelSize( configuration.proposalsVoxelSize );
+    clustering.setMinClusterSize( configuration.proposalsMinPoints );
+    clustering.setMaxClusterSize( configuration.proposalsMaxPoints );
+
+    vector<PointIndices> v_clusters;
 
+    clustering.segment( *cloud, v_inPlane, v_clusters );
+
+    // Fit a box to each cluster
+
+    vector<CBoxPtr> v_proposals;
+
+    for ( size_t cluster_index = 0; cluster_index < v_clusters.size(); cluster_index++ )
+    {
+        TPose3D pose;
+        TPoint3D c1, c2;
+
+        fitProposalBox( *cloud, v_clusters[cluster_index].indices, pose, c1, c2 );
+
+        const double size = 2*std::max( c2.x, std::max( c2.y, c2.z ) );
+
+        if ( ( size > configuration.proposalsMaxSize )
+             || isWithinLabelledBox( TPoint3D(pose.x,pose.y,pose.z) ) )
+            continue;
+
+        CBoxPtr box = CBox::Create( c1, c2 );
+        box->setPose( pose );
+        box->setWireframe(true);
+        box->setLineWidth(2);
+        box->setColor(1.0,0.5,0.0);
+
+        v_proposals.push_back( box );
+    }
+
+    cout << "  [INFO] " << v_proposals.size() << " boxes proposed from "
+         << v_clusters.size() << " clusters (" << v_planes.size() << " planes removed) in "
+         << clock.Tac() << " s." << endl;
+
+    showStatusMessage("");
+
+    if ( v_proposals.empty() )
+        return;
+
+    scene = win3D.get3DSceneAndLock();
+
+    for ( size_t i = 0; i < v_proposals.size(); i++ )
+        scene->insert( v_proposals[i] );
+
+    win3D.unlockAccess3DScene();
+    win3D.forceRepaint();
+
+    //
+    // Review the proposals, biggest first
+
+    size_t N_accepted = 0;
+
+    for ( size_t i = 0; i < v_proposals.size(); i++ )
+    {
+        CBoxPtr box = v_proposals[i];
+        const TPose3D pose = box->getPose();
+
+        box->setLineWidth(5);
+        box->setColor(1.0,0.0,1.0);
+        win3D.setCameraPointingToPoint( pose.x, pose.y, pose.z );
+
+        string cat = readStringFromWindow( format("    Proposal %lu of %lu. Insert the category of the object (empty to discard): ",
+                                                  (unsigned long)i+1, (unsigned long)v_proposals.size()) );
+
+        scene = win3D.get3DSceneAndLock();
+
+        if ( cat.empty() )
+            scene->removeObject( box );
+        else
+        {
+            string label = ( configuration.autoLabelInstances ) ? getInstanceLabel(cat) : cat;
+
+            box->setName( label );
+            box->setColor(1.0,1.0,1.0);
+
+            TPoint3D c1,c2;
+            box->getBoxCorners(c1,c2);
+
+            CText3DPtr text = CText3D::Create();
+            text->setString( label );
+            text->setScale(0.06);
+            text->setPose( TPose3D( TPoint3D( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c1.y,c2.z)) ) ) );
+
+            scene->insert( text );
+
+            v_boxes.push_back( box );
+            v_labels.push_back( text );
+
+            N_accepted++;
+        }
+
+        win3D.unlockAccess3DScene();
+    }
+
+    cout << "  [INFO] " << N_accepted << " proposals accepted." << endl;
+
+    changeBoxesVisualization(true);
     updateVisualListOfBoxes(false);
+    showIDLEMenu();
 }
 
 
@@ -1119,6 +1875,8 @@ void labelScene()
 
     while ( win3D.isOpen() && !end )
     {
+        // Refine the drawn points if the camera moved
+        updateLODCloud();
 
         /*CSpherePtr sphere1 = CSphere::Create(0.025);
         CSpherePtr sphere2 = CSphere::Create(0.025);
@@ -1165,6 +1923,12 @@ void labelScene()
 
                     break;
                 }
+                case ('p') : // Propose boxes for the objects of the scene
+                {
+                    proposeBoxes();
+
+                    break;
+                }
                 case ('e') :
                 {
                     size_t box_index;
@@ -1215,7 +1979,7 @@ void labelScene()
 
                     showStatusMessage("Saving scene...");
 
-                    if ( scene->saveToFile(sceneFileToSave) )
+                    if ( saveScene(sceneFileToSave) )
                     {
                         cout << "done" << endl;
                         showStatusMessage("Saving scene... DONE!");
@@ -1518,6 +2282,15 @@ void labelScene()
 
                     break;
                 }
+                case ('f') : // Fit the box to the points within it
+                {
+                    TPoint3D min, max;
+
+                    if ( pointIndex.getBoundsInBox( CPose3D(boxPose), c1, c2, min, max ) )
+                        box->setBoxCorners(min,max);
+
+                    break;
+                }
                 case ( MRPTK_RETURN ): // Finished editing
                 {
                     TPose3D pose = box->getPose();
@@ -1648,6 +2421,9 @@ void labelScene()
 
                 win3D.addTextMessage(0.02,0.02, "Box pose:" + pose.asString(), TColorf(1,1,1),0,MRPT_GLUT_BITMAP_TIMES_ROMAN_10 );
 
+                if ( STATE == EDITING )
+                    showEnclosedPoints( box );
+
                 win3D.unlockAccess3DScene();
                 win3D.repaint();
             }
@@ -1690,9 +2466,10 @@ int main(int argc, char* argv[])
         initializeVisualization();
 
         //
-        // Segment point cloud (not ready yet!)
+        // Segment the main planes of the scene
 
-        //segmentPointCloud();
+        if ( configuration.segmentPlanes )
+            segmentPointCloud(true);
 
         //
         // Label scene!
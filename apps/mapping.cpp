@@ -78,6 +78,11 @@
 //#include <pcl/filters/voxel_grid.h>
 #include <pcl/filters/fast_bilateral.h>
 
+#include "CSensorRegistry.hpp"
+#include "CDepthProjector.hpp"
+#include "CPointBuffer.hpp"
+#include "CTaskScheduler.hpp"
+
 #include <pcl/visualization/pcl_visualizer.h>
 
 #include <pcl/visualization/cloud_viewer.h>
@@ -184,6 +189,7 @@ vector< T3DRangeScan >  v_3DRangeScans;
 vector< CObservation3DRangeScanPtr > v_pending3DRangeScans;
 vector< double >    v_refinementGoodness;
 vector<string>      RGBD_sensors;
+OLT::CSensorRegistry sensorRegistry; // Camera models of the RGBD sensors
 
 struct TTime
 {
@@ -228,7 +234,8 @@ void showUsageInformation()
             "    -enable_RGBDdecimation: Permits to decimate the number of RGB observations to refine the sensors pose." << endl <<
             "    -enable_memoryDecimation <num>: Decimate the number of obs in the memory by <num>." << endl <<
             "    -enable_visualize2DResults: Visualize localization results in 2D." << endl <<
-            "    -disable_propagateCorrections: Disable the propagation of corrections during the refinement." << endl;
+            "    -disable_propagateCorrections: Disable the propagation of corrections during the refinement." << endl <<
+            "    -threads <num> : Number of threads to use (all the cores by default)." << endl;
 
 }
 
@@ -377,6 +384,13 @@ int loadParameters(int argc, char **argv)
             cout << "  [INFO] Enabled memory decimation, using only 1 of each " <<
                      decimateMemory << " RGBD observations in memory." << endl;
         }
+        else if ( !strcmp(argv[arg], "-threads") )
+        {
+            OLT::CTaskScheduler::setNumThreads( atoi(argv[arg+1]) );
+            arg += 1;
+
+            cout << "  [INFO] Using " << OLT::CTaskScheduler::getNumThreads() << " threads." << endl;
+        }
         else if ( !strcmp(argv[arg], "-h") )
         {
             showUsageInformation();
@@ -509,26 +523,27 @@ void visualizeResults()
 //
 //-----------------------------------------------------------
 
-void smoothObss()
+struct TSmoothObs
 {
-    cout << "  [INFO] Smoothing point clouds... ";
-
-    for ( size_t i = 0; i < v_3DRangeScans.size(); i++ )
-    {
+    const vector<int> &v_sensorIndices;
 
-        CObservation3DRangeScanPtr obs3D = CObservation3DRangeScan::Create();
-        obs3D = v_3DRangeScans[i].obs;
+    TSmoothObs( const vector<int> &v_sensorIndices ) :
+        v_sensorIndices(v_sensorIndices)
+    {}
 
-        // Remove the sensor pose
+    void operator()( size_t i ) const
+    {
+        CObservation3DRangeScanPtr obs3D = v_3DRangeScans[i].obs;
 
-        obs3D.make_unique();
-        obs3D->sensorPose.setFromValues(0,0,0,0,0,0);
+        const OLT::TRGBDCameraModel &model = sensorRegistry[v_sensorIndices[i]];
 
+        // Organized point cloud in the sensor frame (without its pose)
         pcl::PointCloud<pcl::PointXYZ>::Ptr pcl_cloud( new pcl::PointCloud<pcl::PointXYZ>() );
-        obs3D->project3DPointsFromDepthImageInto( *pcl_cloud, true );
 
-        pcl_cloud->height = 240;
-        pcl_cloud->width = 320;
+        OLT::CDepthProjector projector;
+        projector.setTakeIntoAccountSensorPose(false);
+        projector.setPermuteAxes(false);
+        projector.project( *obs3D, model, *pcl_cloud );
 
         // Apply bilateral filter
 
@@ -542,26 +557,27 @@ void smoothObss()
 
         m_bilateralFilter.filter (*pcl_cloud);
 
-        // Fill the original obs
+        // Fill the original obs. Null measurements are kept as (0,0,0) points
 
-        obs3D->points3D_x.clear();
-        obs3D->points3D_y.clear();
-        obs3D->points3D_z.clear();
+        OLT::copyToSoA( OLT::TPointsView::fromPCL(*pcl_cloud),
+                        obs3D->points3D_x, obs3D->points3D_y, obs3D->points3D_z, 0 );
 
-        size_t N_points = pcl_cloud->points.size();
-        obs3D->points3D_x.resize(N_points);
-        obs3D->points3D_y.resize(N_points);
-        obs3D->points3D_z.resize(N_points);
-
-        for ( size_t point_index = 0;
-              point_index < N_points;
-              point_index++ )
-        {
-            v_3DRangeScans[i].obs->points3D_x[point_index] = pcl_cloud->points[point_index].x;
-            v_3DRangeScans[i].obs->points3D_y[point_index] = pcl_cloud->points[point_index].y;
-            v_3DRangeScans[i].obs->points3D_z[point_index] = pcl_cloud->points[point_index].z;
-        }
+        obs3D->hasPoints3D = true;
     }
+};
+
+void smoothObss()
+{
+    cout << "  [INFO] Smoothing point clouds... ";
+
+    // Register the sensors first, so the tasks only read the registry
+    vector<int> v_sensorIndices( v_3DRangeScans.size() );
+
+    for ( size_t i = 0; i < v_3DRangeScans.size(); i++ )
+        v_sensorIndices[i] = sensorRegistry.registerFromObs(*v_3DRangeScans[i].obs);
+
+    TSmoothObs smoothObs(v_sensorIndices);
+    OLT::parallelFor( 0, v_3DRangeScans.size(), smoothObs );
 
     cout << "done!" << endl;
 }
@@ -579,9 +595,15 @@ void computeConvexHulls()
 
     for ( size_t i = 0; i < v_3DRangeScans.size(); i++ )
     {
-        // Get point cloud of old observation
+        const OLT::TRGBDCameraModel &model = sensorRegistry[sensorRegistry.registerFromObs(*v_3DRangeScans[i].obs)];
+
+        // Get point cloud of old observation, without null measurements
         pcl::PointCloud<pcl::PointXYZ>::Ptr pointCloud ( new pcl::PointCloud<pcl::PointXYZ>());
-        v_3DRangeScans[i].obs->project3DPointsFromDepthImageInto(*pointCloud,true);
+
+        OLT::CDepthProjector projector;
+        projector.setPermuteAxes(false);
+        projector.setOrganized(false);
+        projector.project( *v_3DRangeScans[i].obs, model, *pointCloud );
 
         pcl::ConvexHull<pcl::PointXYZ> convex_hull;
         convex_hull.setInputCloud(pointCloud);
@@ -1211,10 +1233,9 @@ void preparePointCloudsForRefinement(vector<T3DRangeScan> &v_obs,
         }
     }
 
-    // Show the scanned points:
-    CSimplePointsMap	M1,M2;
-    //M1.insertionOptions.minDistBetweenLaserPoints = 0.01;
-    //M2.insertionOptions.minDistBetweenLaserPoints = 0.01;
+    // Show the scanned points. Points are gathered in SoA buffers and then
+    // written in bulk into the PCL clouds.
+    OLT::CPointBuffer	M1,M2;
 
     CTicTac clock;
     clock.Tic();
@@ -1228,7 +1249,7 @@ void preparePointCloudsForRefinement(vector<T3DRangeScan> &v_obs,
         {
             // Memory decimation?
             if ( !decimateMemory  || (i < RGBD_sensors.size()*3) || !( i%decimateMemory ) )
-                M1.insertObservationPtr( v_obs[i].obs );
+                M1.appendObs( *v_obs[i].obs );
         }
         else
         {
@@ -1275,31 +1296,28 @@ void preparePointCloudsForRefinement(vector<T3DRangeScan> &v_obs,
             }
 
             if ( insert )
-                M1.insertObservationPtr( v_obs[i].obs );
+                M1.appendObs( *v_obs[i].obs );
         }
 
     }
 
+    size_t N_points2 = 0;
     for ( size_t i = 0; i < v_obs2.size(); i++ )
-        M2.insertObservationPtr( v_obs2[i].obs );
+        N_points2 += v_obs2[i].obs->points3D_x.size();
 
-    cout << "    Time spent inserting points: " << clock.Tac() << " s." << endl;
+    M2.reserve( N_points2 );
 
-    cout << "    Getting points... points 1: ";
-
-    CVectorDouble xs, ys, zs, xs2, ys2, zs2;
-    M1.getAllPoints(xs,ys,zs);
-    M2.getAllPoints(xs2,ys2,zs2);
+    for ( size_t i = 0; i < v_obs2.size(); i++ )
+        M2.appendObs( *v_obs2[i].obs );
 
-    cout << xs.size() << " points 2: " << xs2.size() << " ... done" << endl;
+    cout << "    Time spent inserting points: " << clock.Tac() << " s." << endl;
 
-    //cout << "Inserting points...";
+    cout << "    Getting points... points 1: ";
 
-    for ( size_t i = 0; i < xs.size(); i+= ( ( accumulatePast ) ? 2 : 1) )
-        cloud_old->push_back(PointXYZ(xs[i],ys[i],zs[i]));
+    cout << M1.size() << " points 2: " << M2.size() << " ... done" << endl;
 
-    for ( size_t i = 0; i < xs2.size(); i+= ( ( accumulatePast ) ? 1 : 1) )
-        cloud_new->push_back(PointXYZ(xs2[i],ys2[i],zs2[i]));
+    OLT::appendToPCL( M1.view(), *cloud_old, ( accumulatePast ) ? 2 : 1 );
+    OLT::appendToPCL( M2.view(), *cloud_new );
 }
 
 //-----------------------------------------------------------
@@ -1346,9 +1364,9 @@ void addNormal(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud,
 //
 //-----------------------------------------------------------
 
-void refineLocationGICP( vector<T3DRangeScan> &v_obs,
-                         vector<T3DRangeScan> &v_obs2,
-                         CPose3D              &correction)
+double refineLocationGICP( vector<T3DRangeScan> &v_obs,
+                          vector<T3DRangeScan> &v_obs2,
+                          CPose3D              &correction)
 {
     PointCloud<PointXYZ>::Ptr cloud_old   (new PointCloud<PointXYZ>());
     PointCloud<PointXYZ>::Ptr cloud_new   (new PointCloud<PointXYZ>());
@@ -1357,7 +1375,7 @@ void refineLocationGICP( vector<T3DRangeScan> &v_obs,
 
     // Check if the cloud has points (crashes if so)
     if ( cloud_new->points.size() < 100 )
-        return;
+        return -1;
 
     CTicTac clock;
     PointCloud<PointXYZ>::Ptr   cloud_trans (new PointCloud<PointXYZ>());
@@ -1392,8 +1410,6 @@ void refineLocationGICP( vector<T3DRangeScan> &v_obs,
     score = gicp.getFitnessScore(); // Returns the squared average error between the aligned input and target
     bool converged = gicp.hasConverged();
 
-    v_refinementGoodness.push_back(sqrt(score));
-
     cout << " done! Converged: " << converged << " Average error: " << sqrt(score) << " meters" <<
             " time spent: " << clock.Tac() << " s." << endl;
 
@@ -1416,6 +1432,8 @@ void refineLocationGICP( vector<T3DRangeScan> &v_obs,
 
     if ( processBySensor )
         cout << correction;
+
+    return sqrt(score);
 }
 
 
@@ -1425,9 +1443,9 @@ void refineLocationGICP( vector<T3DRangeScan> &v_obs,
 //
 //-----------------------------------------------------------
 
-void refineLocationICPWN( vector<T3DRangeScan> &v_obs,
-                         vector<T3DRangeScan> &v_obs2,
-                         CPose3D              &correction)
+double refineLocationICPWN( vector<T3DRangeScan> &v_obs,
+                           vector<T3DRangeScan> &v_obs2,
+                           CPose3D              &correction)
 {
     PointCloud<PointXYZ>::Ptr cloud_old   (new PointCloud<PointXYZ>());
     PointCloud<PointXYZ>::Ptr cloud_new   (new PointCloud<PointXYZ>());
@@ -1436,7 +1454,7 @@ void refineLocationICPWN( vector<T3DRangeScan> &v_obs,
 
     // Check if the cloud has points (crashes if so)
     if ( cloud_new->points.size() < 100 )
-        return;
+        return -1;
 
     CTicTac clock;
     PointCloud<PointXYZ>::Ptr   cloud_trans (new PointCloud<PointXYZ>());
@@ -1478,8 +1496,6 @@ void refineLocationICPWN( vector<T3DRangeScan> &v_obs,
     score = icpwn.getFitnessScore(); // Returns the squared average error between the aligned input and target
     bool converged = icpwn.hasConverged();
 
-    v_refinementGoodness.push_back(sqrt(score));
-
     cout << " done! Converged: " << converged << " Average error: " << sqrt(score) << " meters" <<
             " time spent: " << clock.Tac() << " s." << endl;
 
@@ -1502,6 +1518,8 @@ void refineLocationICPWN( vector<T3DRangeScan> &v_obs,
 
     if ( processBySensor )
         cout << correction;
+
+    return sqrt(score);
 }
 
 
@@ -1511,9 +1529,9 @@ void refineLocationICPWN( vector<T3DRangeScan> &v_obs,
 //
 //-----------------------------------------------------------
 
-void refineLocationICPNL( vector<T3DRangeScan> &v_obs,
-                          vector<T3DRangeScan> &v_obs2,
-                          CPose3D              &correction)
+double refineLocationICPNL( vector<T3DRangeScan> &v_obs,
+                           vector<T3DRangeScan> &v_obs2,
+                           CPose3D              &correction)
 {
     PointCloud<PointXYZ>::Ptr cloud_old   (new PointCloud<PointXYZ>());
     PointCloud<PointXYZ>::Ptr cloud_new   (new PointCloud<PointXYZ>());
@@ -1522,7 +1540,7 @@ void refineLocationICPNL( vector<T3DRangeScan> &v_obs,
 
     // Check if the cloud has points (crashes if so)
     if ( cloud_new->points.size() < 100 )
-        return;
+        return -1;
 
     CTicTac clock;
     PointCloud<PointXYZ>::Ptr   cloud_trans (new PointCloud<PointXYZ>());
@@ -1555,8 +1573,6 @@ void refineLocationICPNL( vector<T3DRangeScan> &v_obs,
     double score;
     score = icpnl.getFitnessScore(); // Returns the squared average error between the aligned input and target
 
-    v_refinementGoodness.push_back(sqrt(score));
-
     cout << " done! Average error: " << sqrt(score) << " meters" <<
             " time spent: " << clock.Tac() << " s." << endl;
 
@@ -1578,6 +1594,8 @@ void refineLocationICPNL( vector<T3DRangeScan> &v_obs,
 
     if ( processBySensor )
         cout << correction;
+
+    return sqrt(score);
 }
 
 
@@ -1587,9 +1605,9 @@ void refineLocationICPNL( vector<T3DRangeScan> &v_obs,
 //
 //-----------------------------------------------------------
 
-void refineLocationNDT( vector<T3DRangeScan> &v_obs,
-                        vector<T3DRangeScan> &v_obs2,
-                        CPose3D              &correction)
+double refineLocationNDT( vector<T3DRangeScan> &v_obs,
+                         vector<T3DRangeScan> &v_obs2,
+                         CPose3D              &correction)
 {
     PointCloud<PointXYZ>::Ptr cloud_old   (new PointCloud<PointXYZ>());
     PointCloud<PointXYZ>::Ptr cloud_new   (new PointCloud<PointXYZ>());
@@ -1598,7 +1616,7 @@ void refineLocationNDT( vector<T3DRangeScan> &v_obs,
 
     // Check if the cloud has points (crashes if so)
     if ( cloud_new->points.size() < 100 )
-        return;
+        return -1;
 
     CTicTac clock;
     PointCloud<PointXYZ>::Ptr   cloud_trans (new PointCloud<PointXYZ>());
@@ -1629,7 +1647,6 @@ void refineLocationNDT( vector<T3DRangeScan> &v_obs,
     ndt.align (*cloud_trans);
 
     float score = ndt.getFitnessScore ();
-    v_refinementGoodness.push_back(sqrt(score));
     bool converged = ndt.hasConverged();
 
     std::cout << "    done! Normal Distributions Transform has converged:" << converged
@@ -1660,6 +1677,8 @@ void refineLocationNDT( vector<T3DRangeScan> &v_obs,
 
     if ( processBySensor )
         cout << correction;
+
+    return sqrt(score);
 }
 
 
@@ -1669,9 +1688,9 @@ void refineLocationNDT( vector<T3DRangeScan> &v_obs,
 //
 //-----------------------------------------------------------
 
-void refineLocationICP( vector<T3DRangeScan> &v_obs,
-                        vector<T3DRangeScan> &v_obs2,
-                        CPose3D              &correction)
+double refineLocationICP( vector<T3DRangeScan> &v_obs,
+                         vector<T3DRangeScan> &v_obs2,
+                         CPose3D              &correction)
 {
     PointCloud<PointXYZ>::Ptr cloud_old   (new PointCloud<PointXYZ>());
     PointCloud<PointXYZ>::Ptr cloud_new   (new PointCloud<PointXYZ>());
@@ -1680,7 +1699,7 @@ void refineLocationICP( vector<T3DRangeScan> &v_obs,
 
     // Check if the cloud has points (crashes if so)
     if ( cloud_new->points.size() < 100 )
-        return;
+        return -1;
 
     CTicTac clock;
     PointCloud<PointXYZ>::Ptr   cloud_trans (new PointCloud<PointXYZ>());
@@ -1709,7 +1728,6 @@ void refineLocationICP( vector<T3DRangeScan> &v_obs,
     icp.align (*cloud_trans);
 
     float score = icp.getFitnessScore ();
-    v_refinementGoodness.push_back(sqrt(score));
 
     std::cout << "    done! converged:" << icp.hasConverged ()
               << "    score: " << sqrt(score) << " time spent: " << clock.Tac() << endl;
@@ -1733,6 +1751,8 @@ void refineLocationICP( vector<T3DRangeScan> &v_obs,
 
     if ( processBySensor )
         cout << correction;
+
+    return sqrt(score);
 }
 
 
@@ -1742,9 +1762,9 @@ void refineLocationICP( vector<T3DRangeScan> &v_obs,
 //
 //-----------------------------------------------------------
 
-void refineLocationICPMRPT( vector<T3DRangeScan> &v_obs,
-                        vector<T3DRangeScan> &v_obs2,
-                        CPose3D correction )
+double refineLocationICPMRPT( vector<T3DRangeScan> &v_obs,
+                             vector<T3DRangeScan> &v_obs2,
+                             CPose3D correction )
 {
 
     if (!initialGuessICP2D && !initialGuessDifodo)
@@ -1856,16 +1876,105 @@ void refineLocationICPMRPT( vector<T3DRangeScan> &v_obs,
     //window->waitForKey();
 
     double score = 100*icp_info.goodness;
-    v_refinementGoodness.push_back( score );
 
     correction = mean;
 
     if ( sqrt(score) > scoreThreshold && manuallyFix )
         manuallyFixAlign( v_obs, v_obs2, correction );
 
+    return score;
 }
 
 
+//-----------------------------------------------------------
+//
+//                  Refinement parallel bodies
+//
+//-----------------------------------------------------------
+
+// Compose a correction with the pose of the obs to process
+
+struct TPropagateCorrection
+{
+    const CPose3D   &correction;
+    size_t          firstObs;
+
+    TPropagateCorrection( const CPose3D &correction, size_t firstObs ) :
+        correction(correction), firstObs(firstObs)
+    {}
+
+    void operator()( size_t i ) const
+    {
+        CObservation3DRangeScanPtr &obs = v_3DRangeScans[firstObs+i].obs;
+        obs->sensorPose = correction + obs->sensorPose;
+    }
+};
+
+// Refine the pose of the current obs of a sensor. The goodness of the
+// refinement goes to the slot of the sensor (-1 if it couldn't be refined),
+// since tasks can't share v_refinementGoodness.
+
+struct TRefineSensorLocation
+{
+    vector<T3DRangeScan>            &v_obs;
+    vector<T3DRangeScan>            &v_obsC;
+    vector< vector<T3DRangeScan> >  &v_isolatedObs;
+    vector<double>                  &v_goodness;
+    size_t                          obsIndex;
+
+    TRefineSensorLocation( vector<T3DRangeScan> &v_obs,
+                           vector<T3DRangeScan> &v_obsC,
+                           vector< vector<T3DRangeScan> > &v_isolatedObs,
+                           vector<double> &v_goodness,
+                           size_t obsIndex ) :
+        v_obs(v_obs), v_obsC(v_obsC), v_isolatedObs(v_isolatedObs),
+        v_goodness(v_goodness), obsIndex(obsIndex)
+    {}
+
+    void operator()( size_t i_sensor ) const
+    {
+        const size_t N_scans = v_3DRangeScans.size();
+
+        CPose3D correction;
+        double &goodness = v_goodness[i_sensor];
+
+        if ( refinationMethod == "GICP" )
+            goodness = refineLocationGICP( v_obs, v_isolatedObs[i_sensor],correction );
+        else if ( refinationMethod == "ICP")
+            goodness = refineLocationICP( v_obs, v_isolatedObs[i_sensor],correction );
+        else if ( refinationMethod == "ICPNL")
+            goodness = refineLocationICPNL( v_obs, v_isolatedObs[i_sensor],correction );
+        else if ( refinationMethod == "ICPWN")
+            goodness = refineLocationICPWN( v_obs, v_obsC,correction );
+        else if ( refinationMethod == "NDT")
+            goodness = refineLocationNDT( v_obs, v_isolatedObs[i_sensor],correction );
+
+        // Compose correction with initial guess
+        CObservation3DRangeScanPtr obs = v_isolatedObs[i_sensor][0].obs;
+
+        CPose3D pose;
+        obs->getSensorPose( pose );
+
+        CPose3D finalPose = correction + pose;
+        obs->setSensorPose(finalPose);
+
+        // Propagate the correction to the remaining obs to process
+        if ( propagateCorrections )
+        {
+            for ( size_t i_obs = obsIndex+1; i_obs < N_scans; i_obs++ )
+            {
+                if ( v_3DRangeScans[i_obs].obs->sensorLabel ==
+                     RGBD_sensors[i_sensor] )
+                {
+                    v_3DRangeScans[i_obs].obs->sensorPose =
+                            correction + v_3DRangeScans[i_obs].obs->sensorPose;
+                }
+            }
+        }
+    }
+};
+
+
 //-----------------------------------------------------------
 //
 //                       refine
@@ -1909,7 +2018,10 @@ void refine()
 
             CPose3D correction;
 
-            refineLocationGICP( v_allObs[0], v_allObs[device_index], correction );
+            double goodness = refineLocationGICP( v_allObs[0], v_allObs[device_index], correction );
+
+            if ( goodness >= 0 )
+                v_refinementGoodness.push_back( goodness );
 
             for ( size_t i = 0; i < v_allObs[device_index].size(); i++ )
                 v_allObs[device_index][i].obs->sensorPose =
@@ -1979,13 +2091,20 @@ void refine()
 
                     if ( manuallyFix )
                     {
-                        // TODO: Load this from config to do it more general
-                        // Sensors order:
-                        vector<string> v_RGBDs_order(4);
-                        v_RGBDs_order[0] = "RGBD_4";
-                        v_RGBDs_order[1] = "RGBD_3";
-                        v_RGBDs_order[2] = "RGBD_1";
-                        v_RGBDs_order[3] = "RGBD_2";
+                        // Sensors order: the one of the robot used to collect
+                        // the Robot@Home dataset if its sensors are the ones
+                        // in the rawlog, the order of appearance otherwise
+                        vector<string> v_RGBDs_order = RGBD_sensors;
+
+                        if ( ( N_sensors == 4 ) &&
+                             sensorRegistry.hasSensor("RGBD_1") && sensorRegistry.hasSensor("RGBD_2") &&
+                             sensorRegistry.hasSensor("RGBD_3") && sensorRegistry.hasSensor("RGBD_4") )
+                        {
+                            v_RGBDs_order[0] = "RGBD_4";
+                            v_RGBDs_order[1] = "RGBD_3";
+                            v_RGBDs_order[2] = "RGBD_1";
+                            v_RGBDs_order[3] = "RGBD_2";
+                        }
 
                         vector<T3DRangeScan> v_aligned;
 
@@ -2079,17 +2198,21 @@ void refine()
                 if ( processInBlock )
                 {
                     CPose3D correction;
+                    double goodness = -1;
 
                     if ( refinationMethod == "GICP" )
-                        refineLocationGICP( v_obs, v_obsC,correction );
+                        goodness = refineLocationGICP( v_obs, v_obsC,correction );
                     else if ( refinationMethod == "ICP")
-                        refineLocationICP( v_obs, v_obsC,correction );
+                        goodness = refineLocationICP( v_obs, v_obsC,correction );
                     else if ( refinationMethod == "ICPNL")
-                        refineLocationICPNL( v_obs, v_obsC,correction );
+                        goodness = refineLocationICPNL( v_obs, v_obsC,correction );
                     else if ( refinationMethod == "ICPWN")
-                        refineLocationICPWN( v_obs, v_obsC,correction );
+                        goodness = refineLocationICPWN( v_obs, v_obsC,correction );
                     else if ( refinationMethod == "NDT")
-                        refineLocationNDT( v_obs, v_obsC,correction );
+                        goodness = refineLocationNDT( v_obs, v_obsC,correction );
+
+                    if ( goodness >= 0 )
+                        v_refinementGoodness.push_back( goodness );
 
                     for ( size_t i = 0; i < v_obsC.size(); i++ )
                         v_obsC[i].obs->sensorPose =
@@ -2098,54 +2221,30 @@ void refine()
                     // Propagate the correction to the remaining obs to process
                     if ( propagateCorrections )
                     {
-                        #pragma omp parallel for
-                        for ( size_t i_obs = obsIndex+1; i_obs < N_scans; i_obs++ )
-                            v_3DRangeScans[i_obs].obs->sensorPose =
-                                        correction + v_3DRangeScans[i_obs].obs->sensorPose;
+                        TPropagateCorrection propagate(correction,obsIndex+1);
+                        OLT::parallelFor( 0, N_scans-obsIndex-1, propagate, 1024 );
                     }
                 }
                 else
                 {
-                    #pragma omp parallel for
-                    for ( size_t i_sensor = 0; i_sensor < N_sensors; i_sensor++ )
-                    {
-                        CPose3D correction;
-
-                        if ( refinationMethod == "GICP" )
-                            refineLocationGICP( v_obs, v_isolatedObs[i_sensor],correction );
-                        else if ( refinationMethod == "ICP")
-                            refineLocationICP( v_obs, v_isolatedObs[i_sensor],correction );
-                        else if ( refinationMethod == "ICPNL")
-                            refineLocationICPNL( v_obs, v_isolatedObs[i_sensor],correction );
-                        else if ( refinationMethod == "ICPWN")
-                            refineLocationICPWN( v_obs, v_obsC,correction );
-                        else if ( refinationMethod == "NDT")
-                            refineLocationNDT( v_obs, v_isolatedObs[i_sensor],correction );
-
-                        // Compose correction with initial guess
-                        CObservation3DRangeScanPtr obs = v_isolatedObs[i_sensor][0].obs;
-
-                        CPose3D pose;
-                        obs->getSensorPose( pose );
-
-                        CPose3D finalPose = correction + pose;
-                        obs->setSensorPose(finalPose);
-
-                        // Propagate the correction to the remaining obs to process
-                        if ( propagateCorrections )
-                        {
-                            for ( size_t i_obs = obsIndex+1; i_obs < N_scans; i_obs++ )
-                            {
-                                if ( v_3DRangeScans[i_obs].obs->sensorLabel ==
-                                     RGBD_sensors[i_sensor] )
-                                {
-                                    v_3DRangeScans[i_obs].obs->sensorPose =
-                                            correction + v_3DRangeScans[i_obs].obs->sensorPose;
-                                }
-                            }
-                        }
+                    // Each sensor is refined in a different task, unless
+                    // the alignments could have to be fixed manually, which
+                    // needs windows from the main thread
 
+                    vector<double> v_goodness( N_sensors, -1 );
+                    TRefineSensorLocation refineSensor(v_obs,v_obsC,v_isolatedObs,v_goodness,obsIndex);
+
+                    if ( manuallyFix )
+                    {
+                        for ( size_t i_sensor = 0; i_sensor < N_sensors; i_sensor++ )
+                            refineSensor( i_sensor );
                     }
+                    else
+                        OLT::parallelFor( 0, N_sensors, refineSensor );
+
+                    for ( size_t i_sensor = 0; i_sensor < N_sensors; i_sensor++ )
+                        if ( v_goodness[i_sensor] >= 0 )
+                            v_refinementGoodness.push_back( v_goodness[i_sensor] );
                 }
 
 
@@ -2226,6 +2325,9 @@ void computeInitialGuessDifodo()
 
     bool exit = false, first = true;
 
+    // Number of RGBD sensors to wait for before starting
+    sensorRegistry.discoverSensors(i_rawlogFileName);
+
     while ( !exit && CRawlog::getActionObservationPairOrObservation(i_rawlog,
                                             action,observations,obs,obsIndex) )
     {
@@ -2246,7 +2348,7 @@ void computeInitialGuessDifodo()
                 v_poses.push_back(obs3D->sensorPose);
             }
 
-            if ( RGBD_sensors.size() == 4 )
+            if ( RGBD_sensors.size() == sensorRegistry.size() )
                 exit = true;
 
             if (first)
@@ -2374,6 +2476,8 @@ void computeInitialGuessICP2D()
             CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
             obs3D->load();
 
+            sensorRegistry.registerFromObs(*obs3D);
+
             // Check decimation and insert the observation
             if ( !(RGBDobsPerSensor[getRGBDSensorIndex(label)] % decimation) )
                 v_pending3DRangeScans.push_back( obs3D );
@@ -2429,6 +2533,8 @@ void computeInitialGuessOnlyFill()
             CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
             obs3D->load();
 
+            sensorRegistry.registerFromObs(*obs3D);
+
             T3DRangeScan obs;
             obs.obs = obs3D;
 
@@ -46,6 +46,8 @@
     #include <clams/discrete_depth_distortion_model.h>
 #endif
 #include "processing.hpp"
+#include "CSensorRegistry.hpp"
+#include "CTaskScheduler.hpp"
 using namespace mrpt;
 using namespace mrpt::utils;
 using namespace mrpt::math;
@@ -73,6 +75,7 @@ float removeEmptyObs = 0.0;
 float removeWeirdObs = 0.0;
 bool onlyRemove3DPointClouds;
 bool saveAsPlainText;
+int obsBatchSize = 64;      // Number of obs processed in parallel by processRawlog
 
 string replaceSensorLabel;  // Current sensor label
 string replaceSensorLabelAs;// New sensor label
@@ -113,20 +116,105 @@ struct TScaleCalibration{
 
 vector<TScaleCalibration> v_scaleCalibrations;
 
+#ifdef USING_CLAMS_INTRINSIC_CALIBRATION
+
+// Precomputed version of a CLAMS depth distortion model. For each pixel it
+// stores the multipliers applied by the model at equally spaced depths, so
+// undistorting an image reduces to a branch-free interpolation over the range
+// buffer that can be done in place and vectorized.
+
+struct TDepthUndistortionTable{
+
+    size_t  N_rows;
+    size_t  N_cols;
+    size_t  N_bins;     // Depth bins per pixel, including a trailing guard bin
+    float   resolution; // Distance between bins (m)
+    float   maxDepth;   // Depths beyond this use the multiplier of the last bin
+    vector<float> multipliers; // Stored as [pixel][bin]
+
+    TDepthUndistortionTable() : N_rows(0), N_cols(0), N_bins(0),
+        resolution(0.1), maxDepth(10)
+    {}
+
+    bool isBuilt( size_t rows, size_t cols ) const
+    {
+        return ( !multipliers.empty() && ( N_rows == rows ) && ( N_cols == cols ) );
+    }
+
+    void build( clams::DiscreteDepthDistortionModel &model, size_t rows, size_t cols )
+    {
+        N_rows = rows;
+        N_cols = cols;
+        N_bins = ceil(maxDepth/resolution) + 2;
+
+        const size_t N_pixels = N_rows*N_cols;
+        multipliers.assign(N_pixels*N_bins,1.0);
+
+        // Probe the model with constant depth images, one per bin. Zero depths
+        // are skipped by CLAMS, so the first bin takes the value of the second.
+        Eigen::MatrixXf probe(N_rows,N_cols);
+
+        for ( size_t bin = 1; bin < N_bins-1; bin++ )
+        {
+            const float depth = bin*resolution;
+            probe.setConstant(depth);
+            model.undistort(&probe);
+
+            for ( size_t row = 0; row < N_rows; row++ )
+                for ( size_t col = 0; col < N_cols; col++ )
+                    multipliers[(row*N_cols+col)*N_bins+bin] = probe(row,col)/depth;
+        }
+
+        for ( size_t pixel = 0; pixel < N_pixels; pixel++ )
+        {
+            float *m = &multipliers[pixel*N_bins];
+            m[0] = m[1];
+            m[N_bins-1] = m[N_bins-2];
+        }
+    }
+
+    // Undistort a (row major) range image in place
+    void apply( CMatrix &rangeImage ) const
+    {
+        float *depth = rangeImage.data();
+        const float *table = &multipliers[0];
+        const int   N_pixels = N_rows*N_cols;
+        const int   bins = N_bins;
+        const float invResolution = 1/resolution;
+        const float maxPos = N_bins-2;
+
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for ( int i = 0; i < N_pixels; i++ )
+        {
+            float pos = std::min(depth[i]*invResolution,maxPos);
+            int   bin = (int)pos;
+            float w   = pos - bin;
+            const float *m = table + i*bins + bin;
+
+            // Null measurements stay null, no need to branch on them
+            depth[i] *= m[0] + w*(m[1]-m[0]);
+        }
+    }
+};
+
+#endif
+
 struct TRGBD_Sensor{
-    CPose3D pose;
     string  sensorLabel;
-    bool    loadIntrinsicParameters;
     int     N_obsProcessed;
 #ifdef USING_CLAMS_INTRINSIC_CALIBRATION
     // Intrinsic model to undistort the depth image of an RGBD sensor
     clams::DiscreteDepthDistortionModel depth_intrinsic_model;
+    TDepthUndistortionTable undistortionTable;
 #endif
     TRGBD_Sensor() : N_obsProcessed(0)
     {}
 };
 
-vector<TRGBD_Sensor> v_RGBD_sensors;  // Poses and labels of the RGBD devices in the robot
+vector<TRGBD_Sensor> v_RGBD_sensors;  // Processing info of the RGBD devices in the robot
+OLT::CSensorRegistry sensorRegistry;  // Their camera models, with the same ordering
 
 vector<CPose3D> v_laser_sensorPoses; // Poses of the 2D laser scaners in the robot
 
@@ -153,7 +241,8 @@ void showUsageInformation()
             "    -remove3DPointClouds: Remove all the point clouds within RGBD observations."
             "    -keepOnlyProcessed: Keep only the observations that have been processed." << endl <<
             "    -decimate <num>: Decimate rawlog keeping only one of each <num> observations." << endl <<
-            "    -saveAsPlainText: Save the rawlog as different plain text files. " << endl << endl;
+            "    -saveAsPlainText: Save the rawlog as different plain text files. " << endl <<
+            "    -threads <num> : Number of threads to use (all the cores by default)." << endl << endl;
 }
 
 
@@ -214,6 +303,10 @@ void loadConfig()
     // Load execution mode
 
     setCalibrationParameters = config.read_bool("GENERAL","set_calibration_parameters",true,true);
+    obsBatchSize = config.read_int("GENERAL","obs_batch_size",obsBatchSize,false);
+
+    if ( obsBatchSize < 1 )
+        obsBatchSize = 1;
 
     //
     // Load calibration parameters
@@ -269,51 +362,40 @@ void loadConfig()
         // Load RGBD devices info
         //
 
-        sensorIndex = 1;
-        keepLoading = true;
+        sensorRegistry.loadFromConfigFile(configFileName,calibConfig.useDefaultIntrinsics);
 
-        while ( keepLoading )
+        for ( size_t i = 0; i < sensorRegistry.size(); i++ )
         {
-            sensorLabel = mrpt::format("RGBD_%i",sensorIndex);
+            sensorLabel = sensorRegistry[i].sensorLabel;
 
-            if ( config.sectionExists(sensorLabel) )
-            {
-                x       = config.read_double(sensorLabel,"x",0,true);
-                y       = config.read_double(sensorLabel,"y",0,true);
-                z       = config.read_double(sensorLabel,"z",0,true);
-                yaw     = DEG2RAD(config.read_double(sensorLabel,"yaw",0,true));
-                pitch	= DEG2RAD(config.read_double(sensorLabel,"pitch",0,true));
-                roll	= DEG2RAD(config.read_double(sensorLabel,"roll",0,true));
+            string depthScaleModelPath = config.read_string(sensorLabel,"depth_scale_model_path","",false);
 
-                string depthScaleModelPath = config.read_string(sensorLabel,"depth_scale_model_path","",false);
+            if ( !depthScaleModelPath.empty() && calibConfig.scaleDepthInfo )
+                loadScaleCalibrationFromFile(depthScaleModelPath);
 
-                if ( !depthScaleModelPath.empty() && calibConfig.scaleDepthInfo )
-                    loadScaleCalibrationFromFile(depthScaleModelPath);
+            TRGBD_Sensor RGBD_sensor;
+            RGBD_sensor.sensorLabel = sensorLabel;
 
-                bool loadIntrinsic = config.read_bool(sensorLabel,"loadIntrinsic",0,true);
+#ifdef USING_CLAMS_INTRINSIC_CALIBRATION
+            if ( calibConfig.applyCLAMS )
+            {
+                // Load CLAMS intrinsic model for depth camera
+                string DepthIntrinsicModelpath = config.read_string(sensorLabel,"DepthIntrinsicModelpath","",true);
+                RGBD_sensor.depth_intrinsic_model.load(DepthIntrinsicModelpath);
 
-                TRGBD_Sensor RGBD_sensor;
-                RGBD_sensor.pose.setFromValues(x,y,z,yaw,pitch,roll);
-                RGBD_sensor.sensorLabel = sensorLabel;
-                RGBD_sensor.loadIntrinsicParameters = loadIntrinsic;
+                // Resolution and extent of its precomputed version
+                TDepthUndistortionTable &table = RGBD_sensor.undistortionTable;
+                table.resolution = config.read_float("CALIBRATION","CLAMS_table_resolution",0.1,false);
+                table.maxDepth   = config.read_float("CALIBRATION","CLAMS_table_max_depth",10,false);
 
-#ifdef USING_CLAMS_INTRINSIC_CALIBRATION
-                if ( calibConfig.applyCLAMS )
-                {
-                    // Load CLAMS intrinsic model for depth camera
-                    string DepthIntrinsicModelpath = config.read_string(sensorLabel,"DepthIntrinsicModelpath","",true);
-                    RGBD_sensor.depth_intrinsic_model.load(DepthIntrinsicModelpath);
-                }
+                if ( calibConfig.truncateDepthInfo )
+                    table.maxDepth = calibConfig.truncateDepthInfo;
+            }
 #endif
 
-                v_RGBD_sensors.push_back( RGBD_sensor );
+            v_RGBD_sensors.push_back( RGBD_sensor );
 
-                cout << sensorLabel << " ";
-
-                sensorIndex++;
-            }
-            else
-                keepLoading = false;
+            cout << sensorLabel << " ";
         }
 
         cout << endl;
@@ -491,6 +573,148 @@ void decimateRawlog()
     cout << "  [INFO] Rawlog saved as " << o_rawlogFileName << endl << endl;
 }
 
+//-----------------------------------------------------------
+//
+//                    processRGBDObs
+//
+//-----------------------------------------------------------
+
+void processRGBDObs( CObservation3DRangeScanPtr &obs3D, const TRGBD_Sensor &sensor )
+{
+    // Apply depth intrinsic calibration?
+#ifdef USING_CLAMS_INTRINSIC_CALIBRATION
+    if ( calibConfig.applyCLAMS )
+    {
+        // Undistort Depth image in place
+        sensor.undistortionTable.apply(obs3D->rangeImage);
+    }
+#endif
+
+    // Scale depth info?
+    if ( calibConfig.scaleDepthInfo )
+    {
+        int pos = getSensorPosInScalecalib(obs3D->sensorLabel);
+
+        if ( pos >= 0 )
+        {
+            TScaleCalibration &sc = v_scaleCalibrations[pos];
+            int offset = std::floor(sc.lowerRange*(1/sc.resolution));
+
+            size_t N_cols = obs3D->rangeImage.cols();
+            size_t N_rows = obs3D->rangeImage.rows();
+            for ( size_t row = 0; row < N_rows; row++ )
+                for ( size_t col = 0; col < N_cols; col++ )
+                {
+                    float value = obs3D->rangeImage(row,col);
+
+                    if ( value < sc.lowerRange )
+                        obs3D->rangeImage(row,col) *= sc.scaleMultipliers(0);
+                    else if ( value > sc.higerRange )
+                        obs3D->rangeImage(row,col) *= sc.scaleMultipliers(sc.scaleMultipliers.rows()-1);
+                    else
+                    {
+                        int pos = std::floor(value*(1/sc.resolution));
+                        pos -= offset;
+
+                        obs3D->rangeImage(row,col) *= sc.scaleMultipliers(pos);
+                    }
+                }
+        }
+    }
+
+    // Truncate Range image and 3D points?
+    if ( calibConfig.truncateDepthInfo )
+    {
+        size_t N_cols = obs3D->rangeImage.cols();
+        size_t N_rows = obs3D->rangeImage.rows();
+        for ( size_t row = 0; row < N_rows; row++ )
+            for ( size_t col = 0; col < N_cols; col++ )
+                if( obs3D->rangeImage(row,col) > calibConfig.truncateDepthInfo )
+                    obs3D->rangeImage(row,col) = 0;
+    }
+
+    // Remove 3D points if present
+    if ( calibConfig.remove3DPointClouds )
+    {
+        obs3D->points3D_x.clear();
+        obs3D->points3D_y.clear();
+        obs3D->points3D_z.clear();
+
+        obs3D->hasPoints3D = false;
+    }
+
+    // Equalize histogram of RGB images?
+    if ( calibConfig.equalizeRGBHistograms )
+        obs3D->intensityImage.equalizeHistInPlace();
+}
+
+
+//-----------------------------------------------------------
+//
+//                    projectRGBDObs
+//
+//-----------------------------------------------------------
+
+// Project 3D points from the depth image. Not thread safe: MRPT keeps the
+// projection lookup table of the last camera intrinsics in a static
+// variable, so it's called serially once the obs have been processed.
+
+void projectRGBDObs( CObservation3DRangeScanPtr &obs3D )
+{
+    if ( calibConfig.project3DPointClouds && !calibConfig.remove3DPointClouds )
+        obs3D->project3DPointsFromDepthImage();
+}
+
+
+//-----------------------------------------------------------
+//
+//                    flushObsBatch
+//
+//-----------------------------------------------------------
+
+struct TProcessBatchObs
+{
+    vector<CObservationPtr> &v_obsBatch;
+
+    TProcessBatchObs( vector<CObservationPtr> &v_obsBatch ) : v_obsBatch(v_obsBatch)
+    {}
+
+    void operator()( size_t i ) const
+    {
+        if ( IS_CLASS(v_obsBatch[i], CObservation3DRangeScan) )
+        {
+            CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(v_obsBatch[i]);
+            processRGBDObs(obs3D,v_RGBD_sensors[getSensorPos(obs3D->sensorLabel)]);
+        }
+    }
+};
+
+void flushObsBatch( vector<CObservationPtr> &v_obsBatch, CFileGZOutputStream &o_rawlog )
+{
+    // The RGBD obs within the batch are independent, so process them in
+    // parallel, and then project and save the whole batch keeping the
+    // original order.
+
+    const size_t N_obs = v_obsBatch.size();
+
+    TProcessBatchObs processBatchObs(v_obsBatch);
+    OLT::parallelFor( 0, N_obs, processBatchObs );
+
+    for ( size_t i = 0; i < N_obs; i++ )
+    {
+        if ( IS_CLASS(v_obsBatch[i], CObservation3DRangeScan) )
+        {
+            CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(v_obsBatch[i]);
+            projectRGBDObs(obs3D);
+        }
+
+        o_rawlog << v_obsBatch[i];
+    }
+
+    v_obsBatch.clear();
+}
+
+
 //-----------------------------------------------------------
 //
 //                      processRawlog
@@ -574,14 +798,6 @@ void processRawlog()
 
     CFileGZOutputStream o_rawlog(o_rawlogFileName);
 
-    // Default params
-    TCamera defaultCameraParamsDepth;
-    defaultCameraParamsDepth.nrows = 488;
-    defaultCameraParamsDepth.scaleToResolution(320,244);
-
-    TCamera defaultCameraParamsInt;
-    defaultCameraParamsInt.scaleToResolution(320,240);
-
     //
     // Process rawlog
     //
@@ -591,6 +807,8 @@ void processRawlog()
     CObservationPtr obs;
     size_t obsIndex = 0;
 
+    vector<CObservationPtr> v_obsBatch; // Obs waiting to be processed and saved
+
     cout << "    Process: ";
     cout.flush();
 
@@ -600,6 +818,9 @@ void processRawlog()
         if ( !obs )
             continue;
 
+        if ( (int)v_obsBatch.size() >= obsBatchSize )
+            flushObsBatch(v_obsBatch,o_rawlog);
+
         // Show progress as dots
 
         if ( !(obsIndex % 200) )
@@ -620,13 +841,13 @@ void processRawlog()
 
             obs2D->setSensorPose(v_laser_sensorPoses[0]);
 
-            o_rawlog << obs2D;
+            v_obsBatch.push_back(obs);
         }
         else if ( !calibConfig.only2DLaser )
         {
             // RGBD observation?
 
-            size_t RGBD_sensorIndex = getSensorPos(obs->sensorLabel);
+            int RGBD_sensorIndex = getSensorPos(obs->sensorLabel);
 
             if ( RGBD_sensorIndex >= 0 )
             {
@@ -636,105 +857,21 @@ void processRawlog()
 
                 sensor.N_obsProcessed++;
 
-                obs3D->setSensorPose( sensor.pose );
+                // Set its pose, intrinsics and depth to RGB transformation
+                sensorRegistry[RGBD_sensorIndex].applyTo(*obs3D);
 
-                if ( calibConfig.useDefaultIntrinsics )
-                {
-                    obs3D->cameraParams = defaultCameraParamsDepth;
-                    obs3D->cameraParamsIntensity = defaultCameraParamsInt;
-                }
-                else
-                {
-                    if ( sensor.loadIntrinsicParameters )
-                    {
-                        CConfigFile config( configFileName );
-                        obs3D->cameraParams.loadFromConfigFile(sensor.sensorLabel + "_depth",config);
-                        obs3D->cameraParams.loadFromConfigFile(sensor.sensorLabel + "_intensity",config);
-                    }
-                    else
-                    {
-                        obs3D->cameraParams.scaleToResolution(320,244);
-                        obs3D->cameraParamsIntensity.scaleToResolution(320,240);
-                    }
-
-                }
-
-                // Set the relative pose as pure rotation. For more info. see:
-                // http://reference.mrpt.org/stable/classmrpt_1_1obs_1_1_c_observation3_d_range_scan.html
-                obs3D->relativePoseIntensityWRTDepth = CPose3D(0,0,0,DEG2RAD(-90),0,DEG2RAD(-90));
-
-                // Apply depth intrinsic calibration?
 #ifdef USING_CLAMS_INTRINSIC_CALIBRATION
-                if ( calibConfig.applyCLAMS )
-                {
-                    // Undistort Depth image
-                    Eigen::MatrixXf depthMatrix = obs3D->rangeImage;
-                    v_RGBD_sensors[RGBD_sensorIndex].depth_intrinsic_model.undistort(&depthMatrix);
-
-                    obs3D->rangeImage = depthMatrix;
-                }
+                // Precompute the undistortion table of this sensor, if needed.
+                // This is done here to keep the batch processing read-only.
+                if ( calibConfig.applyCLAMS &&
+                     !sensor.undistortionTable.isBuilt(obs3D->rangeImage.rows(),
+                                                      obs3D->rangeImage.cols()) )
+                    sensor.undistortionTable.build(sensor.depth_intrinsic_model,
+                                                   obs3D->rangeImage.rows(),
+                                                   obs3D->rangeImage.cols());
 #endif
 
-                // Scale depth info?
-                if ( calibConfig.scaleDepthInfo )
-                {
-                    int pos = getSensorPosInScalecalib(obs3D->sensorLabel);
-
-                    if ( pos >= 0 )
-                    {
-                        TScaleCalibration &sc = v_scaleCalibrations[pos];
-                        int offset = std::floor(sc.lowerRange*(1/sc.resolution));
-
-                        size_t N_cols = obs3D->rangeImage.cols();
-                        size_t N_rows = obs3D->rangeImage.rows();
-                        for ( size_t row = 0; row < N_rows; row++ )
-                            for ( size_t col = 0; col < N_cols; col++ )
-                            {
-                                float value = obs3D->rangeImage(row,col);
-
-                                if ( value < sc.lowerRange )
-                                    obs3D->rangeImage(row,col) *= sc.scaleMultipliers(0);
-                                else if ( value > sc.higerRange )
-                                    obs3D->rangeImage(row,col) *= sc.scaleMultipliers(sc.scaleMultipliers.rows()-1);
-                                else
-                                {
-                                    int pos = std::floor(value*(1/sc.resolution));
-                                    pos -= offset;
-
-                                    obs3D->rangeImage(row,col) *= sc.scaleMultipliers(pos);
-                                }
-                            }
-                    }
-                }
-
-                // Truncate Range image and 3D points?
-                if ( calibConfig.truncateDepthInfo )
-                {
-                    size_t N_cols = obs3D->rangeImage.cols();
-                    size_t N_rows = obs3D->rangeImage.rows();
-                    for ( size_t row = 0; row < N_rows; row++ )
-                        for ( size_t col = 0; col < N_cols; col++ )
-                            if( obs3D->rangeImage(row,col) > calibConfig.truncateDepthInfo )
-                                obs3D->rangeImage(row,col) = 0;
-                }
-
-                // Project 3D points from the depth image or remove them if present
-                if ( calibConfig.project3DPointClouds && !calibConfig.remove3DPointClouds )
-                    obs3D->project3DPointsFromDepthImage();
-                else if ( calibConfig.remove3DPointClouds )
-                {
-                    obs3D->points3D_x.clear();
-                    obs3D->points3D_y.clear();
-                    obs3D->points3D_z.clear();
-
-                    obs3D->hasPoints3D = false;
-                }
-
-                // Equalize histogram of RGB images?
-                if ( calibConfig.equalizeRGBHistograms )
-                    obs3D->intensityImage.equalizeHistInPlace();
-
-                o_rawlog << obs3D;
+                v_obsBatch.push_back(obs);
 
                 /*if ( onlyRGBD )
                     o_rawlogRGBD.addObservationMemoryReference(obs3D);
@@ -762,6 +899,8 @@ void processRawlog()
 
     }
 
+    flushObsBatch(v_obsBatch,o_rawlog);
+
     cout << endl << "    Number of RGBD observations processed: " << endl;
 
     for ( size_t i = 0; i < v_RGBD_sensors.size(); i++ )
@@ -917,6 +1056,12 @@ int loadParameters(int argc, char* argv[])
                 calibConfig.onlyRGBD = true;
                 cout << "  [INFO] Processing only rgbd observations."  << endl;
             }
+            else if ( !strcmp(argv[arg],"-threads") )
+            {
+                OLT::CTaskScheduler::setNumThreads( atoi(argv[arg+1]) );
+                cout << "  [INFO] Using " << OLT::CTaskScheduler::getNumThreads() << " threads."  << endl;
+                arg++;
+            }
             else if ( !strcmp(argv[arg],"-h") )
             {
                 showUsageInformation();
@@ -33,9 +33,12 @@
 #include <mrpt/opengl/CAxis.h>
 #include <mrpt/obs/CRawlog.h>
 #include <mrpt/system/threads.h>
+#include <mrpt/system/filesystem.h>
+#include <mrpt/system/string_utils.h>
 #include <mrpt/opengl.h>
 //#include <mrpt/maps.h>
 #include <mrpt/utils/CConfigFile.h>
+#include <mrpt/utils/CFileGZOutputStream.h>
 
 #include <pcl/point_types.h>
 #include <pcl/point_cloud.h>
@@ -53,12 +56,23 @@
 
 #include <pcl/visualization/cloud_viewer.h>
 
-#include <pcl/segmentation/extract_clusters.h>
+#include <boost/unordered_map.hpp>
 
-#include <pcl/surface/convex_hull.h>
-#include <pcl/filters/crop_hull.h>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <map>
+#include <set>
 
-#include <pcl/filters/voxel_grid.h>
+#include "CSensorRegistry.hpp"
+#include "CDepthProjector.hpp"
+#include "CTaskScheduler.hpp"
+#include "CVoxelSet.hpp"
+#include "COrganizedClustering.hpp"
+#include "CPreprocessingCache.hpp"
+#include "CBoxAnnotations.hpp"
+#include "CRegionsFile.hpp"
 
 using namespace mrpt::utils;
 using namespace mrpt::math;
@@ -77,27 +91,59 @@ struct TSegmentedRegion
 {
     pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
     pcl::PointIndices       indices;
-    pcl::PointCloud<pcl::PointXYZ>::Ptr convexHullCloud;
-    vector<pcl::Vertices>   polygons;
+    OLT::CVoxelSet          voxels;     // Occupancy of its points, for tracking
     string                  label;
     size_t                  track_id;
     TPoint3D                color;
     mrpt::opengl::CBoxPtr   box;
+    float                   aabbMin[3]; // Axis aligned bounding box of its points,
+                                        // or of its dilated voxels once tracked
+    float                   aabbMax[3];
 
-    TSegmentedRegion() : convexHullCloud(new pcl::PointCloud<pcl::PointXYZ>()),
-        box( CBox::Create() )
+    TSegmentedRegion() : box( CBox::Create() )
     {}
 };
 
-struct TLabelledBox
+// Region within the tracking window of a sensor: frame and region indices
+struct TRegionRef
 {
-    CBoxPtr                 box;
-    string                  label;
-    pcl::PointCloud<pcl::PointXYZ>::Ptr convexHullCloud;
-    vector<pcl::Vertices>   polygons;
+    size_t  obs_index;
+    size_t  region_index;
 
-    TLabelledBox() : convexHullCloud(new pcl::PointCloud<pcl::PointXYZ>())
+    TRegionRef( size_t obs_index, size_t region_index ) :
+        obs_index(obs_index), region_index(region_index)
     {}
+
+    bool operator<( const TRegionRef &ref ) const
+    {
+        return ( obs_index < ref.obs_index ) ||
+                ( ( obs_index == ref.obs_index ) && ( region_index < ref.region_index ) );
+    }
+};
+
+// Spatial hash of the regions within the tracking window, mapping each cell
+// of a coarse grid to the regions whose AABBs intersect it. Boost's hash
+// table comes with PCL, so lookups are constant time without C++11.
+typedef boost::unordered_map< uint64_t, vector<TRegionRef> > TRegionsHash;
+
+// Geometric segmentation of a frame. It doesn't depend on other frames,
+// so frames can be segmented in parallel.
+struct TSegmentedFrame
+{
+    size_t                              obs_index;
+    size_t                              sensor_index;
+    CObservation3DRangeScanPtr          obs3D;
+    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;      // Filtered organized cloud
+    pcl::PointCloud<pcl::Normal>::Ptr   normals;
+    vector<TSegmentedRegion>            planes;
+    vector<pcl::PointIndices>           clusters;
+    vector<string>                      clusterLabels;
+};
+
+struct TLabelledBox
+{
+    string                  label;
+    OLT::CVoxelSet          voxels;     // Voxels within the box
 };
 
 struct TConfiguration
@@ -109,8 +155,10 @@ struct TConfiguration
     bool showColouredRegions;
     bool labelClusters;
     bool trackClusters;
+    bool headless;          // No visualization, results saved to files
     string rawlogFile;
     string labelledScene;
+    string outputFile;      // Output rawlog in headless mode
 };
 
 struct TPlanarSegmentationConfig
@@ -139,13 +187,15 @@ struct TbilateralFilterConfig
 struct TLabellingConfig
 {
     float minPercentageToLabel;
+    float voxelSize;    // Size of the voxels to compute overlaps with boxes
 };
 
 struct TTrackingConfig
 {
     float   minPercentageToAssingTrack;
-    bool    decimatePointCloud;
-    float   decimationLeafSize;
+    float   voxelSize;      // Size of the voxels to compute overlaps between regions
+    size_t  windowSize;     // Number of previous frames to track against (0 means all)
+    float   hashCellSize;   // Cell size of the spatial hash of regions
 };
 
 struct TFusionConfig
@@ -154,14 +204,26 @@ struct TFusionConfig
     float   maxAngleDiff;
 };
 
+// Parameters of the geometric segmentation, which can be swept
+struct TSegmentationParams
+{
+    bool                            doPlanarSegmentation;
+    bool                            fusePlanes;
+    bool                            doEuclideanSegmentation;
+    TPlanarSegmentationConfig       planar;
+    TEuclideanSegmentationConfig    euclidean;
+    TFusionConfig                   fusion;
+};
+
 typedef Eigen::aligned_allocator< pcl::PlanarRegion<pcl::PointXYZ> > PlanarRegionAllocator;	//!< Typedef for a more readable code.
 
 //
 //  Global variables
 //
 
-mrpt::gui::CDisplayWindow3D     win3D;
-mrpt::opengl::COpenGLScenePtr   labelledScene;
+mrpt::gui::CDisplayWindow3DPtr  win3D;         // Not created in headless mode
+CFileGZOutputStream             o_rawlog;       // Headless outputs
+CFileGZOutputStream             o_regions;
 
 TbilateralFilterConfig          bilateralFilterConfig;
 TEuclideanSegmentationConfig    euclideanSegmentationConfig;
@@ -171,10 +233,12 @@ TTrackingConfig                 trackingConfig;
 TFusionConfig                   fusionConfig;
 TConfiguration                  configuration;
 
+OLT::CSensorRegistry            sensorRegistry;
+OLT::CPreprocessingCache        preprocessingCache;
 vector<vector<CPose3D> >        v_posesPerSensor;
 vector<TLabelledBox>            v_labelled_boxes;
 size_t                          trackID = 0;
-vector<vector<vector<TSegmentedRegion> > >v_regionsPerSensorAndObs;
+vector<deque<vector<TSegmentedRegion> > >v_regionsPerSensorAndObs; // Tracking window per sensor
 
 void  loadLabelledScene();
 
@@ -193,16 +257,13 @@ void loadConfig( string const configFile )
     configuration.showColouredRegions       = config.read_bool("GENERAL","showColouredRegions",0,true);
     configuration.labelClusters             = config.read_bool("GENERAL","labelClusters",0,true);
     configuration.trackClusters             = config.read_bool("GENERAL","trackClusters",0,true);
+    configuration.headless                  = false;
 
     configuration.rawlogFile                = config.read_string("GENERAL","rawlogFile","",true);
     configuration.labelledScene             = config.read_string("GENERAL","labelledScene","",true);
 
     cout << "Rawlog file: " << configuration.rawlogFile << endl;
 
-    // Load labelled boxes?
-    if ( configuration.labelClusters )
-        loadLabelledScene();
-
     TPlanarSegmentationConfig &p = planarSegmentationConfig;
 
     p.minPlaneInliers   = config.read_int("PLANAR_SEGMENTATION","minPlaneInliers",0,true);
@@ -225,22 +286,82 @@ void loadConfig( string const configFile )
     TLabellingConfig &l = labellingConfig;
 
     l.minPercentageToLabel = config.read_double("LABELLING","minPercentageToLabel",0,true);
+    l.voxelSize            = config.read_double("LABELLING","voxelSize",0.05,false);
 
     TTrackingConfig &t = trackingConfig;
 
     t.minPercentageToAssingTrack = config.read_double("TRACKING","minPercentageToAssingTrack",0,true);
-    t.decimatePointCloud         = config.read_bool("TRACKING","decimatePointCloud",0,true);
-    t.decimationLeafSize         = config.read_double("TRACKING","decimationLeafSize",0,true);
+    t.voxelSize                  = config.read_double("TRACKING","voxelSize",0.05,false);
+    t.windowSize                 = config.read_int("TRACKING","windowSize",10,false);
+    t.hashCellSize               = config.read_double("TRACKING","hashCellSize",1.0,false);
 
     TFusionConfig &f = fusionConfig;
 
     f.minDistance   = config.read_double("FUSION","minDistance",0,true);
     f.maxAngleDiff  = config.read_double("FUSION","maxAngleDiff",0,true);
 
+    // Load labelled boxes?
+    if ( configuration.labelClusters )
+        loadLabelledScene();
+
     cout << "[INFO] Configuration successfully loaded." << endl;
 
 }
 
+TSegmentationParams getConfiguredParams()
+{
+    TSegmentationParams params;
+
+    params.doPlanarSegmentation     = configuration.doPlanarSegmentation;
+    params.fusePlanes               = configuration.fusePlanes;
+    params.doEuclideanSegmentation  = configuration.doEuclideanSegmentation;
+    params.planar                   = planarSegmentationConfig;
+    params.euclidean                = euclideanSegmentationConfig;
+    params.fusion                   = fusionConfig;
+
+    return params;
+}
+
+
+//-----------------------------------------------------------
+//                       voxelizeBox
+//-----------------------------------------------------------
+
+// Mark as occupied the voxels with their centers within a box, given its
+// pose and corners and its bounding box with PCL axes.
+void voxelizeBox( const CPose3D &pose, const TPoint3D &c1, const TPoint3D &c2,
+                  const pcl::PointXYZ &boxMin, const pcl::PointXYZ &boxMax,
+                  OLT::CVoxelSet &voxels )
+{
+    voxels.reset( labellingConfig.voxelSize );
+
+    const TPoint3D localMin( std::min(c1.x,c2.x), std::min(c1.y,c2.y), std::min(c1.z,c2.z) );
+    const TPoint3D localMax( std::max(c1.x,c2.x), std::max(c1.y,c2.y), std::max(c1.z,c2.z) );
+
+    const int minX = voxels.getVoxelCoord(boxMin.x), maxX = voxels.getVoxelCoord(boxMax.x);
+    const int minY = voxels.getVoxelCoord(boxMin.y), maxY = voxels.getVoxelCoord(boxMax.y);
+    const int minZ = voxels.getVoxelCoord(boxMin.z), maxZ = voxels.getVoxelCoord(boxMax.z);
+
+    for ( int x = minX; x <= maxX; x++ )
+        for ( int y = minY; y <= maxY; y++ )
+            for ( int z = minZ; z <= maxZ; z++ )
+            {
+                // Back from PCL axes (-y,z,x) to the MRPT ones, and to the box frame
+                double lx, ly, lz;
+                pose.inverseComposePoint( voxels.getVoxelCenter(z),
+                                          -voxels.getVoxelCenter(x),
+                                          voxels.getVoxelCenter(y),
+                                          lx, ly, lz );
+
+                if ( ( lx >= localMin.x ) && ( lx <= localMax.x ) &&
+                     ( ly >= localMin.y ) && ( ly <= localMax.y ) &&
+                     ( lz >= localMin.z ) && ( lz <= localMax.z ) )
+                    voxels.addVoxel(x,y,z);
+            }
+
+    voxels.finalize();
+}
+
 
 //-----------------------------------------------------------
 //                    loadLabelledScene
@@ -248,71 +369,53 @@ void loadConfig( string const configFile )
 
 void  loadLabelledScene()
 {
-    labelledScene = mrpt::opengl::COpenGLScene::Create();
-    if ( labelledScene->loadFromFile( configuration.labelledScene ) )
-    {
-        // Load previously inserted boxes
-        bool keepLoading = true;
-        size_t boxes_inserted = 0;
+    vector<OLT::TBoxAnnotation> v_boxes;
 
-        while ( keepLoading )
+    if ( !OLT::CBoxAnnotations::loadSceneBoxes( configuration.labelledScene, v_boxes ) )
+    {
+        for ( size_t box_index = 0; box_index < v_boxes.size(); box_index++ )
         {
-            CBoxPtr box = labelledScene->getByClass<CBox>(boxes_inserted);
+            const OLT::TBoxAnnotation &box = v_boxes[box_index];
 
-            if ( box.null() )
-                keepLoading = false;
-            else
-            {
-                TLabelledBox labelled_box;
-
-                labelled_box.box = box;
-                labelled_box.label = box->getName();
-
-                TPose3D pose = box->getPose();
-
-                TPoint3D c1,c2;
-                box->getBoxCorners(c1,c2);
-
-                TPoint3D C111 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c1.y,c1.z)) );
-                TPoint3D C112 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c1.y,c2.z)) );
-                TPoint3D C121 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c2.y,c1.z)) );
-                TPoint3D C122 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c2.y,c2.z)) );
-                TPoint3D C211 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c1.y,c1.z)) );
-                TPoint3D C212 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c1.y,c2.z)) );
-                TPoint3D C221 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c2.y,c1.z)) );
-                TPoint3D C222 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c2.y,c2.z)) );
-
-                pcl::PointCloud<pcl::PointXYZ>::Ptr pointCloud ( new pcl::PointCloud<pcl::PointXYZ>());
-                pointCloud->push_back( pcl::PointXYZ( C111.x, C111.y, C111.z ));
-                pointCloud->push_back( pcl::PointXYZ( C112.x, C112.y, C112.z ));
-                pointCloud->push_back( pcl::PointXYZ( C121.x, C121.y, C121.z ));
-                pointCloud->push_back( pcl::PointXYZ( C122.x, C122.y, C122.z ));
-                pointCloud->push_back( pcl::PointXYZ( C211.x, C211.y, C211.z ));
-                pointCloud->push_back( pcl::PointXYZ( C212.x, C212.y, C212.z ));
-                pointCloud->push_back( pcl::PointXYZ( C221.x, C221.y, C221.z ));
-                pointCloud->push_back( pcl::PointXYZ( C222.x, C222.y, C222.z ));
-
-                pcl::ConvexHull<pcl::PointXYZ> convex_hull;
-                convex_hull.setInputCloud(pointCloud);
-                convex_hull.setDimension(3);
-                convex_hull.reconstruct(*labelled_box.convexHullCloud,
-                                        labelled_box.polygons);
-
-                Eigen::Matrix4f transMat;
-
-                transMat(0,0)=0;    transMat(0,1)=-1;     transMat(0,2)=0;    transMat(0,3)=0;
-                transMat(1,0)=0;    transMat(1,1)=0;      transMat(1,2)=+1;   transMat(1,3)=0;
-                transMat(2,0)=1;    transMat(2,1)=0;      transMat(2,2)=0;    transMat(2,3)=0;
-                transMat(3,0)=0;    transMat(3,1)=0;      transMat(3,2)=0;    transMat(3,3)=1;
-
-                pcl::transformPointCloud( *labelled_box.convexHullCloud,
-                                          *labelled_box.convexHullCloud,
-                                          transMat );
-
-                v_labelled_boxes.push_back( labelled_box );
-            }
+            TLabelledBox labelled_box;
 
-            boxes_inserted++;
+            labelled_box.label = box.label;
+
+            const TPose3D &pose = box.pose;
+            const TPoint3D &c1 = box.corner1;
+            const TPoint3D &c2 = box.corner2;
+
+            TPoint3D C111 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c1.y,c1.z)) );
+            TPoint3D C112 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c1.y,c2.z)) );
+            TPoint3D C121 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c2.y,c1.z)) );
+            TPoint3D C122 ( CPose3D(pose) + TPose3D(TPoint3D(c1.x,c2.y,c2.z)) );
+            TPoint3D C211 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c1.y,c1.z)) );
+            TPoint3D C212 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c1.y,c2.z)) );
+            TPoint3D C221 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c2.y,c1.z)) );
+            TPoint3D C222 ( CPose3D(pose) + TPose3D(TPoint3D(c2.x,c2.y,c2.z)) );
+
+            pcl::PointCloud<pcl::PointXYZ>::Ptr pointCloud ( new pcl::PointCloud<pcl::PointXYZ>());
+            pointCloud->push_back( pcl::PointXYZ( C111.x, C111.y, C111.z ));
+            pointCloud->push_back( pcl::PointXYZ( C112.x, C112.y, C112.z ));
+            pointCloud->push_back( pcl::PointXYZ( C121.x, C121.y, C121.z ));
+            pointCloud->push_back( pcl::PointXYZ( C122.x, C122.y, C122.z ));
+            pointCloud->push_back( pcl::PointXYZ( C211.x, C211.y, C211.z ));
+            pointCloud->push_back( pcl::PointXYZ( C212.x, C212.y, C212.z ));
+            pointCloud->push_back( pcl::PointXYZ( C221.x, C221.y, C221.z ));
+            pointCloud->push_back( pcl::PointXYZ( C222.x, C222.y, C222.z ));
+
+            Eigen::Matrix4f transMat = OLT::CDepthProjector::getAxisPermutation();
+
+            pcl::transformPointCloud( *pointCloud, *pointCloud, transMat );
+
+            // Voxelize the box in the frame of the point clouds (PCL axes)
+
+            pcl::PointXYZ boxMin, boxMax;
+            pcl::getMinMax3D( *pointCloud, boxMin, boxMax );
+
+            voxelizeBox( CPose3D(pose), c1, c2, boxMin, boxMax, labelled_box.voxels );
+
+            v_labelled_boxes.push_back( labelled_box );
         }
 
         cout << "[INFO] Label clusters on, " << v_labelled_boxes.size() <<  " labelled boxes loaded." << endl;
@@ -362,72 +465,124 @@ bool poseDifferentEnough( CPose3D &pose, size_t sensor_index)
 
 
 //-----------------------------------------------------------
-//                       getTrack
+//                    Regions spatial hash
 //-----------------------------------------------------------
 
-//int getTrack( const TSegmentedRegion region,
-//              const vector<TSegmentedRegion> previous_regions,
-//              TPoint3D &color )
-int getTrack( const TSegmentedRegion region,
-              const vector<vector<TSegmentedRegion> > previous_regions,
-              TPoint3D &color )
+uint64_t getCellKey( int x, int y, int z )
 {
-    /*cout << "Regions from the previous obs: ";
-    for ( size_t i = 0; i < previous_regions.size(); i++ )
-        cout << "ID:" <<previous_regions[i].track_id << " color:" << previous_regions[i].color << " ";
-
-    cout << endl;*/
-
-    double bestPercentage = trackingConfig.minPercentageToAssingTrack;
-    int indexBestPercentage = -1;
-    int obsBestPercentage = -1;
-    size_t N_points = region.indices.indices.size();
+    const uint64_t mask = 0x1FFFFF; // 21 bits per coordinate
 
-    //cout << "N_points " << N_points << endl;
+    return ( ( (uint64_t)x & mask ) << 42 ) |
+            ( ( (uint64_t)y & mask ) << 21 ) |
+            ( (uint64_t)z & mask );
+}
 
-    pcl::PointCloud<pcl::PointXYZ>::Ptr downsampledCloud(new pcl::PointCloud<pcl::PointXYZ>());
+void getCellRange( const TSegmentedRegion &region, int cellMin[3], int cellMax[3] )
+{
+    const float invCellSize = 1.0 / trackingConfig.hashCellSize;
 
-    if ( trackingConfig.decimatePointCloud )
+    for ( size_t i = 0; i < 3; i++ )
     {
-        // Create the filtering object
-        pcl::VoxelGrid<pcl::PointXYZ> sor;
-        sor.setInputCloud (region.cloud);
-        sor.setIndices( boost::make_shared<const pcl::PointIndices> (region.indices) );
-        sor.setLeafSize (trackingConfig.decimationLeafSize,
-                         trackingConfig.decimationLeafSize,
-                         trackingConfig.decimationLeafSize);
-        sor.filter (*downsampledCloud);
-
-        N_points = downsampledCloud->size();
+        cellMin[i] = floor( region.aabbMin[i]*invCellSize );
+        cellMax[i] = floor( region.aabbMax[i]*invCellSize );
     }
+}
 
-    //cout << "N_points " << N_points << endl;
-
-    for ( size_t obs_index = 0; obs_index < previous_regions.size(); obs_index ++ )
-    {
-    for ( size_t region_index = 0; region_index < previous_regions[obs_index].size(); region_index ++ )
-    {
-        //cout << "Checking with previous region " << region_index;
-        pcl::PointCloud<pcl::PointXYZ>::Ptr outputCloud(new pcl::PointCloud<pcl::PointXYZ>());
-        pcl::CropHull<pcl::PointXYZ> cropHull;
+void buildRegionsHash( const deque<vector<TSegmentedRegion> > &window,
+                       TRegionsHash &regionsHash )
+{
+    regionsHash.clear();
 
-        if ( trackingConfig.decimatePointCloud )
-            cropHull.setInputCloud( downsampledCloud );
-        else
+    for ( size_t obs_index = 0; obs_index < window.size(); obs_index++ )
+        for ( size_t region_index = 0; region_index < window[obs_index].size(); region_index++ )
         {
-            cropHull.setInputCloud( region.cloud );
-            cropHull.setIndices( boost::make_shared<const pcl::PointIndices> (region.indices) );
+            int cellMin[3], cellMax[3];
+            getCellRange( window[obs_index][region_index], cellMin, cellMax );
+
+            for ( int x = cellMin[0]; x <= cellMax[0]; x++ )
+                for ( int y = cellMin[1]; y <= cellMax[1]; y++ )
+                    for ( int z = cellMin[2]; z <= cellMax[2]; z++ )
+                        regionsHash[getCellKey(x,y,z)].push_back(
+                                    TRegionRef(obs_index,region_index) );
         }
+}
+
+bool aabbsOverlap( const TSegmentedRegion &r1, const TSegmentedRegion &r2 )
+{
+    for ( size_t i = 0; i < 3; i++ )
+        if ( ( r1.aabbMax[i] < r2.aabbMin[i] ) || ( r2.aabbMax[i] < r1.aabbMin[i] ) )
+            return false;
+
+    return true;
+}
+
+// Regions of the window sharing a cell with the given one and whose AABBs
+// overlap with its AABB. The AABBs of the window regions bound their dilated
+// voxels, so the others can't share any voxel with it.
+void getCandidateRegions( const TSegmentedRegion &region,
+                          const deque<vector<TSegmentedRegion> > &window,
+                          const TRegionsHash &regionsHash,
+                          vector<TRegionRef> &candidates )
+{
+    set<TRegionRef> s_candidates;
+
+    int cellMin[3], cellMax[3];
+    getCellRange( region, cellMin, cellMax );
+
+    for ( int x = cellMin[0]; x <= cellMax[0]; x++ )
+        for ( int y = cellMin[1]; y <= cellMax[1]; y++ )
+            for ( int z = cellMin[2]; z <= cellMax[2]; z++ )
+            {
+                TRegionsHash::const_iterator it = regionsHash.find(getCellKey(x,y,z));
+
+                if ( it == regionsHash.end() )
+                    continue;
+
+                for ( size_t i = 0; i < it->second.size(); i++ )
+                {
+                    const TRegionRef &ref = it->second[i];
+
+                    if ( aabbsOverlap(region,window[ref.obs_index][ref.region_index]) )
+                        s_candidates.insert(ref);
+                }
+            }
+
+    candidates.assign( s_candidates.begin(), s_candidates.end() );
+}
+
+
+//-----------------------------------------------------------
+//                       getTrack
+//-----------------------------------------------------------
+
+int getTrack( const TSegmentedRegion &region,
+              const deque<vector<TSegmentedRegion> > &previous_regions,
+              const TRegionsHash &regionsHash,
+              TPoint3D &color )
+{
+    double bestPercentage = trackingConfig.minPercentageToAssingTrack;
+    int indexBestPercentage = -1;
+    int obsBestPercentage = -1;
+    size_t N_voxels = region.voxels.size();
+
+    if ( !N_voxels )
+        return -1;
+
+    // Only nearby regions are checked
+
+    vector<TRegionRef> candidates;
+    getCandidateRegions( region, previous_regions, regionsHash, candidates );
 
-        cropHull.setHullIndices(previous_regions[obs_index][region_index].polygons);
-        cropHull.setHullCloud(previous_regions[obs_index][region_index].convexHullCloud);
-        cropHull.setDim(3);
+    for ( size_t candidate = 0; candidate < candidates.size(); candidate++ )
+    {
+        const size_t obs_index    = candidates[candidate].obs_index;
+        const size_t region_index = candidates[candidate].region_index;
 
-        std::vector<int> indices;
-        cropHull.filter(indices);
-        cropHull.filter(*outputCloud);
+        // Percentage of the region within the (dilated) previous one
+        size_t N_common = region.voxels.intersectionSize(
+                            previous_regions[obs_index][region_index].voxels );
 
-        double percentage = (float)outputCloud->size() / (float)N_points;
+        double percentage = (float)N_common / (float)N_voxels;
         //cout << " percentage: " << percentage << endl;
 
         if ( percentage > bestPercentage )
@@ -437,7 +592,6 @@ int getTrack( const TSegmentedRegion region,
             bestPercentage = percentage;
         }
     }
-    }
 
     if ( indexBestPercentage != -1 )
     {
@@ -453,7 +607,7 @@ int getTrack( const TSegmentedRegion region,
 //-----------------------------------------------------------
 
 void getLabel( pcl::PointCloud<pcl::PointXYZ>::Ptr cloud,
-               pcl::PointIndices indices,
+               const pcl::PointIndices &indices,
                string &label )
 {
     double bestPercentage = labellingConfig.minPercentageToLabel;
@@ -462,61 +616,28 @@ void getLabel( pcl::PointCloud<pcl::PointXYZ>::Ptr cloud,
 
     cout << "[INFO] Number of points in the cluster: " << N_points << endl;
 
-    //    boost::shared_ptr<pcl::visualization::PCLVisualizer>	viewer(new pcl::visualization::PCLVisualizer ("3D Viewer"));
-    //    viewer->initCameraParameters ();
+    // Occupancy of the cluster, to intersect it with the one of the boxes
+
+    OLT::CVoxelSet voxels( labellingConfig.voxelSize );
+    voxels.addPoints( *cloud, indices.indices );
+    voxels.finalize();
+
+    size_t N_voxels = voxels.size();
 
-    //    viewer->addPointCloud( cloud );
-    //    while (!viewer->wasStopped())
-    //        viewer->spinOnce(100);
+    if ( !N_voxels )
+        return;
 
     for ( size_t box_index = 0; box_index < v_labelled_boxes.size(); box_index++ )
     {
+        size_t N_common = voxels.intersectionSize( v_labelled_boxes[box_index].voxels );
 
-        TLabelledBox &box = v_labelled_boxes[box_index];
-
-        //cout << "Evaluating " << box.label;
-
-        pcl::PointCloud<pcl::PointXYZ>::Ptr outputCloud(new pcl::PointCloud<pcl::PointXYZ>());
-        pcl::CropHull<pcl::PointXYZ> cropHull;
-        cropHull.setInputCloud( cloud );
-        cropHull.setIndices( boost::make_shared<const pcl::PointIndices> (indices) );
-        cropHull.setHullIndices(box.polygons);
-        cropHull.setHullCloud(box.convexHullCloud);
-        cropHull.setDim(3);
-
-        //        // Extract the planar inliers from the input cloud
-        //        pcl::ExtractIndices<pcl::PointXYZ> extract;
-        //        extract.setInputCloud (cloud);
-        //        extract.setIndices (boost::make_shared<const pcl::PointIndices> (indices) );
-        //        extract.setNegative (false);
-
-        //        pcl::PointCloud<pcl::PointXYZ>::Ptr cluster_cloud ( new pcl::PointCloud<pcl::PointXYZ>() );
-        //        extract.filter (*cluster_cloud);
-
-        //        viewer->removeAllPointClouds();
-        //        viewer->addPointCloud( cluster_cloud,  mrpt::utils::format( "cloud_%i",box_index) );
-        //        viewer->resetStoppedFlag();
-        //        while (!viewer->wasStopped())
-        //            viewer->spinOnce(100);
-
-        std::vector<int> indices;
-        cropHull.filter(indices);
-        cropHull.filter(*outputCloud);
-
-        //        viewer->removeAllPointClouds();
-        //        viewer->addPointCloud( box.convexHullCloud );
-        //        viewer->addPointCloud( outputCloud,  mrpt::utils::format( "cloud_%i",box_index) );
-        //        viewer->resetStoppedFlag();
-        //        while (!viewer->wasStopped())
-        //            viewer->spinOnce(100);
-
-        double percentage = (float)outputCloud->size() / (float)N_points;
+        double percentage = (float)N_common / (float)N_voxels;
         //cout << " percentage: " << percentage << endl;
 
         if ( percentage > bestPercentage )
         {
             bestBoxIndex = box_index;
-            label = box.label;
+            label = v_labelled_boxes[box_index].label;
             bestPercentage = percentage;
         }
 
@@ -577,7 +698,34 @@ void applyBilateralFilter( pcl::PointCloud<pcl::PointXYZ>::Ptr cloud )
 //                      segmentPlanes
 //-----------------------------------------------------------
 
+// Parameters of the normal estimation, also part of the key of the
+// preprocessing cache
+const float NORMALS_MAX_DEPTH_CHANGE_FACTOR = 0.02f;
+const float NORMALS_SMOOTHING_SIZE          = 10.0f;
+
+void computeNormals( pcl::PointCloud<pcl::PointXYZ>::Ptr cloud,
+                     pcl::PointCloud<pcl::Normal>::Ptr normalCloud )
+{
+    cout << "[SEGMENT_PLANES] Computing normals." << endl;
+
+    pcl::IntegralImageNormalEstimation<pcl::PointXYZ, pcl::Normal> ne;
+    ne.setNormalEstimationMethod (ne.COVARIANCE_MATRIX);
+    ne.setMaxDepthChangeFactor (NORMALS_MAX_DEPTH_CHANGE_FACTOR);
+    ne.setNormalSmoothingSize (NORMALS_SMOOTHING_SIZE);
+
+    double normal_start = pcl::getTime ();
+
+    ne.setInputCloud (cloud);
+    ne.compute (*normalCloud);
+
+    double normal_end = pcl::getTime ();
+
+    cout << "[SEGMENT_PLANES] Normal Estimation took: " << double (normal_end - normal_start) << endl;
+}
+
 void segmentPlanes( pcl::PointCloud<pcl::PointXYZ>::Ptr cloud,
+                    pcl::PointCloud<pcl::Normal>::Ptr normalCloud,
+                    const TPlanarSegmentationConfig &planarSegmentationConfig,
                     std::vector<pcl::PointIndices> &inlierIndices,
                     vector<pcl::ModelCoefficients> &modelCoefficients,
                     vector<pcl::PointIndices>      &boundaryIndices)
@@ -598,27 +746,9 @@ void segmentPlanes( pcl::PointCloud<pcl::PointXYZ>::Ptr cloud,
     vector<pcl::PlanarRegion<pcl::PointXYZ>, PlanarRegionAllocator> regions;
     vector<pcl::PointIndices>       labelIndices;			//!< Points agrouped in each label.
 
-    pcl::PointCloud<pcl::Normal>::Ptr   normalCloud;			//!< Normals computed of the input point cloud.
     pcl::PointCloud<pcl::Label>::Ptr    labels;				//!< Labels of each plane.
 
     labels		= pcl::PointCloud<pcl::Label>::Ptr( new pcl::PointCloud<pcl::Label>);
-    normalCloud	= pcl::PointCloud<pcl::Normal>::Ptr(new pcl::PointCloud<pcl::Normal>);
-
-    cout << "[SEGMENT_PLANES] Computing normals." << endl;
-
-    pcl::IntegralImageNormalEstimation<pcl::PointXYZ, pcl::Normal> ne;
-    ne.setNormalEstimationMethod (ne.COVARIANCE_MATRIX);
-    ne.setMaxDepthChangeFactor (0.02f);
-    ne.setNormalSmoothingSize (10.0f);
-
-    double normal_start = pcl::getTime ();
-
-    ne.setInputCloud (cloud);
-    ne.compute (*normalCloud);
-
-    double normal_end = pcl::getTime ();
-
-    cout << "[SEGMENT_PLANES] Normal Estimation took: " << double (normal_end - normal_start) << endl;
 
     pcl::OrganizedMultiPlaneSegmentation<pcl::PointXYZ, pcl::Normal, pcl::Label> mps;
     mps.setMinInliers ( planarSegmentationConfig.minPlaneInliers );
@@ -648,44 +778,31 @@ void segmentPlanes( pcl::PointCloud<pcl::PointXYZ>::Ptr cloud,
 //                      segmentClusters
 //-----------------------------------------------------------
 
-void segmentClusters( pcl::PointCloud<pcl::PointXYZ>::Ptr &cloud, pcl::PointIndices &m_outlierIndices, std::vector<pcl::PointIndices> &cluster_indices )
+void segmentClusters( pcl::PointCloud<pcl::PointXYZ>::Ptr &cloud,
+                      const vector<bool> &v_indices_to_remove,
+                      const TEuclideanSegmentationConfig &euclideanSegmentationConfig,
+                      std::vector<pcl::PointIndices> &cluster_indices )
 {
     cout << "[SEGMENT_CLUSTERS] Segmenting clusters..." << endl;
 
-    // Creating the KdTree object for the search method of the extraction
-    pcl::search::KdTree<pcl::PointXYZ>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZ>);
-    tree->setInputCloud (cloud);
-
+    // The cloud is organized, so neighbours are looked for in the image
+    // instead of building a KdTree. Inliers of planes are ignored.
 
-    pcl::EuclideanClusterExtraction<pcl::PointXYZ> ec;
-    ec.setClusterTolerance (euclideanSegmentationConfig.clusterTolerance); // 2cm
-    ec.setMinClusterSize (euclideanSegmentationConfig.minClusterSize);
-    ec.setMaxClusterSize (euclideanSegmentationConfig.maxClusterSize);
-    ec.setSearchMethod (tree);
-    ec.setIndices( boost::make_shared<const pcl::PointIndices> (m_outlierIndices) );
-    ec.setInputCloud (cloud);
+    OLT::COrganizedClustering clustering;
+    clustering.setClusterTolerance (euclideanSegmentationConfig.clusterTolerance); // 2cm
+    clustering.setMinClusterSize (euclideanSegmentationConfig.minClusterSize);
+    clustering.setMaxClusterSize (euclideanSegmentationConfig.maxClusterSize);
 
     double cluster_extract_start = pcl::getTime ();
 
-    ec.extract (cluster_indices);
+    clustering.segment (*cloud, v_indices_to_remove, cluster_indices);
 
     double cluster_extract_end = pcl::getTime ();
 
     cout << "[SEGMENT_CLUSTERS] Cluster segmentation took " << double (cluster_extract_end - cluster_extract_start) << endl;
 
-    int j = 0;
-    for (std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin (); it != cluster_indices.end (); ++it)
-    {
-        pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_cluster (new pcl::PointCloud<pcl::PointXYZ>);
-        for (std::vector<int>::const_iterator pit = it->indices.begin (); pit != it->indices.end (); ++pit)
-            cloud_cluster->points.push_back (cloud->points[*pit]);
-        cloud_cluster->width = cloud_cluster->points.size ();
-        cloud_cluster->height = 1;
-        cloud_cluster->is_dense = true;
-        std::cout << "PointCloud representing the Cluster: " << cloud_cluster->points.size () << " data points." << std::endl;
-
-
-    }
+    for ( size_t i = 0; i < cluster_indices.size(); i++ )
+        std::cout << "PointCloud representing the Cluster: " << cluster_indices[i].indices.size () << " data points." << std::endl;
 
 }
 
@@ -694,238 +811,585 @@ void segmentClusters( pcl::PointCloud<pcl::PointXYZ>::Ptr &cloud, pcl::PointIndi
 //                          planesFusion
 //-----------------------------------------------------------
 
-void planesFusion( pcl::PointCloud<pcl::PointXYZ>::Ptr pcl_cloud,
-                   std::vector<pcl::PointIndices> &inliers_indices,
-                   vector<pcl::ModelCoefficients> &modelCoefficients,
-                   vector<pcl::PointIndices>      &boundaryIndices)
+// Boundary points of a plane binned in a grid with cells of the size of the
+// fusion distance, so the points closer than it to a given point are in
+// the 27 cells around it.
+struct TBoundaryGrid
 {
-    cout << "[PLANES_FUSION] Fusing planes..." << endl;
+    vector< pair<uint64_t,int> >    cells;  // (cell key, point index), sorted
+    float                           cellSize;
+    float                           aabbMin[3];
+    float                           aabbMax[3];
+};
 
-    bool fused = true;
+void getBoundaryCell( const pcl::PointXYZ &p, float cellSize, int cell[3] )
+{
+    const float invCellSize = 1.0 / cellSize;
 
-    double fusion_start = pcl::getTime ();
+    cell[0] = floor( p.x*invCellSize );
+    cell[1] = floor( p.y*invCellSize );
+    cell[2] = floor( p.z*invCellSize );
+}
 
-    while ( fused )
+void buildBoundaryGrid( const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                        const vector<int> &boundary,
+                        float cellSize,
+                        TBoundaryGrid &grid )
+{
+    grid.cellSize = cellSize;
+    grid.cells.clear();
+    grid.cells.reserve( boundary.size() );
+
+    for ( size_t i = 0; i < 3; i++ )
     {
-        size_t N_planes = inliers_indices.size();
-        fused = false;
+        grid.aabbMin[i] = std::numeric_limits<float>::max();
+        grid.aabbMax[i] = -std::numeric_limits<float>::max();
+    }
 
-        // Do we have planes to work?
-        if ( !N_planes )
-            continue;
+    for ( size_t b = 0; b < boundary.size(); b++ )
+    {
+        const pcl::PointXYZ &p = cloud.points[boundary[b]];
+
+        int cell[3];
+        getBoundaryCell( p, cellSize, cell );
 
-        size_t region_index1 = 0;
+        grid.cells.push_back( make_pair( getCellKey(cell[0],cell[1],cell[2]), boundary[b] ) );
 
+        const float coords[3] = { p.x, p.y, p.z };
 
-        while ( ( region_index1 < N_planes-1 ) && !fused )
+        for ( size_t i = 0; i < 3; i++ )
         {
-            size_t region_index2 = region_index1+1;
+            grid.aabbMin[i] = std::min( grid.aabbMin[i], coords[i] );
+            grid.aabbMax[i] = std::max( grid.aabbMax[i], coords[i] );
+        }
+    }
 
-            while ( (region_index2 < N_planes) && !fused )
-            {
-                cout << "Checking fusion between " << region_index1 << " and " << region_index2 << endl;
-                vector<int> &boundary1 = boundaryIndices[region_index1].indices;
-                vector<int> &boundary2 = boundaryIndices[region_index2].indices;
+    std::sort( grid.cells.begin(), grid.cells.end() );
+}
 
-                double minDist = std::numeric_limits<double>::max();
+// Is any boundary point of a plane closer than the fusion distance to one of
+// the other plane? It stops at the first pair found.
+bool areBoundariesClose( const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                         const TBoundaryGrid &grid1,
+                         const TBoundaryGrid &grid2 )
+{
+    const float minDistance = grid1.cellSize;
 
-                for ( size_t b1 = 0; b1 < boundary1.size(); b1++ )
-                    for ( size_t b2 = 0; b2 < boundary2.size(); b2++ )
-                    {
-                        double dist = sqrt( pow(pcl_cloud->points[boundary1[b1]].x
-                                                - pcl_cloud->points[boundary2[b2]].x,2)
-                                            + pow (pcl_cloud->points[boundary1[b1]].y
-                                                   - pcl_cloud->points[boundary2[b2]].y,2)
-                                            + pow( pcl_cloud->points[boundary1[b1]].z
-                                                   - pcl_cloud->points[boundary2[b2]].z,2) );
-
-                        minDist = ( minDist > dist ) ? dist : minDist;
-                    }
+    for ( size_t i = 0; i < 3; i++ )
+        if ( ( grid1.aabbMax[i] + minDistance < grid2.aabbMin[i] ) ||
+             ( grid2.aabbMax[i] + minDistance < grid1.aabbMin[i] ) )
+            return false;
 
-                //cout << "Min dist: " << minDist << endl;
-                if ( minDist < fusionConfig.minDistance )
-                {
-                    cout << "Model coeffs 1: " << modelCoefficients[region_index1] << endl;
-                    cout << "Model coeffs 2: " << modelCoefficients[region_index2] << endl;
+    // Query the grid of the plane with more boundary points
 
-                    vector<float> &coeff1 = modelCoefficients[region_index1].values;
-                    vector<float> &coeff2 = modelCoefficients[region_index2].values;
+    const TBoundaryGrid &queries = ( grid1.cells.size() < grid2.cells.size() ) ? grid1 : grid2;
+    const TBoundaryGrid &grid    = ( grid1.cells.size() < grid2.cells.size() ) ? grid2 : grid1;
 
-                    float scalarProduct = coeff1[0]*coeff2[0]
-                                            + coeff1[1]*coeff2[1]
-                                            + coeff1[2]*coeff2[2];
+    const float sqrMinDistance = minDistance*minDistance;
 
-                    float angleDiff = acos( scalarProduct );
+    for ( size_t q = 0; q < queries.cells.size(); q++ )
+    {
+        const pcl::PointXYZ &p = cloud.points[queries.cells[q].second];
 
-                    cout << "ANGLE DIF: " << RAD2DEG(angleDiff) << endl;
+        int cell[3];
+        getBoundaryCell( p, minDistance, cell );
 
-                    if ( ( angleDiff < DEG2RAD(fusionConfig.maxAngleDiff) ) ||
-                           ( angleDiff > 180 - DEG2RAD(fusionConfig.maxAngleDiff) ) )
-                    {
-                        cout << "FUSE!";
-                        vector<int> &indices1 = inliers_indices[region_index1].indices;
-                        vector<int> &indices2 = inliers_indices[region_index2].indices;
-                        indices1.insert( indices1.begin(), indices2.begin(), indices2.end() );
+        for ( int x = cell[0]-1; x <= cell[0]+1; x++ )
+            for ( int y = cell[1]-1; y <= cell[1]+1; y++ )
+                for ( int z = cell[2]-1; z <= cell[2]+1; z++ )
+                {
+                    const uint64_t key = getCellKey(x,y,z);
+
+                    vector< pair<uint64_t,int> >::const_iterator it =
+                            std::lower_bound( grid.cells.begin(), grid.cells.end(),
+                                              make_pair(key,-1) );
 
-                        boundary1.insert( boundary1.begin(), boundary2.begin(), boundary2.end() );
+                    for ( ; ( it != grid.cells.end() ) && ( it->first == key ); it++ )
+                    {
+                        const pcl::PointXYZ &p2 = cloud.points[it->second];
 
-                        inliers_indices.erase( inliers_indices.begin()+region_index2);
-                        modelCoefficients.erase(modelCoefficients.begin()+region_index2);
-                        boundaryIndices.erase(boundaryIndices.begin()+region_index2);
+                        const float dx = p.x - p2.x;
+                        const float dy = p.y - p2.y;
+                        const float dz = p.z - p2.z;
 
-                        fused = true;
+                        if ( dx*dx + dy*dy + dz*dz < sqrMinDistance )
+                            return true;
                     }
-
                 }
+    }
 
-                region_index2++;
-            }
-            region_index1++;
-        }
+    return false;
+}
+
+struct TBuildBoundaryGrids
+{
+    const pcl::PointCloud<pcl::PointXYZ> &cloud;
+    const vector<pcl::PointIndices>      &boundaryIndices;
+    float                                 cellSize;
+    vector<TBoundaryGrid>                &grids;
+
+    TBuildBoundaryGrids( const pcl::PointCloud<pcl::PointXYZ> &c,
+                         const vector<pcl::PointIndices> &b,
+                         float s, vector<TBoundaryGrid> &g ) :
+        cloud(c), boundaryIndices(b), cellSize(s), grids(g)
+    {}
+
+    void operator()( size_t plane_index ) const
+    {
+        buildBoundaryGrid( cloud, boundaryIndices[plane_index].indices,
+                           cellSize, grids[plane_index] );
     }
+};
 
-    double fusion_end = pcl::getTime ();
-    cout << "[PLANES_FUSION] Cluster segmentation took " << double (fusion_end - fusion_start) << endl;
+struct TCheckPlanesProximity
+{
+    const pcl::PointCloud<pcl::PointXYZ>    &cloud;
+    const vector<TBoundaryGrid>             &grids;
+    const vector< pair<size_t,size_t> >     &pairs;
+    vector<char>                            &close;
+
+    TCheckPlanesProximity( const pcl::PointCloud<pcl::PointXYZ> &c,
+                           const vector<TBoundaryGrid> &g,
+                           const vector< pair<size_t,size_t> > &p,
+                           vector<char> &cl ) :
+        cloud(c), grids(g), pairs(p), close(cl)
+    {}
+
+    void operator()( size_t pair_index ) const
+    {
+        close[pair_index] = areBoundariesClose( cloud,
+                                                grids[pairs[pair_index].first],
+                                                grids[pairs[pair_index].second] );
+    }
+};
+
+// Do two planes have a similar orientation (or opposite normals)?
+bool haveSimilarOrientation( const pcl::ModelCoefficients &model1,
+                             const pcl::ModelCoefficients &model2,
+                             float maxAngleDiff )
+{
+    const vector<float> &coeff1 = model1.values;
+    const vector<float> &coeff2 = model2.values;
+
+    float scalarProduct = coeff1[0]*coeff2[0]
+                            + coeff1[1]*coeff2[1]
+                            + coeff1[2]*coeff2[2];
 
+    scalarProduct = std::max( -1.f, std::min( 1.f, scalarProduct ) );
+
+    float angleDiff = acos( scalarProduct );
+
+    return ( angleDiff < maxAngleDiff ) || ( angleDiff > M_PI - maxAngleDiff );
 }
 
+size_t getFusedPlane( vector<size_t> &v_fusedWith, size_t plane_index )
+{
+    while ( v_fusedWith[plane_index] != plane_index )
+    {
+        v_fusedWith[plane_index] = v_fusedWith[v_fusedWith[plane_index]];
+        plane_index = v_fusedWith[plane_index];
+    }
 
-//-----------------------------------------------------------
-//                          main
-//-----------------------------------------------------------
+    return plane_index;
+}
 
-int main(int argc, char* argv[])
+void planesFusion( pcl::PointCloud<pcl::PointXYZ>::Ptr pcl_cloud,
+                   std::vector<pcl::PointIndices> &inliers_indices,
+                   vector<pcl::ModelCoefficients> &modelCoefficients,
+                   vector<pcl::PointIndices>      &boundaryIndices,
+                   const TFusionConfig            &fusionConfig )
 {
-    // Create vector of colors for visualization
-    vector<TPoint3D> v_colors;
+    cout << "[PLANES_FUSION] Fusing planes..." << endl;
 
-    for ( double mult1 = 0; mult1 <= 1; mult1+= 0.2 )
-        for ( double mult2 = 0; mult2 <= 1; mult2+= 0.2 )
-            for ( double mult3 = 0; mult3 <= 1; mult3+= 0.2 )
-                v_colors.push_back( TPoint3D(1.0*mult1, 1.0*mult2, 1.0*mult3) );
+    const size_t N_planes = inliers_indices.size();
 
-    // Set 3D window
+    // Do we have planes to work?
+    if ( ( N_planes < 2 ) || ( fusionConfig.minDistance <= 0 ) )
+        return;
 
-    vector<string> sensors_to_use;
-    sensors_to_use.push_back("RGBD_1");
-    sensors_to_use.push_back("RGBD_2");
-    sensors_to_use.push_back("RGBD_3");
-    sensors_to_use.push_back("RGBD_4");
+    double fusion_start = pcl::getTime ();
 
-    win3D.setWindowTitle("Segmentation");
+    // Pairs of planes with similar orientation (or opposite normals)
 
-    win3D.resize(400,300);
+    const float maxAngleDiff = DEG2RAD(fusionConfig.maxAngleDiff);
 
-    win3D.setCameraAzimuthDeg(140);
-    win3D.setCameraElevationDeg(20);
-    win3D.setCameraZoom(6.0);
-    win3D.setCameraPointingToPoint(2.5,0,0);
+    vector< pair<size_t,size_t> > v_candidatePairs;
 
-    mrpt::opengl::COpenGLScenePtr scene = win3D.get3DSceneAndLock();
+    for ( size_t region_index1 = 0; region_index1 < N_planes-1; region_index1++ )
+        for ( size_t region_index2 = region_index1+1; region_index2 < N_planes; region_index2++ )
+            if ( haveSimilarOrientation( modelCoefficients[region_index1],
+                                         modelCoefficients[region_index2],
+                                         maxAngleDiff ) )
+                v_candidatePairs.push_back( make_pair(region_index1,region_index2) );
 
-    opengl::CGridPlaneXYPtr obj = opengl::CGridPlaneXY::Create(-7,7,-7,7,0,1);
-    obj->setColor(0.7,0.7,0.7);
-    obj->setLocation(0,0,0);
-    scene->insert( obj );
+    // Check, in parallel, if their boundaries are close
 
-    win3D.unlockAccess3DScene();
+    vector<TBoundaryGrid> v_grids( N_planes );
 
-    bool stepByStepExecution = false;
+    TBuildBoundaryGrids buildGrids( *pcl_cloud, boundaryIndices, fusionConfig.minDistance, v_grids );
+    OLT::parallelFor( 0, N_planes, buildGrids );
 
-    CRawlog rawlog;
+    vector<char> v_close( v_candidatePairs.size(), false );
 
-    if ( argc > 2 )
+    TCheckPlanesProximity checkProximity( *pcl_cloud, v_grids, v_candidatePairs, v_close );
+    OLT::parallelFor( 0, v_candidatePairs.size(), checkProximity );
+
+    // Fuse the planes connected by close pairs into the one with the
+    // lowest index, which keeps its model coefficients. As when fusing them
+    // one at a time, a pair only joins two groups of planes if the planes
+    // they were fused into also have a similar orientation, so A-B and B-C
+    // don't fuse A with C if A and C fail that check
+
+    vector<size_t> v_fusedWith( N_planes );
+
+    for ( size_t plane_index = 0; plane_index < N_planes; plane_index++ )
+        v_fusedWith[plane_index] = plane_index;
+
+    for ( size_t pair_index = 0; pair_index < v_candidatePairs.size(); pair_index++ )
     {
-        // Get rawlog file name
+        if ( !v_close[pair_index] )
+            continue;
 
-        cout << "1:" << argv[1] << endl;
+        size_t plane1 = getFusedPlane( v_fusedWith, v_candidatePairs[pair_index].first );
+        size_t plane2 = getFusedPlane( v_fusedWith, v_candidatePairs[pair_index].second );
 
-        string configFile = argv[1];
-        loadConfig(configFile);
+        if ( ( plane1 != plane2 ) &&
+             !haveSimilarOrientation( modelCoefficients[plane1],
+                                      modelCoefficients[plane2],
+                                      maxAngleDiff ) )
+            continue;
 
-        // Get optional paramteres
-        if ( argc > 1 )
+        if ( plane1 < plane2 )
+            v_fusedWith[plane2] = plane1;
+        else if ( plane2 < plane1 )
+            v_fusedWith[plane1] = plane2;
+    }
+
+    size_t N_fused = 0;
+
+    for ( size_t plane_index = 0; plane_index < N_planes; plane_index++ )
+    {
+        size_t fusedWith = getFusedPlane( v_fusedWith, plane_index );
+
+        if ( fusedWith != plane_index )
         {
-            bool alreadyReset = false;
+            vector<int> &indices1 = inliers_indices[fusedWith].indices;
+            vector<int> &indices2 = inliers_indices[plane_index].indices;
+            indices1.insert( indices1.end(), indices2.begin(), indices2.end() );
 
-            size_t arg = 2;
+            vector<int> &boundary1 = boundaryIndices[fusedWith].indices;
+            vector<int> &boundary2 = boundaryIndices[plane_index].indices;
+            boundary1.insert( boundary1.end(), boundary2.begin(), boundary2.end() );
 
-            while ( arg < argc )
-            {
-                if ( !strcmp(argv[arg],"-i") )
-                {
-                    configuration.rawlogFile = argv[arg+1];
-                    arg += 2;
-                }
-                else if ( !strcmp(argv[arg],"-sensor") )
-                {
-                    string sensor = argv[arg+1];
-                    arg += 2;
+            N_fused++;
+        }
+    }
 
-                    if ( !alreadyReset )
-                    {
-                        sensors_to_use.clear();
-                        alreadyReset = true;
-                    }
+    // Remove the fused planes keeping the order of the others
 
-                    sensors_to_use.push_back(  sensor );
+    size_t N_remaining = 0;
 
-                }
-                else if ( !strcmp(argv[arg], "-step") )
-                {
-                    stepByStepExecution = true;
-                    arg++;
-                }
-                else
-                {
-                    cout << "[Error] " << argv[arg] << " unknown paramter" << endl;
-                    return -1;
-                }
+    for ( size_t plane_index = 0; plane_index < N_planes; plane_index++ )
+    {
+        if ( v_fusedWith[plane_index] != plane_index )
+            continue;
 
-            }
+        if ( N_remaining != plane_index )
+        {
+            inliers_indices[N_remaining].indices.swap( inliers_indices[plane_index].indices );
+            boundaryIndices[N_remaining].indices.swap( boundaryIndices[plane_index].indices );
+            modelCoefficients[N_remaining] = modelCoefficients[plane_index];
         }
+
+        N_remaining++;
+    }
+
+    inliers_indices.resize( N_remaining );
+    boundaryIndices.resize( N_remaining );
+    modelCoefficients.resize( N_remaining );
+
+    double fusion_end = pcl::getTime ();
+    cout << "[PLANES_FUSION] Fused " << N_fused << " planes, took "
+         << double (fusion_end - fusion_start) << endl;
+
+}
+
+
+//-----------------------------------------------------------
+//                      preprocessFrame
+//-----------------------------------------------------------
+
+// Parameters of the preprocessing, identifying its cached products
+string getPreprocessingParameters()
+{
+    stringstream ss;
+    ss << "sigmaS=" << bilateralFilterConfig.sigmaS
+       << ";sigmaR=" << bilateralFilterConfig.sigmaR
+       << ";maxDepthChangeFactor=" << NORMALS_MAX_DEPTH_CHANGE_FACTOR
+       << ";normalSmoothingSize=" << NORMALS_SMOOTHING_SIZE;
+
+    return ss.str();
+}
+
+// Calibration used to project a frame: depth intrinsics of the model of
+// its sensor and pose of the sensor, so cached frames aren't reused after
+// a calibration change.
+string getCalibrationParameters( const TSegmentedFrame &frame )
+{
+    const OLT::TRGBDCameraModel &model = sensorRegistry[frame.sensor_index];
+    const CPose3D &pose = frame.obs3D->sensorPose;
+
+    stringstream ss;
+    ss << setprecision(10)
+       << "size=" << model.depthCols << "x" << model.depthRows
+       << ";cx=" << model.depthParams.cx() << ";cy=" << model.depthParams.cy()
+       << ";fx=" << model.depthParams.fx() << ";fy=" << model.depthParams.fy()
+       << ";pose=" << pose.x() << "," << pose.y() << "," << pose.z() << ","
+       << pose.yaw() << "," << pose.pitch() << "," << pose.roll();
+
+    return ss.str();
+}
+
+// Filtered organized cloud of a frame and, if needed, its normals. They
+// are taken from the preprocessing cache if available, and stored there
+// otherwise. It can be called concurrently.
+void preprocessFrame( TSegmentedFrame &frame, bool computeNormalsToo )
+{
+    frame.cloud.reset( new pcl::PointCloud<pcl::PointXYZ>() );
+    frame.normals.reset( new pcl::PointCloud<pcl::Normal>() );
+
+    pcl::PointCloud<pcl::PointXYZ>::Ptr &pcl_cloud = frame.cloud;
+
+    const string calibration = ( preprocessingCache.isOpen() ) ?
+                getCalibrationParameters( frame ) : string();
+
+    if ( preprocessingCache.load( frame.obs_index, calibration, *pcl_cloud, *frame.normals ) )
+    {
+        if ( !computeNormalsToo || !frame.normals->empty() )
+            return;
+
+        computeNormals( pcl_cloud, frame.normals );
     }
     else
     {
-        cout << "Usage information. At least two expected arguments: " << endl <<
-                " \t <conf_fil>       : Configuration file." << endl <<
-                " \t -i <rawlog_file> : Rawlog file to process." << endl;
-        cout << "Then, optional parameters:" << endl <<
-                " \t -sensor <sensor_label> : Use obs. from this sensor (all used by default)." << endl <<
-                " \t -step                  : Enable step by step execution." << endl;
+        // Organized point cloud in the robot frame, with PCL axes
+        OLT::CDepthProjector projector;
+        projector.project( *frame.obs3D, sensorRegistry[frame.sensor_index], *pcl_cloud );
 
-        return -1;
+        cout << "Number of points in point cloud: " << pcl_cloud->size() << endl;
+
+        applyBilateralFilter(pcl_cloud);
+
+        if ( computeNormalsToo )
+            computeNormals( pcl_cloud, frame.normals );
     }
 
-    rawlog.loadFromRawLogFile( configuration.rawlogFile );
+    if ( preprocessingCache.isOpen() )
+        preprocessingCache.save( frame.obs_index, calibration, *pcl_cloud, *frame.normals );
+}
 
-    // Set the number of sensors used into the vector to track the segmented regions
-    v_regionsPerSensorAndObs.resize( sensors_to_use.size() );
-    v_posesPerSensor.resize(sensors_to_use.size() );
 
-    size_t N_segmented_point_clouds = 0;
+//-----------------------------------------------------------
+//                    segmentPreprocessed
+//-----------------------------------------------------------
 
-    // Iterate over the obs into the rawlog and show them in the 3D window
+// Segmentation of planes and arbitrary regions of a preprocessed frame,
+// with the given parameters. It can be called concurrently.
+void segmentPreprocessed( const TSegmentedFrame &frame,
+                          const TSegmentationParams &params,
+                          vector<pcl::PointIndices> &planes,
+                          vector<pcl::PointIndices> &clusters )
+{
+    planes.clear();
+    clusters.clear();
 
-    size_t color_index = 0;
+    pcl::PointCloud<pcl::PointXYZ>::Ptr pcl_cloud = frame.cloud;
 
-    for ( size_t obs_index = 0; obs_index < rawlog.size(); obs_index++ )
+    vector<bool> v_indices_to_remove(pcl_cloud->size(),false);
+
+    //
+    // Do segmentation of planes
+    //
+
+    if ( params.doPlanarSegmentation )
+    {
+        vector<pcl::ModelCoefficients>  modelCoefficients; // Planes Coefficients of
+        vector<pcl::PointIndices>       boundaryIndices;   // Boundary indices of each plane.
+
+        // Segment
+        segmentPlanes(pcl_cloud,
+                      frame.normals,
+                      params.planar,
+                      planes,
+                      modelCoefficients,
+                      boundaryIndices);
+
+        if ( params.fusePlanes )
+        {
+            planesFusion(pcl_cloud,
+                         planes,
+                         modelCoefficients,
+                         boundaryIndices,
+                         params.fusion);
+
+        }
+
+        cout << "[INFO] Num of segmented planes: " <<  planes.size() << endl;
+
+        // Planes are not considered by the segmentation of arbitrary regions
+        for ( size_t region_index = 0; region_index < planes.size(); region_index++ )
+        {
+            const vector<int> &v_indices = planes[region_index].indices;
+
+            for ( size_t point_index = 0; point_index < v_indices.size(); point_index++ )
+                v_indices_to_remove[v_indices[point_index]] = true;
+        }
+    }
+
+    //
+    // Do segmentation of arbitrary regions
+    //
+
+    if ( params.doEuclideanSegmentation )
+        segmentClusters( pcl_cloud, v_indices_to_remove, params.euclidean, clusters );
+}
+
+
+//-----------------------------------------------------------
+//                      segmentFrame
+//-----------------------------------------------------------
+
+// Segmentation of planes and arbitrary regions of a frame, up to what is
+// independent of the other frames. It can be called concurrently.
+void segmentFrame( TSegmentedFrame &frame )
+{
+    frame.planes.clear();
+    frame.clusters.clear();
+    frame.clusterLabels.clear();
+
+    if ( !configuration.doEuclideanSegmentation &&
+         !configuration.doPlanarSegmentation )
+        return;
+
+    preprocessFrame( frame, configuration.doPlanarSegmentation );
+
+    pcl::PointCloud<pcl::PointXYZ>::Ptr &pcl_cloud = frame.cloud;
+
+    vector<pcl::PointIndices> inliers_indices;
+
+    segmentPreprocessed( frame, getConfiguredParams(), inliers_indices, frame.clusters );
+
+    // Regions of the planes, to be tracked
+
+    size_t N_planes = inliers_indices.size();
+
+    frame.planes.resize( N_planes );
+
+    for ( size_t region_index = 0; region_index < N_planes; region_index++ )
+    {
+        TSegmentedRegion &region = frame.planes[region_index];
+
+        region.cloud = pcl_cloud;
+        region.indices.indices.swap( inliers_indices[region_index].indices );
+
+        vector<int> &v_indices = region.indices.indices;
+
+        Eigen::Vector4f v_min;
+        Eigen::Vector4f v_max;
+
+        pcl::getMinMax3D( *pcl_cloud, v_indices, v_min, v_max );
+
+        for ( size_t i = 0; i < 3; i++ )
+        {
+            region.aabbMin[i] = v_min(i);
+            region.aabbMax[i] = v_max(i);
+        }
+
+        //cout << "V_min: " << v_min.transpose() << endl;
+        //cout << "V_max: " << v_max.transpose() << endl;
+
+        region.box->setBoxCorners( TPoint3D(v_min(2),-v_min(0),v_min(1)),
+                                   TPoint3D(v_max(2),-v_max(0),v_max(1)));
+
+        region.box->setWireframe( true );
+        region.box->setColor( 1,0,0 );
+
+        if ( configuration.trackClusters )
+        {
+            region.voxels.reset( trackingConfig.voxelSize );
+            region.voxels.addPoints( *pcl_cloud, v_indices );
+            region.voxels.finalize();
+        }
+    }
+
+    // Normals are no longer needed
+    frame.normals.reset();
+}
+
+struct TSegmentFrameTask : public OLT::CTask
+{
+    TSegmentedFrame &frame;
+
+    TSegmentFrameTask( TSegmentedFrame &f ) : frame(f)
+    {}
+
+    void run() { segmentFrame( frame ); }
+};
+
+struct TSegmentFrames
+{
+    vector<TSegmentedFrame> &frames;
+
+    TSegmentFrames( vector<TSegmentedFrame> &f ) : frames(f)
+    {}
+
+    void operator()( size_t frame_index ) const
+    {
+        segmentFrame( frames[frame_index] );
+    }
+};
+
+
+//-----------------------------------------------------------
+//                      selectFrames
+//-----------------------------------------------------------
+
+// Get the next frames to segment from the rawlog, up to a given number.
+// Sensors are registered here, so it must not be called while frames are
+// being segmented.
+void selectFrames( CRawlog &rawlog, size_t &obs_index,
+                   const vector<string> &sensors_to_use,
+                   size_t N_frames,
+                   vector<TSegmentedFrame> &frames )
+{
+    frames.clear();
+
+    for ( ; ( obs_index < rawlog.size() ) && ( frames.size() < N_frames ); obs_index++ )
     {
         CObservationPtr obs = rawlog.getAsObservation(obs_index);
 
-        // Check if the sensor is being used
-        if ( find(sensors_to_use.begin(), sensors_to_use.end(),obs->sensorLabel) == sensors_to_use.end() )
+        if ( !IS_CLASS(obs, CObservation3DRangeScan) )
             continue;
 
-        // Get sensor index
-        size_t sensor_index = find(sensors_to_use.begin(),
-                                   sensors_to_use.end(),obs->sensorLabel)
-                - sensors_to_use.begin();
+        // Check if the sensor is being used
+        if ( !sensors_to_use.empty() &&
+             find(sensors_to_use.begin(), sensors_to_use.end(),obs->sensorLabel) == sensors_to_use.end() )
+            continue;
 
         // Get obs pose
         CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
         obs3D->load();
 
+        // Get sensor index, registering it if it is new
+        size_t sensor_index = sensorRegistry.registerFromObs( *obs3D );
+
+        // Set the number of sensors used into the vector to track the segmented regions
+        if ( sensor_index >= v_regionsPerSensorAndObs.size() )
+        {
+            v_regionsPerSensorAndObs.resize( sensor_index+1 );
+            v_posesPerSensor.resize( sensor_index+1 );
+        }
+
         CPose3D pose;
         obs3D->getSensorPose( pose );
         cout << "Pose [" << obs_index << "]: " << pose << endl;
@@ -934,345 +1398,862 @@ int main(int argc, char* argv[])
         if ( !poseDifferentEnough(pose,sensor_index) )
             continue;
 
-        v_regionsPerSensorAndObs[sensor_index].push_back( vector< TSegmentedRegion >() );
-        size_t obsRealIndex = v_regionsPerSensorAndObs[sensor_index].size()-1;
+        frames.push_back( TSegmentedFrame() );
+
+        TSegmentedFrame &frame = frames.back();
+        frame.obs_index     = obs_index;
+        frame.sensor_index  = sensor_index;
+        frame.obs3D         = obs3D;
+    }
+}
+
+
+//-----------------------------------------------------------
+//                    saveFrameResults
+//-----------------------------------------------------------
+
+// Bytes of the per-pixel label masks (TPixelLabelInfo<N> holds N*8 bits, one
+// per label). Labels are the names of the boxes, so frames of cluttered
+// scenes can see more than 16 of them.
+const unsigned int LABEL_SIZE = 4; // 32 bits
+
+// Set the pixels of a region in the output of a frame, adding its label
+// to the label layer of the observation if needed.
+void setRegionPixels( CObservation3DRangeScan &obs, const vector<int> &v_indices,
+                      int32_t region_id, int32_t track_id, const string &label,
+                      size_t cols, vector<int32_t> &regionIds,
+                      vector<int32_t> &trackIds )
+{
+    int labelIndex = -1;
+
+    if ( !label.empty() )
+    {
+        labelIndex = obs.pixelLabels->checkLabelNameExistence( label );
+
+        // If not, add it to the labels map with a new index
+        if ( labelIndex < 0 )
+        {
+            labelIndex = obs.pixelLabels->pixelLabelNames.size()+1;
+
+            if ( labelIndex >= (int)( 8*LABEL_SIZE ) )
+            {
+                cerr << "  [WARNING] No room for the label " << label
+                     << " in the per-pixel labels of the frame" << endl;
+                labelIndex = -1;
+            }
+            else
+                obs.pixelLabels->setLabelName( labelIndex, label );
+        }
+    }
+
+    for ( size_t i = 0; i < v_indices.size(); i++ )
+    {
+        const int &index = v_indices[i];
+
+        regionIds[index] = region_id;
+        trackIds[index]  = track_id;
+
+        if ( labelIndex >= 0 )
+            obs.pixelLabels->setLabel( index / cols, index % cols, labelIndex );
+    }
+}
+
+// Save the regions of a frame: the observation with the assigned labels as
+// per-pixel labels (the same layer written by Label_rawlog) to the output
+// rawlog, and the per-pixel region and track ids (-1 if none) to the
+// regions file (see OLT::CRegionsFile for its layout). Planes are the first
+// regions, followed by the clusters.
+void saveFrameResults( TSegmentedFrame &frame )
+{
+    CObservation3DRangeScan &obs = *frame.obs3D;
+    const OLT::TRGBDCameraModel &model = sensorRegistry[frame.sensor_index];
+
+    const uint32_t rows = model.depthRows;
+    const uint32_t cols = model.depthCols;
+
+    obs.pixelLabels = CObservation3DRangeScan::TPixelLabelInfoPtr( new CObservation3DRangeScan::TPixelLabelInfo< LABEL_SIZE >() );
+    obs.pixelLabels->setSize(rows,cols);
+
+    OLT::TFrameRegions frameRegions;
+    frameRegions.obs_index   = frame.obs_index;
+    frameRegions.sensorLabel = obs.sensorLabel;
+    frameRegions.timestamp   = obs.timestamp;
+    frameRegions.rows        = rows;
+    frameRegions.cols        = cols;
+
+    vector<int32_t> &regionIds = frameRegions.regionIds;
+    vector<int32_t> &trackIds  = frameRegions.trackIds;
+
+    regionIds.assign( rows*cols, -1 );
+    trackIds.assign( rows*cols, -1 );
+
+    const size_t N_planes = frame.planes.size();
+
+    for ( size_t region_index = 0; region_index < N_planes; region_index++ )
+    {
+        const TSegmentedRegion &region = frame.planes[region_index];
+
+        setRegionPixels( obs, region.indices.indices, region_index,
+                         configuration.trackClusters ? (int32_t)region.track_id : -1,
+                         region.label, cols, regionIds, trackIds );
+    }
+
+    for ( size_t region_index = 0; region_index < frame.clusters.size(); region_index++ )
+        setRegionPixels( obs, frame.clusters[region_index].indices,
+                         N_planes + region_index, -1,
+                         frame.clusterLabels[region_index], cols,
+                         regionIds, trackIds );
+
+    o_rawlog << frame.obs3D;
 
-        mrpt::opengl::COpenGLScenePtr scene = win3D.get3DSceneAndLock();
+    OLT::CRegionsFile::writeFrame( o_regions, frameRegions );
+}
+
+
+//-----------------------------------------------------------
+//                      processFrame
+//-----------------------------------------------------------
+
+// Tracking, labelling and visualization of the regions of a segmented frame,
+// which depend on the previous frames, so frames are processed in order.
+void processFrame( TSegmentedFrame &frame, const vector<TPoint3D> &v_colors,
+                   size_t &color_index, bool stepByStepExecution )
+{
+    CObservation3DRangeScanPtr &obs3D = frame.obs3D;
+    pcl::PointCloud<pcl::PointXYZ>::Ptr &pcl_cloud = frame.cloud;
 
-        mrpt::opengl::CPointCloudColouredPtr gl_points = mrpt::opengl::CPointCloudColoured::Create();
-        gl_points->setPointSize(6);
+    // Keep only the last frames of the sensor in its tracking window,
+    // and index their regions to look for the nearby ones
 
-        CColouredPointsMap colouredMap;
-        colouredMap.colorScheme.scheme = CColouredPointsMap::cmFromIntensityImage;
-        colouredMap.loadFromRangeScan( *obs3D );
+    deque<vector<TSegmentedRegion> > &trackingWindow = v_regionsPerSensorAndObs[frame.sensor_index];
 
-        gl_points->loadFromPointsMap( &colouredMap );
-        //scene->insert( gl_points );
-        win3D.unlockAccess3DScene();
+    if ( trackingConfig.windowSize )
+        while ( trackingWindow.size() > trackingConfig.windowSize )
+            trackingWindow.pop_front();
 
-        pcl::PointCloud<pcl::PointXYZ>::Ptr pcl_cloud( new pcl::PointCloud<pcl::PointXYZ>() );
+    TRegionsHash regionsHash;
 
-        //
-        // Do segmentation of planes or arbitrary regions?
-        //
+    if ( configuration.trackClusters )
+        buildRegionsHash( trackingWindow, regionsHash );
 
-        if ( configuration.doEuclideanSegmentation ||
-             configuration.doPlanarSegmentation )
+    trackingWindow.push_back( vector< TSegmentedRegion >() );
+
+    size_t N_planes = frame.planes.size();
+
+    for ( size_t region_index = 0; region_index < N_planes; region_index++ )
+    {
+        TSegmentedRegion &region = frame.planes[region_index];
+        vector<int> &v_indices = region.indices.indices;
+
+        if ( configuration.trackClusters )
         {
+            TPoint3D color;
+            int tracked = getTrack(region,trackingWindow,regionsHash,color);
+
+            // Future regions are compared with a dilated version,
+            // tolerating noise and small registration errors. Its AABB
+            // grows with it, or the candidate regions of future frames
+            // would miss regions that moved less than a voxel
+            region.voxels.dilate();
+            region.voxels.getBounds( region.aabbMin, region.aabbMax );
+
+            // Already existing track
+            if ( tracked != -1 )
+            {
+                region.track_id = tracked;
+                region.color    =  color;
+
+            }
+            // Create new track
+            else
+            {
+                region.color = v_colors[color_index];
+
+                color_index+=1;
+                if ( color_index > v_colors.size()-1 )
+                    color_index = 0;
+
+                region.track_id = trackID++;
+
+                cout << "New track!" << endl;
+            }
+
+            cout << "Previously tracked: " << tracked << endl;
+        }
+
+        trackingWindow.back().push_back(region);
+
+        // Show segmentation results
+        if ( configuration.showSegmentation)
+        {
+            size_t N_inliers = v_indices.size();
+
+            CColouredPointsMap region_pm;
+
+            CPose3D sensorPose;
+            obs3D->getSensorPose( sensorPose );
 
-            obs3D->project3DPointsFromDepthImageInto( *pcl_cloud, true );
+            for( size_t point_index = 0; point_index < N_inliers; point_index++ )
+            {
+                float x = obs3D->points3D_x[v_indices[point_index]];
+                float y = obs3D->points3D_y[v_indices[point_index]];
+                float z = obs3D->points3D_z[v_indices[point_index]];
 
-            Eigen::Matrix4f transMat;
+                TPoint3D point( sensorPose + CPoint3D(x,y,z) );
 
-            transMat(0,0)=0;    transMat(0,1)=-1;     transMat(0,2)=0;    transMat(0,3)=0;
-            transMat(1,0)=0;    transMat(1,1)=0;      transMat(1,2)=+1;   transMat(1,3)=0;
-            transMat(2,0)=1;    transMat(2,1)=0;      transMat(2,2)=0;    transMat(2,3)=0;
-            transMat(3,0)=0;    transMat(3,1)=0;      transMat(3,2)=0;    transMat(3,3)=1;
+                if ( configuration.showColouredRegions )
+                    if ( configuration.trackClusters )
+                        region_pm.insertPoint( point.x, point.y, point.z,
+                                               region.color.x,
+                                               region.color.y,
+                                               region.color.z);
+                    else
+                        region_pm.insertPoint( point.x, point.y, point.z,
+                                               v_colors[color_index].x,
+                                               v_colors[color_index].y,
+                                               v_colors[color_index].z);
 
-            pcl::transformPointCloud( *pcl_cloud, *pcl_cloud, transMat );
+                else
+                    region_pm.insertPoint( point.x, point.y, point.z, 0, 1 , 0);
 
-            cout << "Number of points in point cloud: " << pcl_cloud->size() << endl;
-            pcl_cloud->height = 240;
-            pcl_cloud->width = 320;
+            }
 
-            applyBilateralFilter(pcl_cloud);
+            mrpt::opengl::COpenGLScenePtr scene = win3D->get3DSceneAndLock();
 
-            std::vector<pcl::PointIndices> inliers_indices;
-            vector<bool> v_indices_to_remove(obs3D->points3D_x.size(),false);
+            scene->insert(region.box);
 
-            //
-            // Do segmentation of planes
-            //
+            mrpt::opengl::CPointCloudColouredPtr gl_points_region = mrpt::opengl::CPointCloudColoured::Create();
+            gl_points_region->setPointSize(7);
 
-            if ( configuration.doPlanarSegmentation )
+            gl_points_region->loadFromPointsMap( &region_pm );
+
+            scene->insert( gl_points_region );
+
+            if ( !configuration.trackClusters )
             {
+                color_index+=2;
+                if ( color_index > v_colors.size()-1 )
+                    color_index = 0;
+            }
+        }
+
+        if ( configuration.labelClusters )
+        {
+            cout << "[INFO] Getting clusters labels." << endl;
 
-                vector<pcl::ModelCoefficients>  modelCoefficients; // Planes Coefficients of
-                vector<pcl::PointIndices>       boundaryIndices;   // Boundary indices of each plane.
+            getLabel( pcl_cloud, region.indices, region.label );
 
-                // Segment
-                segmentPlanes(pcl_cloud,
-                              inliers_indices,
-                              modelCoefficients,
-                              boundaryIndices);
+            cout << "Label: " << region.label << endl;
+        }
 
-                if ( configuration.fusePlanes )
+        if ( configuration.showSegmentation )
+        {
+            win3D->unlockAccess3DScene();
+            win3D->repaint();
+
+            if ( stepByStepExecution )
+                win3D->waitForKey();
+        }
+    }
+
+    size_t N_clusters = frame.clusters.size();
+
+    frame.clusterLabels.resize( N_clusters );
+
+    if ( configuration.showSegmentation || configuration.labelClusters )
+    {
+        for ( size_t region_index = 0; region_index < N_clusters; region_index++ )
+        {
+            vector<int> &v_indices = frame.clusters[region_index].indices;
+
+            if ( configuration.showSegmentation )
+            {
+                size_t N_inliers = v_indices.size();
+
+                CColouredPointsMap region;
+
+                CPose3D sensorPose;
+                obs3D->getSensorPose( sensorPose );
+
+                for( size_t point_index = 0; point_index < N_inliers; point_index++ )
                 {
-                    planesFusion(pcl_cloud,
-                                 inliers_indices,
-                                 modelCoefficients,
-                                 boundaryIndices);
+                    float x = obs3D->points3D_x[v_indices[point_index]];
+                    float y = obs3D->points3D_y[v_indices[point_index]];
+                    float z = obs3D->points3D_z[v_indices[point_index]];
+
+                    TPoint3D point( sensorPose + CPoint3D(x,y,z) );
+
+                    if ( configuration.showColouredRegions )
+                        region.insertPoint( point.x, point.y, point.z,
+                                            v_colors[color_index].x,
+                                            v_colors[color_index].y,
+                                            v_colors[color_index].z);
+                    else
+                        region.insertPoint( point.x, point.y, point.z, 0, 0 , 1);
 
                 }
 
-                size_t N_planes = inliers_indices.size();
-                cout << "[INFO] Num of segmented planes: " <<  N_planes << endl;
+                mrpt::opengl::COpenGLScenePtr scene = win3D->get3DSceneAndLock();
 
-                for ( size_t region_index = 0; region_index < N_planes; region_index++ )
-                {
-                    vector<int> &v_indices = inliers_indices[region_index].indices;
 
-                    // Keep track of segmented regions into the scene
+                Eigen::Vector4f v_min;
+                Eigen::Vector4f v_max;
 
-                    TSegmentedRegion region;
+                pcl::getMinMax3D( *pcl_cloud, v_indices, v_min, v_max );
 
-                    region.cloud = pcl_cloud;
-                    region.indices = inliers_indices[region_index];
+                //cout << "V_min: " << v_min.transpose() << endl;
+                //cout << "V_max: " << v_max.transpose() << endl;
 
-                    pcl::ConvexHull<pcl::PointXYZ> convex_hull;
-                    convex_hull.setInputCloud( pcl_cloud );
-                    convex_hull.setIndices( boost::make_shared<const pcl::PointIndices> (region.indices) );
-                    convex_hull.setDimension(3);
-                    convex_hull.reconstruct(*region.convexHullCloud,
-                                            region.polygons);
+                mrpt::opengl::CBoxPtr box = CBox::Create();
+                box->setBoxCorners( TPoint3D(v_min(2),-v_min(0),v_min(1)),
+                                    TPoint3D(v_max(2),-v_max(0),v_max(1)));
+                box->setWireframe( true );
+                box->setColor( 1,1,0 );
 
-                    Eigen::Vector4f v_min;
-                    Eigen::Vector4f v_max;
+                scene->insert(box);
 
-                    pcl::getMinMax3D( *pcl_cloud, v_indices, v_min, v_max );
 
-                    //cout << "V_min: " << v_min.transpose() << endl;
-                    //cout << "V_max: " << v_max.transpose() << endl;
+                mrpt::opengl::CPointCloudColouredPtr gl_points_region = mrpt::opengl::CPointCloudColoured::Create();
+                gl_points_region->setPointSize(7);
 
-                    region.box->setBoxCorners( TPoint3D(v_min(2),-v_min(0),v_min(1)),
-                                               TPoint3D(v_max(2),-v_max(0),v_max(1)));
+                gl_points_region->loadFromPointsMap( &region );
 
-                    region.box->setWireframe( true );
-                    region.box->setColor( 1,0,0 );
+                scene->insert( gl_points_region );
 
-                    if ( configuration.trackClusters )
-                    {
-                        TPoint3D color;
-                        int tracked = ( !obsRealIndex ) ? -1 :
-                                      getTrack(region,v_regionsPerSensorAndObs[sensor_index],color);
-                                      //getTrack(region,v_regionsPerSensorAndObs[sensor_index][obsRealIndex-1],color);
+                color_index+=2;
+                if ( color_index > v_colors.size()-1 )
+                    color_index = 0;
+            }
 
-                        // Already existing track
-                        if ( tracked != -1 )
-                        {
-                            region.track_id = tracked;
-                            region.color    =  color;
+            if ( configuration.labelClusters )
+            {
+                cout << "[INFO] Getting clusters labels." << endl;
 
-                        }
-                        // Create new track
-                        else
-                        {
-                            region.color = v_colors[color_index];
+                string &label = frame.clusterLabels[region_index];
+                getLabel( pcl_cloud, frame.clusters[region_index], label );
 
-                            color_index+=1;
-                            if ( color_index > v_colors.size()-1 )
-                                color_index = 0;
+                cout << "Label: " << label << endl;
+            }
 
-                            region.track_id = trackID++;
+            if ( configuration.showSegmentation )
+            {
+                win3D->unlockAccess3DScene();
+                win3D->repaint();
 
-                            cout << "New track!" << endl;
-                        }
+                if ( stepByStepExecution )
+                    win3D->waitForKey();
 
-                        cout << "Previously tracked: " << tracked << endl;
-                    }
+            }
+        }
+    }
 
-                    v_regionsPerSensorAndObs[sensor_index][obsRealIndex].push_back(region);
+    if ( configuration.headless )
+    {
+        saveFrameResults( frame );
+        return;
+    }
 
-                    // Show segmentation results
-                    if ( configuration.showSegmentation)
-                    {
-                        size_t N_inliers = v_indices.size();
+    win3D->repaint();
 
-                        CColouredPointsMap region_pm;
+    if ( stepByStepExecution )
+        win3D->waitForKey();
+}
 
-                        for( size_t point_index = 0; point_index < N_inliers; point_index++ )
-                        {
-                            v_indices_to_remove[v_indices[point_index]] = true;
 
-                            float x = obs3D->points3D_x[v_indices[point_index]];
-                            float y = obs3D->points3D_y[v_indices[point_index]];
-                            float z = obs3D->points3D_z[v_indices[point_index]];
+//-----------------------------------------------------------
+//                      Parameter sweep
+//-----------------------------------------------------------
 
-                            CPose3D sensorPose;
-                            obs3D->getSensorPose( sensorPose );
+// Statistics of the segmentation of some frames with a set of parameters
+struct TSweepStats
+{
+    size_t  N_frames;
+    size_t  N_planes;
+    size_t  N_clusters;
+    size_t  N_segmentedPoints;
+    size_t  N_validPoints;
+    double  time;
+
+    TSweepStats() : N_frames(0), N_planes(0), N_clusters(0),
+        N_segmentedPoints(0), N_validPoints(0), time(0)
+    {}
 
-                            TPoint3D point( sensorPose + CPoint3D(x,y,z) );
+    void add( const TSweepStats &other )
+    {
+        N_frames            += other.N_frames;
+        N_planes            += other.N_planes;
+        N_clusters          += other.N_clusters;
+        N_segmentedPoints   += other.N_segmentedPoints;
+        N_validPoints       += other.N_validPoints;
+        time                += other.time;
+    }
+};
 
-                            if ( configuration.showColouredRegions )
-                                if ( configuration.trackClusters )
-                                    region_pm.insertPoint( point.x, point.y, point.z,
-                                                           region.color.x,
-                                                           region.color.y,
-                                                           region.color.z);
-                                else
-                                    region_pm.insertPoint( point.x, point.y, point.z,
-                                                           v_colors[color_index].x,
-                                                           v_colors[color_index].y,
-                                                           v_colors[color_index].z);
+bool setSweepParameter( TSegmentationParams &params, const string &section,
+                        const string &key, const string &value )
+{
+    const double v = atof( value.c_str() );
 
-                            else
-                                region_pm.insertPoint( point.x, point.y, point.z, 0, 1 , 0);
+    if ( section == "PLANAR_SEGMENTATION" )
+    {
+        if ( key == "minPlaneInliers" )         params.planar.minPlaneInliers = v;
+        else if ( key == "distThreshold" )      params.planar.distThreshold = v;
+        else if ( key == "angleThreshold" )     params.planar.angleThreshold = v;
+        else if ( key == "maximumCurvature" )   params.planar.maximumCurvature = v;
+        else return false;
+    }
+    else if ( section == "EUCLIDEAN_SEGMENTATION" )
+    {
+        if ( key == "clusterTolerance" )        params.euclidean.clusterTolerance = v;
+        else if ( key == "minClusterSize" )     params.euclidean.minClusterSize = v;
+        else if ( key == "maxClusterSize" )     params.euclidean.maxClusterSize = v;
+        else return false;
+    }
+    else if ( section == "FUSION" )
+    {
+        if ( key == "minDistance" )             params.fusion.minDistance = v;
+        else if ( key == "maxAngleDiff" )       params.fusion.maxAngleDiff = v;
+        else return false;
+    }
+    else
+        return false;
 
-                        }
+    return true;
+}
 
-                        mrpt::opengl::COpenGLScenePtr scene = win3D.get3DSceneAndLock();
+// Load the sets of parameters to evaluate. The sweep file has the same
+// sections as the configuration file, and each key lists the values to try,
+// e.g. 'distThreshold = 0.02 0.03 0.04'. All the combinations are evaluated,
+// taking the parameters not in the sweep file from the configuration.
+int loadSweep( const string &sweepFile,
+               vector<TSegmentationParams> &v_params,
+               vector<string> &v_descriptions )
+{
+    if ( !mrpt::system::fileExists(sweepFile) )
+    {
+        cerr << "  [ERROR] The sweep file " << sweepFile << " doesn't exist." << endl;
+        return -1;
+    }
 
-                        scene->insert(region.box);
+    CConfigFile sweep( sweepFile );
 
-                        mrpt::opengl::CPointCloudColouredPtr gl_points_region = mrpt::opengl::CPointCloudColoured::Create();
-                        gl_points_region->setPointSize(7);
+    v_params.assign( 1, getConfiguredParams() );
+    v_descriptions.assign( 1, "" );
 
-                        gl_points_region->loadFromPointsMap( &region_pm );
+    const char* sections[] = { "PLANAR_SEGMENTATION", "EUCLIDEAN_SEGMENTATION", "FUSION" };
 
-                        scene->insert( gl_points_region );
+    for ( size_t section_index = 0; section_index < 3; section_index++ )
+    {
+        const string section = sections[section_index];
 
-                        if ( !configuration.trackClusters )
-                        {
-                            color_index+=2;
-                            if ( color_index > v_colors.size()-1 )
-                                color_index = 0;
-                        }
-                    }
+        vector<string> keys;
+        sweep.getAllKeys( section, keys );
 
-                    if ( configuration.labelClusters )
-                    {
-                        cout << "[INFO] Getting clusters labels." << endl;
+        for ( size_t key_index = 0; key_index < keys.size(); key_index++ )
+        {
+            const string &key = keys[key_index];
 
-                        string label;
-                        getLabel( pcl_cloud, inliers_indices[region_index], label);
+            vector<string> values;
+            mrpt::system::tokenize( sweep.read_string(section,key,"",true), " ,\t", values );
 
-                        cout << "Label: " << label << endl;
-                    }
+            if ( values.empty() )
+                continue;
 
-                    if ( configuration.showSegmentation )
-                    {
-                        win3D.unlockAccess3DScene();
-                        win3D.repaint();
+            vector<TSegmentationParams> v_newParams;
+            vector<string> v_newDescriptions;
 
-                        if ( stepByStepExecution )
-                            win3D.waitForKey();
+            for ( size_t i = 0; i < v_params.size(); i++ )
+                for ( size_t value_index = 0; value_index < values.size(); value_index++ )
+                {
+                    TSegmentationParams params = v_params[i];
+
+                    if ( !setSweepParameter( params, section, key, values[value_index] ) )
+                    {
+                        cerr << "  [ERROR] Unknown sweep parameter " << section << "/" << key << endl;
+                        return -1;
                     }
+
+                    v_newParams.push_back( params );
+                    v_newDescriptions.push_back( v_descriptions[i] + key + "="
+                                                 + values[value_index] + " " );
                 }
-            }
 
+            v_params.swap( v_newParams );
+            v_descriptions.swap( v_newDescriptions );
+        }
+    }
 
-            //
-            // Do segmentation of arbitrary regions
-            //
+    return 0;
+}
 
-            if ( configuration.doEuclideanSegmentation )
-            {
+struct TPreprocessFrames
+{
+    vector<TSegmentedFrame> &frames;
+    bool                     computeNormalsToo;
 
-                pcl::PointIndices v_outliers_indices;
+    TPreprocessFrames( vector<TSegmentedFrame> &f, bool n ) :
+        frames(f), computeNormalsToo(n)
+    {}
 
-                for ( size_t i = 0; i < obs3D->points3D_x.size(); i++ )
-                    if ( !v_indices_to_remove[i] )
-                        v_outliers_indices.indices.push_back(i);
+    void operator()( size_t frame_index ) const
+    {
+        preprocessFrame( frames[frame_index], computeNormalsToo );
+    }
+};
 
-                std::vector<pcl::PointIndices> cluster_indices;
+// Segment every frame with every set of parameters
+struct TSweepFrames
+{
+    const vector<TSegmentedFrame>       &frames;
+    const vector<TSegmentationParams>   &params;
+    vector<TSweepStats>                 &stats;  // Per pair of params and frame
 
-                segmentClusters( pcl_cloud, v_outliers_indices, cluster_indices);
+    TSweepFrames( const vector<TSegmentedFrame> &f,
+                  const vector<TSegmentationParams> &p,
+                  vector<TSweepStats> &s ) : frames(f), params(p), stats(s)
+    {}
 
-                size_t N_clusters = cluster_indices.size();
+    void operator()( size_t i ) const
+    {
+        const TSegmentedFrame &frame = frames[i % frames.size()];
+        TSweepStats &s = stats[i];
 
-                if ( configuration.showSegmentation || configuration.labelClusters )
-                {
-                    for ( size_t region_index = 0; region_index < N_clusters; region_index++ )
-                    {
-                        vector<int> &v_indices = cluster_indices[region_index].indices;
+        double start = pcl::getTime ();
 
-                        if ( configuration.showSegmentation )
-                        {
-                            size_t N_inliers = v_indices.size();
+        vector<pcl::PointIndices> planes, clusters;
+        segmentPreprocessed( frame, params[i / frames.size()], planes, clusters );
 
-                            CColouredPointsMap region;
+        s.time = pcl::getTime () - start;
 
-                            for( size_t point_index = 0; point_index < N_inliers; point_index++ )
-                            {
-                                float x = obs3D->points3D_x[v_indices[point_index]];
-                                float y = obs3D->points3D_y[v_indices[point_index]];
-                                float z = obs3D->points3D_z[v_indices[point_index]];
+        s.N_frames      = 1;
+        s.N_planes      = planes.size();
+        s.N_clusters    = clusters.size();
 
-                                CPose3D sensorPose;
-                                obs3D->getSensorPose( sensorPose );
+        for ( size_t j = 0; j < planes.size(); j++ )
+            s.N_segmentedPoints += planes[j].indices.size();
 
-                                TPoint3D point( sensorPose + CPoint3D(x,y,z) );
+        for ( size_t j = 0; j < clusters.size(); j++ )
+            s.N_segmentedPoints += clusters[j].indices.size();
 
-                                if ( configuration.showColouredRegions )
-                                    region.insertPoint( point.x, point.y, point.z,
-                                                        v_colors[color_index].x,
-                                                        v_colors[color_index].y,
-                                                        v_colors[color_index].z);
-                                else
-                                    region.insertPoint( point.x, point.y, point.z, 0, 0 , 1);
+        for ( size_t j = 0; j < frame.cloud->size(); j++ )
+            if ( pcl_isfinite( frame.cloud->points[j].z ) )
+                s.N_validPoints++;
+    }
+};
 
-                            }
+// Evaluate the sets of parameters of a sweep file on the frames of the
+// rawlog, preprocessed once (or taken from the cache) per batch of frames.
+// Results are shown and saved to a .csv file next to the sweep file.
+int runSweep( CRawlog &rawlog, const vector<string> &sensors_to_use,
+              const string &sweepFile )
+{
+    vector<TSegmentationParams> v_params;
+    vector<string>              v_descriptions;
 
-                            mrpt::opengl::COpenGLScenePtr scene = win3D.get3DSceneAndLock();
+    if ( loadSweep( sweepFile, v_params, v_descriptions ) )
+        return -1;
 
+    const size_t N_params = v_params.size();
 
-                            Eigen::Vector4f v_min;
-                            Eigen::Vector4f v_max;
+    cout << "  [INFO] Evaluating " << N_params << " sets of parameters." << endl;
 
-                            pcl::getMinMax3D( *pcl_cloud, v_indices, v_min, v_max );
+    bool computeNormalsToo = false;
 
-                            //cout << "V_min: " << v_min.transpose() << endl;
-                            //cout << "V_max: " << v_max.transpose() << endl;
+    for ( size_t i = 0; i < N_params; i++ )
+        computeNormalsToo |= v_params[i].doPlanarSegmentation;
 
-                            mrpt::opengl::CBoxPtr box = CBox::Create();
-                            box->setBoxCorners( TPoint3D(v_min(2),-v_min(0),v_min(1)),
-                                                TPoint3D(v_max(2),-v_max(0),v_max(1)));
-                            box->setWireframe( true );
-                            box->setColor( 1,1,0 );
+    vector<TSweepStats> v_totalStats( N_params );
 
-                            scene->insert(box);
+    const size_t batchSize = 4*OLT::CTaskScheduler::getNumThreads();
 
+    vector<TSegmentedFrame> v_frames;
+    size_t obs_index = 0;
 
-                            mrpt::opengl::CPointCloudColouredPtr gl_points_region = mrpt::opengl::CPointCloudColoured::Create();
-                            gl_points_region->setPointSize(7);
+    selectFrames( rawlog, obs_index, sensors_to_use, batchSize, v_frames );
 
-                            gl_points_region->loadFromPointsMap( &region );
+    while ( !v_frames.empty() )
+    {
+        TPreprocessFrames preprocessFrames( v_frames, computeNormalsToo );
+        OLT::parallelFor( 0, v_frames.size(), preprocessFrames );
 
-                            scene->insert( gl_points_region );
+        vector<TSweepStats> v_stats( N_params*v_frames.size() );
 
-                            color_index+=2;
-                            if ( color_index > v_colors.size()-1 )
-                                color_index = 0;
-                        }
+        TSweepFrames sweepFrames( v_frames, v_params, v_stats );
+        OLT::parallelFor( 0, v_stats.size(), sweepFrames );
 
-                        if ( configuration.labelClusters )
-                        {
-                            cout << "[INFO] Getting clusters labels." << endl;
+        for ( size_t i = 0; i < v_stats.size(); i++ )
+            v_totalStats[i / v_frames.size()].add( v_stats[i] );
 
-                            string label;
-                            getLabel( pcl_cloud, cluster_indices[region_index], label );
+        selectFrames( rawlog, obs_index, sensors_to_use, batchSize, v_frames );
+    }
 
-                            cout << "Label: " << label << endl;
-                        }
+    // Show and save results
 
-                        if ( configuration.showSegmentation )
-                        {
-                            win3D.unlockAccess3DScene();
-                            win3D.repaint();
+    const string resultsFile = mrpt::system::fileNameChangeExtension( sweepFile, "csv" );
+    ofstream results( resultsFile.c_str() );
 
-                            if ( stepByStepExecution )
-                                win3D.waitForKey();
+    results << "params,frames,planes_per_frame,clusters_per_frame,segmented_ratio,time_per_frame" << endl;
 
-                        }
-                    }
+    cout << endl << "  [INFO] Results: " << endl;
+
+    for ( size_t i = 0; i < N_params; i++ )
+    {
+        const TSweepStats &s = v_totalStats[i];
+        const double N_frames = std::max<size_t>( s.N_frames, 1 );
+        const double segmentedRatio = s.N_validPoints ?
+                    s.N_segmentedPoints / (double)s.N_validPoints : 0;
+
+        cout << "           - [" << i << "] " << v_descriptions[i] << endl;
+        cout << "             planes/frame: " << s.N_planes/N_frames
+             << " clusters/frame: " << s.N_clusters/N_frames
+             << " segmented: " << segmentedRatio*100 << "%"
+             << " time/frame: " << s.time/N_frames << endl;
+
+        results << "\"" << v_descriptions[i] << "\"," << s.N_frames << ","
+                << s.N_planes/N_frames << "," << s.N_clusters/N_frames << ","
+                << segmentedRatio << "," << s.time/N_frames << endl;
+    }
+
+    cout << "  [INFO] Results saved to " << resultsFile << endl;
+
+    return 0;
+}
+
+
+//-----------------------------------------------------------
+//                          main
+//-----------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    // Create vector of colors for visualization
+    vector<TPoint3D> v_colors;
+
+    for ( double mult1 = 0; mult1 <= 1; mult1+= 0.2 )
+        for ( double mult2 = 0; mult2 <= 1; mult2+= 0.2 )
+            for ( double mult3 = 0; mult3 <= 1; mult3+= 0.2 )
+                v_colors.push_back( TPoint3D(1.0*mult1, 1.0*mult2, 1.0*mult3) );
+
+    vector<string> sensors_to_use; // All the sensors within the rawlog if empty
+
+    bool stepByStepExecution = false;
+    bool pipelined = false;
+    string cacheDirectory;
+    string sweepFile;
+
+    CRawlog rawlog;
+
+    if ( argc > 2 )
+    {
+        // Get rawlog file name
+
+        cout << "1:" << argv[1] << endl;
+
+        string configFile = argv[1];
+        loadConfig(configFile);
+
+        // Get optional paramteres
+        if ( argc > 1 )
+        {
+            size_t arg = 2;
+
+            while ( arg < argc )
+            {
+                if ( !strcmp(argv[arg],"-i") )
+                {
+                    configuration.rawlogFile = argv[arg+1];
+                    arg += 2;
+                }
+                else if ( !strcmp(argv[arg],"-sensor") )
+                {
+                    string sensor = argv[arg+1];
+                    arg += 2;
+
+                    sensors_to_use.push_back(  sensor );
+
+                }
+                else if ( !strcmp(argv[arg], "-step") )
+                {
+                    stepByStepExecution = true;
+                    arg++;
+                }
+                else if ( !strcmp(argv[arg], "-headless") )
+                {
+                    configuration.headless = true;
+                    arg++;
+                }
+                else if ( !strcmp(argv[arg], "-o") )
+                {
+                    configuration.outputFile = argv[arg+1];
+                    arg += 2;
                 }
+                else if ( !strcmp(argv[arg], "-cache") )
+                {
+                    cacheDirectory = argv[arg+1];
+                    arg += 2;
+                }
+                else if ( !strcmp(argv[arg], "-sweep") )
+                {
+                    sweepFile = argv[arg+1];
+                    arg += 2;
+                }
+                else if ( !strcmp(argv[arg], "-pipeline") )
+                {
+                    pipelined = true;
+                    arg++;
+                }
+                else if ( !strcmp(argv[arg], "-threads") )
+                {
+                    OLT::CTaskScheduler::setNumThreads( atoi(argv[arg+1]) );
+                    arg += 2;
+                }
+                else
+                {
+                    cout << "[Error] " << argv[arg] << " unknown paramter" << endl;
+                    return -1;
+                }
+
             }
         }
+    }
+    else
+    {
+        cout << "Usage information. At least two expected arguments: " << endl <<
+                " \t <conf_fil>       : Configuration file." << endl <<
+                " \t -i <rawlog_file> : Rawlog file to process." << endl;
+        cout << "Then, optional parameters:" << endl <<
+                " \t -sensor <sensor_label> : Use obs. from this sensor (all used by default)." << endl <<
+                " \t -step                  : Enable step by step execution." << endl <<
+                " \t -pipeline              : Segment frames in parallel with the tracking of previous ones." << endl <<
+                " \t -headless              : No visualization, save per-pixel regions, tracks and labels." << endl <<
+                " \t -cache <directory>     : Cache filtered clouds and normals in this directory." << endl <<
+                " \t -sweep <sweep_file>    : Evaluate the combinations of parameters in this file." << endl <<
+                " \t -o <rawlog_file>       : Output rawlog in headless mode (<rawlog>_segmented.rawlog by default)." << endl <<
+                " \t -threads <num>         : Number of threads to use (all the cores by default)." << endl;
+
+        return -1;
+    }
+
+    if ( !cacheDirectory.empty() &&
+         preprocessingCache.open( cacheDirectory, configuration.rawlogFile,
+                                  getPreprocessingParameters() ) )
+        return -1;
+
+    if ( !sweepFile.empty() )
+    {
+        rawlog.loadFromRawLogFile( configuration.rawlogFile );
+
+        return runSweep( rawlog, sensors_to_use, sweepFile );
+    }
+
+    if ( configuration.headless )
+    {
+        // Labelled observations go to the output rawlog, and region and
+        // track ids to a .regions file next to it
+
+        configuration.showSegmentation = false;
+
+        if ( configuration.outputFile.empty() )
+        {
+            configuration.outputFile = configuration.rawlogFile.substr(0,configuration.rawlogFile.size()-7);
+            configuration.outputFile += "_segmented.rawlog";
+        }
 
-        scene = win3D.get3DSceneAndLock();
-        N_segmented_point_clouds++;
+        string regionsFile = mrpt::system::fileNameChangeExtension( configuration.outputFile, "regions" );
 
-        win3D.unlockAccess3DScene();
-        win3D.repaint();
+        if ( !o_rawlog.open( configuration.outputFile ) || !o_regions.open( regionsFile ) )
+        {
+            cerr << "  [ERROR] Couldn't open the output files " << configuration.outputFile;
+            cerr << " and " << regionsFile << endl;
+            return -1;
+        }
 
-        if ( stepByStepExecution )
-            win3D.waitForKey();
+        cout << "  [INFO] Saving results to " << configuration.outputFile;
+        cout << " and " << regionsFile << endl;
     }
+    else
+    {
+        // Set 3D window
 
-    cout << "[INFO] Number of points clouds segmented: " << N_segmented_point_clouds << endl;
+        win3D = mrpt::gui::CDisplayWindow3DPtr( new mrpt::gui::CDisplayWindow3D() );
+
+        win3D->setWindowTitle("Segmentation");
+
+        win3D->resize(400,300);
+
+        win3D->setCameraAzimuthDeg(140);
+        win3D->setCameraElevationDeg(20);
+        win3D->setCameraZoom(6.0);
+        win3D->setCameraPointingToPoint(2.5,0,0);
+
+        mrpt::opengl::COpenGLScenePtr scene = win3D->get3DSceneAndLock();
+
+        opengl::CGridPlaneXYPtr obj = opengl::CGridPlaneXY::Create(-7,7,-7,7,0,1);
+        obj->setColor(0.7,0.7,0.7);
+        obj->setLocation(0,0,0);
+        scene->insert( obj );
+
+        win3D->unlockAccess3DScene();
+    }
+
+    rawlog.loadFromRawLogFile( configuration.rawlogFile );
+
+    size_t N_segmented_point_clouds = 0;
+
+    // Iterate over the obs into the rawlog and show them in the 3D window.
+    // In pipelined mode, a batch of frames is segmented by the task
+    // scheduler while the previous one is being tracked, labelled and shown,
+    // which must be done in order.
+
+    size_t color_index = 0;
+    size_t obs_index = 0;
+
+    const size_t batchSize = pipelined ? 2*OLT::CTaskScheduler::getNumThreads() : 1;
+
+    vector<TSegmentedFrame> v_frames;       // Frames being processed
+    vector<TSegmentedFrame> v_nextFrames;   // Frames being segmented meanwhile
+
+    selectFrames( rawlog, obs_index, sensors_to_use, batchSize, v_nextFrames );
+
+    TSegmentFrames segmentFirstFrames( v_nextFrames );
+    OLT::parallelFor( 0, v_nextFrames.size(), segmentFirstFrames );
+
+    while ( !v_nextFrames.empty() )
+    {
+        v_frames.swap( v_nextFrames );
+
+        selectFrames( rawlog, obs_index, sensors_to_use, batchSize, v_nextFrames );
+
+        OLT::CTaskGroup group;
 
+        if ( pipelined )
+            for ( size_t frame_index = 0; frame_index < v_nextFrames.size(); frame_index++ )
+                group.run( new TSegmentFrameTask( v_nextFrames[frame_index] ) );
 
-    mrpt::system::pause();
+        for ( size_t frame_index = 0; frame_index < v_frames.size(); frame_index++ )
+        {
+            processFrame( v_frames[frame_index], v_colors, color_index, stepByStepExecution );
+            N_segmented_point_clouds++;
+        }
+
+        group.wait();
+
+        if ( !pipelined )
+        {
+            TSegmentFrames segmentFrames( v_nextFrames );
+            OLT::parallelFor( 0, v_nextFrames.size(), segmentFrames );
+        }
+    }
+
+    cout << "[INFO] Number of points clouds segmented: " << N_segmented_point_clouds << endl;
+
+    if ( configuration.headless )
+    {
+        o_rawlog.close();
+        o_regions.close();
+    }
+    else
+        mrpt::system::pause();
 
     return 0;
 }
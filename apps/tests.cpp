@@ -0,0 +1,154 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+/** Checks of the components of OLT core. It returns 0 if all of them pass.
+  */
+
+#include "CVoxelSet.hpp"
+
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+
+//-----------------------------------------------------------
+//                     aabbsOverlap
+//-----------------------------------------------------------
+
+bool aabbsOverlap( const float min1[3], const float max1[3],
+                   const float min2[3], const float max2[3] )
+{
+    for ( size_t i = 0; i < 3; i++ )
+        if ( ( max1[i] < min2[i] ) || ( max2[i] < min1[i] ) )
+            return false;
+
+    return true;
+}
+
+
+//-----------------------------------------------------------
+//                testTrackingThinPlane
+//-----------------------------------------------------------
+
+// A floor seen in two frames, shifted along z by less than a voxel but
+// falling into the next layer of voxels. The AABBs of its points don't
+// overlap, while the previous, dilated, occupancy does overlap with the new
+// one, so the bounds used to preselect candidate regions in Segmentation
+// must be the ones of the dilated voxels.
+
+int testTrackingThinPlane()
+{
+    const float voxelSize = 0.05;
+
+    OLT::CVoxelSet previous( voxelSize );
+    OLT::CVoxelSet current( voxelSize );
+
+    // Points every 2cm in [0,0.98], within the voxels 0 to 19 along x and y
+    float previousMin[3] = { 0, 0, 0.04 }, previousMax[3] = { 0.98, 0.98, 0.04 };
+    float currentMin[3]  = { 0, 0, 0.06 }, currentMax[3]  = { 0.98, 0.98, 0.06 };
+
+    for ( size_t i = 0; i < 50; i++ )
+        for ( size_t j = 0; j < 50; j++ )
+        {
+            previous.addPoint( i*0.02, j*0.02, previousMin[2] );
+            current.addPoint( i*0.02, j*0.02, currentMin[2] );
+        }
+
+    previous.finalize();
+    current.finalize();
+
+    if ( aabbsOverlap( previousMin, previousMax, currentMin, currentMax ) )
+    {
+        cerr << "  [ERROR] The AABBs of the points of the planes overlap" << endl;
+        return -1;
+    }
+
+    previous.dilate();
+
+    if ( !current.intersectionSize( previous ) )
+    {
+        cerr << "  [ERROR] The dilated plane doesn't overlap with the shifted one" << endl;
+        return -1;
+    }
+
+    if ( !previous.getBounds( previousMin, previousMax ) )
+    {
+        cerr << "  [ERROR] No bounds for a non empty voxel set" << endl;
+        return -1;
+    }
+
+    if ( !aabbsOverlap( previousMin, previousMax, currentMin, currentMax ) )
+    {
+        cerr << "  [ERROR] The bounds of the dilated plane don't overlap "
+             << "with the shifted one" << endl;
+        return -1;
+    }
+
+    // One voxel of dilation around the voxels of the points
+    const float expectedMin[3] = { -voxelSize, -voxelSize, -voxelSize };
+    const float expectedMax[3] = { 21*voxelSize, 21*voxelSize, 2*voxelSize };
+
+    for ( size_t i = 0; i < 3; i++ )
+        if ( ( fabs( previousMin[i] - expectedMin[i] ) > 1e-4 ) ||
+             ( fabs( previousMax[i] - expectedMax[i] ) > 1e-4 ) )
+        {
+            cerr << "  [ERROR] Wrong bounds of the dilated plane along axis "
+                 << i << endl;
+            return -1;
+        }
+
+    OLT::CVoxelSet empty( voxelSize );
+
+    if ( empty.getBounds( previousMin, previousMax ) )
+    {
+        cerr << "  [ERROR] Bounds for an empty voxel set" << endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+//-----------------------------------------------------------
+//                         main
+//-----------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    int N_failed = 0;
+
+    cout << "  [INFO] Tracking of a thin plane shifted less than a voxel" << endl;
+
+    if ( testTrackingThinPlane() )
+        N_failed++;
+
+    if ( N_failed )
+    {
+        cerr << "  [ERROR] " << N_failed << " test(s) failed" << endl;
+        return -1;
+    }
+
+    cout << "  [INFO] All tests passed" << endl;
+
+    return 0;
+}
@@ -46,6 +46,10 @@
 
 #include <mrpt/utils/CFileGZInputStream.h>
 
+#include "CSensorRegistry.hpp"
+#include "CDepthProjector.hpp"
+#include "CVoxelFusionMap.hpp"
+
 using namespace mrpt::utils;
 using namespace mrpt::opengl;
 using namespace mrpt::obs;
@@ -74,10 +78,16 @@ size_t N_limitOfObs = std::numeric_limits<size_t>::max();
 size_t N_lowerLimitOfObs = 0;
 size_t decimate = 0;
 float distBetweenPoints = 0.02;
+float fusionVoxelSize = 0; // Fuse points per voxel of this size if > 0
 float pointSize = 3;
 bool equalizeRGBDHist = false;
 bool visualize2Dposes = false;
 bool saveAsPlainText = false;
+bool headless = false; // Build the scene without GUI and save it
+string o_sceneFilename; // Output scene file name (<rawlog>.scene by default)
+OLT::CSensorRegistry sensorRegistry; // Camera models of the sensors
+
+const size_t CHUNK_SIZE = 500000; // Max number of points of each point cloud in the scene
 
 //-----------------------------------------------------------
 //
@@ -96,6 +106,7 @@ void showUsageInformation()
             "    -decimate <num>        : Visualize one of each <num> RGBD observations."  << endl <<
             "    -pointSize <num>       : Size of the points for visualization purposes (default 3)."  << endl <<
             "    -distBetweenPoints <num>: Min distance between two points to insert the second one." << endl <<
+            "    -fuse <voxel_size>     : Fuse the points within each voxel, averaging their colours." << endl <<
             "    -step                  : Enable step by step execution." << endl <<
             "    -equalizeRGBDHist      : Enable the equalization of the RGB images." << endl <<
             "    -clear                 : Clear the scene after a step." << endl <<
@@ -103,7 +114,9 @@ void showUsageInformation()
             "    -zUpperLimit           : Remove points with a height higher than this paramter." << endl <<
             "    -limit                 : Sets a limit to the number of obs to process." << endl <<
             "    -lowerLimit            : Sets a lower limit to the number of obs to process." << endl <<
-            "    -saveAsPlainText       : If a scene is loaded, save it as plain text." << endl << endl;
+            "    -saveAsPlainText       : If a scene is loaded, save it as plain text." << endl <<
+            "    -headless              : Build the scene without GUI and save it directly." << endl <<
+            "    -o <scene_file>        : Output scene file (<rawlog>.scene by default)." << endl << endl;
 
 }
 
@@ -184,6 +197,13 @@ int loadParameters(int argc, char* argv[])
 
                     cout << "  [INFO] Point size set to: " << pointSize << endl;
                 }
+                else if ( !strcmp(argv[arg],"-fuse") )
+                {
+                    fusionVoxelSize = atof(argv[arg+1]);
+                    arg += 2;
+
+                    cout << "  [INFO] Fusing points in voxels of size: " << fusionVoxelSize << endl;
+                }
                 else if ( !strcmp(argv[arg],"-distBetweenPoints") )
                 {
                     distBetweenPoints = atof(argv[arg+1]);
@@ -219,6 +239,18 @@ int loadParameters(int argc, char* argv[])
                     N_lowerLimitOfObs = atoi(argv[arg+1]);
                     arg += 2;
                 }
+                else if ( !strcmp(argv[arg], "-headless") )
+                {
+                    headless = true;
+                    arg++;
+
+                    cout << "  [INFO] Building the scene without GUI" << endl;
+                }
+                else if ( !strcmp(argv[arg],"-o") )
+                {
+                    o_sceneFilename = argv[arg+1];
+                    arg += 2;
+                }
                 else if ( !strcmp(argv[arg],"-zUpperLimit") )
                 {
                     zUpperLimit = atof(argv[arg+1]);
@@ -240,6 +272,8 @@ int loadParameters(int argc, char* argv[])
 
         return -1;
     }
+
+    return 1;
 }
 
 
@@ -277,6 +311,131 @@ void visualizeScene()
 }
 
 
+//-----------------------------------------------------------
+//
+//                   insertCloudIntoChunk
+//
+//-----------------------------------------------------------
+
+// Append the points of an observation to a point cloud of the scene. Points
+// higher than zUpperLimit are not inserted.
+void insertCloudIntoChunk( const pcl::PointCloud<pcl::PointXYZRGB> &cloud,
+                           CPointCloudColoured &chunk )
+{
+    // As CColouredPointsMap::loadFromRangeScan(), skip points closer than
+    // distBetweenPoints to the last inserted one
+    const float minDist2 = distBetweenPoints*distBetweenPoints;
+    float lastX = 0, lastY = 0, lastZ = 0;
+    bool first = true;
+
+    chunk.reserve( chunk.size() + cloud.size() );
+
+    for ( size_t i = 0; i < cloud.size(); i++ )
+    {
+        const pcl::PointXYZRGB &point = cloud.points[i];
+
+        if ( point.z > zUpperLimit )
+            continue;
+
+        if ( !first )
+        {
+            float dx = point.x - lastX, dy = point.y - lastY, dz = point.z - lastZ;
+
+            if ( dx*dx + dy*dy + dz*dz < minDist2 )
+                continue;
+        }
+
+        chunk.push_back( point.x, point.y, point.z,
+                         point.r/255.f, point.g/255.f, point.b/255.f );
+
+        lastX = point.x; lastY = point.y; lastZ = point.z;
+        first = false;
+    }
+}
+
+
+//-----------------------------------------------------------
+//
+//                   lockScene / unlockScene
+//
+//-----------------------------------------------------------
+
+// The scene is shared with the 3D window, if any (not in headless mode)
+
+void lockScene()
+{
+    if ( !win3D.null() )
+        win3D->get3DSceneAndLock();
+}
+
+void unlockScene()
+{
+    if ( !win3D.null() )
+    {
+        win3D->unlockAccess3DScene();
+        win3D->repaint();
+    }
+}
+
+
+//-----------------------------------------------------------
+//
+//                   fuseCloudIntoChunks
+//
+//-----------------------------------------------------------
+
+// Fuse the points of an observation into the voxel map, and show the
+// changes. The point of voxel i is the (i % CHUNK_SIZE)-th one of chunk
+// i / CHUNK_SIZE, so new voxels are appended and the others are updated.
+void fuseCloudIntoChunks( const pcl::PointCloud<pcl::PointXYZRGB> &cloud,
+                          OLT::CVoxelFusionMap &fusionMap,
+                          vector<CPointCloudColouredPtr> &v_chunks )
+{
+    const size_t N_previous = fusionMap.size();
+    vector<size_t> v_updated; // Previous voxels changed by this observation
+
+    for ( size_t i = 0; i < cloud.size(); i++ )
+    {
+        const pcl::PointXYZRGB &point = cloud.points[i];
+
+        if ( point.z > zUpperLimit )
+            continue;
+
+        size_t index = fusionMap.insertPoint( point.x, point.y, point.z,
+                                              point.r/255.f, point.g/255.f, point.b/255.f );
+
+        if ( index < N_previous )
+            v_updated.push_back( index );
+    }
+
+    std::sort( v_updated.begin(), v_updated.end() );
+    v_updated.erase( std::unique( v_updated.begin(), v_updated.end() ), v_updated.end() );
+
+    float x, y, z, R, G, B;
+
+    for ( size_t i = 0; i < v_updated.size(); i++ )
+    {
+        fusionMap.getPoint( v_updated[i], x, y, z, R, G, B );
+        v_chunks[v_updated[i]/CHUNK_SIZE]->setPoint( v_updated[i] % CHUNK_SIZE,
+                    CPointCloudColoured::TPointColour(x,y,z,R,G,B) );
+    }
+
+    for ( size_t index = N_previous; index < fusionMap.size(); index++ )
+    {
+        if ( v_chunks.empty() || ( v_chunks.back()->size() >= CHUNK_SIZE ) )
+        {
+            v_chunks.push_back( CPointCloudColoured::Create() );
+            v_chunks.back()->setPointSize(pointSize);
+            v_chunks.back()->reserve(CHUNK_SIZE);
+            scene->insert( v_chunks.back() );
+        }
+
+        fusionMap.getPoint( index, x, y, z, R, G, B );
+        v_chunks.back()->push_back( x, y, z, R, G, B );
+    }
+}
+
+
 //-----------------------------------------------------------
 //
 //                       buildScene
@@ -312,51 +471,63 @@ void buildScene()
     //
     // Set 3D window and visualization objects
 
-    // Get rawlog name
-    vector<string> tokens;
-    mrpt::system::tokenize(i_rawlogFileName,"/",tokens);
+    if ( headless )
+        scene = COpenGLScene::Create();
+    else
+    {
+        // Get rawlog name
+        vector<string> tokens;
+        mrpt::system::tokenize(i_rawlogFileName,"/",tokens);
 
-    win3D = gui::CDisplayWindow3DPtr( new gui::CDisplayWindow3D() );
-    win3D->setWindowTitle(format("Building reconstruction visualization of %s",tokens[tokens.size()-1].c_str()));
+        win3D = gui::CDisplayWindow3DPtr( new gui::CDisplayWindow3D() );
+        win3D->setWindowTitle(format("Building reconstruction visualization of %s",tokens[tokens.size()-1].c_str()));
 
-    win3D->resize(400,300);
+        win3D->resize(400,300);
 
-    win3D->setCameraAzimuthDeg(140);
-    win3D->setCameraElevationDeg(20);
-    win3D->setCameraZoom(6.0);
-    win3D->setCameraPointingToPoint(2.5,0,0);
+        win3D->setCameraAzimuthDeg(140);
+        win3D->setCameraElevationDeg(20);
+        win3D->setCameraZoom(6.0);
+        win3D->setCameraPointingToPoint(2.5,0,0);
 
-    scene = win3D->get3DSceneAndLock();
+        scene = win3D->get3DSceneAndLock();
+    }
 
     opengl::CGridPlaneXYPtr obj = opengl::CGridPlaneXY::Create(-7,7,-7,7,0,1);
     obj->setColor(0.7,0.7,0.7);
     obj->setLocation(0,0,0);
     scene->insert( obj );
 
-    mrpt::opengl::CPointCloudColouredPtr gl_points = mrpt::opengl::CPointCloudColoured::Create();
-    gl_points->setPointSize(pointSize);
-    CColouredPointsMap colouredMap;
-    colouredMap.colorScheme.scheme = CColouredPointsMap::cmFromIntensityImage;
-    colouredMap.insertionOptions.minDistBetweenLaserPoints = distBetweenPoints;
-    //colouredMap.insertionOptions.fuseWithExisting = true;
+    // Points are appended to the last of a set of point clouds (chunks), so
+    // each observation is only inserted once, and the chunks are kept small
+    // enough to not stall the window when one of them changes
 
-    scene->insert( gl_points );
+    vector<CPointCloudColouredPtr> v_chunks;
+    size_t N_points = 0;
 
-    win3D->unlockAccess3DScene();
+    // Or, if enabled, points are fused per voxel into a single map
+
+    OLT::CVoxelFusionMap fusionMap( fusionVoxelSize );
+
+    unlockScene();
 
     //
     // Set 2D window
 
-    if ( visualize2Dposes )
+    if ( visualize2Dposes && !headless )
     {
         win = gui::CDisplayWindowPlotsPtr( new gui::CDisplayWindowPlots("2D poses localization") );
         win->hold_on();
     }
 
+    OLT::CDepthProjector projector;
+    projector.setPermuteAxes(false);
+    projector.setOrganized(false);
+
     //
     // Let's go!
 
-    mrpt::system::sleep(3000);
+    if ( !headless )
+        mrpt::system::sleep(3000);
 
     size_t N_inserted_point_clouds = 0;
 
@@ -396,17 +567,22 @@ void buildScene()
         CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
         obs3D->load();
 
-        if ( !obs3D->hasPoints3D )
-            obs3D->project3DPointsFromDepthImage();
-
         if (equalizeRGBDHist)
             obs3D->intensityImage.equalizeHistInPlace();
 
+        // Coloured point cloud in the robot frame, without null measurements
+        const OLT::TRGBDCameraModel &model = sensorRegistry[sensorRegistry.registerFromObs(*obs3D)];
+
+        pcl::PointCloud<pcl::PointXYZRGB> cloud;
+        projector.project( *obs3D, model, cloud );
+
         CPose3D pose;
         obs3D->getSensorPose( pose );
         cout << "    Sensor " << obs3D->sensorLabel << " index "
              << obsIndex << " pose: " << pose << endl;
 
+        lockScene();
+
         // Clear previous point clouds?
         if ( clearAfterStep )
         {
@@ -415,21 +591,38 @@ void buildScene()
                                               sensors_to_use.end(),obs->sensorLabel));
             if ( !index )
             {
-                colouredMap.clear();
-                colouredMap.loadFromRangeScan( *obs3D );
+                for ( size_t i = 0; i < v_chunks.size(); i++ )
+                    scene->removeObject( v_chunks[i] );
+
+                v_chunks.clear();
+                N_points = 0;
+
+                fusionMap.reset( fusionVoxelSize );
             }
         }
+
+        if ( fusionVoxelSize > 0 )
+        {
+            fuseCloudIntoChunks( cloud, fusionMap, v_chunks );
+
+            N_points = fusionMap.size();
+        }
         else
         {
-            CColouredPointsMap localColouredMap;
-            localColouredMap.colorScheme.scheme = CColouredPointsMap::cmFromIntensityImage;
-            localColouredMap.insertionOptions.minDistBetweenLaserPoints = distBetweenPoints;
-            localColouredMap.loadFromRangeScan( *obs3D );
+            if ( v_chunks.empty() || ( v_chunks.back()->size() >= CHUNK_SIZE ) )
+            {
+                v_chunks.push_back( CPointCloudColoured::Create() );
+                v_chunks.back()->setPointSize(pointSize);
+                scene->insert( v_chunks.back() );
+            }
+
+            size_t N_chunkPoints = v_chunks.back()->size();
+
+            insertCloudIntoChunk( cloud, *v_chunks.back() );
 
-            colouredMap.addFrom( localColouredMap );
+            N_points += v_chunks.back()->size() - N_chunkPoints;
         }
 
-        size_t N_points = colouredMap.size();
         cout << "    Points in the map: " << N_points << endl;
 
         CVectorDouble coords,x,y;
@@ -438,22 +631,12 @@ void buildScene()
         y.push_back( coords[1] );
         CPoint3D point((double)coords[0], (double)coords[1], (double)coords[2]);
 
-        if ( visualize2Dposes )
+        if ( visualize2Dposes && !headless )
         {
             // Plot sensor pose into the 2D window
             win->plot(x,y,"b.4");
         }
 
-        // Plot point cloud into the 3D window
-        scene = win3D->get3DSceneAndLock();
-
-        gl_points->loadFromPointsMap( &colouredMap );
-
-        // Remove points with a z higher than a given one
-        for ( size_t i = 0; i < N_points; i++ )
-            if ( gl_points->getPointf(i).z > zUpperLimit )
-                gl_points->setPoint_fast(i,0,0,0);
-
         // Show spheres representing the observation poses?
         if ( showPoses )
         {
@@ -464,11 +647,10 @@ void buildScene()
 
         N_inserted_point_clouds++;
 
-        win3D->unlockAccess3DScene();
-        win3D->repaint();
+        unlockScene();
 
         // Step by step execution?
-        if ( stepByStepExecution )
+        if ( stepByStepExecution && !headless )
             win3D->waitForKey();
     }
 
@@ -484,13 +666,53 @@ void buildScene()
 
 void saveSceneToFile()
 {
-    string sceneFile;
-    sceneFile.assign( i_rawlogFileName.begin(), i_rawlogFileName.end()-7 );
-    sceneFile += ".scene";
+    string sceneFile = o_sceneFilename;
+
+    if ( sceneFile.empty() )
+    {
+        sceneFile.assign( i_rawlogFileName.begin(), i_rawlogFileName.end()-7 );
+        sceneFile += ".scene";
+    }
 
     cout << "  [INFO] Saving to scene file " << sceneFile;
     cout.flush();
 
+    // Scene files have a single point cloud, so merge the chunks
+
+    lockScene();
+
+    vector<CPointCloudColouredPtr> v_chunks;
+    size_t N_points = 0;
+
+    for ( CPointCloudColouredPtr chunk = scene->getByClass<CPointCloudColoured>(0);
+          chunk.present();
+          chunk = scene->getByClass<CPointCloudColoured>(v_chunks.size()) )
+    {
+        v_chunks.push_back( chunk );
+        N_points += chunk->size();
+    }
+
+    if ( v_chunks.size() > 1 )
+    {
+        CPointCloudColouredPtr gl_points = CPointCloudColoured::Create();
+        gl_points->setPointSize(pointSize);
+        gl_points->reserve(N_points);
+
+        for ( size_t i = 0; i < v_chunks.size(); i++ )
+        {
+            CPointCloudColoured::const_iterator it;
+
+            for ( it = v_chunks[i]->begin(); it != v_chunks[i]->end(); it++ )
+                gl_points->push_back( it->x, it->y, it->z, it->R, it->G, it->B );
+
+            scene->removeObject( v_chunks[i] );
+        }
+
+        scene->insert( gl_points );
+    }
+
+    unlockScene();
+
     scene->saveToFile( sceneFile );
     cout << " ... done" << endl;
 
@@ -532,7 +754,12 @@ int main(int argc, char* argv[])
             //
             // Decide if save the scene or not
 
-            if ( !win3D.null() )
+            if ( headless )
+            {
+                if ( !scene.null() )
+                    saveSceneToFile();
+            }
+            else if ( !win3D.null() )
             {
                 cout << "  [INFO] Press 's' to save the scene or other key to end the program." << endl;
                 while ( win3D->isOpen() && !win3D->keyHit() )
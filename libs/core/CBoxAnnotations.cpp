@@ -0,0 +1,187 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+#include "CBoxAnnotations.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <mrpt/opengl/CBox.h>
+#include <mrpt/system/filesystem.h>
+
+using namespace OLT;
+using namespace mrpt::math;
+using namespace mrpt::opengl;
+using namespace std;
+
+
+//-----------------------------------------------------------
+//
+//                    CBoxAnnotations
+//
+//-----------------------------------------------------------
+
+// Format of the file, after the header lines starting with '#':
+//   [number_of_boxes]
+//   [box_1_label]
+//   [x] [y] [z] [yaw] [pitch] [roll] [c1_x] [c1_y] [c1_z] [c2_x] [c2_y] [c2_z]
+//   ...
+
+string CBoxAnnotations::getFileName( const string &sceneFile )
+{
+    return mrpt::system::fileNameChangeExtension( sceneFile, "boxes" );
+}
+
+bool CBoxAnnotations::exists( const string &sceneFile )
+{
+    return mrpt::system::fileExists( getFileName(sceneFile) );
+}
+
+int CBoxAnnotations::save( const string &sceneFile,
+                           const vector<TBoxAnnotation> &boxes )
+{
+    const string fileName = getFileName( sceneFile );
+    const string tmpFileName = fileName + ".tmp";
+
+    ofstream file( tmpFileName.c_str() );
+
+    if ( !file.is_open() )
+    {
+        cerr << "  [ERROR] Couldn't create the boxes file " << fileName << endl;
+        return -1;
+    }
+
+    file << "# Boxes labelled in " << mrpt::system::extractFileName(sceneFile) << endl;
+    file << "# [label] and then [x y z yaw pitch roll] [corner1 x y z] [corner2 x y z]" << endl;
+    file << boxes.size() << endl;
+
+    file << setprecision(9);
+
+    for ( size_t i = 0; i < boxes.size(); i++ )
+    {
+        const TBoxAnnotation &box = boxes[i];
+
+        file << box.label << endl;
+        file << box.pose.x << " " << box.pose.y << " " << box.pose.z << " "
+             << box.pose.yaw << " " << box.pose.pitch << " " << box.pose.roll << " "
+             << box.corner1.x << " " << box.corner1.y << " " << box.corner1.z << " "
+             << box.corner2.x << " " << box.corner2.y << " " << box.corner2.z << endl;
+    }
+
+    file.close();
+
+    if ( file.fail() || rename( tmpFileName.c_str(), fileName.c_str() ) )
+    {
+        cerr << "  [ERROR] While writing the boxes file " << fileName << endl;
+        remove( tmpFileName.c_str() );
+        return -1;
+    }
+
+    return 0;
+}
+
+int CBoxAnnotations::load( const string &sceneFile,
+                           vector<TBoxAnnotation> &boxes )
+{
+    boxes.clear();
+
+    const string fileName = getFileName( sceneFile );
+
+    ifstream file( fileName.c_str() );
+
+    if ( !file.is_open() )
+        return -1;
+
+    string line;
+
+    while ( ( file >> ws ) && ( file.peek() == '#' ) )
+        getline( file, line );
+
+    size_t N_boxes;
+
+    if ( !( file >> N_boxes ) )
+    {
+        cerr << "  [ERROR] Invalid boxes file " << fileName << endl;
+        return -1;
+    }
+
+    boxes.resize( N_boxes );
+
+    for ( size_t i = 0; i < N_boxes; i++ )
+    {
+        TBoxAnnotation &box = boxes[i];
+
+        file >> ws;
+        getline( file, box.label );
+
+        if ( !( file >> box.pose.x >> box.pose.y >> box.pose.z
+                     >> box.pose.yaw >> box.pose.pitch >> box.pose.roll
+                     >> box.corner1.x >> box.corner1.y >> box.corner1.z
+                     >> box.corner2.x >> box.corner2.y >> box.corner2.z ) )
+        {
+            cerr << "  [ERROR] Invalid box " << i << " in the boxes file " << fileName << endl;
+            boxes.clear();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void CBoxAnnotations::getFromScene( const COpenGLScene &scene,
+                                    vector<TBoxAnnotation> &boxes )
+{
+    boxes.clear();
+
+    for ( CBoxPtr box = scene.getByClass<CBox>(0);
+          !box.null();
+          box = scene.getByClass<CBox>(boxes.size()) )
+    {
+        TBoxAnnotation annotation;
+
+        annotation.label = box->getName();
+        annotation.pose  = box->getPose();
+        box->getBoxCorners( annotation.corner1, annotation.corner2 );
+
+        boxes.push_back( annotation );
+    }
+}
+
+int CBoxAnnotations::loadSceneBoxes( const string &sceneFile,
+                                     vector<TBoxAnnotation> &boxes )
+{
+    if ( exists(sceneFile) )
+        return load( sceneFile, boxes );
+
+    COpenGLScene scene;
+
+    if ( !scene.loadFromFile( sceneFile ) )
+    {
+        boxes.clear();
+        return -1;
+    }
+
+    getFromScene( scene, boxes );
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+#ifndef _OLT_BOX_ANNOTATIONS_
+#define _OLT_BOX_ANNOTATIONS_
+
+#include "core.hpp"
+
+#include <string>
+#include <vector>
+#include <mrpt/math/lightweight_geom_data.h>
+#include <mrpt/opengl/COpenGLScene.h>
+
+
+namespace OLT
+{
+    /** Bounding box labelled in a scene. */
+
+    struct TBoxAnnotation
+    {
+        std::string             label;  // e.g. scourer, or scourer_1 if working with instances
+        mrpt::math::TPose3D     pose;   // Pose of the box in the scene
+        mrpt::math::TPoint3D    corner1;// Opposite corners, in the box frame
+        mrpt::math::TPoint3D    corner2;
+    };
+
+    /** Storage of the boxes labelled in a scene in a small plain text file
+      * next to it (<scene>.boxes), so they are saved and loaded without
+      * serializing the point cloud of the scene. Scenes labelled before the
+      * file existed keep working: their boxes are then read from the CBox
+      * objects of the scene. When both exist, the file prevails. */
+
+    class CBoxAnnotations
+    {
+    public:
+
+        static std::string getFileName( const std::string &sceneFile );
+
+        static bool exists( const std::string &sceneFile );
+
+        static int save( const std::string &sceneFile,
+                         const std::vector<TBoxAnnotation> &boxes );
+
+        /** Load the boxes from the file of a scene. */
+        static int load( const std::string &sceneFile,
+                         std::vector<TBoxAnnotation> &boxes );
+
+        /** Get the boxes from the CBox objects of an already loaded scene. */
+        static void getFromScene( const mrpt::opengl::COpenGLScene &scene,
+                                  std::vector<TBoxAnnotation> &boxes );
+
+        /** Load the boxes of a labelled scene from its file or, if it has
+          * none, from the scene itself. */
+        static int loadSceneBoxes( const std::string &sceneFile,
+                                   std::vector<TBoxAnnotation> &boxes );
+    };
+}
+
+
+#endif
@@ -0,0 +1,227 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#include "CDepthProjector.hpp"
+
+#include <limits>
+#include <mrpt/math/CMatrixFixedNumeric.h>
+
+using namespace OLT;
+using namespace std;
+
+using namespace mrpt;
+using namespace mrpt::obs;
+using namespace mrpt::math;
+using namespace mrpt::utils;
+using namespace mrpt::poses;
+
+
+namespace
+{
+    // Shared kernel of the XYZ and XYZRGB projections. Every pixel only needs
+    // its two ray coefficients and its depth, so the loop vectorizes.
+    template <class POINT>
+    int projectPoints( const CObservation3DRangeScan &obs,
+                       const TRGBDCameraModel &model,
+                       const Eigen::Matrix4f &T,
+                       pcl::PointCloud<POINT> &cloud )
+    {
+        const size_t rows = obs.rangeImage.rows();
+        const size_t cols = obs.rangeImage.cols();
+        const int N_pixels = rows*cols;
+
+        if ( !obs.hasRangeImage || ( model.rayY.size() != (size_t)N_pixels ) )
+        {
+            cerr << "  [ERROR] The range image of " << obs.sensorLabel
+                 << " doesn't match the size of its camera model." << endl;
+            return 0;
+        }
+
+        cloud.resize(N_pixels);
+        cloud.width    = cols;
+        cloud.height   = rows;
+        cloud.is_dense = false;
+
+        const float *depth = obs.rangeImage.data();
+        const float *rayY  = &model.rayY[0];
+        const float *rayZ  = &model.rayZ[0];
+        POINT *points = &cloud.points[0];
+
+        const float t00 = T(0,0), t01 = T(0,1), t02 = T(0,2), t03 = T(0,3);
+        const float t10 = T(1,0), t11 = T(1,1), t12 = T(1,2), t13 = T(1,3);
+        const float t20 = T(2,0), t21 = T(2,1), t22 = T(2,2), t23 = T(2,3);
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for ( int i = 0; i < N_pixels; i++ )
+        {
+            const float d = depth[i];
+            const bool valid = ( d > 0 );
+
+            points[i].x = valid ? d*(t00 + t01*rayY[i] + t02*rayZ[i]) + t03 : nan;
+            points[i].y = valid ? d*(t10 + t11*rayY[i] + t12*rayZ[i]) + t13 : nan;
+            points[i].z = valid ? d*(t20 + t21*rayY[i] + t22*rayZ[i]) + t23 : nan;
+        }
+
+        return 1;
+    }
+
+    // Remove the points from null depths of an organized cloud
+    template <class POINT>
+    void makeDense( pcl::PointCloud<POINT> &cloud )
+    {
+        size_t N_valid = 0;
+
+        for ( size_t i = 0; i < cloud.points.size(); i++ )
+            if ( pcl_isfinite(cloud.points[i].x) )
+                cloud.points[N_valid++] = cloud.points[i];
+
+        cloud.points.resize(N_valid);
+        cloud.width    = N_valid;
+        cloud.height   = 1;
+        cloud.is_dense = true;
+    }
+}
+
+
+//-----------------------------------------------------------
+//
+//                      CDepthProjector
+//
+//-----------------------------------------------------------
+
+Eigen::Matrix4f CDepthProjector::getAxisPermutation()
+{
+    Eigen::Matrix4f transMat;
+
+    transMat(0,0)=0;    transMat(0,1)=-1;     transMat(0,2)=0;    transMat(0,3)=0;
+    transMat(1,0)=0;    transMat(1,1)=0;      transMat(1,2)=+1;   transMat(1,3)=0;
+    transMat(2,0)=1;    transMat(2,1)=0;      transMat(2,2)=0;    transMat(2,3)=0;
+    transMat(3,0)=0;    transMat(3,1)=0;      transMat(3,2)=0;    transMat(3,3)=1;
+
+    return transMat;
+}
+
+Eigen::Matrix4f CDepthProjector::getTransformation( const CObservation3DRangeScan &obs ) const
+{
+    Eigen::Matrix4f T = Eigen::Matrix4f::Identity();
+
+    if ( m_takeIntoAccountSensorPose )
+    {
+        CMatrixDouble44 pose;
+        obs.sensorPose.getHomogeneousMatrix(pose);
+
+        for ( size_t row = 0; row < 4; row++ )
+            for ( size_t col = 0; col < 4; col++ )
+                T(row,col) = pose(row,col);
+    }
+
+    if ( m_permuteAxes )
+        T = getAxisPermutation()*T;
+
+    return T;
+}
+
+int CDepthProjector::project( const CObservation3DRangeScan &obs,
+                              const TRGBDCameraModel &model,
+                              pcl::PointCloud<pcl::PointXYZ> &cloud ) const
+{
+    if ( !projectPoints(obs,model,getTransformation(obs),cloud) )
+        return 0;
+
+    if ( !m_organized )
+        makeDense(cloud);
+
+    return 1;
+}
+
+int CDepthProjector::project( const CObservation3DRangeScan &obs,
+                              const TRGBDCameraModel &model,
+                              pcl::PointCloud<pcl::PointXYZRGB> &cloud ) const
+{
+    if ( !projectPoints(obs,model,getTransformation(obs),cloud) )
+        return 0;
+
+    //
+    // Colorize the points
+
+    const size_t N_pixels = cloud.points.size();
+    const CImage &img = obs.intensityImage;
+    const bool isColor = img.isColor();
+    const bool hasImage = obs.hasIntensityImage
+            && ( img.getWidth() == model.intensityCols )
+            && ( img.getHeight() == model.intensityRows );
+
+    const float *depth = obs.rangeImage.data();
+
+    for ( size_t i = 0; i < N_pixels; i++ )
+    {
+        pcl::PointXYZRGB &point = cloud.points[i];
+        point.r = point.g = point.b = 255;
+
+        if ( !hasImage || !( depth[i] > 0 ) )
+            continue;
+
+        int col = model.intensityCol[i];
+        int row = model.intensityRow[i];
+
+        // With a translation between both cameras the pixel depends on depth
+        if ( !model.colorizationIsExact )
+        {
+            double qx, qy, qz;
+            model.depthToIntensity.inverseComposePoint(depth[i],depth[i]*model.rayY[i],
+                                                       depth[i]*model.rayZ[i],qx,qy,qz);
+            col = -1;
+
+            if ( qz > 0 )
+            {
+                col = round(model.intensityParams.cx() + model.intensityParams.fx()*qx/qz);
+                row = round(model.intensityParams.cy() + model.intensityParams.fy()*qy/qz);
+
+                if ( ( row < 0 ) || ( row >= (int)model.intensityRows ) ||
+                     ( col >= (int)model.intensityCols ) )
+                    col = -1;
+            }
+        }
+
+        if ( col < 0 )
+            continue;
+
+        const unsigned char *pixel = img.get_unsafe(col,row,0);
+
+        if ( isColor )
+        {
+            point.r = pixel[2];
+            point.g = pixel[1];
+            point.b = pixel[0];
+        }
+        else
+            point.r = point.g = point.b = pixel[0];
+    }
+
+    if ( !m_organized )
+        makeDense(cloud);
+
+    return 1;
+}
@@ -0,0 +1,81 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#ifndef _OLT_DEPTH_PROJECTOR_
+#define _OLT_DEPTH_PROJECTOR_
+
+#include "core.hpp"
+#include "CSensorRegistry.hpp"
+
+#include <Eigen/Dense>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+
+namespace OLT
+{
+    /** Projects the depth image of an RGB-D observation into a PCL point
+      * cloud in a single pass, using the precomputed tables of the camera
+      * model of its sensor. It replaces project3DPointsFromDepthImageInto()
+      * followed by pcl::transformPointCloud() with the axis permutation, and
+      * colouring through CColouredPointsMap::cmFromIntensityImage. */
+
+    class CDepthProjector
+    {
+        bool m_takeIntoAccountSensorPose;
+        bool m_permuteAxes;
+        bool m_organized;
+
+    public:
+
+        /** Default options: points in the robot frame, axes permuted to the
+          * PCL convention and organized clouds (null depths give NaN points). */
+        CDepthProjector() : m_takeIntoAccountSensorPose(true),
+            m_permuteAxes(true), m_organized(true)
+        {}
+
+        /** Axis permutation from MRPT frames (x forward, z up) to the ones
+          * used with PCL through the toolkit (z forward, y up). */
+        static Eigen::Matrix4f getAxisPermutation();
+
+        void setTakeIntoAccountSensorPose( bool take ) { m_takeIntoAccountSensorPose = take; }
+        void setPermuteAxes( bool permute ) { m_permuteAxes = permute; }
+
+        /** If false, points from null depths are removed and the cloud is
+          * returned as an unorganized dense one. */
+        void setOrganized( bool organized ) { m_organized = organized; }
+
+        /** Transformation applied to the points in the sensor frame. */
+        Eigen::Matrix4f getTransformation( const mrpt::obs::CObservation3DRangeScan &obs ) const;
+
+        int project( const mrpt::obs::CObservation3DRangeScan &obs,
+                     const TRGBDCameraModel &model,
+                     pcl::PointCloud<pcl::PointXYZ> &cloud ) const;
+
+        int project( const mrpt::obs::CObservation3DRangeScan &obs,
+                     const TRGBDCameraModel &model,
+                     pcl::PointCloud<pcl::PointXYZRGB> &cloud ) const;
+    };
+}
+
+
+#endif
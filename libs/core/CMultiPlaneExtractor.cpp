@@ -0,0 +1,433 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+#include "CMultiPlaneExtractor.hpp"
+#include "CTaskScheduler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Eigenvalues>
+
+using namespace OLT;
+using namespace std;
+
+
+namespace
+{
+    const size_t BLOCK_WORDS = 512; // Words of the bitmask per task of the full passes
+
+    struct TPlaneHypothesis
+    {
+        float   a, b, c, d;
+        bool    valid;
+    };
+
+    // Sums of the inliers of a plane, relative to a reference point to keep
+    // the precision of the covariance
+    struct TMoments
+    {
+        double  N;
+        double  x, y, z;
+        double  xx, xy, xz, yy, yz, zz;
+
+        TMoments() : N(0), x(0), y(0), z(0), xx(0), xy(0), xz(0), yy(0), yz(0), zz(0)
+        {}
+
+        void add( const TMoments &other )
+        {
+            N += other.N;
+            x += other.x; y += other.y; z += other.z;
+            xx += other.xx; xy += other.xy; xz += other.xz;
+            yy += other.yy; yz += other.yz; zz += other.zz;
+        }
+    };
+
+    // xorshift32, enough to draw samples and hypotheses reproducibly
+    inline uint32_t nextRandom( uint32_t &state )
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+
+        return state;
+    }
+
+    inline TPlaneHypothesis planeFromPoints( const float *x, const float *y, const float *z,
+                                             size_t i1, size_t i2, size_t i3 )
+    {
+        TPlaneHypothesis plane;
+
+        const float u[3] = { x[i2]-x[i1], y[i2]-y[i1], z[i2]-z[i1] };
+        const float v[3] = { x[i3]-x[i1], y[i3]-y[i1], z[i3]-z[i1] };
+
+        plane.a = u[1]*v[2] - u[2]*v[1];
+        plane.b = u[2]*v[0] - u[0]*v[2];
+        plane.c = u[0]*v[1] - u[1]*v[0];
+
+        const float norm = sqrt( plane.a*plane.a + plane.b*plane.b + plane.c*plane.c );
+
+        plane.valid = ( norm > 1e-9f );
+
+        if ( plane.valid )
+        {
+            plane.a /= norm; plane.b /= norm; plane.c /= norm;
+            plane.d = -( plane.a*x[i1] + plane.b*y[i1] + plane.c*z[i1] );
+        }
+
+        return plane;
+    }
+}
+
+
+//-----------------------------------------------------------
+//
+//                   Parallel bodies
+//
+//-----------------------------------------------------------
+
+// Number of points of the sample within the threshold of each hypothesis.
+// The loop is branchless over contiguous arrays so it gets vectorized.
+
+struct CMultiPlaneExtractor::TScoreHypotheses
+{
+    const float                         *x, *y, *z;
+    size_t                              N_points;
+    const vector<TPlaneHypothesis>      &hypotheses;
+    vector<size_t>                      &scores;
+    float                               threshold;
+
+    TScoreHypotheses( const vector<float> &x_, const vector<float> &y_,
+                      const vector<float> &z_, size_t N_points_,
+                      const vector<TPlaneHypothesis> &hypotheses_,
+                      vector<size_t> &scores_, float threshold_ ) :
+        x(&x_[0]), y(&y_[0]), z(&z_[0]), N_points(N_points_),
+        hypotheses(hypotheses_), scores(scores_), threshold(threshold_)
+    {}
+
+    void operator()( size_t h )
+    {
+        const TPlaneHypothesis &plane = hypotheses[h];
+
+        if ( !plane.valid )
+        {
+            scores[h] = 0;
+            return;
+        }
+
+        const float a = plane.a, b = plane.b, c = plane.c, d = plane.d;
+        const float t = threshold;
+
+        size_t count = 0;
+
+        for ( size_t i = 0; i < N_points; i++ )
+            count += ( fabs( a*x[i] + b*y[i] + c*z[i] + d ) <= t );
+
+        scores[h] = count;
+    }
+};
+
+// Moments of the remaining points within the threshold of a plane, per
+// block of the bitmask.
+
+struct CMultiPlaneExtractor::TFitBlock
+{
+    const CMultiPlaneExtractor  &extractor;
+    const TPlaneHypothesis      &plane;
+    const float                 *reference;
+    vector<TMoments>            &moments;
+
+    TFitBlock( const CMultiPlaneExtractor &extractor_, const TPlaneHypothesis &plane_,
+               const float *reference_, vector<TMoments> &moments_ ) :
+        extractor(extractor_), plane(plane_), reference(reference_), moments(moments_)
+    {}
+
+    void operator()( size_t block )
+    {
+        const vector<uint64_t> &remaining = extractor.m_remaining;
+        const size_t lastWord = min( (block+1)*BLOCK_WORDS, remaining.size() );
+
+        TMoments sums;
+
+        for ( size_t w = block*BLOCK_WORDS; w < lastWord; w++ )
+        {
+            for ( uint64_t word = remaining[w]; word; word &= word - 1 )
+            {
+                const size_t i = w*64 + __builtin_ctzll(word);
+
+                const float px = extractor.m_x[i];
+                const float py = extractor.m_y[i];
+                const float pz = extractor.m_z[i];
+
+                if ( fabs( plane.a*px + plane.b*py + plane.c*pz + plane.d ) > extractor.m_distanceThreshold )
+                    continue;
+
+                const double dx = px - reference[0];
+                const double dy = py - reference[1];
+                const double dz = pz - reference[2];
+
+                sums.N++;
+                sums.x += dx; sums.y += dy; sums.z += dz;
+                sums.xx += dx*dx; sums.xy += dx*dy; sums.xz += dx*dz;
+                sums.yy += dy*dy; sums.yz += dy*dz; sums.zz += dz*dz;
+            }
+        }
+
+        moments[block] = sums;
+    }
+};
+
+// Bitmask of the remaining points within the threshold of a plane, per
+// block of the bitmask.
+
+struct CMultiPlaneExtractor::TExtractBlock
+{
+    const CMultiPlaneExtractor  &extractor;
+    const TPlaneHypothesis      &plane;
+    vector<uint64_t>            &inliers;
+    vector<size_t>              &counts;
+
+    TExtractBlock( const CMultiPlaneExtractor &extractor_, const TPlaneHypothesis &plane_,
+                   vector<uint64_t> &inliers_, vector<size_t> &counts_ ) :
+        extractor(extractor_), plane(plane_), inliers(inliers_), counts(counts_)
+    {}
+
+    void operator()( size_t block )
+    {
+        const vector<uint64_t> &remaining = extractor.m_remaining;
+        const size_t lastWord = min( (block+1)*BLOCK_WORDS, remaining.size() );
+        const size_t N_points = extractor.m_x.size();
+
+        const float *x = &extractor.m_x[0];
+        const float *y = &extractor.m_y[0];
+        const float *z = &extractor.m_z[0];
+        const float a = plane.a, b = plane.b, c = plane.c, d = plane.d;
+        const float t = extractor.m_distanceThreshold;
+
+        size_t count = 0;
+
+        for ( size_t w = block*BLOCK_WORDS; w < lastWord; w++ )
+        {
+            inliers[w] = 0;
+
+            if ( !remaining[w] )
+                continue;
+
+            const size_t first = w*64;
+            const size_t N = min( (size_t)64, N_points - first );
+
+            uint64_t bits = 0;
+
+            for ( size_t j = 0; j < N; j++ )
+                bits |= (uint64_t)( fabs( a*x[first+j] + b*y[first+j] + c*z[first+j] + d ) <= t ) << j;
+
+            inliers[w] = bits & remaining[w];
+            count += __builtin_popcountll( inliers[w] );
+        }
+
+        counts[block] = count;
+    }
+};
+
+
+//-----------------------------------------------------------
+//
+//                 CMultiPlaneExtractor
+//
+//-----------------------------------------------------------
+
+CMultiPlaneExtractor::CMultiPlaneExtractor() : m_distanceThreshold(0.05),
+    m_maxIterations(1000), m_minInliers(1000), m_maxPlanes(50),
+    m_sampleSize(50000), m_seed(12345), m_N_remaining(0)
+{
+}
+
+int CMultiPlaneExtractor::segment( const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                                   vector<pcl::PointIndices> &planes,
+                                   vector<pcl::ModelCoefficients> &coefficients )
+{
+    planes.clear();
+    coefficients.clear();
+
+    const size_t N_points = cloud.size();
+
+    m_x.resize( N_points );
+    m_y.resize( N_points );
+    m_z.resize( N_points );
+    m_remaining.assign( ( N_points + 63 ) / 64, 0 );
+    m_N_remaining = 0;
+
+    for ( size_t i = 0; i < N_points; i++ )
+    {
+        const pcl::PointXYZ &point = cloud.points[i];
+
+        m_x[i] = point.x;
+        m_y[i] = point.y;
+        m_z[i] = point.z;
+
+        if ( pcl_isfinite(point.x) && pcl_isfinite(point.y) && pcl_isfinite(point.z) )
+        {
+            m_remaining[i/64] |= (uint64_t)1 << (i%64);
+            m_N_remaining++;
+        }
+    }
+
+    if ( !m_maxIterations || !m_sampleSize )
+        return -1;
+
+    const size_t N_blocks = ( m_remaining.size() + BLOCK_WORDS - 1 ) / BLOCK_WORDS;
+
+    uint32_t state = m_seed ? m_seed : 1;
+
+    vector<size_t>              v_sample;
+    vector<float>               sx, sy, sz;
+    vector<TPlaneHypothesis>    v_hypotheses( m_maxIterations );
+    vector<size_t>              v_scores( m_maxIterations );
+    vector<TMoments>            v_moments( N_blocks );
+    vector<uint64_t>            v_inliers( m_remaining.size() );
+    vector<size_t>              v_counts( N_blocks );
+
+    while ( ( planes.size() < m_maxPlanes ) &&
+            ( m_N_remaining >= max( m_minInliers, (size_t)3 ) ) )
+    {
+        //
+        // Random sample of the remaining points
+
+        v_sample.clear();
+
+        for ( size_t w = 0; w < m_remaining.size(); w++ )
+            for ( uint64_t word = m_remaining[w]; word; word &= word - 1 )
+                v_sample.push_back( w*64 + __builtin_ctzll(word) );
+
+        const size_t N_sample = min( m_sampleSize, v_sample.size() );
+
+        for ( size_t i = 0; i < N_sample; i++ )
+            swap( v_sample[i], v_sample[ i + nextRandom(state) % ( v_sample.size() - i ) ] );
+
+        sx.resize( N_sample );
+        sy.resize( N_sample );
+        sz.resize( N_sample );
+
+        for ( size_t i = 0; i < N_sample; i++ )
+        {
+            sx[i] = m_x[v_sample[i]];
+            sy[i] = m_y[v_sample[i]];
+            sz[i] = m_z[v_sample[i]];
+        }
+
+        //
+        // Score the hypotheses against the sample
+
+        for ( size_t h = 0; h < m_maxIterations; h++ )
+        {
+            const size_t i1 = nextRandom(state) % N_sample;
+            const size_t i2 = nextRandom(state) % N_sample;
+            const size_t i3 = nextRandom(state) % N_sample;
+
+            v_hypotheses[h] = planeFromPoints( &sx[0], &sy[0], &sz[0], i1, i2, i3 );
+        }
+
+        TScoreHypotheses score( sx, sy, sz, N_sample, v_hypotheses, v_scores, m_distanceThreshold );
+        parallelFor( 0, m_maxIterations, score, 16 );
+
+        const size_t best = max_element( v_scores.begin(), v_scores.end() ) - v_scores.begin();
+
+        const double expectedInliers = v_scores[best] * (double)m_N_remaining / N_sample;
+
+        if ( !v_hypotheses[best].valid || ( expectedInliers < m_minInliers ) )
+            break;
+
+        //
+        // Refit the plane to all the inliers of the best hypothesis
+
+        const float reference[3] = { sx[0], sy[0], sz[0] };
+
+        TFitBlock fit( *this, v_hypotheses[best], reference, v_moments );
+        parallelFor( 0, N_blocks, fit );
+
+        TMoments sums;
+
+        for ( size_t block = 0; block < N_blocks; block++ )
+            sums.add( v_moments[block] );
+
+        if ( sums.N < 3 )
+            break;
+
+        Eigen::Vector3d mean( sums.x/sums.N, sums.y/sums.N, sums.z/sums.N );
+        Eigen::Matrix3d covariance;
+        covariance << sums.xx/sums.N, sums.xy/sums.N, sums.xz/sums.N,
+                      sums.xy/sums.N, sums.yy/sums.N, sums.yz/sums.N,
+                      sums.xz/sums.N, sums.yz/sums.N, sums.zz/sums.N;
+        covariance -= mean*mean.transpose();
+
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver( covariance );
+        const Eigen::Vector3d normal = solver.eigenvectors().col(0); // Smallest eigenvalue
+
+        TPlaneHypothesis plane;
+        plane.a = normal(0);
+        plane.b = normal(1);
+        plane.c = normal(2);
+        plane.d = -( normal(0)*( mean(0) + reference[0] ) +
+                     normal(1)*( mean(1) + reference[1] ) +
+                     normal(2)*( mean(2) + reference[2] ) );
+        plane.valid = true;
+
+        //
+        // Extract its inliers
+
+        TExtractBlock extract( *this, plane, v_inliers, v_counts );
+        parallelFor( 0, N_blocks, extract );
+
+        size_t N_inliers = 0;
+
+        for ( size_t block = 0; block < N_blocks; block++ )
+            N_inliers += v_counts[block];
+
+        if ( N_inliers < m_minInliers )
+            break;
+
+        pcl::PointIndices indices;
+        indices.indices.reserve( N_inliers );
+
+        for ( size_t w = 0; w < m_remaining.size(); w++ )
+        {
+            m_remaining[w] &= ~v_inliers[w];
+
+            for ( uint64_t word = v_inliers[w]; word; word &= word - 1 )
+                indices.indices.push_back( w*64 + __builtin_ctzll(word) );
+        }
+
+        m_N_remaining -= N_inliers;
+
+        pcl::ModelCoefficients coeffs;
+        coeffs.values.resize(4);
+        coeffs.values[0] = plane.a;
+        coeffs.values[1] = plane.b;
+        coeffs.values[2] = plane.c;
+        coeffs.values[3] = plane.d;
+
+        planes.push_back( indices );
+        coefficients.push_back( coeffs );
+    }
+
+    return 0;
+}
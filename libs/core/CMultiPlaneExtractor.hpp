@@ -0,0 +1,94 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+#ifndef _OLT_MULTI_PLANE_EXTRACTOR_
+#define _OLT_MULTI_PLANE_EXTRACTOR_
+
+#include "core.hpp"
+
+#include <vector>
+#include <stdint.h>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+#include <pcl/ModelCoefficients.h>
+
+
+namespace OLT
+{
+    /** Sequential RANSAC extraction of the dominant planes of an unorganized
+      * point cloud (e.g. a whole scene). The points not yet assigned to a
+      * plane are kept in a bitmask, so removing the inliers of a plane is
+      * just clearing bits. Each round, the hypotheses are scored in parallel
+      * by the task scheduler against a random sample of the remaining
+      * points, stored as contiguous coordinate arrays the compiler
+      * vectorizes. The best one is then refitted by least squares to all
+      * its inliers. Results don't depend on the number of threads. */
+
+    class CMultiPlaneExtractor
+    {
+        float                   m_distanceThreshold;
+        size_t                  m_maxIterations;
+        size_t                  m_minInliers;
+        size_t                  m_maxPlanes;
+        size_t                  m_sampleSize;
+        uint32_t                m_seed;
+
+        std::vector<float>      m_x, m_y, m_z;  // Coordinates of the cloud
+        std::vector<uint64_t>   m_remaining;    // Bit per point not in a plane yet
+        size_t                  m_N_remaining;
+
+        struct TScoreHypotheses;
+        struct TFitBlock;
+        struct TExtractBlock;
+
+    public:
+
+        CMultiPlaneExtractor();
+
+        void setDistanceThreshold( float threshold ) { m_distanceThreshold = threshold; }
+        void setMaxIterations( size_t iterations ) { m_maxIterations = iterations; }
+        void setMinInliers( size_t inliers ) { m_minInliers = inliers; }
+        void setMaxPlanes( size_t planes ) { m_maxPlanes = planes; }
+        void setSampleSize( size_t size ) { m_sampleSize = size; }
+        void setSeed( uint32_t seed ) { m_seed = seed; }
+
+        /** Extract planes until the best one has less than the minimum number
+          * of inliers or the maximum number of planes is reached. NaN points
+          * are ignored. Coefficients are [a b c d], with a unit normal. */
+        int segment( const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                     std::vector<pcl::PointIndices> &planes,
+                     std::vector<pcl::ModelCoefficients> &coefficients );
+
+        /** Whether a point of the last segmented cloud is in no plane. */
+        bool isRemaining( size_t index ) const
+        {
+            return ( m_remaining[index/64] >> (index%64) ) & 1;
+        }
+
+        size_t getNumberOfRemainingPoints() const { return m_N_remaining; }
+    };
+}
+
+
+#endif
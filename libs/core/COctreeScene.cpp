@@ -0,0 +1,423 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+#include "COctreeScene.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <queue>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace OLT;
+using namespace std;
+
+
+namespace
+{
+    const uint32_t OCTREE_MAGIC   = 0x4F544C4F; // "OLTO"
+    const uint32_t OCTREE_VERSION = 1;
+
+    const int      SAMPLE_GRID    = 32;   // Cells per axis of the subsample of inner nodes
+    const int      MAX_DEPTH      = 20;
+
+    struct THeader
+    {
+        uint32_t    magic;
+        uint32_t    version;
+        uint64_t    N_nodes;
+        uint64_t    N_points;
+        float       pointSize;
+        uint32_t    padding;
+    };
+
+    struct TBuilder
+    {
+        vector<COctreeScene::TPoint>   &points;
+        vector<COctreeScene::TNode>    nodes;
+        vector<COctreeScene::TPoint>   buffer;
+        vector<uint32_t>               cellKeys;
+        vector<uint8_t>                classes; // 0 if in the subsample, 1+octant otherwise
+        size_t                         maxLeafPoints;
+
+        TBuilder( vector<COctreeScene::TPoint> &points_, size_t maxLeafPoints_ ) :
+            points( points_ ), maxLeafPoints( maxLeafPoints_ )
+        {}
+
+        int32_t buildNode( size_t begin, size_t end,
+                           const float center[3], float halfSize, int depth );
+    };
+
+    struct TSortByCell
+    {
+        const vector<uint32_t> &keys;
+
+        TSortByCell( const vector<uint32_t> &keys_ ) : keys( keys_ ) {}
+
+        bool operator()( size_t i1, size_t i2 ) const
+        {
+            return ( keys[i1] < keys[i2] ) || ( ( keys[i1] == keys[i2] ) && ( i1 < i2 ) );
+        }
+    };
+
+    inline int getCell( float coord, float min, float invCellSize )
+    {
+        int cell = (int)( ( coord - min ) * invCellSize );
+        return ( cell < 0 ) ? 0 : ( ( cell >= SAMPLE_GRID ) ? SAMPLE_GRID-1 : cell );
+    }
+}
+
+
+//-----------------------------------------------------------
+//
+//                        TBuilder
+//
+//-----------------------------------------------------------
+
+int32_t TBuilder::buildNode( size_t begin, size_t end,
+                             const float center[3], float halfSize, int depth )
+{
+    const size_t N_points = end - begin;
+    const int32_t nodeIndex = nodes.size();
+
+    COctreeScene::TNode node;
+    memcpy( node.center, center, sizeof(node.center) );
+    node.halfSize   = halfSize;
+    node.firstPoint = begin;
+    node.N_points   = N_points;
+    node.padding    = 0;
+
+    for ( size_t child = 0; child < 8; child++ )
+        node.children[child] = -1;
+
+    nodes.push_back( node );
+
+    if ( ( N_points <= maxLeafPoints ) || ( depth >= MAX_DEPTH ) )
+        return nodeIndex;
+
+    //
+    // Keep the first point falling into each cell of a coarse grid over the
+    // node, and classify the remaining ones by octant
+
+    const float invCellSize = SAMPLE_GRID / ( 2*halfSize );
+    const float min[3] = { center[0]-halfSize, center[1]-halfSize, center[2]-halfSize };
+
+    cellKeys.resize( N_points );
+    classes.resize( N_points );
+
+    vector<size_t> order( N_points );
+
+    for ( size_t i = 0; i < N_points; i++ )
+    {
+        const COctreeScene::TPoint &point = points[begin+i];
+
+        cellKeys[i] = ( getCell(point.x,min[0],invCellSize)*SAMPLE_GRID
+                        + getCell(point.y,min[1],invCellSize) )*SAMPLE_GRID
+                        + getCell(point.z,min[2],invCellSize);
+
+        classes[i] = 1 + ( ( point.x >= center[0] ) ? 1 : 0 )
+                       + ( ( point.y >= center[1] ) ? 2 : 0 )
+                       + ( ( point.z >= center[2] ) ? 4 : 0 );
+        order[i] = i;
+    }
+
+    sort( order.begin(), order.end(), TSortByCell( cellKeys ) );
+
+    for ( size_t i = 0; i < N_points; i++ )
+        if ( !i || ( cellKeys[order[i]] != cellKeys[order[i-1]] ) )
+            classes[order[i]] = 0;
+
+    //
+    // Counting sort of the points by class, so the subsample and the points
+    // of each child end up contiguous
+
+    size_t counts[9] = { 0 };
+
+    for ( size_t i = 0; i < N_points; i++ )
+        counts[classes[i]]++;
+
+    size_t offsets[9];
+    offsets[0] = 0;
+
+    for ( size_t c = 1; c < 9; c++ )
+        offsets[c] = offsets[c-1] + counts[c-1];
+
+    buffer.resize( N_points );
+
+    size_t positions[9];
+    memcpy( positions, offsets, sizeof(positions) );
+
+    for ( size_t i = 0; i < N_points; i++ )
+        buffer[positions[classes[i]]++] = points[begin+i];
+
+    copy( buffer.begin(), buffer.end(), points.begin()+begin );
+
+    nodes[nodeIndex].N_points = counts[0];
+
+    //
+    // Build the children
+
+    const float childHalfSize = halfSize / 2;
+
+    for ( size_t child = 0; child < 8; child++ )
+    {
+        if ( !counts[child+1] )
+            continue;
+
+        const float childCenter[3] = {
+            center[0] + ( ( child & 1 ) ? childHalfSize : -childHalfSize ),
+            center[1] + ( ( child & 2 ) ? childHalfSize : -childHalfSize ),
+            center[2] + ( ( child & 4 ) ? childHalfSize : -childHalfSize ) };
+
+        const size_t childBegin = begin + offsets[child+1];
+
+        int32_t childIndex = buildNode( childBegin, childBegin + counts[child+1],
+                                        childCenter, childHalfSize, depth+1 );
+
+        nodes[nodeIndex].children[child] = childIndex;
+    }
+
+    return nodeIndex;
+}
+
+
+//-----------------------------------------------------------
+//
+//                      COctreeScene
+//
+//-----------------------------------------------------------
+
+COctreeScene::COctreeScene() : m_mapping(NULL), m_mappingSize(0),
+    m_nodes(NULL), m_points(NULL), m_N_nodes(0), m_N_points(0), m_pointSize(1)
+{
+}
+
+COctreeScene::~COctreeScene()
+{
+    close();
+}
+
+int COctreeScene::build( vector<TPoint> &points, const string &fileName,
+                         float pointSize, size_t maxLeafPoints )
+{
+    // Drop the points without valid coordinates, which would corrupt the
+    // bounds of the cloud
+
+    size_t N_valid = 0;
+
+    for ( size_t i = 0; i < points.size(); i++ )
+        if ( std::isfinite(points[i].x) && std::isfinite(points[i].y) && std::isfinite(points[i].z) )
+            points[N_valid++] = points[i];
+
+    points.resize( N_valid );
+
+    if ( points.empty() )
+    {
+        cerr << "  [ERROR] Can't build the octree of an empty point cloud." << endl;
+        return -1;
+    }
+
+    // Bounding cube of the cloud
+
+    float min[3] = { points[0].x, points[0].y, points[0].z };
+    float max[3] = { points[0].x, points[0].y, points[0].z };
+
+    for ( size_t i = 1; i < points.size(); i++ )
+    {
+        const float coords[3] = { points[i].x, points[i].y, points[i].z };
+
+        for ( size_t axis = 0; axis < 3; axis++ )
+        {
+            min[axis] = std::min( min[axis], coords[axis] );
+            max[axis] = std::max( max[axis], coords[axis] );
+        }
+    }
+
+    float center[3];
+    float halfSize = 0;
+
+    for ( size_t axis = 0; axis < 3; axis++ )
+    {
+        center[axis] = ( min[axis] + max[axis] ) / 2;
+        halfSize = std::max( halfSize, ( max[axis] - min[axis] ) / 2 );
+    }
+
+    halfSize = std::max( halfSize*1.001f, 1e-3f );
+
+    TBuilder builder( points, std::max( maxLeafPoints, (size_t)1 ) );
+    builder.buildNode( 0, points.size(), center, halfSize, 0 );
+
+    // Write to a temporary file and rename it, so a viewer never maps a
+    // partially written octree
+
+    const string tmpFileName = fileName + ".tmp";
+
+    FILE *file = fopen( tmpFileName.c_str(), "wb" );
+
+    if ( !file )
+    {
+        cerr << "  [ERROR] Couldn't create the octree file " << fileName << endl;
+        return -1;
+    }
+
+    THeader header;
+    header.magic     = OCTREE_MAGIC;
+    header.version   = OCTREE_VERSION;
+    header.N_nodes   = builder.nodes.size();
+    header.N_points  = points.size();
+    header.pointSize = pointSize;
+    header.padding   = 0;
+
+    bool ok = ( fwrite( &header, sizeof(header), 1, file ) == 1 ) &&
+              ( fwrite( &builder.nodes[0], sizeof(TNode), builder.nodes.size(), file ) == builder.nodes.size() ) &&
+              ( fwrite( &points[0], sizeof(TPoint), points.size(), file ) == points.size() );
+
+    ok = ( fclose( file ) == 0 ) && ok;
+
+    if ( !ok || rename( tmpFileName.c_str(), fileName.c_str() ) )
+    {
+        cerr << "  [ERROR] While writing the octree file " << fileName << endl;
+        remove( tmpFileName.c_str() );
+        return -1;
+    }
+
+    return 0;
+}
+
+int COctreeScene::open( const string &fileName )
+{
+    close();
+
+    int fd = ::open( fileName.c_str(), O_RDONLY );
+
+    if ( fd < 0 )
+        return -1;
+
+    struct stat info;
+
+    if ( ( fstat( fd, &info ) < 0 ) || ( (size_t)info.st_size < sizeof(THeader) ) )
+    {
+        ::close( fd );
+        return -1;
+    }
+
+    void *mapping = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+
+    if ( mapping == MAP_FAILED )
+        return -1;
+
+    const THeader *header = (const THeader*)mapping;
+
+    const size_t expectedSize = sizeof(THeader) + header->N_nodes*sizeof(TNode)
+                                + header->N_points*sizeof(TPoint);
+
+    if ( ( header->magic != OCTREE_MAGIC ) || ( header->version != OCTREE_VERSION ) ||
+         !header->N_nodes || ( expectedSize != (size_t)info.st_size ) )
+    {
+        cerr << "  [ERROR] Invalid octree file " << fileName << endl;
+        munmap( mapping, info.st_size );
+        return -1;
+    }
+
+    m_mapping       = mapping;
+    m_mappingSize   = info.st_size;
+    m_N_nodes       = header->N_nodes;
+    m_N_points      = header->N_points;
+    m_pointSize     = header->pointSize;
+    m_nodes         = (const TNode*)( (const char*)mapping + sizeof(THeader) );
+    m_points        = (const TPoint*)( m_nodes + m_N_nodes );
+
+    return 0;
+}
+
+void COctreeScene::close()
+{
+    if ( m_mapping )
+        munmap( m_mapping, m_mappingSize );
+
+    m_mapping       = NULL;
+    m_mappingSize   = 0;
+    m_nodes         = NULL;
+    m_points        = NULL;
+    m_N_nodes       = 0;
+    m_N_points      = 0;
+}
+
+size_t COctreeScene::selectNodes( float eye_x, float eye_y, float eye_z,
+                                  size_t maxPoints,
+                                  vector<size_t> &nodes ) const
+{
+    nodes.clear();
+
+    if ( !isOpen() )
+        return 0;
+
+    // Nodes by their apparent size from the viewpoint, the biggest on top
+
+    priority_queue< pair<float,size_t> > candidates;
+    candidates.push( make_pair( 0.f, (size_t)0 ) );
+
+    size_t N_points = 0;
+
+    while ( !candidates.empty() )
+    {
+        const TNode &node = m_nodes[candidates.top().second];
+        const size_t nodeIndex = candidates.top().second;
+        candidates.pop();
+
+        // The root is always taken, so there is something to draw even if
+        // its subsample alone exceeds the budget
+
+        if ( !nodes.empty() && ( N_points + node.N_points > maxPoints ) )
+            break;
+
+        nodes.push_back( nodeIndex );
+        N_points += node.N_points;
+
+        for ( size_t child = 0; child < 8; child++ )
+        {
+            if ( node.children[child] < 0 )
+                continue;
+
+            const TNode &childNode = m_nodes[node.children[child]];
+
+            const float dx = childNode.center[0] - eye_x;
+            const float dy = childNode.center[1] - eye_y;
+            const float dz = childNode.center[2] - eye_z;
+
+            const float distance = std::max( sqrt( dx*dx + dy*dy + dz*dz ),
+                                             childNode.halfSize );
+
+            candidates.push( make_pair( childNode.halfSize / distance,
+                                        (size_t)node.children[child] ) );
+        }
+    }
+
+    return std::min( N_points, maxPoints );
+}
@@ -0,0 +1,126 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+#ifndef _OLT_OCTREE_SCENE_
+#define _OLT_OCTREE_SCENE_
+
+#include "core.hpp"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace OLT
+{
+    /** Coloured point cloud of a scene organized in an octree for level of
+      * detail rendering. Every point is stored exactly once: each inner node
+      * keeps a spatially uniform subsample of the points within its cube
+      * (one per cell of a coarse grid), and the remaining ones go down to
+      * its children. Drawing a node together with all its ancestors then
+      * gives a decimated representation of its volume, which gets denser
+      * as deeper nodes are added.
+      *
+      * The file is a header followed by the arrays of nodes and points, with
+      * the points of every node contiguous, so it is memory-mapped instead
+      * of deserialized: opening it is instantaneous regardless of its size,
+      * and only the pages of the nodes actually drawn are read from disk. */
+
+    class COctreeScene
+    {
+    public:
+
+        struct TPoint
+        {
+            float       x, y, z;
+            uint8_t     R, G, B, A;
+        };
+
+        struct TNode
+        {
+            float       center[3];
+            float       halfSize;
+            uint64_t    firstPoint; // Points of the node: [firstPoint, firstPoint+N_points)
+            uint32_t    N_points;
+            int32_t     children[8];// -1 if empty
+            uint32_t    padding;
+        };
+
+    private:
+
+        void            *m_mapping;
+        size_t          m_mappingSize;
+
+        const TNode     *m_nodes;
+        const TPoint    *m_points;
+        size_t          m_N_nodes;
+        size_t          m_N_points;
+        float           m_pointSize;
+
+        // Not copyable, it owns the mapping
+        COctreeScene( const COctreeScene & );
+        COctreeScene &operator=( const COctreeScene & );
+
+    public:
+
+        COctreeScene();
+        ~COctreeScene();
+
+        /** Build the octree of a point cloud and write it to a file. The
+          * points are reordered in place, and the ones with non finite
+          * coordinates removed. pointSize is the rendering size of
+          * the points in the original scene, kept for the viewers. */
+        static int build( std::vector<TPoint> &points,
+                          const std::string &fileName,
+                          float pointSize = 1,
+                          size_t maxLeafPoints = 8192 );
+
+        /** Map an octree file into memory. */
+        int open( const std::string &fileName );
+
+        void close();
+
+        bool isOpen() const { return m_mapping != NULL; }
+
+        size_t getNumberOfNodes() const { return m_N_nodes; }
+        size_t getNumberOfPoints() const { return m_N_points; }
+        float getPointSize() const { return m_pointSize; }
+
+        const TNode &getNode( size_t index ) const { return m_nodes[index]; }
+        const TPoint *getPoints() const { return m_points; }
+
+        /** Choose the nodes to draw from a viewpoint, without exceeding a
+          * number of points. Nodes are taken from the root down, those
+          * looking bigger from the viewpoint first, so the detail
+          * concentrates close to the camera. Returns the number of points of
+          * the selected nodes. The root is always selected: if its points
+          * alone exceed maxPoints, maxPoints is returned, and they are to be
+          * subsampled to that number. */
+        size_t selectNodes( float eye_x, float eye_y, float eye_z,
+                            size_t maxPoints,
+                            std::vector<size_t> &nodes ) const;
+    };
+}
+
+
+#endif
@@ -0,0 +1,272 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#include "COrganizedClustering.hpp"
+#include "CTaskScheduler.hpp"
+
+#include <algorithm>
+#include <limits>
+
+using namespace OLT;
+using namespace std;
+
+
+namespace
+{
+    // Root of a pixel, halving the path on the way.
+    inline int findRoot( vector<int> &parents, int i )
+    {
+        while ( parents[i] != i )
+        {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+
+        return i;
+    }
+
+    // The smaller index becomes the root, so the result doesn't depend on
+    // the order of the unions.
+    inline void unite( vector<int> &parents, int a, int b )
+    {
+        a = findRoot(parents,a);
+        b = findRoot(parents,b);
+
+        if ( a < b )
+            parents[b] = a;
+        else if ( b < a )
+            parents[a] = b;
+    }
+
+    inline bool areClose( const pcl::PointXYZ &a, const pcl::PointXYZ &b,
+                          float sqrTolerance )
+    {
+        const float dx = a.x - b.x;
+        const float dy = a.y - b.y;
+        const float dz = a.z - b.z;
+
+        return ( dx*dx + dy*dy + dz*dz <= sqrTolerance );
+    }
+
+    // Connect the valid pixels of a row with their neighbours in the row
+    // and, if given, with the ones in the next row.
+    void uniteRows( const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                    vector<int> &parents, size_t row, bool withNextRow,
+                    float sqrTolerance )
+    {
+        const int cols = cloud.width;
+        const int first = row*cols;
+
+        for ( int col = 0; col < cols; col++ )
+        {
+            const int i = first + col;
+
+            if ( parents[i] < 0 )
+                continue;
+
+            const pcl::PointXYZ &p = cloud.points[i];
+
+            if ( ( col+1 < cols ) && ( parents[i+1] >= 0 )
+                 && areClose(p,cloud.points[i+1],sqrTolerance) )
+                unite(parents,i,i+1);
+
+            if ( !withNextRow )
+                continue;
+
+            for ( int offset = -1; offset <= 1; offset++ )
+            {
+                if ( ( col+offset < 0 ) || ( col+offset >= cols ) )
+                    continue;
+
+                const int j = i + cols + offset;
+
+                if ( ( parents[j] >= 0 ) && areClose(p,cloud.points[j],sqrTolerance) )
+                    unite(parents,i,j);
+            }
+        }
+    }
+}
+
+
+//-----------------------------------------------------------
+//
+//                  Parallel bands of rows
+//
+//-----------------------------------------------------------
+
+// Union-find restricted to the rows of each band, so bands touch disjoint
+// parts of the forest and can run concurrently.
+struct COrganizedClustering::TUnionBand
+{
+    const pcl::PointCloud<pcl::PointXYZ> &cloud;
+    const vector<bool> &mask;
+    vector<int>        &parents;
+    size_t              rowsPerBand;
+    float               sqrTolerance;
+
+    TUnionBand( const pcl::PointCloud<pcl::PointXYZ> &c, const vector<bool> &m,
+                vector<int> &p, size_t r, float t ) : cloud(c), mask(m),
+        parents(p), rowsPerBand(r), sqrTolerance(t)
+    {}
+
+    void operator()( size_t band ) const
+    {
+        const size_t firstRow = band*rowsPerBand;
+        const size_t lastRow  = std::min<size_t>( firstRow + rowsPerBand, cloud.height );
+        const size_t cols = cloud.width;
+
+        for ( size_t i = firstRow*cols; i < lastRow*cols; i++ )
+        {
+            const pcl::PointXYZ &p = cloud.points[i];
+            const bool valid = ( mask.empty() || !mask[i] )
+                    && pcl_isfinite(p.x) && pcl_isfinite(p.y) && pcl_isfinite(p.z);
+
+            parents[i] = valid ? i : -1;
+        }
+
+        for ( size_t row = firstRow; row < lastRow; row++ )
+            uniteRows( cloud, parents, row, row+1 < lastRow, sqrTolerance );
+    }
+};
+
+// Label each pixel with its root. The forest is only read here.
+struct COrganizedClustering::TLabelBand
+{
+    const vector<int>  &parents;
+    vector<int>        &labels;
+    size_t              pixelsPerBand;
+
+    TLabelBand( const vector<int> &p, vector<int> &l, size_t n ) :
+        parents(p), labels(l), pixelsPerBand(n)
+    {}
+
+    void operator()( size_t band ) const
+    {
+        const size_t first = band*pixelsPerBand;
+        const size_t last  = std::min( first + pixelsPerBand, parents.size() );
+
+        for ( size_t i = first; i < last; i++ )
+        {
+            int root = parents[i];
+
+            if ( root >= 0 )
+                while ( parents[root] != root )
+                    root = parents[root];
+
+            labels[i] = root;
+        }
+    }
+};
+
+
+//-----------------------------------------------------------
+//
+//                  COrganizedClustering
+//
+//-----------------------------------------------------------
+
+COrganizedClustering::COrganizedClustering() : m_tolerance(0.02),
+    m_minClusterSize(1), m_maxClusterSize(std::numeric_limits<int>::max())
+{
+}
+
+int COrganizedClustering::segment( const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                                   const vector<bool> &mask,
+                                   vector<pcl::PointIndices> &clusters )
+{
+    clusters.clear();
+
+    const size_t rows = cloud.height;
+    const size_t cols = cloud.width;
+    const size_t N_pixels = rows*cols;
+
+    if ( ( rows <= 1 ) || ( N_pixels != cloud.size() ) )
+    {
+        cerr << "  [ERROR] Organized clustering requires an organized point cloud." << endl;
+        return -1;
+    }
+
+    if ( !mask.empty() && ( mask.size() != N_pixels ) )
+    {
+        cerr << "  [ERROR] The size of the clustering mask doesn't match the point cloud." << endl;
+        return -1;
+    }
+
+    const float sqrTolerance = m_tolerance*m_tolerance;
+
+    m_parents.resize(N_pixels);
+    m_labels.resize(N_pixels);
+
+    // Connect the pixels within each band, then along the borders of the bands
+
+    const size_t N_threads = CTaskScheduler::getNumThreads();
+    const size_t N_bands = std::max<size_t>( 1, std::min( 4*N_threads, rows/8 ) );
+    const size_t rowsPerBand = ( rows + N_bands - 1 ) / N_bands;
+
+    TUnionBand unionBand( cloud, mask, m_parents, rowsPerBand, sqrTolerance );
+    parallelFor( 0, N_bands, unionBand );
+
+    for ( size_t row = rowsPerBand-1; row+1 < rows; row += rowsPerBand )
+        uniteRows( cloud, m_parents, row, true, sqrTolerance );
+
+    TLabelBand labelBand( m_parents, m_labels, rowsPerBand*cols );
+    parallelFor( 0, N_bands, labelBand );
+
+    // Gather the clusters with a valid size, biggest first
+
+    m_sizes.assign(N_pixels,0);
+
+    for ( size_t i = 0; i < N_pixels; i++ )
+        if ( m_labels[i] >= 0 )
+            m_sizes[m_labels[i]]++;
+
+    vector<pair<int,int> > v_clusterSizes; // (-size, root)
+
+    for ( size_t i = 0; i < N_pixels; i++ )
+        if ( ( m_labels[i] == (int)i ) && ( m_sizes[i] >= (int)m_minClusterSize )
+             && ( m_sizes[i] <= (int)std::min<size_t>(m_maxClusterSize,N_pixels) ) )
+            v_clusterSizes.push_back( make_pair(-m_sizes[i],(int)i) );
+
+    std::sort( v_clusterSizes.begin(), v_clusterSizes.end() );
+
+    // From now on, m_sizes stores the cluster of each root (or -1)
+
+    const size_t N_clusters = v_clusterSizes.size();
+    clusters.resize(N_clusters);
+
+    for ( size_t i = 0; i < N_pixels; i++ )
+        if ( m_labels[i] == (int)i )
+            m_sizes[i] = -1;
+
+    for ( size_t cluster = 0; cluster < N_clusters; cluster++ )
+    {
+        m_sizes[v_clusterSizes[cluster].second] = cluster;
+        clusters[cluster].indices.reserve( -v_clusterSizes[cluster].first );
+        clusters[cluster].header = cloud.header;
+    }
+
+    for ( size_t i = 0; i < N_pixels; i++ )
+        if ( ( m_labels[i] >= 0 ) && ( m_sizes[m_labels[i]] >= 0 ) )
+            clusters[m_sizes[m_labels[i]]].indices.push_back(i);
+
+    return 0;
+}
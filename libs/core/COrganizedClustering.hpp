@@ -0,0 +1,75 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#ifndef _OLT_ORGANIZED_CLUSTERING_
+#define _OLT_ORGANIZED_CLUSTERING_
+
+#include "core.hpp"
+
+#include <vector>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+
+
+namespace OLT
+{
+    /** Euclidean clustering of organized point clouds (depth images). Instead
+      * of radius searches in a KD-tree, each pixel is only connected with its
+      * 8 neighbours in the image when their 3D distance is under a tolerance,
+      * and the connected components are found through union-find. The image
+      * is split in bands of rows processed in parallel by the task scheduler,
+      * and the unions across the borders of the bands are done afterwards. */
+
+    class COrganizedClustering
+    {
+        float               m_tolerance;
+        size_t              m_minClusterSize;
+        size_t              m_maxClusterSize;
+
+        std::vector<int>    m_parents;  // Union-find forest, -1 for not valid pixels
+        std::vector<int>    m_labels;   // Root of each pixel, -1 for not valid pixels
+        std::vector<int>    m_sizes;    // Number of pixels of each root
+
+        struct TUnionBand;
+        struct TLabelBand;
+
+    public:
+
+        COrganizedClustering();
+
+        void setClusterTolerance( float tolerance ) { m_tolerance = tolerance; }
+        void setMinClusterSize( size_t size ) { m_minClusterSize = size; }
+        void setMaxClusterSize( size_t size ) { m_maxClusterSize = size; }
+
+        /** Segment the clusters of an organized cloud. Pixels with NaN points
+          * or set in the mask (e.g. inliers of planes) are ignored; an empty
+          * mask ignores nothing. Clusters are returned sorted by decreasing
+          * size, as pcl::EuclideanClusterExtraction does. */
+        int segment( const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                     const std::vector<bool> &mask,
+                     std::vector<pcl::PointIndices> &clusters );
+    };
+}
+
+
+#endif
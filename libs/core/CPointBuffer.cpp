@@ -0,0 +1,159 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#include "CPointBuffer.hpp"
+
+#include <cmath>
+
+using namespace OLT;
+using namespace std;
+
+using namespace mrpt;
+using namespace mrpt::obs;
+using namespace mrpt::math;
+using namespace mrpt::opengl;
+using namespace mrpt::poses;
+
+
+//-----------------------------------------------------------
+//
+//                        TPointsView
+//
+//-----------------------------------------------------------
+
+TPointsView TPointsView::fromSoA( const vector<float> &xs,
+                                  const vector<float> &ys,
+                                  const vector<float> &zs )
+{
+    TPointsView view;
+
+    if ( xs.empty() )
+        return view;
+
+    view.x      = &xs[0];
+    view.y      = &ys[0];
+    view.z      = &zs[0];
+    view.stride = 1;
+    view.size   = xs.size();
+
+    return view;
+}
+
+TPointsView TPointsView::fromOpenGL( const CPointCloudColoured &cloud )
+{
+    TPointsView view;
+
+    if ( !cloud.size() )
+        return view;
+
+    // Points are stored as a vector of TPointColour {x,y,z,R,G,B}
+    const CPointCloudColoured::TPointColour &first = *cloud.begin();
+
+    view.x      = &first.x;
+    view.y      = &first.y;
+    view.z      = &first.z;
+    view.stride = sizeof(CPointCloudColoured::TPointColour)/sizeof(float);
+    view.size   = cloud.size();
+
+    return view;
+}
+
+void OLT::copyToSoA( const TPointsView &view,
+                     vector<float> &xs, vector<float> &ys, vector<float> &zs,
+                     float invalidValue )
+{
+    xs.resize(view.size);
+    ys.resize(view.size);
+    zs.resize(view.size);
+
+    for ( size_t i = 0; i < view.size; i++ )
+    {
+        const size_t k = i*view.stride;
+        const bool valid = std::isfinite(view.x[k]);
+
+        xs[i] = ( valid ) ? view.x[k] : invalidValue;
+        ys[i] = ( valid ) ? view.y[k] : invalidValue;
+        zs[i] = ( valid ) ? view.z[k] : invalidValue;
+    }
+}
+
+
+//-----------------------------------------------------------
+//
+//                        CPointBuffer
+//
+//-----------------------------------------------------------
+
+void CPointBuffer::append( const TPointsView &view, const CPose3D &pose,
+                           float minDistBetweenPoints )
+{
+    CMatrixDouble44 H;
+    pose.getHomogeneousMatrix(H);
+
+    const float r00 = H(0,0), r01 = H(0,1), r02 = H(0,2), tx = H(0,3);
+    const float r10 = H(1,0), r11 = H(1,1), r12 = H(1,2), ty = H(1,3);
+    const float r20 = H(2,0), r21 = H(2,1), r22 = H(2,2), tz = H(2,3);
+
+    const float minDist2 = minDistBetweenPoints*minDistBetweenPoints;
+    float lastX = 0, lastY = 0, lastZ = 0;
+    bool  first = true;
+
+    // Not reserving here, so appending many views grows the buffers
+    // geometrically instead of reallocating them on every call
+
+    for ( size_t i = 0; i < view.size; i++ )
+    {
+        const size_t k = i*view.stride;
+        const float x = view.x[k], y = view.y[k], z = view.z[k];
+
+        if ( ( !x && !y && !z ) || !std::isfinite(x) )
+            continue;
+
+        const float gx = r00*x + r01*y + r02*z + tx;
+        const float gy = r10*x + r11*y + r12*z + ty;
+        const float gz = r20*x + r21*y + r22*z + tz;
+
+        if ( !first && ( minDist2 > 0 ) )
+        {
+            const float dx = gx-lastX, dy = gy-lastY, dz = gz-lastZ;
+
+            if ( dx*dx + dy*dy + dz*dz < minDist2 )
+                continue;
+        }
+
+        m_x.push_back(gx);
+        m_y.push_back(gy);
+        m_z.push_back(gz);
+
+        lastX = gx; lastY = gy; lastZ = gz;
+        first = false;
+    }
+}
+
+void CPointBuffer::swapInto( CObservation3DRangeScan &obs )
+{
+    obs.points3D_x.swap(m_x);
+    obs.points3D_y.swap(m_y);
+    obs.points3D_z.swap(m_z);
+
+    obs.hasPoints3D = true;
+}
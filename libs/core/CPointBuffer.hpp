@@ -0,0 +1,158 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#ifndef _OLT_POINT_BUFFER_
+#define _OLT_POINT_BUFFER_
+
+#include "core.hpp"
+
+#include <vector>
+#include <mrpt/poses/CPose3D.h>
+#include <mrpt/obs/CObservation3DRangeScan.h>
+#include <mrpt/maps/CPointsMap.h>
+#include <mrpt/opengl/CPointCloudColoured.h>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+
+namespace OLT
+{
+    /** Zero-copy view of the XYZ coordinates of a set of points. They can be
+      * stored as separate arrays (SoA, as MRPT observations and points maps
+      * do) or interleaved with other fields (AoS, as PCL clouds and
+      * CPointCloudColoured do). The viewed container must outlive the view
+      * and not be resized meanwhile. */
+
+    struct TPointsView
+    {
+        const float *x;
+        const float *y;
+        const float *z;
+        size_t      stride; // Distance between consecutive points, in floats
+        size_t      size;
+
+        TPointsView() : x(NULL), y(NULL), z(NULL), stride(1), size(0)
+        {}
+
+        static TPointsView fromSoA( const std::vector<float> &xs,
+                                    const std::vector<float> &ys,
+                                    const std::vector<float> &zs );
+
+        static TPointsView fromObs( const mrpt::obs::CObservation3DRangeScan &obs )
+        { return fromSoA(obs.points3D_x,obs.points3D_y,obs.points3D_z); }
+
+        static TPointsView fromPointsMap( const mrpt::maps::CPointsMap &map )
+        { return fromSoA(map.getPointsBufferRef_x(),map.getPointsBufferRef_y(),
+                         map.getPointsBufferRef_z()); }
+
+        static TPointsView fromOpenGL( const mrpt::opengl::CPointCloudColoured &cloud );
+
+        template <class POINT>
+        static TPointsView fromPCL( const pcl::PointCloud<POINT> &cloud )
+        {
+            TPointsView view;
+
+            if ( cloud.points.empty() )
+                return view;
+
+            view.x      = &cloud.points[0].x;
+            view.y      = &cloud.points[0].y;
+            view.z      = &cloud.points[0].z;
+            view.stride = sizeof(POINT)/sizeof(float);
+            view.size   = cloud.points.size();
+
+            return view;
+        }
+    };
+
+
+    /** Append the points of a view, taking one of each 'step' of them, to a
+      * PCL cloud. The cloud is resized only once. */
+    template <class POINT>
+    void appendToPCL( const TPointsView &view, pcl::PointCloud<POINT> &cloud,
+                      size_t step = 1 )
+    {
+        const size_t N_old = cloud.points.size();
+        const size_t N_new = ( view.size + step - 1 )/step;
+
+        cloud.points.resize(N_old+N_new);
+        cloud.width  = cloud.points.size();
+        cloud.height = 1;
+
+        for ( size_t i = 0, j = N_old; i < view.size; i += step, j++ )
+        {
+            const size_t k = i*view.stride;
+            cloud.points[j].x = view.x[k];
+            cloud.points[j].y = view.y[k];
+            cloud.points[j].z = view.z[k];
+        }
+    }
+
+    /** Copy the points of a view into SoA vectors, replacing non finite
+      * coordinates (e.g. NaNs from organized clouds) by invalidValue. */
+    void copyToSoA( const TPointsView &view,
+                    std::vector<float> &xs, std::vector<float> &ys, std::vector<float> &zs,
+                    float invalidValue = 0 );
+
+
+    /** Owning SoA buffer of points, to gather the points of several
+      * observations before handing them to MRPT or PCL in bulk. */
+
+    class CPointBuffer
+    {
+        std::vector<float> m_x;
+        std::vector<float> m_y;
+        std::vector<float> m_z;
+
+    public:
+
+        size_t size() const { return m_x.size(); }
+        bool   empty() const { return m_x.empty(); }
+        void   clear() { m_x.clear(); m_y.clear(); m_z.clear(); }
+        void   reserve( size_t N ) { m_x.reserve(N); m_y.reserve(N); m_z.reserve(N); }
+
+        const std::vector<float>& x() const { return m_x; }
+        const std::vector<float>& y() const { return m_y; }
+        const std::vector<float>& z() const { return m_z; }
+
+        TPointsView view() const { return TPointsView::fromSoA(m_x,m_y,m_z); }
+
+        /** Append the points of a view transformed by a pose. As in
+          * CPointsMap insertions, points closer than minDistBetweenPoints to
+          * the last appended one are skipped, and points at the origin of
+          * the view frame (null measurements) are ignored. */
+        void append( const TPointsView &view, const mrpt::poses::CPose3D &pose,
+                     float minDistBetweenPoints = 0 );
+
+        /** Append the 3D points of an observation, placed with its sensor pose. */
+        void appendObs( const mrpt::obs::CObservation3DRangeScan &obs,
+                        float minDistBetweenPoints = 0.02 )
+        { append(TPointsView::fromObs(obs),obs.sensorPose,minDistBetweenPoints); }
+
+        /** Hand the points to an observation without copying them. The
+          * buffer is left with the previous points of the observation. */
+        void swapInto( mrpt::obs::CObservation3DRangeScan &obs );
+    };
+}
+
+
+#endif
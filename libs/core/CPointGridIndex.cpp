@@ -0,0 +1,323 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+#include "CPointGridIndex.hpp"
+
+#include <algorithm>
+#include <limits>
+
+using namespace OLT;
+using namespace mrpt::math;
+using namespace mrpt::poses;
+using namespace std;
+
+
+//-----------------------------------------------------------
+//
+//                    CPointGridIndex
+//
+//-----------------------------------------------------------
+
+CPointGridIndex::CPointGridIndex( float cellSize )
+{
+    reset( cellSize );
+}
+
+void CPointGridIndex::reset( float cellSize )
+{
+    m_cellSize = cellSize;
+
+    m_x.clear();
+    m_y.clear();
+    m_z.clear();
+    m_cellKeys.clear();
+    m_cellStarts.clear();
+
+    for ( size_t axis = 0; axis < 3; axis++ )
+    {
+        m_minCell[axis] = 0;
+        m_dims[axis] = 0;
+    }
+}
+
+void CPointGridIndex::reserve( size_t N_points )
+{
+    m_x.reserve( N_points );
+    m_y.reserve( N_points );
+    m_z.reserve( N_points );
+}
+
+void CPointGridIndex::finalize()
+{
+    m_cellKeys.clear();
+    m_cellStarts.clear();
+
+    // Drop the points with NaN coordinates
+
+    size_t N_points = 0;
+
+    for ( size_t i = 0; i < m_x.size(); i++ )
+    {
+        if ( !std::isfinite(m_x[i]) || !std::isfinite(m_y[i]) || !std::isfinite(m_z[i]) )
+            continue;
+
+        m_x[N_points] = m_x[i];
+        m_y[N_points] = m_y[i];
+        m_z[N_points] = m_z[i];
+        N_points++;
+    }
+
+    m_x.resize( N_points );
+    m_y.resize( N_points );
+    m_z.resize( N_points );
+
+    if ( !N_points )
+        return;
+
+    // Limits of the grid
+
+    int maxCell[3];
+
+    m_minCell[0] = maxCell[0] = getCell(m_x[0]);
+    m_minCell[1] = maxCell[1] = getCell(m_y[0]);
+    m_minCell[2] = maxCell[2] = getCell(m_z[0]);
+
+    for ( size_t i = 1; i < N_points; i++ )
+    {
+        const int cell[3] = { getCell(m_x[i]), getCell(m_y[i]), getCell(m_z[i]) };
+
+        for ( size_t axis = 0; axis < 3; axis++ )
+        {
+            m_minCell[axis] = std::min( m_minCell[axis], cell[axis] );
+            maxCell[axis] = std::max( maxCell[axis], cell[axis] );
+        }
+    }
+
+    for ( size_t axis = 0; axis < 3; axis++ )
+        m_dims[axis] = (int64_t)maxCell[axis] - m_minCell[axis] + 1;
+
+    // Sort the points by cell
+
+    vector< pair<uint64_t,uint32_t> > v_keys( N_points );
+
+    for ( size_t i = 0; i < N_points; i++ )
+        v_keys[i] = make_pair( getKey( getCell(m_x[i]) - m_minCell[0],
+                                       getCell(m_y[i]) - m_minCell[1],
+                                       getCell(m_z[i]) - m_minCell[2] ), (uint32_t)i );
+
+    sort( v_keys.begin(), v_keys.end() );
+
+    vector<float> sorted( N_points );
+
+    for ( size_t i = 0; i < N_points; i++ ) sorted[i] = m_x[v_keys[i].second];
+    m_x.swap( sorted );
+    for ( size_t i = 0; i < N_points; i++ ) sorted[i] = m_y[v_keys[i].second];
+    m_y.swap( sorted );
+    for ( size_t i = 0; i < N_points; i++ ) sorted[i] = m_z[v_keys[i].second];
+    m_z.swap( sorted );
+
+    for ( size_t i = 0; i < N_points; i++ )
+    {
+        if ( !i || ( v_keys[i].first != v_keys[i-1].first ) )
+        {
+            m_cellKeys.push_back( v_keys[i].first );
+            m_cellStarts.push_back( i );
+        }
+    }
+
+    m_cellStarts.push_back( N_points );
+}
+
+size_t CPointGridIndex::queryBox( const CPose3D &pose,
+                                  const TPoint3D &corner1,
+                                  const TPoint3D &corner2,
+                                  bool computeBounds,
+                                  TPoint3D &min,
+                                  TPoint3D &max ) const
+{
+    if ( empty() )
+        return 0;
+
+    const float lo[3] = { (float)std::min(corner1.x,corner2.x),
+                          (float)std::min(corner1.y,corner2.y),
+                          (float)std::min(corner1.z,corner2.z) };
+    const float hi[3] = { (float)std::max(corner1.x,corner2.x),
+                          (float)std::max(corner1.y,corner2.y),
+                          (float)std::max(corner1.z,corner2.z) };
+
+    // Points go to the box frame as R^T (p - t)
+
+    CMatrixDouble33 R;
+    pose.getRotationMatrix( R );
+
+    float Rt[3][3];
+
+    for ( size_t row = 0; row < 3; row++ )
+        for ( size_t col = 0; col < 3; col++ )
+            Rt[row][col] = R(col,row);
+
+    const float t[3] = { (float)pose.x(), (float)pose.y(), (float)pose.z() };
+
+    // Cells overlapping the bounding box of the box in the world
+
+    float worldMin[3], worldMax[3];
+
+    for ( size_t axis = 0; axis < 3; axis++ )
+    {
+        worldMin[axis] = numeric_limits<float>::max();
+        worldMax[axis] = -numeric_limits<float>::max();
+    }
+
+    for ( size_t corner = 0; corner < 8; corner++ )
+    {
+        const float local[3] = { ( corner & 1 ) ? hi[0] : lo[0],
+                                 ( corner & 2 ) ? hi[1] : lo[1],
+                                 ( corner & 4 ) ? hi[2] : lo[2] };
+
+        for ( size_t axis = 0; axis < 3; axis++ )
+        {
+            const float world = R(axis,0)*local[0] + R(axis,1)*local[1] + R(axis,2)*local[2] + t[axis];
+            worldMin[axis] = std::min( worldMin[axis], world );
+            worldMax[axis] = std::max( worldMax[axis], world );
+        }
+    }
+
+    int64_t cellMin[3], cellMax[3];
+
+    for ( size_t axis = 0; axis < 3; axis++ )
+    {
+        cellMin[axis] = std::max( (int64_t)getCell(worldMin[axis]) - m_minCell[axis], (int64_t)0 );
+        cellMax[axis] = std::min( (int64_t)getCell(worldMax[axis]) - m_minCell[axis], m_dims[axis]-1 );
+
+        if ( cellMin[axis] > cellMax[axis] )
+            return 0;
+    }
+
+    // Half extent of a cell projected over each axis of the box
+
+    float radius[3];
+
+    for ( size_t axis = 0; axis < 3; axis++ )
+        radius[axis] = m_cellSize/2 * ( fabs(Rt[axis][0]) + fabs(Rt[axis][1]) + fabs(Rt[axis][2]) );
+
+    size_t N_points = 0;
+
+    float boundsMin[3] = {  numeric_limits<float>::max(),  numeric_limits<float>::max(),  numeric_limits<float>::max() };
+    float boundsMax[3] = { -numeric_limits<float>::max(), -numeric_limits<float>::max(), -numeric_limits<float>::max() };
+
+    for ( int64_t ix = cellMin[0]; ix <= cellMax[0]; ix++ )
+        for ( int64_t iy = cellMin[1]; iy <= cellMax[1]; iy++ )
+        {
+            // The cells of the row are contiguous in the sorted keys
+
+            const uint64_t rowKey  = getKey( ix, iy, 0 );
+            const uint64_t lastKey = rowKey + cellMax[2];
+
+            size_t cell = lower_bound( m_cellKeys.begin(), m_cellKeys.end(), rowKey + cellMin[2] )
+                          - m_cellKeys.begin();
+
+            for ( ; ( cell < m_cellKeys.size() ) && ( m_cellKeys[cell] <= lastKey ); cell++ )
+            {
+                const int64_t iz = m_cellKeys[cell] - rowKey;
+
+                const float center[3] = { ( ix + m_minCell[0] + 0.5f )*m_cellSize - t[0],
+                                          ( iy + m_minCell[1] + 0.5f )*m_cellSize - t[1],
+                                          ( iz + m_minCell[2] + 0.5f )*m_cellSize - t[2] };
+
+                bool inside = true;
+                bool outside = false;
+
+                for ( size_t axis = 0; axis < 3; axis++ )
+                {
+                    const float local = Rt[axis][0]*center[0] + Rt[axis][1]*center[1] + Rt[axis][2]*center[2];
+
+                    if ( ( local + radius[axis] < lo[axis] ) || ( local - radius[axis] > hi[axis] ) )
+                        outside = true;
+
+                    if ( ( local - radius[axis] < lo[axis] ) || ( local + radius[axis] > hi[axis] ) )
+                        inside = false;
+                }
+
+                if ( outside )
+                    continue;
+
+                if ( inside && !computeBounds )
+                {
+                    N_points += m_cellStarts[cell+1] - m_cellStarts[cell];
+                    continue;
+                }
+
+                for ( size_t i = m_cellStarts[cell]; i < m_cellStarts[cell+1]; i++ )
+                {
+                    const float p[3] = { m_x[i] - t[0], m_y[i] - t[1], m_z[i] - t[2] };
+
+                    float local[3];
+                    bool within = true;
+
+                    for ( size_t axis = 0; axis < 3; axis++ )
+                    {
+                        local[axis] = Rt[axis][0]*p[0] + Rt[axis][1]*p[1] + Rt[axis][2]*p[2];
+                        within = within && ( local[axis] >= lo[axis] ) && ( local[axis] <= hi[axis] );
+                    }
+
+                    if ( !within )
+                        continue;
+
+                    N_points++;
+
+                    if ( computeBounds )
+                        for ( size_t axis = 0; axis < 3; axis++ )
+                        {
+                            boundsMin[axis] = std::min( boundsMin[axis], local[axis] );
+                            boundsMax[axis] = std::max( boundsMax[axis], local[axis] );
+                        }
+                }
+            }
+        }
+
+    if ( computeBounds && N_points )
+    {
+        min = TPoint3D( boundsMin[0], boundsMin[1], boundsMin[2] );
+        max = TPoint3D( boundsMax[0], boundsMax[1], boundsMax[2] );
+    }
+
+    return N_points;
+}
+
+size_t CPointGridIndex::countPointsInBox( const CPose3D &pose,
+                                          const TPoint3D &corner1,
+                                          const TPoint3D &corner2 ) const
+{
+    TPoint3D min, max;
+
+    return queryBox( pose, corner1, corner2, false, min, max );
+}
+
+size_t CPointGridIndex::getBoundsInBox( const CPose3D &pose,
+                                        const TPoint3D &corner1,
+                                        const TPoint3D &corner2,
+                                        TPoint3D &min,
+                                        TPoint3D &max ) const
+{
+    return queryBox( pose, corner1, corner2, true, min, max );
+}
@@ -0,0 +1,114 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+#ifndef _OLT_POINT_GRID_INDEX_
+#define _OLT_POINT_GRID_INDEX_
+
+#include "core.hpp"
+
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+#include <mrpt/poses/CPose3D.h>
+#include <mrpt/math/lightweight_geom_data.h>
+
+
+namespace OLT
+{
+    /** Spatial index of a static point cloud for oriented box queries. Points
+      * are bucketed in the cells of a regular grid and stored sorted by cell,
+      * with the keys of the occupied cells sorted so the cells along a row of
+      * the grid are contiguous. A query only visits the cells overlapping the
+      * bounding box of the oriented box: cells completely inside it are
+      * counted as a whole, cells completely outside are skipped, and only the
+      * points of the cells crossing its faces are tested one by one. */
+
+    class CPointGridIndex
+    {
+        float                   m_cellSize;
+
+        std::vector<float>      m_x, m_y, m_z;  // Sorted by cell after finalize()
+        std::vector<uint64_t>   m_cellKeys;     // Occupied cells, sorted
+        std::vector<uint32_t>   m_cellStarts;   // First point of each cell, plus the end
+
+        int                     m_minCell[3];   // Grid limits (in cells)
+        int64_t                 m_dims[3];
+
+        uint64_t getKey( int64_t ix, int64_t iy, int64_t iz ) const
+        { return ( ix*m_dims[1] + iy )*m_dims[2] + iz; }
+
+        int getCell( float coord ) const { return (int)std::floor( coord/m_cellSize ); }
+
+        size_t queryBox( const mrpt::poses::CPose3D &pose,
+                         const mrpt::math::TPoint3D &corner1,
+                         const mrpt::math::TPoint3D &corner2,
+                         bool computeBounds,
+                         mrpt::math::TPoint3D &min,
+                         mrpt::math::TPoint3D &max ) const;
+
+    public:
+
+        CPointGridIndex( float cellSize = 0.05 );
+
+        /** Remove all the points and set a new cell size. */
+        void reset( float cellSize );
+
+        float getCellSize() const { return m_cellSize; }
+
+        void reserve( size_t N_points );
+
+        /** Add a point. Changes take effect after finalize(). */
+        void addPoint( float x, float y, float z )
+        {
+            m_x.push_back(x); m_y.push_back(y); m_z.push_back(z);
+        }
+
+        /** Build the index of the points added. */
+        void finalize();
+
+        size_t size() const { return m_x.size(); }
+        bool empty() const { return m_cellKeys.empty(); }
+
+        /** Occupied cells, and number of points in each one. */
+        size_t getNumberOfCells() const { return m_cellKeys.size(); }
+        size_t getNumberOfPointsInCell( size_t cell ) const
+        { return m_cellStarts[cell+1] - m_cellStarts[cell]; }
+
+        /** Number of points within a box with the given pose and opposite
+          * corners (in the box frame), as mrpt::opengl::CBox. */
+        size_t countPointsInBox( const mrpt::poses::CPose3D &pose,
+                                 const mrpt::math::TPoint3D &corner1,
+                                 const mrpt::math::TPoint3D &corner2 ) const;
+
+        /** Tight bounds, in the box frame, of the points within a box.
+          * Returns the number of points, the bounds are only set if any. */
+        size_t getBoundsInBox( const mrpt::poses::CPose3D &pose,
+                               const mrpt::math::TPoint3D &corner1,
+                               const mrpt::math::TPoint3D &corner2,
+                               mrpt::math::TPoint3D &min,
+                               mrpt::math::TPoint3D &max ) const;
+    };
+}
+
+
+#endif
@@ -0,0 +1,260 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#include "CPreprocessingCache.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdint.h>
+#include <mrpt/system/filesystem.h>
+
+using namespace OLT;
+using namespace std;
+
+
+namespace
+{
+    const uint32_t CACHE_MAGIC   = 0x43544C4F; // "OLTC"
+    const uint32_t CACHE_VERSION = 1;
+
+    struct TCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t hasNormals;
+    };
+
+    // FNV-1a, enough to tell rawlogs and parameters apart
+    uint64_t hashString( const string &str, uint64_t hash = 14695981039346656037ULL )
+    {
+        for ( size_t i = 0; i < str.size(); i++ )
+        {
+            hash ^= (unsigned char)str[i];
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+}
+
+
+//-----------------------------------------------------------
+//
+//                  CPreprocessingCache
+//
+//-----------------------------------------------------------
+
+int CPreprocessingCache::open( const string &directory,
+                               const string &rawlogFile,
+                               const string &parameters )
+{
+    m_key.clear();
+
+    if ( !mrpt::system::fileExists(rawlogFile) )
+    {
+        cerr << "  [ERROR] Can't use a cache for the non existing rawlog " << rawlogFile << endl;
+        return -1;
+    }
+
+    if ( !mrpt::system::directoryExists(directory) &&
+         !mrpt::system::createDirectory(directory) )
+    {
+        cerr << "  [ERROR] Couldn't create the cache directory " << directory << endl;
+        return -1;
+    }
+
+    m_directory = directory;
+
+    stringstream fingerprint;
+    fingerprint << mrpt::system::extractFileName(rawlogFile) << ";"
+                << mrpt::system::getFileSize(rawlogFile) << ";"
+                << mrpt::system::getFileModificationTime(rawlogFile) << ";"
+                << parameters;
+
+    stringstream key;
+    key << hex << hashString( fingerprint.str() );
+    m_key = key.str();
+
+    cout << "  [INFO] Using preprocessing cache " << m_directory << "/" << m_key << "_*" << endl;
+
+    return 0;
+}
+
+string CPreprocessingCache::getFileName( size_t obs_index,
+                                         const string &calibration ) const
+{
+    stringstream fileName;
+    fileName << m_directory << "/" << m_key << "_"
+             << hex << hashString( calibration ) << dec << "_"
+             << obs_index << ".cache";
+
+    return fileName.str();
+}
+
+bool CPreprocessingCache::load( size_t obs_index, const string &calibration,
+                                pcl::PointCloud<pcl::PointXYZ> &cloud,
+                                pcl::PointCloud<pcl::Normal> &normals ) const
+{
+    if ( !isOpen() )
+        return false;
+
+    ifstream file( getFileName(obs_index,calibration).c_str(), ios::binary );
+
+    if ( !file.is_open() )
+        return false;
+
+    TCacheHeader header;
+
+    if ( !file.read( (char*)&header, sizeof(header) ) ||
+         ( header.magic != CACHE_MAGIC ) || ( header.version != CACHE_VERSION ) )
+        return false;
+
+    const size_t N_points = header.width*header.height;
+
+    if ( !N_points )
+        return false;
+
+    vector<float> buffer( 3*N_points );
+
+    if ( !file.read( (char*)&buffer[0], buffer.size()*sizeof(float) ) )
+        return false;
+
+    cloud.resize( N_points );
+    cloud.width     = header.width;
+    cloud.height    = header.height;
+    cloud.is_dense  = false;
+
+    for ( size_t i = 0; i < N_points; i++ )
+    {
+        cloud.points[i].x = buffer[3*i];
+        cloud.points[i].y = buffer[3*i+1];
+        cloud.points[i].z = buffer[3*i+2];
+    }
+
+    normals.clear();
+
+    if ( header.hasNormals )
+    {
+        buffer.resize( 4*N_points );
+
+        if ( !file.read( (char*)&buffer[0], buffer.size()*sizeof(float) ) )
+            return false;
+
+        normals.resize( N_points );
+        normals.width   = header.width;
+        normals.height  = header.height;
+        normals.is_dense = false;
+
+        for ( size_t i = 0; i < N_points; i++ )
+        {
+            normals.points[i].normal_x  = buffer[4*i];
+            normals.points[i].normal_y  = buffer[4*i+1];
+            normals.points[i].normal_z  = buffer[4*i+2];
+            normals.points[i].curvature = buffer[4*i+3];
+        }
+    }
+
+    return true;
+}
+
+int CPreprocessingCache::save( size_t obs_index, const string &calibration,
+                               const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                               const pcl::PointCloud<pcl::Normal> &normals ) const
+{
+    if ( !isOpen() )
+        return -1;
+
+    const size_t N_points = cloud.size();
+    const bool hasNormals = !normals.empty();
+
+    if ( !N_points || ( N_points != cloud.width*cloud.height ) )
+        return -1;
+
+    if ( hasNormals && ( normals.size() != N_points ) )
+    {
+        cerr << "  [ERROR] Number of normals and points differ, frame not cached." << endl;
+        return -1;
+    }
+
+    // Write to a temporary file and rename it, so readers never see
+    // partially written frames
+
+    const string fileName = getFileName(obs_index,calibration);
+    const string tmpFileName = fileName + ".tmp";
+
+    ofstream file( tmpFileName.c_str(), ios::binary );
+
+    if ( !file.is_open() )
+    {
+        cerr << "  [ERROR] Couldn't write the cache file " << tmpFileName << endl;
+        return -1;
+    }
+
+    TCacheHeader header;
+    header.magic      = CACHE_MAGIC;
+    header.version    = CACHE_VERSION;
+    header.width      = cloud.width;
+    header.height     = cloud.height;
+    header.hasNormals = hasNormals;
+
+    file.write( (const char*)&header, sizeof(header) );
+
+    vector<float> buffer( 3*N_points );
+
+    for ( size_t i = 0; i < N_points; i++ )
+    {
+        buffer[3*i]   = cloud.points[i].x;
+        buffer[3*i+1] = cloud.points[i].y;
+        buffer[3*i+2] = cloud.points[i].z;
+    }
+
+    file.write( (const char*)&buffer[0], buffer.size()*sizeof(float) );
+
+    if ( hasNormals )
+    {
+        buffer.resize( 4*N_points );
+
+        for ( size_t i = 0; i < N_points; i++ )
+        {
+            buffer[4*i]   = normals.points[i].normal_x;
+            buffer[4*i+1] = normals.points[i].normal_y;
+            buffer[4*i+2] = normals.points[i].normal_z;
+            buffer[4*i+3] = normals.points[i].curvature;
+        }
+
+        file.write( (const char*)&buffer[0], buffer.size()*sizeof(float) );
+    }
+
+    file.close();
+
+    if ( !file || ( rename( tmpFileName.c_str(), fileName.c_str() ) != 0 ) )
+    {
+        cerr << "  [ERROR] Couldn't write the cache file " << fileName << endl;
+        remove( tmpFileName.c_str() );
+        return -1;
+    }
+
+    return 0;
+}
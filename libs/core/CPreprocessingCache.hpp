@@ -0,0 +1,78 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#ifndef _OLT_PREPROCESSING_CACHE_
+#define _OLT_PREPROCESSING_CACHE_
+
+#include "core.hpp"
+
+#include <string>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+
+namespace OLT
+{
+    /** On-disk cache of the preprocessed products of the frames of a rawlog
+      * (filtered organized point cloud and, optionally, its normals), so
+      * tuning the parameters of the later stages doesn't recompute them.
+      * Each frame is stored in its own file, named after a fingerprint of
+      * the rawlog (name, size and modification time), a string with the
+      * parameters of the preprocessing, a string with the calibration of
+      * its sensor (intrinsics and pose) and the index of the observation.
+      * Changing any of them simply misses the old files. */
+
+    class CPreprocessingCache
+    {
+        std::string m_directory;
+        std::string m_key;      // Fingerprint of rawlog and parameters
+
+    public:
+
+        /** Use a directory (created if needed) as cache for the frames of a
+          * rawlog preprocessed with the given parameters. */
+        int open( const std::string &directory,
+                  const std::string &rawlogFile,
+                  const std::string &parameters );
+
+        bool isOpen() const { return !m_key.empty(); }
+
+        std::string getFileName( size_t obs_index,
+                                 const std::string &calibration ) const;
+
+        /** Load a cached frame preprocessed with the given calibration of
+          * its sensor. Normals are left empty if they weren't cached.
+          * Returns false if the frame is not in the cache. */
+        bool load( size_t obs_index, const std::string &calibration,
+                   pcl::PointCloud<pcl::PointXYZ> &cloud,
+                   pcl::PointCloud<pcl::Normal> &normals ) const;
+
+        /** Store a frame. Normals are not stored if empty. It can be called
+          * concurrently for different frames. */
+        int save( size_t obs_index, const std::string &calibration,
+                  const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                  const pcl::PointCloud<pcl::Normal> &normals ) const;
+    };
+}
+
+
+#endif
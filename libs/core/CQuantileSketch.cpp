@@ -0,0 +1,189 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+
+#include "CQuantileSketch.hpp"
+
+#include <cmath>
+#include <limits>
+#include <iomanip>
+
+using namespace OLT;
+using namespace std;
+
+
+//-----------------------------------------------------------
+//
+//                    CQuantileSketch
+//
+//-----------------------------------------------------------
+
+CQuantileSketch::CQuantileSketch( double relativeAccuracy, size_t maxBuckets ) :
+    m_relativeAccuracy(relativeAccuracy),
+    m_logGamma( log( ( 1 + relativeAccuracy ) / ( 1 - relativeAccuracy ) ) ),
+    m_maxBuckets( std::max<size_t>( maxBuckets, 2 ) )
+{
+    clear();
+}
+
+void CQuantileSketch::clear()
+{
+    m_buckets.clear();
+    m_zeroCount = 0;
+    m_count = 0;
+    m_min = std::numeric_limits<double>::max();
+    m_max = -std::numeric_limits<double>::max();
+}
+
+void CQuantileSketch::add( double value, uint64_t count )
+{
+    if ( !count || ( value != value ) ) // Nothing to add or NaN
+        return;
+
+    if ( value > 0 )
+    {
+        m_buckets[ (int)ceil( log(value) / m_logGamma ) ] += count;
+
+        if ( m_buckets.size() > m_maxBuckets )
+            collapse();
+    }
+    else
+        m_zeroCount += count;
+
+    m_count += count;
+    m_min = std::min( m_min, value );
+    m_max = std::max( m_max, value );
+}
+
+// Move the counts of the lowest buckets to the lowest one to be kept.
+void CQuantileSketch::collapse()
+{
+    while ( m_buckets.size() > m_maxBuckets )
+    {
+        map<int,uint64_t>::iterator lowest = m_buckets.begin();
+        map<int,uint64_t>::iterator next = lowest;
+        next++;
+
+        next->second += lowest->second;
+        m_buckets.erase( lowest );
+    }
+}
+
+int CQuantileSketch::merge( const CQuantileSketch &other )
+{
+    if ( fabs( other.m_relativeAccuracy - m_relativeAccuracy ) > 1e-12 )
+    {
+        cerr << "  [ERROR] Can't merge quantile sketches with different accuracies." << endl;
+        return -1;
+    }
+
+    map<int,uint64_t>::const_iterator it;
+
+    for ( it = other.m_buckets.begin(); it != other.m_buckets.end(); it++ )
+        m_buckets[it->first] += it->second;
+
+    if ( m_buckets.size() > m_maxBuckets )
+        collapse();
+
+    m_zeroCount += other.m_zeroCount;
+    m_count += other.m_count;
+    m_min = std::min( m_min, other.m_min );
+    m_max = std::max( m_max, other.m_max );
+
+    return 0;
+}
+
+double CQuantileSketch::getQuantile( double quantile ) const
+{
+    if ( !m_count )
+        return 0;
+
+    quantile = std::min( std::max( quantile, 0.0 ), 1.0 );
+
+    // Lowest value with more than rank values below or at it
+    const double rank = quantile*( m_count - 1 );
+
+    if ( rank < m_zeroCount )
+        return std::min( 0.0, m_max );
+
+    uint64_t accumulated = m_zeroCount;
+    map<int,uint64_t>::const_iterator it;
+
+    for ( it = m_buckets.begin(); it != m_buckets.end(); it++ )
+    {
+        accumulated += it->second;
+
+        if ( accumulated > rank )
+            break;
+    }
+
+    if ( it == m_buckets.end() )
+        return m_max;
+
+    // Middle of the bucket in relative terms
+    const double gamma = exp( m_logGamma );
+    const double value = 2*exp( it->first*m_logGamma ) / ( gamma + 1 );
+
+    return std::min( std::max( value, m_min ), m_max );
+}
+
+void CQuantileSketch::save( ostream &stream ) const
+{
+    const streamsize precision = stream.precision();
+
+    stream << setprecision(17) << m_relativeAccuracy << " " << m_maxBuckets << " "
+           << m_count << " " << m_zeroCount << " " << m_min << " " << m_max << " "
+           << m_buckets.size();
+
+    map<int,uint64_t>::const_iterator it;
+
+    for ( it = m_buckets.begin(); it != m_buckets.end(); it++ )
+        stream << " " << it->first << " " << it->second;
+
+    stream << setprecision(precision);
+}
+
+int CQuantileSketch::load( istream &stream )
+{
+    size_t N_buckets;
+
+    if ( !( stream >> m_relativeAccuracy >> m_maxBuckets >> m_count >> m_zeroCount
+                   >> m_min >> m_max >> N_buckets ) )
+        return -1;
+
+    m_logGamma = log( ( 1 + m_relativeAccuracy ) / ( 1 - m_relativeAccuracy ) );
+    m_buckets.clear();
+
+    for ( size_t i = 0; i < N_buckets; i++ )
+    {
+        int index;
+        uint64_t count;
+
+        if ( !( stream >> index >> count ) )
+            return -1;
+
+        m_buckets[index] = count;
+    }
+
+    return 0;
+}
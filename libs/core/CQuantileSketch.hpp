@@ -0,0 +1,87 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+
+#ifndef _OLT_QUANTILE_SKETCH_
+#define _OLT_QUANTILE_SKETCH_
+
+#include "core.hpp"
+
+#include <map>
+#include <iostream>
+#include <stdint.h>
+
+
+namespace OLT
+{
+    /** Streaming quantiles of positive values with a bounded relative error
+      * (DDSketch). Values are counted in logarithmic buckets, the i-th one
+      * covering (gamma^(i-1), gamma^i] with gamma = (1+a)/(1-a), so any
+      * quantile is returned within a relative accuracy a, and two sketches
+      * with the same accuracy are merged adding their buckets. Memory is
+      * bounded collapsing the lowest buckets, which only degrades the
+      * accuracy of the lowest quantiles. Values <= 0 are counted apart. */
+
+    class CQuantileSketch
+    {
+        double                      m_relativeAccuracy;
+        double                      m_logGamma;
+        size_t                      m_maxBuckets;
+
+        std::map<int,uint64_t>      m_buckets;  // <bucket index,count>
+        uint64_t                    m_zeroCount;
+        uint64_t                    m_count;
+        double                      m_min, m_max;
+
+        void collapse();
+
+    public:
+
+        CQuantileSketch( double relativeAccuracy = 0.01, size_t maxBuckets = 2048 );
+
+        /** Remove all the values, keeping the accuracy. */
+        void clear();
+
+        void add( double value, uint64_t count = 1 );
+
+        /** Add the values of another sketch. Both must have the same
+          * relative accuracy. */
+        int merge( const CQuantileSketch &other );
+
+        /** Value at a quantile in [0,1], 0 if the sketch is empty. */
+        double getQuantile( double quantile ) const;
+
+        uint64_t getCount() const { return m_count; }
+        bool empty() const { return !m_count; }
+        double getMin() const { return m_min; }
+        double getMax() const { return m_max; }
+        double getRelativeAccuracy() const { return m_relativeAccuracy; }
+
+        /** Write/read the sketch as a single line of text. */
+        void save( std::ostream &stream ) const;
+        int load( std::istream &stream );
+    };
+}
+
+
+#endif
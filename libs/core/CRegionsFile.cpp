@@ -0,0 +1,93 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#include "CRegionsFile.hpp"
+
+#include <mrpt/utils/CFileGZInputStream.h>
+#include <mrpt/system/filesystem.h>
+
+using namespace OLT;
+using namespace std;
+
+using namespace mrpt::utils;
+
+
+//-----------------------------------------------------------
+//
+//                       CRegionsFile
+//
+//-----------------------------------------------------------
+
+void CRegionsFile::writeFrame( CStream &stream, const TFrameRegions &frame )
+{
+    stream << frame.obs_index << frame.sensorLabel << frame.timestamp
+           << frame.rows << frame.cols
+           << frame.regionIds << frame.trackIds;
+}
+
+int CRegionsFile::readFrame( CStream &stream, TFrameRegions &frame )
+{
+    // MRPT streams throw when there is nothing left to read
+
+    try
+    {
+        stream >> frame.obs_index >> frame.sensorLabel >> frame.timestamp
+               >> frame.rows >> frame.cols
+               >> frame.regionIds >> frame.trackIds;
+    }
+    catch ( std::exception & )
+    {
+        return -1;
+    }
+
+    const size_t N_pixels = (size_t)frame.rows*frame.cols;
+
+    if ( ( frame.regionIds.size() != N_pixels ) || ( frame.trackIds.size() != N_pixels ) )
+    {
+        cerr << "  [ERROR] Frame " << frame.obs_index << " of a regions file with "
+             << frame.regionIds.size() << " ids for " << N_pixels << " pixels." << endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+int CRegionsFile::load( const string &fileName, vector<TFrameRegions> &frames )
+{
+    frames.clear();
+
+    if ( !mrpt::system::fileExists(fileName) )
+    {
+        cerr << "  [ERROR] A regions file with name " << fileName;
+        cerr << " doesn't exist." << endl;
+        return -1;
+    }
+
+    CFileGZInputStream stream( fileName );
+
+    TFrameRegions frame;
+
+    while ( !readFrame( stream, frame ) )
+        frames.push_back( frame );
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#ifndef _OLT_REGIONS_FILE_
+#define _OLT_REGIONS_FILE_
+
+#include "core.hpp"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <mrpt/utils/CStream.h>
+
+
+namespace OLT
+{
+    /** Regions of a frame segmented by Segmentation (see its headless mode). */
+
+    struct TFrameRegions
+    {
+        uint64_t                obs_index;  // Index of the observation in the input rawlog
+        std::string             sensorLabel;
+        uint64_t                timestamp;
+        uint32_t                rows, cols;
+        std::vector<int32_t>    regionIds;  // Per pixel, row major, -1 if none
+        std::vector<int32_t>    trackIds;   // Per pixel, row major, -1 if not tracked
+    };
+
+    /** Files with the per-pixel regions of the frames of a segmented rawlog
+      * (<output rawlog>.regions), stored next to the output rawlog with the
+      * labels of the regions. The file is a gzip MRPT stream with a record
+      * per frame, in the order of the output rawlog:
+      *
+      *   uint64_t      obs_index
+      *   std::string   sensorLabel
+      *   uint64_t      timestamp
+      *   uint32_t      rows, cols
+      *   vector<int32_t> regionIds (rows*cols, row major)
+      *   vector<int32_t> trackIds  (rows*cols, row major)
+      *
+      * Region ids index the planes of the frame first, followed by its
+      * clusters. Track ids are only set for tracked planes. */
+
+    class CRegionsFile
+    {
+    public:
+
+        static void writeFrame( mrpt::utils::CStream &stream, const TFrameRegions &frame );
+
+        /** Read the next frame. Fails at the end of the stream. */
+        static int readFrame( mrpt::utils::CStream &stream, TFrameRegions &frame );
+
+        /** Load all the frames of a regions file. */
+        static int load( const std::string &fileName, std::vector<TFrameRegions> &frames );
+    };
+}
+
+
+#endif
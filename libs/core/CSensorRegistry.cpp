@@ -0,0 +1,360 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#include "CSensorRegistry.hpp"
+
+#include <mrpt/obs/CRawlog.h>
+#include <mrpt/utils/CConfigFile.h>
+#include <mrpt/utils/CFileGZInputStream.h>
+#include <mrpt/system/filesystem.h>
+#include <mrpt/utils.h>
+
+using namespace OLT;
+using namespace std;
+
+using namespace mrpt;
+using namespace mrpt::obs;
+using namespace mrpt::utils;
+using namespace mrpt::poses;
+
+
+//-----------------------------------------------------------
+//
+//                     TRGBDCameraModel
+//
+//-----------------------------------------------------------
+
+TRGBDCameraModel::TRGBDCameraModel() :
+    depthParams(CSensorRegistry::getDefaultDepthParams()),
+    intensityParams(CSensorRegistry::getDefaultIntensityParams()),
+    depthToIntensity(CSensorRegistry::getDefaultDepthToIntensity()),
+    intrinsicsSource(DEFAULT),
+    depthRows(depthParams.nrows), depthCols(depthParams.ncols),
+    intensityRows(intensityParams.nrows), intensityCols(intensityParams.ncols),
+    colorizationIsExact(true)
+{
+}
+
+void TRGBDCameraModel::computeUnprojectionTables()
+{
+    const float cx = depthParams.cx();
+    const float cy = depthParams.cy();
+    const float fx_inv = 1.0/depthParams.fx();
+    const float fy_inv = 1.0/depthParams.fy();
+
+    rayY.resize(depthRows*depthCols);
+    rayZ.resize(depthRows*depthCols);
+
+    for ( size_t row = 0; row < depthRows; row++ )
+        for ( size_t col = 0; col < depthCols; col++ )
+        {
+            rayY[row*depthCols+col] = (cx - col)*fx_inv;
+            rayZ[row*depthCols+col] = (cy - row)*fy_inv;
+        }
+
+    computeColorizationTable();
+}
+
+void TRGBDCameraModel::computeColorizationTable()
+{
+    const size_t N_pixels = rayY.size();
+
+    intensityCol.assign(N_pixels,-1);
+    intensityRow.assign(N_pixels,-1);
+
+    colorizationIsExact = ( depthToIntensity.norm() < 1e-6 );
+
+    for ( size_t i = 0; i < N_pixels; i++ )
+    {
+        // Ray of the pixel expressed in the RGB camera frame
+        double qx, qy, qz;
+        depthToIntensity.inverseComposePoint(1,rayY[i],rayZ[i],qx,qy,qz);
+
+        if ( qz <= 0 )
+            continue;
+
+        int col = round(intensityParams.cx() + intensityParams.fx()*qx/qz);
+        int row = round(intensityParams.cy() + intensityParams.fy()*qy/qz);
+
+        if ( ( col >= 0 ) && ( col < (int)intensityCols )
+             && ( row >= 0 ) && ( row < (int)intensityRows ) )
+        {
+            intensityCol[i] = col;
+            intensityRow[i] = row;
+        }
+    }
+}
+
+void TRGBDCameraModel::applyTo( CObservation3DRangeScan &obs ) const
+{
+    obs.setSensorPose( pose );
+
+    if ( intrinsicsSource == OBSERVATION )
+    {
+        obs.cameraParams.scaleToResolution(depthParams.ncols,depthParams.nrows);
+        obs.cameraParamsIntensity.scaleToResolution(intensityParams.ncols,intensityParams.nrows);
+    }
+    else
+    {
+        obs.cameraParams = depthParams;
+        obs.cameraParamsIntensity = intensityParams;
+    }
+
+    obs.relativePoseIntensityWRTDepth = depthToIntensity;
+}
+
+
+//-----------------------------------------------------------
+//
+//                      CSensorRegistry
+//
+//-----------------------------------------------------------
+
+TCamera CSensorRegistry::getDefaultDepthParams()
+{
+    TCamera params;
+    params.nrows = 488;
+    params.scaleToResolution(320,244);
+
+    return params;
+}
+
+TCamera CSensorRegistry::getDefaultIntensityParams()
+{
+    TCamera params;
+    params.scaleToResolution(320,240);
+
+    return params;
+}
+
+CPose3D CSensorRegistry::getDefaultDepthToIntensity()
+{
+    // Pure rotation. For more info. see:
+    // http://reference.mrpt.org/stable/classmrpt_1_1obs_1_1_c_observation3_d_range_scan.html
+    return CPose3D(0,0,0,DEG2RAD(-90),0,DEG2RAD(-90));
+}
+
+int CSensorRegistry::loadFromConfigFile( const string &configFileName,
+                                         bool useDefaultIntrinsics )
+{
+    if (!mrpt::system::fileExists(configFileName))
+    {
+        cerr << "  [ERROR] A configuration file with name " << configFileName;
+        cerr << " doesn't exist." << endl;
+        return 0;
+    }
+
+    CConfigFile config( configFileName );
+
+    size_t sensorIndex = 1;
+    string sensorLabel = mrpt::format("RGBD_%i",(int)sensorIndex);
+
+    while ( config.sectionExists(sensorLabel) )
+    {
+        TRGBDCameraModel model;
+        model.sensorLabel = sensorLabel;
+
+        double x       = config.read_double(sensorLabel,"x",0,true);
+        double y       = config.read_double(sensorLabel,"y",0,true);
+        double z       = config.read_double(sensorLabel,"z",0,true);
+        double yaw     = DEG2RAD(config.read_double(sensorLabel,"yaw",0,true));
+        double pitch   = DEG2RAD(config.read_double(sensorLabel,"pitch",0,true));
+        double roll    = DEG2RAD(config.read_double(sensorLabel,"roll",0,true));
+
+        model.pose.setFromValues(x,y,z,yaw,pitch,roll);
+
+        bool loadIntrinsic = config.read_bool(sensorLabel,"loadIntrinsic",false,false);
+
+        if ( useDefaultIntrinsics )
+            model.intrinsicsSource = TRGBDCameraModel::DEFAULT;
+        else if ( loadIntrinsic )
+        {
+            model.depthParams.loadFromConfigFile(sensorLabel + "_depth",config);
+            model.intensityParams.loadFromConfigFile(sensorLabel + "_intensity",config);
+            model.intrinsicsSource = TRGBDCameraModel::CONFIG_FILE;
+        }
+        else
+            model.intrinsicsSource = TRGBDCameraModel::OBSERVATION;
+
+        model.depthRows     = model.depthParams.nrows;
+        model.depthCols     = model.depthParams.ncols;
+        model.intensityRows = model.intensityParams.nrows;
+        model.intensityCols = model.intensityParams.ncols;
+
+        model.computeUnprojectionTables();
+
+        registerSensor( model );
+
+        sensorIndex++;
+        sensorLabel = mrpt::format("RGBD_%i",(int)sensorIndex);
+    }
+
+    return 1;
+}
+
+int CSensorRegistry::registerSensor( const TRGBDCameraModel &model )
+{
+    int index = getSensorIndex(model.sensorLabel);
+
+    if ( index >= 0 )
+    {
+        m_sensors[index] = model;
+        return index;
+    }
+
+    m_sensors.push_back(model);
+
+    return m_sensors.size()-1;
+}
+
+int CSensorRegistry::registerFromObs( const CObservation3DRangeScan &obs )
+{
+    int index = getSensorIndex(obs.sensorLabel);
+
+    size_t depthRows = ( obs.hasRangeImage ) ? obs.rangeImage.rows() : obs.cameraParams.nrows;
+    size_t depthCols = ( obs.hasRangeImage ) ? obs.rangeImage.cols() : obs.cameraParams.ncols;
+
+    if ( index >= 0 )
+    {
+        TRGBDCameraModel &model = m_sensors[index];
+
+        if ( ( model.depthRows != depthRows ) || ( model.depthCols != depthCols ) )
+        {
+            model.depthRows = depthRows;
+            model.depthCols = depthCols;
+            model.computeUnprojectionTables();
+        }
+
+        if ( obs.hasIntensityImage &&
+             ( ( model.intensityRows != obs.intensityImage.getHeight() ) ||
+               ( model.intensityCols != obs.intensityImage.getWidth() ) ) )
+        {
+            model.intensityRows = obs.intensityImage.getHeight();
+            model.intensityCols = obs.intensityImage.getWidth();
+            model.computeColorizationTable();
+        }
+
+        return index;
+    }
+
+    TRGBDCameraModel model;
+
+    model.sensorLabel       = obs.sensorLabel;
+    model.pose              = obs.sensorPose;
+    model.depthParams       = obs.cameraParams;
+    model.intensityParams   = obs.cameraParamsIntensity;
+    model.depthToIntensity  = obs.relativePoseIntensityWRTDepth;
+    model.intrinsicsSource  = TRGBDCameraModel::OBSERVATION;
+
+    model.depthRows = depthRows;
+    model.depthCols = depthCols;
+    model.intensityRows = ( obs.hasIntensityImage ) ?
+                obs.intensityImage.getHeight() : obs.cameraParamsIntensity.nrows;
+    model.intensityCols = ( obs.hasIntensityImage ) ?
+                obs.intensityImage.getWidth() : obs.cameraParamsIntensity.ncols;
+
+    model.computeUnprojectionTables();
+
+    m_sensors.push_back(model);
+
+    return m_sensors.size()-1;
+}
+
+int CSensorRegistry::discoverSensors( const string &rawlogFileName,
+                                      const vector<string> &expectedSensors,
+                                      size_t maxObs )
+{
+    if (!mrpt::system::fileExists(rawlogFileName))
+    {
+        cerr << "  [ERROR] A rawlog file with name " << rawlogFileName;
+        cerr << " doesn't exist." << endl;
+        return 0;
+    }
+
+    CFileGZInputStream i_rawlog(rawlogFileName);
+
+    CActionCollectionPtr action;
+    CSensoryFramePtr observations;
+    CObservationPtr obs;
+    size_t obsIndex = 0;
+
+    size_t N_expectedFound = 0;
+    vector<bool> expectedFound( expectedSensors.size(), false );
+
+    while ( ( !maxObs || ( obsIndex < maxObs ) ) &&
+            ( expectedSensors.empty() || ( N_expectedFound < expectedSensors.size() ) ) &&
+            CRawlog::getActionObservationPairOrObservation(i_rawlog,action,observations,obs,obsIndex) )
+    {
+        if ( !obs || !IS_CLASS(obs, CObservation3DRangeScan) )
+            continue;
+
+        // Only the first observation of each sensor is loaded
+
+        if ( hasSensor( obs->sensorLabel ) )
+            continue;
+
+        CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
+        obs3D->load();
+
+        registerFromObs(*obs3D);
+
+        for ( size_t i = 0; i < expectedSensors.size(); i++ )
+            if ( !expectedFound[i] && ( expectedSensors[i] == obs3D->sensorLabel ) )
+            {
+                expectedFound[i] = true;
+                N_expectedFound++;
+            }
+    }
+
+    for ( size_t i = 0; i < expectedSensors.size(); i++ )
+        if ( !expectedFound[i] )
+            cerr << "  [WARNING] Sensor " << expectedSensors[i] << " not found in "
+                 << rawlogFileName << endl;
+
+    return m_sensors.size();
+}
+
+int CSensorRegistry::getSensorIndex( const string &sensorLabel ) const
+{
+    for ( size_t i = 0; i < m_sensors.size(); i++ )
+        if ( m_sensors[i].sensorLabel == sensorLabel )
+            return i;
+
+    return -1;
+}
+
+const TRGBDCameraModel* CSensorRegistry::getModel( const string &sensorLabel ) const
+{
+    int index = getSensorIndex(sensorLabel);
+
+    return ( index >= 0 ) ? &m_sensors[index] : NULL;
+}
+
+vector<string> CSensorRegistry::getSensorLabels() const
+{
+    vector<string> labels;
+
+    for ( size_t i = 0; i < m_sensors.size(); i++ )
+        labels.push_back(m_sensors[i].sensorLabel);
+
+    return labels;
+}
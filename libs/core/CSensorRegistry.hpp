@@ -0,0 +1,141 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#ifndef _OLT_SENSOR_REGISTRY_
+#define _OLT_SENSOR_REGISTRY_
+
+#include "core.hpp"
+
+#include <string>
+#include <vector>
+#include <mrpt/utils/TCamera.h>
+#include <mrpt/poses/CPose3D.h>
+#include <mrpt/obs/CObservation3DRangeScan.h>
+
+
+namespace OLT
+{
+    /** Camera model of an RGB-D sensor. It is computed once (from a
+      * configuration file or from the first observation of the sensor) and
+      * shared by all the observations with the same sensor label. */
+
+    struct TRGBDCameraModel
+    {
+        /** Where the intrinsic parameters come from:
+          * 'DEFAULT'     : default parameters of the toolkit.
+          * 'CONFIG_FILE' : sections <label>_depth and <label>_intensity.
+          * 'OBSERVATION' : the ones within the observations, scaled to the
+          *                 resolution of depthParams and intensityParams. */
+        enum TIntrinsicsSource { DEFAULT = 0, CONFIG_FILE, OBSERVATION };
+
+        std::string             sensorLabel;
+        mrpt::poses::CPose3D    pose;             // Pose of the sensor in the robot
+        mrpt::utils::TCamera    depthParams;
+        mrpt::utils::TCamera    intensityParams;
+        mrpt::poses::CPose3D    depthToIntensity; // Pose of the RGB camera wrt the depth one
+        TIntrinsicsSource       intrinsicsSource;
+
+        size_t  depthRows;       // Size of the range images
+        size_t  depthCols;
+        size_t  intensityRows;   // Size of the intensity images
+        size_t  intensityCols;
+
+        // Unprojection tables of the depth camera, one entry per pixel (row
+        // major). As in MRPT, pixel i with depth d is projected to the point
+        // (d, d*rayY[i], d*rayZ[i]) in the sensor frame.
+        std::vector<float>      rayY;
+        std::vector<float>      rayZ;
+
+        // Colorization table: pixel of the intensity image seen by each pixel
+        // of the depth image (-1 if out of it). It doesn't depend on depth if
+        // the RGB camera is only rotated wrt the depth one, otherwise it has
+        // to be computed per point.
+        std::vector<int>        intensityCol;
+        std::vector<int>        intensityRow;
+        bool                    colorizationIsExact;
+
+        TRGBDCameraModel();
+
+        void computeUnprojectionTables();
+        void computeColorizationTable();
+
+        /** Set the pose, intrinsics and depth to RGB transformation of the
+          * model into an observation of the sensor. */
+        void applyTo( mrpt::obs::CObservation3DRangeScan &obs ) const;
+    };
+
+
+    class CSensorRegistry
+    {
+        std::vector<TRGBDCameraModel> m_sensors;
+
+    public:
+
+        static mrpt::utils::TCamera getDefaultDepthParams();
+        static mrpt::utils::TCamera getDefaultIntensityParams();
+        static mrpt::poses::CPose3D getDefaultDepthToIntensity();
+
+        /** Load the sensors RGBD_1, RGBD_2, ... from a configuration file.
+          * Each one is defined in a section with its pose (x, y, z, yaw,
+          * pitch and roll in degrees) and, if loadIntrinsic is set and the
+          * default intrinsics are not used, with the sections <label>_depth
+          * and <label>_intensity. */
+        int loadFromConfigFile( const std::string &configFileName,
+                                bool useDefaultIntrinsics = true );
+
+        /** Register a model, returning its index. If a sensor with the same
+          * label was already registered its model is replaced. */
+        int registerSensor( const TRGBDCameraModel &model );
+
+        /** Register the sensor of an observation if it is new, or update the
+          * size of its images if they changed. Returns its index. */
+        int registerFromObs( const mrpt::obs::CObservation3DRangeScan &obs );
+
+        /** Register the RGB-D sensors appearing in a rawlog. The scan stops
+          * once all the expected sensors are registered (if any are given),
+          * otherwise it goes through the whole rawlog, or through its first
+          * maxObs observations if maxObs is not 0. Expected sensors not
+          * found are reported. Returns the number of sensors. */
+        int discoverSensors( const std::string &rawlogFileName,
+                             const std::vector<std::string> &expectedSensors = std::vector<std::string>(),
+                             size_t maxObs = 0 );
+
+        int getSensorIndex( const std::string &sensorLabel ) const;
+
+        bool hasSensor( const std::string &sensorLabel ) const
+        { return ( getSensorIndex(sensorLabel) >= 0 ); }
+
+        const TRGBDCameraModel* getModel( const std::string &sensorLabel ) const;
+
+        std::vector<std::string> getSensorLabels() const;
+
+        size_t size() const { return m_sensors.size(); }
+        bool   empty() const { return m_sensors.empty(); }
+        void   clear() { m_sensors.clear(); }
+
+        TRGBDCameraModel& operator[]( size_t index ) { return m_sensors[index]; }
+        const TRGBDCameraModel& operator[]( size_t index ) const { return m_sensors[index]; }
+    };
+}
+
+
+#endif
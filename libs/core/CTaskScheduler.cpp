@@ -0,0 +1,484 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#include "CTaskScheduler.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+using namespace OLT;
+using namespace std;
+
+
+//-----------------------------------------------------------
+//
+//                      CScratchArena
+//
+//-----------------------------------------------------------
+
+const size_t MIN_SCRATCH_BLOCK_SIZE = 64*1024;
+
+CScratchArena::CScratchArena() : m_currentBlock(0), m_offset(0)
+{}
+
+CScratchArena::~CScratchArena()
+{
+    for ( size_t i = 0; i < m_blocks.size(); i++ )
+        delete [] m_blocks[i];
+}
+
+void* CScratchArena::allocate( size_t bytes, size_t alignment )
+{
+    while ( m_currentBlock < m_blocks.size() )
+    {
+        size_t offset = ( m_offset + alignment - 1 ) & ~( alignment - 1 );
+
+        if ( offset + bytes <= m_blockSizes[m_currentBlock] )
+        {
+            m_offset = offset + bytes;
+            return m_blocks[m_currentBlock] + offset;
+        }
+
+        // Move to the next block, if any
+        if ( m_currentBlock + 1 == m_blocks.size() )
+            break;
+
+        m_currentBlock++;
+        m_offset = 0;
+    }
+
+    // Not enough room, add a new block at least doubling the capacity
+    size_t blockSize = std::max( bytes + alignment, MIN_SCRATCH_BLOCK_SIZE );
+    blockSize = std::max( blockSize, capacity() );
+
+    m_blocks.push_back( new char[blockSize] );
+    m_blockSizes.push_back( blockSize );
+
+    m_currentBlock = m_blocks.size()-1;
+    m_offset = 0;
+
+    return allocate( bytes, alignment );
+}
+
+CScratchArena::TMarker CScratchArena::getMarker() const
+{
+    TMarker marker;
+    marker.block  = m_currentBlock;
+    marker.offset = m_offset;
+
+    return marker;
+}
+
+void CScratchArena::release( const TMarker &marker )
+{
+    m_currentBlock = marker.block;
+    m_offset       = marker.offset;
+
+    // Everything released? Merge the blocks so the next time it fits in one
+    if ( !m_currentBlock && !m_offset && ( m_blocks.size() > 1 ) )
+    {
+        size_t totalSize = capacity();
+
+        for ( size_t i = 0; i < m_blocks.size(); i++ )
+            delete [] m_blocks[i];
+
+        m_blocks.assign( 1, new char[totalSize] );
+        m_blockSizes.assign( 1, totalSize );
+    }
+}
+
+size_t CScratchArena::capacity() const
+{
+    size_t totalSize = 0;
+
+    for ( size_t i = 0; i < m_blockSizes.size(); i++ )
+        totalSize += m_blockSizes[i];
+
+    return totalSize;
+}
+
+
+//-----------------------------------------------------------
+//
+//                      CTaskScheduler
+//
+//-----------------------------------------------------------
+
+namespace
+{
+    struct TTaskEntry
+    {
+        CTask       *task;
+        CTaskGroup  *group;
+    };
+
+    struct TTaskQueue
+    {
+        pthread_mutex_t         lock;
+        std::deque<TTaskEntry>  tasks;
+
+        TTaskQueue() { pthread_mutex_init(&lock,NULL); }
+        ~TTaskQueue() { pthread_mutex_destroy(&lock); }
+    };
+
+    size_t  requestedNumThreads = 0;   // 0 until set or resolved
+
+    // Index of the queue of the calling thread, -1 if it is not a worker
+    __thread int            t_queueIndex = -1;
+    __thread CScratchArena  *t_arena = NULL;
+
+    // Arenas of threads out of the pool (e.g. the main one)
+    pthread_mutex_t         externalArenasLock = PTHREAD_MUTEX_INITIALIZER;
+    vector<CScratchArena*>  externalArenas;
+}
+
+struct CTaskScheduler::TImpl
+{
+    size_t                  N_workers;
+    vector<pthread_t>       workers;
+    vector<TTaskQueue*>     queues;     // One per worker plus one shared by external threads
+    vector<CScratchArena*>  arenas;     // One per worker
+
+    pthread_mutex_t         idleLock;
+    pthread_cond_t          idleCond;
+    volatile long           N_queued;
+    volatile bool           stop;
+
+    struct TWorkerArgs
+    {
+        TImpl   *impl;
+        size_t  index;
+    };
+
+    bool popTask( size_t self, TTaskEntry &entry );
+};
+
+bool CTaskScheduler::TImpl::popTask( size_t self, TTaskEntry &entry )
+{
+    const size_t N_queues = queues.size();
+
+    // Own queue first (LIFO, the most recent task is the hottest in cache)
+    TTaskQueue &own = *queues[self];
+
+    pthread_mutex_lock(&own.lock);
+    if ( !own.tasks.empty() )
+    {
+        entry = own.tasks.back();
+        own.tasks.pop_back();
+        pthread_mutex_unlock(&own.lock);
+        return true;
+    }
+    pthread_mutex_unlock(&own.lock);
+
+    // Steal the oldest (and usually largest) task of another queue
+    for ( size_t i = 1; i < N_queues; i++ )
+    {
+        TTaskQueue &victim = *queues[(self+i)%N_queues];
+
+        pthread_mutex_lock(&victim.lock);
+        if ( !victim.tasks.empty() )
+        {
+            entry = victim.tasks.front();
+            victim.tasks.pop_front();
+            pthread_mutex_unlock(&victim.lock);
+            return true;
+        }
+        pthread_mutex_unlock(&victim.lock);
+    }
+
+    return false;
+}
+
+bool CTaskScheduler::runTask( TImpl *impl, size_t self )
+{
+    TTaskEntry entry;
+
+    if ( !impl->popTask(self,entry) )
+        return false;
+
+    __sync_fetch_and_sub(&impl->N_queued,1);
+
+    // Failures are recorded in the group and thrown from its wait(), the
+    // task is always accounted for so waiting threads don't hang
+    try
+    {
+        entry.task->run();
+    }
+    catch (exception &e)
+    {
+        entry.group->fail( e.what() );
+    }
+    catch (...)
+    {
+        entry.group->fail( "Unknown exception" );
+    }
+
+    delete entry.task;
+
+    __sync_fetch_and_sub(&entry.group->m_pending,1);
+
+    return true;
+}
+
+void* CTaskScheduler::workerMain( void *args )
+{
+    TImpl::TWorkerArgs *workerArgs = static_cast<TImpl::TWorkerArgs*>(args);
+    TImpl *impl = workerArgs->impl;
+    const size_t index = workerArgs->index;
+    delete workerArgs;
+
+    t_queueIndex = index;
+    t_arena = impl->arenas[index];
+
+    while ( true )
+    {
+        if ( runTask(impl,index) )
+            continue;
+
+        pthread_mutex_lock(&impl->idleLock);
+
+        while ( !impl->stop && !__sync_fetch_and_add(&impl->N_queued,0) )
+            pthread_cond_wait(&impl->idleCond,&impl->idleLock);
+
+        bool stop = impl->stop;
+
+        pthread_mutex_unlock(&impl->idleLock);
+
+        if ( stop )
+            break;
+    }
+
+    return NULL;
+}
+
+CTaskScheduler::CTaskScheduler() : m_impl(NULL)
+{}
+
+CTaskScheduler::~CTaskScheduler()
+{
+    shutdown();
+
+    pthread_mutex_lock(&externalArenasLock);
+
+    for ( size_t i = 0; i < externalArenas.size(); i++ )
+        delete externalArenas[i];
+
+    externalArenas.clear();
+
+    pthread_mutex_unlock(&externalArenasLock);
+}
+
+void CTaskScheduler::start( size_t N_threads )
+{
+    m_impl = new TImpl;
+
+    m_impl->N_workers = ( N_threads > 1 ) ? N_threads-1 : 0;
+    m_impl->N_queued  = 0;
+    m_impl->stop      = false;
+
+    pthread_mutex_init(&m_impl->idleLock,NULL);
+    pthread_cond_init(&m_impl->idleCond,NULL);
+
+    for ( size_t i = 0; i < m_impl->N_workers+1; i++ )
+        m_impl->queues.push_back( new TTaskQueue() );
+
+    for ( size_t i = 0; i < m_impl->N_workers; i++ )
+        m_impl->arenas.push_back( new CScratchArena() );
+
+    m_impl->workers.resize( m_impl->N_workers );
+
+    for ( size_t i = 0; i < m_impl->N_workers; i++ )
+    {
+        TImpl::TWorkerArgs *args = new TImpl::TWorkerArgs;
+        args->impl  = m_impl;
+        args->index = i;
+
+        if ( pthread_create(&m_impl->workers[i],NULL,workerMain,args) )
+        {
+            delete args;
+            throw runtime_error("Unable to create the threads of the task scheduler.");
+        }
+    }
+}
+
+void CTaskScheduler::shutdown()
+{
+    if ( !m_impl )
+        return;
+
+    pthread_mutex_lock(&m_impl->idleLock);
+    m_impl->stop = true;
+    pthread_cond_broadcast(&m_impl->idleCond);
+    pthread_mutex_unlock(&m_impl->idleLock);
+
+    for ( size_t i = 0; i < m_impl->workers.size(); i++ )
+        pthread_join(m_impl->workers[i],NULL);
+
+    for ( size_t i = 0; i < m_impl->queues.size(); i++ )
+        delete m_impl->queues[i];
+
+    for ( size_t i = 0; i < m_impl->arenas.size(); i++ )
+        delete m_impl->arenas[i];
+
+    pthread_mutex_destroy(&m_impl->idleLock);
+    pthread_cond_destroy(&m_impl->idleCond);
+
+    delete m_impl;
+    m_impl = NULL;
+}
+
+CTaskScheduler& CTaskScheduler::instance()
+{
+    static CTaskScheduler scheduler;
+
+    if ( !scheduler.m_impl )
+        scheduler.start( getNumThreads() );
+
+    return scheduler;
+}
+
+void CTaskScheduler::setNumThreads( size_t N_threads )
+{
+    if ( !N_threads )
+    {
+        long N_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        N_threads = ( N_cores > 0 ) ? N_cores : 1;
+    }
+
+    if ( N_threads == requestedNumThreads )
+        return;
+
+    requestedNumThreads = N_threads;
+
+    // Restart the pool if it is already running
+    CTaskScheduler &scheduler = instance();
+    scheduler.shutdown();
+    scheduler.start( N_threads );
+}
+
+size_t CTaskScheduler::getNumThreads()
+{
+    if ( !requestedNumThreads )
+    {
+        long N_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        requestedNumThreads = ( N_cores > 0 ) ? N_cores : 1;
+    }
+
+    return requestedNumThreads;
+}
+
+void CTaskScheduler::spawn( CTask *task, CTaskGroup &group )
+{
+    __sync_fetch_and_add(&group.m_pending,1);
+
+    // Workers push into their own queue, other threads into the shared one
+    size_t index = ( t_queueIndex >= 0 ) ? t_queueIndex : m_impl->N_workers;
+
+    TTaskEntry entry;
+    entry.task  = task;
+    entry.group = &group;
+
+    TTaskQueue &queue = *m_impl->queues[index];
+
+    pthread_mutex_lock(&queue.lock);
+    queue.tasks.push_back(entry);
+    pthread_mutex_unlock(&queue.lock);
+
+    pthread_mutex_lock(&m_impl->idleLock);
+    __sync_fetch_and_add(&m_impl->N_queued,1);
+    pthread_cond_signal(&m_impl->idleCond);
+    pthread_mutex_unlock(&m_impl->idleLock);
+}
+
+bool CTaskScheduler::runPendingTask()
+{
+    size_t self = ( t_queueIndex >= 0 ) ? t_queueIndex : m_impl->N_workers;
+
+    return runTask( m_impl, self );
+}
+
+CScratchArena& CTaskScheduler::getScratchArena()
+{
+    if ( !t_arena )
+    {
+        t_arena = new CScratchArena();
+
+        pthread_mutex_lock(&externalArenasLock);
+        externalArenas.push_back(t_arena);
+        pthread_mutex_unlock(&externalArenasLock);
+    }
+
+    return *t_arena;
+}
+
+
+//-----------------------------------------------------------
+//
+//                        CTaskGroup
+//
+//-----------------------------------------------------------
+
+void CTaskGroup::run( CTask *task )
+{
+    CTaskScheduler::instance().spawn( task, *this );
+}
+
+void CTaskGroup::join()
+{
+    if ( !__sync_fetch_and_add(&m_pending,0) )
+        return;
+
+    CTaskScheduler &scheduler = CTaskScheduler::instance();
+
+    // Help with pending tasks instead of blocking, so nested groups work
+    while ( __sync_fetch_and_add(&m_pending,0) )
+        if ( !scheduler.runPendingTask() )
+            sched_yield();
+}
+
+void CTaskGroup::fail( const string &error )
+{
+    // Only the first failure is kept. It's written before the task is
+    // accounted for in m_pending, whose atomic updates are full barriers,
+    // so wait() reads it once all the tasks have finished
+    if ( __sync_bool_compare_and_swap(&m_failed,0,1) )
+        m_error = error;
+}
+
+void CTaskGroup::wait()
+{
+    join();
+
+    if ( __sync_fetch_and_add(&m_failed,0) )
+    {
+        string error = m_error;
+
+        m_failed = 0;
+        m_error.clear();
+
+        throw runtime_error( "Task failed: " + error );
+    }
+}
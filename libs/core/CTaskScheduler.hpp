@@ -0,0 +1,234 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#ifndef _OLT_TASK_SCHEDULER_
+#define _OLT_TASK_SCHEDULER_
+
+#include "core.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+namespace OLT
+{
+    /** Unit of work to be executed by the task scheduler. */
+
+    class CTask
+    {
+    public:
+        virtual ~CTask() {}
+        virtual void run() = 0;
+    };
+
+
+    /** Bump allocator for temporary buffers. Each thread of the scheduler owns
+      * one, so tasks can get scratch memory without hitting the heap. Memory
+      * is given back in LIFO order through markers (see CScratchScope). */
+
+    class CScratchArena
+    {
+        std::vector<char*>  m_blocks;
+        std::vector<size_t> m_blockSizes;
+        size_t              m_currentBlock;
+        size_t              m_offset;
+
+        CScratchArena( const CScratchArena & );
+        CScratchArena& operator=( const CScratchArena & );
+
+    public:
+
+        struct TMarker
+        {
+            size_t block;
+            size_t offset;
+        };
+
+        CScratchArena();
+        ~CScratchArena();
+
+        void* allocate( size_t bytes, size_t alignment = 16 );
+
+        template <class T>
+        T* allocate( size_t N ) { return static_cast<T*>(allocate(N*sizeof(T))); }
+
+        TMarker getMarker() const;
+
+        /** Release the memory allocated after the marker. When everything is
+          * released, the blocks are merged into one to avoid future growth. */
+        void release( const TMarker &marker );
+
+        size_t capacity() const;
+    };
+
+    /** Gives back to an arena the memory allocated during its lifetime. */
+
+    class CScratchScope
+    {
+        CScratchArena           &m_arena;
+        CScratchArena::TMarker  m_marker;
+
+    public:
+        CScratchScope( CScratchArena &arena ) : m_arena(arena),
+            m_marker(arena.getMarker())
+        {}
+
+        ~CScratchScope() { m_arena.release(m_marker); }
+    };
+
+
+    /** Set of tasks that can be waited for. Tasks run through a group are
+      * owned by the scheduler, which deletes them once executed. Waiting
+      * threads execute pending tasks meanwhile, so tasks can spawn and wait
+      * for nested groups without blocking the pool. */
+
+    class CTaskGroup
+    {
+        volatile long   m_pending;
+        volatile long   m_failed;   // Set by the first task throwing
+        std::string     m_error;    // Message of its exception
+
+        friend class CTaskScheduler;
+
+        void join();
+        void fail( const std::string &error );
+
+    public:
+        CTaskGroup() : m_pending(0), m_failed(0)
+        {}
+
+        ~CTaskGroup() { join(); }
+
+        void run( CTask *task );
+
+        /** Wait for all the tasks of the group. If any of them threw an
+          * exception, it throws a std::runtime_error with the message of the
+          * first one once the others have finished. */
+        void wait();
+    };
+
+
+    /** Work-stealing pool of threads shared by the whole application. Each
+      * thread pushes and pops tasks at the back of its own queue, while idle
+      * threads steal them from the front of the others. The thread calling
+      * CTaskGroup::wait() counts as one of the threads, so a pool of N
+      * threads has N-1 workers, and a single thread runs everything inline. */
+
+    class CTaskScheduler
+    {
+        struct TImpl;
+
+        TImpl   *m_impl;
+
+        CTaskScheduler();
+        ~CTaskScheduler();
+
+        void start( size_t N_threads );
+        void shutdown();
+
+        void spawn( CTask *task, CTaskGroup &group );
+
+        static bool runTask( TImpl *impl, size_t self );
+        static void* workerMain( void *args );
+
+        friend class CTaskGroup;
+
+    public:
+
+        static CTaskScheduler& instance();
+
+        /** Set the number of threads (0 means the number of cores). It must
+          * be called when no tasks are running, e.g. after parsing the common
+          * '-threads' argument of the apps. */
+        static void setNumThreads( size_t N_threads );
+        static size_t getNumThreads();
+
+        /** Execute one pending task, if any, in the calling thread. */
+        bool runPendingTask();
+
+        /** Scratch arena of the calling thread. */
+        static CScratchArena& getScratchArena();
+    };
+
+
+    /** Task executing body(i) for i in a range. It recursively leaves the
+      * upper half of the range to other threads until reaching the grain. */
+
+    template <class BODY>
+    class CRangeTask : public CTask
+    {
+        BODY        &m_body;
+        size_t      m_begin;
+        size_t      m_end;
+        size_t      m_grain;
+        CTaskGroup  &m_group;
+
+    public:
+        CRangeTask( BODY &body, size_t begin, size_t end, size_t grain,
+                    CTaskGroup &group ) : m_body(body), m_begin(begin),
+            m_end(end), m_grain(grain), m_group(group)
+        {}
+
+        void run()
+        {
+            while ( m_end - m_begin > m_grain )
+            {
+                size_t middle = m_begin + ( m_end - m_begin )/2;
+                m_group.run( new CRangeTask<BODY>(m_body,middle,m_end,m_grain,m_group) );
+                m_end = middle;
+            }
+
+            for ( size_t i = m_begin; i < m_end; i++ )
+                m_body(i);
+        }
+    };
+
+    /** Call body(i) for each i in [begin,end) using the scheduler. The body
+      * must be safe to call concurrently with different indices. Exceptions
+      * thrown by the body reach the caller as a std::runtime_error. */
+
+    template <class BODY>
+    void parallelFor( size_t begin, size_t end, BODY &body, size_t grain = 1 )
+    {
+        if ( begin >= end )
+            return;
+
+        if ( grain < 1 )
+            grain = 1;
+
+        if ( ( CTaskScheduler::getNumThreads() <= 1 ) || ( end - begin <= grain ) )
+        {
+            for ( size_t i = begin; i < end; i++ )
+                body(i);
+
+            return;
+        }
+
+        CTaskGroup group;
+        group.run( new CRangeTask<BODY>(body,begin,end,grain,group) );
+        group.wait();
+    }
+}
+
+
+#endif
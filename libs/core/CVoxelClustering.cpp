@@ -0,0 +1,435 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+
+#include "CVoxelClustering.hpp"
+#include "CTaskScheduler.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+using namespace OLT;
+using namespace std;
+
+
+namespace
+{
+    // Voxel keys are (x,y,z) with biased coordinates, x in the highest bits,
+    // so voxels of the same slab of the x axis are contiguous once sorted,
+    // and the key of a neighbour is the key of the voxel plus a constant.
+
+    const int      COORD_BITS = 21;
+    const int64_t  COORD_BIAS = 1 << (COORD_BITS-1);
+    const uint64_t INVALID_KEY = std::numeric_limits<uint64_t>::max();
+
+    const uint64_t Y_STEP = uint64_t(1) << COORD_BITS;
+    const uint64_t X_STEP = uint64_t(1) << (2*COORD_BITS);
+
+    // Half of the 26 neighbours of a voxel have a greater key. Apart from
+    // (0,0,+1), they are runs of 3 consecutive keys (z-1,z,z+1), starting at
+    // these offsets. The last three are in the next slab.
+    const uint64_t RUN_OFFSETS[4] = { Y_STEP - 1,
+                                      X_STEP - Y_STEP - 1,
+                                      X_STEP - 1,
+                                      X_STEP + Y_STEP - 1 };
+
+    inline uint64_t getSlab( uint64_t key )
+    {
+        return key >> (2*COORD_BITS);
+    }
+
+    // Root of a voxel, halving the path on the way.
+    inline int findRoot( vector<int> &parents, int i )
+    {
+        while ( parents[i] != i )
+        {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+
+        return i;
+    }
+
+    // The smaller index becomes the root, so the result doesn't depend on
+    // the order of the unions.
+    inline void unite( vector<int> &parents, int a, int b )
+    {
+        a = findRoot(parents,a);
+        b = findRoot(parents,b);
+
+        if ( a < b )
+            parents[b] = a;
+        else if ( b < a )
+            parents[a] = b;
+    }
+
+    // Connect the voxels in [first,last) with their neighbours in
+    // [searchBegin,searchEnd) through the runs of offsets from firstRun on.
+    // Targets grow with the voxel keys, so each run only moves a cursor
+    // forward along the sorted keys.
+    void uniteRuns( const vector<uint64_t> &keys, vector<int> &parents,
+                    size_t first, size_t last,
+                    size_t searchBegin, size_t searchEnd, size_t firstRun )
+    {
+        for ( size_t run = firstRun; run < 4; run++ )
+        {
+            size_t cursor = searchBegin;
+
+            for ( size_t i = first; i < last; i++ )
+            {
+                const uint64_t target = keys[i] + RUN_OFFSETS[run];
+
+                while ( ( cursor < searchEnd ) && ( keys[cursor] < target ) )
+                    cursor++;
+
+                for ( size_t j = cursor; ( j < searchEnd ) && ( keys[j] <= target+2 ); j++ )
+                    unite(parents,i,j);
+            }
+        }
+    }
+}
+
+
+//-----------------------------------------------------------
+//
+//                   Parallel blocks
+//
+//-----------------------------------------------------------
+
+// Voxel key of each point, INVALID_KEY for the ignored ones.
+struct CVoxelClustering::TKeyBlock
+{
+    const pcl::PointCloud<pcl::PointXYZ> &cloud;
+    const vector<bool>  &mask;
+    vector<pair<uint64_t,int> > &points;
+    size_t               pointsPerBlock;
+    float                invVoxelSize;
+
+    TKeyBlock( const pcl::PointCloud<pcl::PointXYZ> &c, const vector<bool> &m,
+               vector<pair<uint64_t,int> > &p, size_t n, float v ) :
+        cloud(c), mask(m), points(p), pointsPerBlock(n), invVoxelSize(1.f/v)
+    {}
+
+    // Biased voxel coordinate, or -1 if out of the grid. The first and last
+    // coordinates are left out, so the keys of the neighbours never wrap.
+    inline int64_t getCoord( float coord ) const
+    {
+        const int64_t biased = (int64_t)std::floor( coord*invVoxelSize ) + COORD_BIAS;
+
+        return ( ( biased > 0 ) && ( biased < 2*COORD_BIAS-1 ) ) ? biased : -1;
+    }
+
+    void operator()( size_t block ) const
+    {
+        const size_t first = block*pointsPerBlock;
+        const size_t last  = std::min( first + pointsPerBlock, points.size() );
+
+        for ( size_t i = first; i < last; i++ )
+        {
+            const pcl::PointXYZ &p = cloud.points[i];
+            uint64_t key = INVALID_KEY;
+
+            if ( ( mask.empty() || !mask[i] )
+                 && pcl_isfinite(p.x) && pcl_isfinite(p.y) && pcl_isfinite(p.z) )
+            {
+                const int64_t x = getCoord(p.x);
+                const int64_t y = getCoord(p.y);
+                const int64_t z = getCoord(p.z);
+
+                if ( ( x >= 0 ) && ( y >= 0 ) && ( z >= 0 ) )
+                    key = ( uint64_t(x) << (2*COORD_BITS) ) | ( uint64_t(y) << COORD_BITS ) | uint64_t(z);
+            }
+
+            points[i] = make_pair(key,(int)i);
+        }
+    }
+};
+
+struct CVoxelClustering::TSortBlock
+{
+    vector<pair<uint64_t,int> > &points;
+    size_t               pointsPerBlock;
+
+    TSortBlock( vector<pair<uint64_t,int> > &p, size_t n ) :
+        points(p), pointsPerBlock(n)
+    {}
+
+    void operator()( size_t block ) const
+    {
+        const size_t first = block*pointsPerBlock;
+        const size_t last  = std::min( first + pointsPerBlock, points.size() );
+
+        std::sort( points.begin() + first, points.begin() + last );
+    }
+};
+
+// Merge pairs of consecutive sorted runs of a given width.
+struct CVoxelClustering::TMergeBlocks
+{
+    vector<pair<uint64_t,int> > &points;
+    size_t               width;
+
+    TMergeBlocks( vector<pair<uint64_t,int> > &p, size_t w ) :
+        points(p), width(w)
+    {}
+
+    void operator()( size_t i_pair ) const
+    {
+        const size_t first  = 2*i_pair*width;
+        const size_t middle = std::min( first + width, points.size() );
+        const size_t last   = std::min( first + 2*width, points.size() );
+
+        std::inplace_merge( points.begin() + first, points.begin() + middle,
+                            points.begin() + last );
+    }
+};
+
+// Union-find restricted to the voxels of each band of slabs, so bands touch
+// disjoint parts of the forest and can run concurrently.
+struct CVoxelClustering::TUnionSlabs
+{
+    const vector<uint64_t> &keys;
+    const vector<size_t>   &bandStarts;
+    vector<int>            &parents;
+
+    TUnionSlabs( const vector<uint64_t> &k, const vector<size_t> &b, vector<int> &p ) :
+        keys(k), bandStarts(b), parents(p)
+    {}
+
+    void operator()( size_t band ) const
+    {
+        const size_t first = bandStarts[band];
+        const size_t last  = bandStarts[band+1];
+
+        for ( size_t i = first; i < last; i++ )
+            parents[i] = i;
+
+        for ( size_t i = first; i+1 < last; i++ )
+            if ( keys[i+1] == keys[i]+1 )
+                unite(parents,i,i+1);
+
+        uniteRuns( keys, parents, first, last, first, last, 0 );
+    }
+};
+
+// Label each voxel with its root. The forest is only read here.
+struct CVoxelClustering::TLabelBlock
+{
+    const vector<int>  &parents;
+    vector<int>        &labels;
+    size_t              voxelsPerBlock;
+
+    TLabelBlock( const vector<int> &p, vector<int> &l, size_t n ) :
+        parents(p), labels(l), voxelsPerBlock(n)
+    {}
+
+    void operator()( size_t block ) const
+    {
+        const size_t first = block*voxelsPerBlock;
+        const size_t last  = std::min( first + voxelsPerBlock, parents.size() );
+
+        for ( size_t i = first; i < last; i++ )
+        {
+            int root = parents[i];
+
+            while ( parents[root] != root )
+                root = parents[root];
+
+            labels[i] = root;
+        }
+    }
+};
+
+
+//-----------------------------------------------------------
+//
+//                    CVoxelClustering
+//
+//-----------------------------------------------------------
+
+CVoxelClustering::CVoxelClustering() : m_voxelSize(0.03),
+    m_minClusterSize(1), m_maxClusterSize(std::numeric_limits<int>::max())
+{
+}
+
+int CVoxelClustering::segment( const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                               const vector<bool> &mask,
+                               vector<pcl::PointIndices> &clusters )
+{
+    clusters.clear();
+    m_voxelKeys.clear();
+    m_voxelStarts.clear();
+
+    const size_t N_points = cloud.size();
+
+    if ( N_points >= (size_t)std::numeric_limits<int>::max() )
+    {
+        cerr << "  [ERROR] Too many points to cluster." << endl;
+        return -1;
+    }
+
+    if ( !mask.empty() && ( mask.size() != N_points ) )
+    {
+        cerr << "  [ERROR] The size of the clustering mask doesn't match the point cloud." << endl;
+        return -1;
+    }
+
+    if ( m_voxelSize <= 0 )
+    {
+        cerr << "  [ERROR] The voxel size of the clustering must be positive." << endl;
+        return -1;
+    }
+
+    if ( !N_points )
+        return 0;
+
+    //
+    // Sort the points by voxel key: blocks in parallel, then merged by pairs
+
+    const size_t N_threads = CTaskScheduler::getNumThreads();
+    const size_t N_blocks = std::max<size_t>( 1, std::min( 4*N_threads, N_points/4096 ) );
+    const size_t pointsPerBlock = ( N_points + N_blocks - 1 ) / N_blocks;
+
+    m_points.resize(N_points);
+
+    TKeyBlock keyBlock( cloud, mask, m_points, pointsPerBlock, m_voxelSize );
+    parallelFor( 0, N_blocks, keyBlock );
+
+    TSortBlock sortBlock( m_points, pointsPerBlock );
+    parallelFor( 0, N_blocks, sortBlock );
+
+    for ( size_t width = pointsPerBlock; width < N_points; width *= 2 )
+    {
+        TMergeBlocks mergeBlocks( m_points, width );
+        parallelFor( 0, ( N_points + 2*width - 1 ) / (2*width), mergeBlocks );
+    }
+
+    // Ignored points were sorted at the end
+
+    size_t N_valid = N_points;
+
+    while ( N_valid && ( m_points[N_valid-1].first == INVALID_KEY ) )
+        N_valid--;
+
+    for ( size_t i = 0; i < N_valid; i++ )
+        if ( !i || ( m_points[i].first != m_points[i-1].first ) )
+        {
+            m_voxelKeys.push_back( m_points[i].first );
+            m_voxelStarts.push_back( i );
+        }
+
+    m_voxelStarts.push_back( N_valid );
+
+    const size_t N_voxels = m_voxelKeys.size();
+
+    if ( !N_voxels )
+        return 0;
+
+    //
+    // Connect the voxels within bands of whole slabs, then across the bands
+
+    vector<size_t> bandStarts(1,0);
+    const size_t voxelsPerBand = ( N_voxels + N_blocks - 1 ) / N_blocks;
+
+    while ( bandStarts.back() < N_voxels )
+    {
+        size_t end = std::min( bandStarts.back() + voxelsPerBand, N_voxels );
+
+        while ( ( end < N_voxels ) && ( getSlab(m_voxelKeys[end]) == getSlab(m_voxelKeys[end-1]) ) )
+            end++;
+
+        bandStarts.push_back(end);
+    }
+
+    const size_t N_bands = bandStarts.size()-1;
+
+    m_parents.resize(N_voxels);
+    m_labels.resize(N_voxels);
+
+    TUnionSlabs unionSlabs( m_voxelKeys, bandStarts, m_parents );
+    parallelFor( 0, N_bands, unionSlabs );
+
+    for ( size_t band = 0; band+1 < N_bands; band++ )
+    {
+        const size_t end = bandStarts[band+1];
+        size_t lastSlab = end-1;
+
+        while ( ( lastSlab > bandStarts[band] )
+                && ( getSlab(m_voxelKeys[lastSlab-1]) == getSlab(m_voxelKeys[end-1]) ) )
+            lastSlab--;
+
+        uniteRuns( m_voxelKeys, m_parents, lastSlab, end, end, bandStarts[band+2], 1 );
+    }
+
+    const size_t voxelsPerBlock = ( N_voxels + N_blocks - 1 ) / N_blocks;
+
+    TLabelBlock labelBlock( m_parents, m_labels, voxelsPerBlock );
+    parallelFor( 0, N_blocks, labelBlock );
+
+    //
+    // Gather the clusters with a valid size, biggest first
+
+    m_sizes.assign(N_voxels,0);
+
+    for ( size_t i = 0; i < N_voxels; i++ )
+        m_sizes[m_labels[i]] += m_voxelStarts[i+1] - m_voxelStarts[i];
+
+    vector<pair<int,int> > v_clusterSizes; // (-size, root)
+
+    for ( size_t i = 0; i < N_voxels; i++ )
+        if ( ( m_labels[i] == (int)i ) && ( m_sizes[i] >= (int)m_minClusterSize )
+             && ( m_sizes[i] <= (int)std::min<size_t>(m_maxClusterSize,N_points) ) )
+            v_clusterSizes.push_back( make_pair(-m_sizes[i],(int)i) );
+
+    std::sort( v_clusterSizes.begin(), v_clusterSizes.end() );
+
+    // From now on, m_sizes stores the cluster of each root (or -1)
+
+    const size_t N_clusters = v_clusterSizes.size();
+    clusters.resize(N_clusters);
+
+    for ( size_t i = 0; i < N_voxels; i++ )
+        if ( m_labels[i] == (int)i )
+            m_sizes[i] = -1;
+
+    for ( size_t cluster = 0; cluster < N_clusters; cluster++ )
+    {
+        m_sizes[v_clusterSizes[cluster].second] = cluster;
+        clusters[cluster].indices.reserve( -v_clusterSizes[cluster].first );
+        clusters[cluster].header = cloud.header;
+    }
+
+    for ( size_t i = 0; i < N_voxels; i++ )
+    {
+        const int cluster = m_sizes[m_labels[i]];
+
+        if ( cluster < 0 )
+            continue;
+
+        for ( int j = m_voxelStarts[i]; j < m_voxelStarts[i+1]; j++ )
+            clusters[cluster].indices.push_back( m_points[j].second );
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+
+#ifndef _OLT_VOXEL_CLUSTERING_
+#define _OLT_VOXEL_CLUSTERING_
+
+#include "core.hpp"
+
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+
+
+namespace OLT
+{
+    /** Euclidean clustering of unorganized point clouds (e.g. whole scenes).
+      * The points are put into a regular grid, and two occupied voxels are
+      * connected if they are among the 26 neighbours of each other, so the
+      * clusters are the connected components of the occupied voxels. The
+      * voxel keys are sorted in parallel blocks by the task scheduler, and
+      * the neighbours of the voxels are found merging the sorted keys with
+      * themselves, shifted. The union-find runs in parallel over slabs of
+      * the x axis, and the unions across slabs are done afterwards. */
+
+    class CVoxelClustering
+    {
+        float                   m_voxelSize;
+        size_t                  m_minClusterSize;
+        size_t                  m_maxClusterSize;
+
+        std::vector<std::pair<uint64_t,int> > m_points; // (voxel key, point), sorted
+        std::vector<uint64_t>   m_voxelKeys;    // Sorted, unique
+        std::vector<int>        m_voxelStarts;  // First entry of each voxel in m_points
+        std::vector<int>        m_parents;      // Union-find forest of the voxels
+        std::vector<int>        m_labels;       // Root of each voxel
+        std::vector<int>        m_sizes;        // Number of points of each root
+
+        struct TKeyBlock;
+        struct TSortBlock;
+        struct TMergeBlocks;
+        struct TUnionSlabs;
+        struct TLabelBlock;
+
+    public:
+
+        CVoxelClustering();
+
+        void setVoxelSize( float size ) { m_voxelSize = size; }
+        void setMinClusterSize( size_t size ) { m_minClusterSize = size; }
+        void setMaxClusterSize( size_t size ) { m_maxClusterSize = size; }
+
+        /** Segment the clusters of a cloud. Points with NaN coordinates or set
+          * in the mask (e.g. inliers of planes) are ignored; an empty mask
+          * ignores nothing. Cluster sizes are in points, and clusters are
+          * returned sorted by decreasing size. */
+        int segment( const pcl::PointCloud<pcl::PointXYZ> &cloud,
+                     const std::vector<bool> &mask,
+                     std::vector<pcl::PointIndices> &clusters );
+
+        /** Number of occupied voxels in the last segmented cloud. */
+        size_t getNumberOfVoxels() const { return m_voxelKeys.size(); }
+    };
+}
+
+
+#endif
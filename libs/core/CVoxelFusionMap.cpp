@@ -0,0 +1,143 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#include "CVoxelFusionMap.hpp"
+
+using namespace OLT;
+using namespace std;
+
+
+//-----------------------------------------------------------
+//
+//                    CVoxelFusionMap
+//
+//-----------------------------------------------------------
+
+// Keys pack the biased voxel coordinates in 21 bits each, and are spread
+// over the table with a multiplicative hash.
+
+static inline size_t hashKey( uint64_t key, size_t mask )
+{
+    return ( ( key * 0x9E3779B97F4A7C15ULL ) >> 20 ) & mask;
+}
+
+CVoxelFusionMap::CVoxelFusionMap( float voxelSize )
+{
+    reset( voxelSize );
+}
+
+void CVoxelFusionMap::reset( float voxelSize )
+{
+    m_voxelSize = voxelSize;
+
+    m_voxels.clear();
+    m_keys.assign( 1024, EMPTY_KEY );
+    m_indices.assign( 1024, 0 );
+}
+
+void CVoxelFusionMap::reserve( size_t N_voxels )
+{
+    m_voxels.reserve( N_voxels );
+
+    // Keep the load of the table under 1/2
+    size_t capacity = m_keys.size();
+
+    while ( capacity < 2*N_voxels )
+        capacity *= 2;
+
+    if ( capacity != m_keys.size() )
+        rehash( capacity );
+}
+
+void CVoxelFusionMap::rehash( size_t capacity )
+{
+    vector<uint64_t> keys( capacity, EMPTY_KEY );
+    vector<uint32_t> indices( capacity, 0 );
+
+    const size_t mask = capacity - 1;
+
+    for ( size_t i = 0; i < m_keys.size(); i++ )
+    {
+        if ( m_keys[i] == EMPTY_KEY )
+            continue;
+
+        size_t slot = hashKey( m_keys[i], mask );
+
+        while ( keys[slot] != EMPTY_KEY )
+            slot = ( slot + 1 ) & mask;
+
+        keys[slot]    = m_keys[i];
+        indices[slot] = m_indices[i];
+    }
+
+    m_keys.swap( keys );
+    m_indices.swap( indices );
+}
+
+size_t CVoxelFusionMap::insertPoint( float x, float y, float z,
+                                     float R, float G, float B )
+{
+    const uint64_t coordMask = ( 1 << COORD_BITS ) - 1;
+    const float invVoxelSize = 1.f / m_voxelSize;
+
+    const uint64_t vx = ( (int)floor( x*invVoxelSize ) + COORD_BIAS ) & coordMask;
+    const uint64_t vy = ( (int)floor( y*invVoxelSize ) + COORD_BIAS ) & coordMask;
+    const uint64_t vz = ( (int)floor( z*invVoxelSize ) + COORD_BIAS ) & coordMask;
+
+    const uint64_t key = ( vx << 42 ) | ( vy << 21 ) | vz;
+
+    const size_t mask = m_keys.size() - 1;
+    size_t slot = hashKey( key, mask );
+
+    while ( ( m_keys[slot] != EMPTY_KEY ) && ( m_keys[slot] != key ) )
+        slot = ( slot + 1 ) & mask;
+
+    if ( m_keys[slot] == key )
+    {
+        TVoxel &voxel = m_voxels[m_indices[slot]];
+
+        voxel.x += x; voxel.y += y; voxel.z += z;
+        voxel.R += R; voxel.G += G; voxel.B += B;
+        voxel.N_points++;
+
+        return m_indices[slot];
+    }
+
+    // New voxel
+
+    const size_t index = m_voxels.size();
+
+    TVoxel voxel;
+    voxel.x = x; voxel.y = y; voxel.z = z;
+    voxel.R = R; voxel.G = G; voxel.B = B;
+    voxel.N_points = 1;
+
+    m_voxels.push_back( voxel );
+
+    m_keys[slot]    = key;
+    m_indices[slot] = index;
+
+    if ( 2*m_voxels.size() > m_keys.size() )
+        rehash( 2*m_keys.size() );
+
+    return index;
+}
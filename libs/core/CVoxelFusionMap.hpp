@@ -0,0 +1,95 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#ifndef _OLT_VOXEL_FUSION_MAP_
+#define _OLT_VOXEL_FUSION_MAP_
+
+#include "core.hpp"
+
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+
+
+namespace OLT
+{
+    /** Coloured point map fusing all the points falling into the same voxel
+      * of a regular grid into a single one, with the running average of their
+      * positions and colours. Voxels are found through an open addressing
+      * hash table, so inserting a point is O(1) regardless of the size of
+      * the map, and the map only grows with the observed volume instead of
+      * with the number of overlapping observations. */
+
+    class CVoxelFusionMap
+    {
+        struct TVoxel
+        {
+            float       x, y, z;    // Sums of the fused points
+            float       R, G, B;
+            uint32_t    N_points;
+        };
+
+        float                   m_voxelSize;
+        std::vector<TVoxel>     m_voxels;   // In order of creation
+        std::vector<uint64_t>   m_keys;     // Hash table, EMPTY_KEY if free
+        std::vector<uint32_t>   m_indices;  // Voxel of each entry of the table
+
+        static const int        COORD_BITS = 21;
+        static const int        COORD_BIAS = 1 << (COORD_BITS-1);
+        static const uint64_t   EMPTY_KEY  = ~(uint64_t)0;
+
+        void rehash( size_t capacity );
+
+    public:
+
+        CVoxelFusionMap( float voxelSize = 0.01 );
+
+        /** Remove all the points and set a new voxel size. */
+        void reset( float voxelSize );
+
+        float getVoxelSize() const { return m_voxelSize; }
+
+        /** Fuse a point (colour in [0,1]) into its voxel, returning the index
+          * of the voxel. Indices of new voxels are consecutive, starting at
+          * the previous size of the map. */
+        size_t insertPoint( float x, float y, float z, float R, float G, float B );
+
+        /** Number of voxels (fused points). */
+        size_t size() const { return m_voxels.size(); }
+
+        void reserve( size_t N_voxels );
+
+        /** Average position and colour of the points fused into a voxel. */
+        void getPoint( size_t index, float &x, float &y, float &z,
+                       float &R, float &G, float &B ) const
+        {
+            const TVoxel &voxel = m_voxels[index];
+            const float invN = 1.f / voxel.N_points;
+
+            x = voxel.x*invN; y = voxel.y*invN; z = voxel.z*invN;
+            R = voxel.R*invN; G = voxel.G*invN; B = voxel.B*invN;
+        }
+    };
+}
+
+
+#endif
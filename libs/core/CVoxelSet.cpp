@@ -0,0 +1,243 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#include "CVoxelSet.hpp"
+
+#include <algorithm>
+
+using namespace OLT;
+using namespace std;
+
+
+//-----------------------------------------------------------
+//
+//                        CVoxelSet
+//
+//-----------------------------------------------------------
+
+// Voxel keys are (y,z,x) with biased coordinates, x in the lowest bits, so
+// the key of the block of a voxel is key>>6 and its bit in the mask key&63.
+
+static inline uint64_t getVoxelKey( uint64_t x, uint64_t y, uint64_t z )
+{
+    return ( y << 42 ) | ( z << 21 ) | x;
+}
+
+void CVoxelSet::reset( float voxelSize )
+{
+    m_voxelSize = voxelSize;
+
+    m_blockKeys.clear();
+    m_masks.clear();
+    m_pending.clear();
+}
+
+void CVoxelSet::addVoxel( int x, int y, int z )
+{
+    const uint64_t mask = ( 1 << COORD_BITS ) - 1;
+
+    m_pending.push_back( getVoxelKey( ( x + COORD_BIAS ) & mask,
+                                      ( y + COORD_BIAS ) & mask,
+                                      ( z + COORD_BIAS ) & mask ) );
+}
+
+void CVoxelSet::finalize()
+{
+    if ( m_pending.empty() )
+        return;
+
+    sort( m_pending.begin(), m_pending.end() );
+
+    // Group pending voxels into blocks
+
+    vector<uint64_t> blockKeys, masks;
+
+    for ( size_t i = 0; i < m_pending.size(); i++ )
+    {
+        const uint64_t blockKey = m_pending[i] >> 6;
+        const uint64_t bit      = (uint64_t)1 << ( m_pending[i] & 63 );
+
+        if ( blockKeys.empty() || ( blockKeys.back() != blockKey ) )
+        {
+            blockKeys.push_back( blockKey );
+            masks.push_back( bit );
+        }
+        else
+            masks.back() |= bit;
+    }
+
+    m_pending.clear();
+
+    if ( m_blockKeys.empty() )
+    {
+        m_blockKeys.swap( blockKeys );
+        m_masks.swap( masks );
+        return;
+    }
+
+    // Union with the blocks already in the set
+
+    vector<uint64_t> mergedKeys, mergedMasks;
+    mergedKeys.reserve( m_blockKeys.size() + blockKeys.size() );
+    mergedMasks.reserve( m_blockKeys.size() + blockKeys.size() );
+
+    size_t i = 0, j = 0;
+
+    while ( ( i < m_blockKeys.size() ) || ( j < blockKeys.size() ) )
+    {
+        if ( ( j == blockKeys.size() ) ||
+             ( ( i < m_blockKeys.size() ) && ( m_blockKeys[i] < blockKeys[j] ) ) )
+        {
+            mergedKeys.push_back( m_blockKeys[i] );
+            mergedMasks.push_back( m_masks[i++] );
+        }
+        else if ( ( i == m_blockKeys.size() ) || ( blockKeys[j] < m_blockKeys[i] ) )
+        {
+            mergedKeys.push_back( blockKeys[j] );
+            mergedMasks.push_back( masks[j++] );
+        }
+        else
+        {
+            mergedKeys.push_back( m_blockKeys[i] );
+            mergedMasks.push_back( m_masks[i++] | masks[j++] );
+        }
+    }
+
+    m_blockKeys.swap( mergedKeys );
+    m_masks.swap( mergedMasks );
+}
+
+void CVoxelSet::dilate()
+{
+    finalize();
+
+    const uint64_t xMask = ( 1 << ( COORD_BITS-6 ) ) - 1;
+    const uint64_t cMask = ( 1 << COORD_BITS ) - 1;
+
+    for ( size_t i = 0; i < m_blockKeys.size(); i++ )
+    {
+        const uint64_t key = m_blockKeys[i] << 6;
+        const uint64_t bx  = ( key >> 6 ) & xMask;
+        const uint64_t y   = ( key >> 42 ) & cMask;
+        const uint64_t z   = ( key >> 21 ) & cMask;
+
+        // Dilation along x within the block, carrying into the neighbour blocks
+        const uint64_t mask   = m_masks[i];
+        const uint64_t dilated = mask | ( mask << 1 ) | ( mask >> 1 );
+        const bool carryLow  = ( mask & 1 );
+        const bool carryHigh = ( mask >> 63 ) & 1;
+
+        for ( int dy = -1; dy <= 1; dy++ )
+            for ( int dz = -1; dz <= 1; dz++ )
+            {
+                const uint64_t ny = ( y + dy ) & cMask;
+                const uint64_t nz = ( z + dz ) & cMask;
+                const uint64_t base = getVoxelKey( bx << 6, ny, nz );
+
+                for ( size_t bit = 0; bit < 64; bit++ )
+                    if ( ( dilated >> bit ) & 1 )
+                        m_pending.push_back( base | bit );
+
+                if ( carryLow && bx )
+                    m_pending.push_back( getVoxelKey( ( ( bx - 1 ) << 6 ) | 63, ny, nz ) );
+
+                if ( carryHigh && ( bx < xMask ) )
+                    m_pending.push_back( getVoxelKey( ( bx + 1 ) << 6, ny, nz ) );
+            }
+    }
+
+    finalize();
+}
+
+size_t CVoxelSet::size() const
+{
+    size_t N_voxels = 0;
+
+    for ( size_t i = 0; i < m_masks.size(); i++ )
+        N_voxels += __builtin_popcountll( m_masks[i] );
+
+    return N_voxels;
+}
+
+size_t CVoxelSet::intersectionSize( const CVoxelSet &other ) const
+{
+    size_t N_voxels = 0;
+    size_t i = 0, j = 0;
+
+    const size_t N1 = m_blockKeys.size();
+    const size_t N2 = other.m_blockKeys.size();
+
+    while ( ( i < N1 ) && ( j < N2 ) )
+    {
+        const uint64_t key1 = m_blockKeys[i];
+        const uint64_t key2 = other.m_blockKeys[j];
+
+        if ( key1 < key2 )
+            i++;
+        else if ( key2 < key1 )
+            j++;
+        else
+            N_voxels += __builtin_popcountll( m_masks[i++] & other.m_masks[j++] );
+    }
+
+    return N_voxels;
+}
+
+bool CVoxelSet::getBounds( float aabbMin[3], float aabbMax[3] ) const
+{
+    if ( m_blockKeys.empty() )
+        return false;
+
+    const uint64_t xMask = ( 1 << ( COORD_BITS-6 ) ) - 1;
+    const uint64_t cMask = ( 1 << COORD_BITS ) - 1;
+
+    int voxelMin[3], voxelMax[3];
+
+    for ( size_t i = 0; i < m_blockKeys.size(); i++ )
+    {
+        const uint64_t key = m_blockKeys[i] << 6;
+        const int bx = (int)( ( key >> 6 ) & xMask ) << 6;
+
+        // Lowest and highest occupied voxels of the block along x
+        const int voxel[3][2] = {
+            { bx + __builtin_ctzll( m_masks[i] ) - COORD_BIAS,
+              bx + 63 - __builtin_clzll( m_masks[i] ) - COORD_BIAS },
+            { (int)( ( key >> 42 ) & cMask ) - COORD_BIAS,
+              (int)( ( key >> 42 ) & cMask ) - COORD_BIAS },
+            { (int)( ( key >> 21 ) & cMask ) - COORD_BIAS,
+              (int)( ( key >> 21 ) & cMask ) - COORD_BIAS } };
+
+        for ( size_t c = 0; c < 3; c++ )
+        {
+            voxelMin[c] = ( i == 0 ) ? voxel[c][0] : min( voxelMin[c], voxel[c][0] );
+            voxelMax[c] = ( i == 0 ) ? voxel[c][1] : max( voxelMax[c], voxel[c][1] );
+        }
+    }
+
+    for ( size_t c = 0; c < 3; c++ )
+    {
+        aabbMin[c] = voxelMin[c]*m_voxelSize;
+        aabbMax[c] = ( voxelMax[c] + 1 )*m_voxelSize;
+    }
+
+    return true;
+}
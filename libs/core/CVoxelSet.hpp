@@ -0,0 +1,110 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#ifndef _OLT_VOXEL_SET_
+#define _OLT_VOXEL_SET_
+
+#include "core.hpp"
+
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+
+namespace OLT
+{
+    /** Sparse set of occupied voxels of a regular grid in world coordinates.
+      * Voxels are stored as sorted blocks of 64 consecutive voxels along the
+      * x axis, each one with a 64 bits occupancy mask, so the size of the
+      * intersection of two sets is computed merging the block keys and
+      * counting the bits of the AND of their masks (popcount). */
+
+    class CVoxelSet
+    {
+        float                   m_voxelSize;
+        std::vector<uint64_t>   m_blockKeys;    // Sorted
+        std::vector<uint64_t>   m_masks;        // Occupancy of each block
+        std::vector<uint64_t>   m_pending;      // Voxels added since last finalize()
+
+        static const int COORD_BITS = 21;
+        static const int COORD_BIAS = 1 << (COORD_BITS-1);
+
+    public:
+
+        CVoxelSet( float voxelSize = 0.05 ) : m_voxelSize(voxelSize)
+        {}
+
+        float getVoxelSize() const { return m_voxelSize; }
+
+        /** Remove all the voxels and set a new voxel size. */
+        void reset( float voxelSize );
+
+        /** Index of the voxel containing a coordinate. */
+        int getVoxelCoord( float coord ) const { return (int)std::floor( coord/m_voxelSize ); }
+
+        /** Coordinate of the center of the voxel with a given index. */
+        float getVoxelCenter( int index ) const { return ( index + 0.5f )*m_voxelSize; }
+
+        /** Mark voxels as occupied. Changes take effect after finalize(). */
+        void addVoxel( int x, int y, int z );
+
+        void addPoint( float x, float y, float z )
+        { addVoxel(getVoxelCoord(x),getVoxelCoord(y),getVoxelCoord(z)); }
+
+        template <class POINT>
+        void addPoints( const pcl::PointCloud<POINT> &cloud, const std::vector<int> &indices )
+        {
+            m_pending.reserve( m_pending.size() + indices.size() );
+
+            for ( size_t i = 0; i < indices.size(); i++ )
+            {
+                const POINT &point = cloud.points[indices[i]];
+
+                if ( std::isfinite(point.x) )
+                    addPoint( point.x, point.y, point.z );
+            }
+        }
+
+        /** Merge the voxels added since the last call into the set. */
+        void finalize();
+
+        /** Also mark as occupied the 26 neighbours of each occupied voxel. */
+        void dilate();
+
+        /** Number of occupied voxels. */
+        size_t size() const;
+        bool empty() const { return m_blockKeys.empty(); }
+
+        /** Number of voxels occupied in both sets. They must have the same
+          * voxel size. */
+        size_t intersectionSize( const CVoxelSet &other ) const;
+
+        /** Axis aligned bounding box of the occupied voxels, in world
+          * coordinates. It returns false if the set is empty. */
+        bool getBounds( float aabbMin[3], float aabbMax[3] ) const;
+    };
+}
+
+
+#endif
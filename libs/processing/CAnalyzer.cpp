@@ -21,21 +21,13 @@
  *---------------------------------------------------------------------------*/
 
 #include "CAnalyzer.hpp"
+#include "CAnalyzerEngine.hpp"
+#include <algorithm>
 #include <cmath>
-#include <mrpt/obs/CObservation2DRangeScan.h>
+#include <limits>
 #include <mrpt/obs/CObservation3DRangeScan.h>
-#include <mrpt/obs/CRawlog.h>
-#include <mrpt/math/lightweight_geom_data.h>
-#include <mrpt/utils/CImage.h>
-#include <mrpt/opengl.h>
-#include <mrpt/opengl/CBox.h>
-#include <mrpt/opengl/CText3D.h>
-#include <mrpt/opengl/CPointCloudColoured.h>
-#include <mrpt/utils.h>
 #include <mrpt/poses/CPose3D.h>
 
-#include <opencv2/opencv.hpp>
-
 
 using namespace OLT;
 using namespace std;
@@ -46,81 +38,638 @@ using namespace mrpt::math;
 using namespace mrpt::utils;
 using namespace mrpt::opengl;
 using namespace mrpt::poses;
+using namespace mrpt::system;
+
 
+//-----------------------------------------------------------
+//
+//                        CAnalyzer
+//
+//-----------------------------------------------------------
 
-int CDepthInfoAnalyzer::process(vector<double> &results)
+int CAnalyzer::process(vector<double> &results)
 {
+    CAnalyzerEngine engine;
+    engine.addAnalyzer( this );
+
     if ( m_iRawlog.is_open() )
-        return processRawlog(results);
+    {
+        if ( engine.processRawlog( m_iRawlog ) )
+            return 0;
+    }
     else
-        return processScene(results);
+    {
+        vector<TBoxAnnotation> boxes;
+
+        if ( !m_sceneName.empty() && CBoxAnnotations::exists( m_sceneName ) )
+            CBoxAnnotations::load( m_sceneName, boxes );
+        else
+            CBoxAnnotations::getFromScene( m_scene, boxes );
+
+        if ( engine.processScene( m_scene, boxes ) )
+            return 0;
+    }
+
+    getResults( results );
+
+    cout << "  [INFO] Done!" << endl << endl;
+
+    return 1;
 }
 
-int CDepthInfoAnalyzer::processRawlog(vector<double> &results)
+
+//-----------------------------------------------------------
+//
+//                   CDepthInfoAnalyzer
+//
+//-----------------------------------------------------------
+
+CDepthInfoAnalyzer::CDepthInfoAnalyzer() : m_maxDepth(0),
+    m_minDepth(std::numeric_limits<double>::max()), m_sumMeanDepth(0),
+    m_N_observations(0)
 {
-    cout << "  [INFO] Analyzing depth information." << endl;
+}
 
-    double maxValue = 0;
-    double minValue = std::numeric_limits<double>::max();
-    double meanValue=0;
-    double N_obs = 0;
+CAnalyzer* CDepthInfoAnalyzer::createAccumulator() const
+{
+    CDepthInfoAnalyzer *accumulator = new CDepthInfoAnalyzer();
+    accumulator->copyOptions( *this );
+
+    return accumulator;
+}
+
+void CDepthInfoAnalyzer::processObservation( CObservationPtr obs )
+{
+    if ( !IS_CLASS(obs, CObservation3DRangeScan) )
+        return;
+
+    CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
 
-    //
-    // Process rawlog
-    //
+    if ( !obs3D->hasRangeImage )
+        return;
 
-    CActionCollectionPtr action;
-    CSensoryFramePtr observations;
-    CObservationPtr obs;
-    size_t obsIndex = 0;
+    double max = obs3D->rangeImage.maxCoeff();
+    // Pixels without a measurement are 0, they don't count
+    double min = ( obs3D->rangeImage.array() > 0 ).select(
+                obs3D->rangeImage.array(), max ).minCoeff();
+    double mean = obs3D->rangeImage.mean();
 
-    cout << "    Process: ";
-    cout.flush();
+    if ( max > m_maxDepth )
+        m_maxDepth = max;
+    if ( min < m_minDepth )
+        m_minDepth = min;
+
+    m_sumMeanDepth += mean;
+    m_N_observations++;
+}
 
-    while ( CRawlog::getActionObservationPairOrObservation(m_iRawlog,action,observations,obs,obsIndex) )
+void CDepthInfoAnalyzer::processScene( const TSceneData &scene )
+{
+    const size_t N_points = scene.x.size();
+
+    if ( !N_points )
+        return;
+
+    double sumDistance = 0;
+
+    for ( size_t i = 0; i < N_points; i++ )
     {
-        // Show progress as dots
+        double distance = sqrt( scene.x[i]*scene.x[i] + scene.y[i]*scene.y[i]
+                                + scene.z[i]*scene.z[i] );
 
-        if ( !(obsIndex % 200) )
-        {
-            if ( !(obsIndex % 1000) ) cout << "+ "; else cout << ". ";
-            cout.flush();
-        }
+        if ( distance > m_maxDepth )
+            m_maxDepth = distance;
+        if ( distance < m_minDepth )
+            m_minDepth = distance;
+
+        sumDistance += distance;
+    }
+
+    m_sumMeanDepth += sumDistance / N_points;
+    m_N_observations++;
+}
+
+void CDepthInfoAnalyzer::merge( const CAnalyzer &other )
+{
+    const CDepthInfoAnalyzer &accumulator = static_cast<const CDepthInfoAnalyzer&>(other);
+
+    m_maxDepth = std::max( m_maxDepth, accumulator.m_maxDepth );
+    m_minDepth = std::min( m_minDepth, accumulator.m_minDepth );
+    m_sumMeanDepth   += accumulator.m_sumMeanDepth;
+    m_N_observations += accumulator.m_N_observations;
+}
+
+void CDepthInfoAnalyzer::getResults( vector<double> &results ) const
+{
+    results.push_back( m_maxDepth );
+    results.push_back( m_minDepth );
+    results.push_back( m_N_observations ? m_sumMeanDepth / m_N_observations : 0 );
+}
+
+void CDepthInfoAnalyzer::report( ostream &stream ) const
+{
+    vector<double> results;
+    getResults( results );
+
+    stream << "         Max depth  = " << results[0] << endl;
+    stream << "         Min depth  = " << results[1] << endl;
+    stream << "         Mean depth = " << results[2] << endl;
+}
+
+
+//-----------------------------------------------------------
+//
+//                     CLabelAnalyzer
+//
+//-----------------------------------------------------------
+
+CAnalyzer* CLabelAnalyzer::createAccumulator() const
+{
+    CLabelAnalyzer *accumulator = new CLabelAnalyzer();
+    accumulator->copyOptions( *this );
+
+    return accumulator;
+}
+
+void CLabelAnalyzer::processObservation( CObservationPtr obs )
+{
+    if ( IS_CLASS(obs, CObservation3DRangeScan) )
+        m_statistics.addObservation( CObservation3DRangeScanPtr(obs) );
+}
+
+void CLabelAnalyzer::processScene( const TSceneData &scene )
+{
+    for ( size_t i_box = 0; i_box < scene.boxes.size(); i_box++ )
+        m_sceneBoxes[ scene.boxes[i_box].label ]++;
+}
+
+void CLabelAnalyzer::merge( const CAnalyzer &other )
+{
+    const CLabelAnalyzer &accumulator = static_cast<const CLabelAnalyzer&>(other);
+
+    m_statistics.merge( accumulator.m_statistics );
+
+    map<string,size_t>::const_iterator it;
+
+    for ( it = accumulator.m_sceneBoxes.begin(); it != accumulator.m_sceneBoxes.end(); it++ )
+        m_sceneBoxes[it->first] += it->second;
+}
+
+// Number of different labels, occurrences of labels in observations and
+// boxes in scenes
+
+void CLabelAnalyzer::getResults( vector<double> &results ) const
+{
+    TSensorStatistics total;
+    map<string,TSensorStatistics>::const_iterator it;
+
+    for ( it = m_statistics.sensors.begin(); it != m_statistics.sensors.end(); it++ )
+        total.merge( it->second );
+
+    size_t N_occurrences = 0;
+    map<string,size_t>::const_iterator itLabel;
+
+    for ( itLabel = total.labelOccurrences.begin(); itLabel != total.labelOccurrences.end(); itLabel++ )
+        N_occurrences += itLabel->second;
+
+    size_t N_boxes = 0;
+
+    for ( itLabel = m_sceneBoxes.begin(); itLabel != m_sceneBoxes.end(); itLabel++ )
+        N_boxes += itLabel->second;
+
+    results.push_back( total.labelOccurrences.size() + m_sceneBoxes.size() );
+    results.push_back( N_occurrences );
+    results.push_back( N_boxes );
+}
+
+void CLabelAnalyzer::report( ostream &stream ) const
+{
+    TSensorStatistics total;
+    map<string,TSensorStatistics>::const_iterator it;
+
+    for ( it = m_statistics.sensors.begin(); it != m_statistics.sensors.end(); it++ )
+        total.merge( it->second );
+
+    map<string,size_t>::const_iterator itLabel;
+
+    for ( itLabel = total.labelOccurrences.begin(); itLabel != total.labelOccurrences.end(); itLabel++ )
+    {
+        const TLabelDistributions &distributions = total.labelDistributions[itLabel->first];
+
+        stream << "         " << itLabel->first << " : " << itLabel->second
+               << " occurrences, " << total.labelNumOfPixels[itLabel->first]
+               << " pixels, median distance " << distributions.distance.getQuantile(0.5) << endl;
+    }
+
+    for ( itLabel = m_sceneBoxes.begin(); itLabel != m_sceneBoxes.end(); itLabel++ )
+        stream << "         " << itLabel->first << " : " << itLabel->second
+               << " boxes in scenes" << endl;
+}
+
+
+//-----------------------------------------------------------
+//
+//                    CQualityAnalyzer
+//
+//-----------------------------------------------------------
+
+CQualityAnalyzer::CQualityAnalyzer() : m_N_observations(0),
+    m_N_withoutDepth(0), m_N_withoutIntensity(0), m_N_withoutLabels(0)
+{
+}
+
+CAnalyzer* CQualityAnalyzer::createAccumulator() const
+{
+    CQualityAnalyzer *accumulator = new CQualityAnalyzer();
+    accumulator->copyOptions( *this );
+
+    return accumulator;
+}
+
+void CQualityAnalyzer::processObservation( CObservationPtr obs )
+{
+    if ( !IS_CLASS(obs, CObservation3DRangeScan) )
+        return;
+
+    CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
+
+    m_N_observations++;
+
+    if ( !obs3D->hasIntensityImage )
+        m_N_withoutIntensity++;
+
+    if ( obs3D->hasRangeImage && obs3D->rangeImage.size() )
+        m_validDepthRatio.add( ( obs3D->rangeImage.array() > 0 ).count()
+                               / (double)obs3D->rangeImage.size() );
+    else
+        m_N_withoutDepth++;
+
+    if ( !obs3D->hasPixelLabels() )
+    {
+        m_N_withoutLabels++;
+        return;
+    }
+
+    int N_rows, N_cols;
+    obs3D->pixelLabels->getSize(N_rows,N_cols);
+
+    if ( !N_rows || !N_cols )
+        return;
+
+    size_t N_labelled = 0;
 
-        if (IS_CLASS(obs, CObservation3DRangeScan))
+    for ( int row = 0; row < N_rows; row++ )
+        for ( int col = 0; col < N_cols; col++ )
         {
-            CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
-            obs3D->load();         
-
-            if ( obs3D->hasRangeImage )
-            {
-                double max = obs3D->rangeImage.maxCoeff();
-                double min = obs3D->rangeImage.minCoeff();
-                double mean = obs3D->rangeImage.mean();
-
-                if ( max > maxValue )
-                    maxValue = max;
-                if ( minValue < min )
-                    min = minValue;
-
-                meanValue += mean;
-                N_obs++;
-            }
+            uint64_t labels;
+            obs3D->pixelLabels->getLabels(row,col,labels);
+
+            if ( labels )
+                N_labelled++;
         }
+
+    m_labelledRatio.add( N_labelled / (double)( N_rows*N_cols ) );
+}
+
+void CQualityAnalyzer::merge( const CAnalyzer &other )
+{
+    const CQualityAnalyzer &accumulator = static_cast<const CQualityAnalyzer&>(other);
+
+    m_N_observations     += accumulator.m_N_observations;
+    m_N_withoutDepth     += accumulator.m_N_withoutDepth;
+    m_N_withoutIntensity += accumulator.m_N_withoutIntensity;
+    m_N_withoutLabels    += accumulator.m_N_withoutLabels;
+
+    m_validDepthRatio.merge( accumulator.m_validDepthRatio );
+    m_labelledRatio.merge( accumulator.m_labelledRatio );
+}
+
+void CQualityAnalyzer::getResults( vector<double> &results ) const
+{
+    results.push_back( m_N_observations );
+    results.push_back( m_N_withoutDepth );
+    results.push_back( m_N_withoutIntensity );
+    results.push_back( m_N_withoutLabels );
+    results.push_back( m_validDepthRatio.getQuantile(0.5) );
+    results.push_back( m_labelledRatio.getQuantile(0.5) );
+}
+
+void CQualityAnalyzer::report( ostream &stream ) const
+{
+    stream << "         3D observations         = " << m_N_observations << endl;
+    stream << "         Without depth           = " << m_N_withoutDepth << endl;
+    stream << "         Without intensity       = " << m_N_withoutIntensity << endl;
+    stream << "         Without labels          = " << m_N_withoutLabels << endl;
+    stream << "         Valid depth (5/50/95%)  = " << m_validDepthRatio.getQuantile(0.05)
+           << " / " << m_validDepthRatio.getQuantile(0.5)
+           << " / " << m_validDepthRatio.getQuantile(0.95) << endl;
+    stream << "         Labelled (5/50/95%)     = " << m_labelledRatio.getQuantile(0.05)
+           << " / " << m_labelledRatio.getQuantile(0.5)
+           << " / " << m_labelledRatio.getQuantile(0.95) << endl;
+}
+
+
+//-----------------------------------------------------------
+//
+//                   CTimingGapsAnalyzer
+//
+//-----------------------------------------------------------
+
+CAnalyzer* CTimingGapsAnalyzer::createAccumulator() const
+{
+    CTimingGapsAnalyzer *accumulator = new CTimingGapsAnalyzer();
+    accumulator->copyOptions( *this );
+
+    return accumulator;
+}
+
+void CTimingGapsAnalyzer::processObservation( CObservationPtr obs )
+{
+    if ( obs->timestamp == INVALID_TIMESTAMP )
+        return;
+
+    map<string,TTimeStamp>::iterator it = m_lastTimestamps.find( obs->sensorLabel );
+
+    if ( it == m_lastTimestamps.end() )
+    {
+        m_lastTimestamps[obs->sensorLabel] = obs->timestamp;
+        return;
     }
 
-    results.push_back( maxValue );
-    results.push_back( minValue );
-    results.push_back( meanValue / N_obs );
+    TSensorGaps &sensor = m_sensors[obs->sensorLabel];
+    const double gap = timeDifference( it->second, obs->timestamp );
+
+    if ( gap < 0 )
+        sensor.N_backwards++;
+    else
+    {
+        sensor.gaps.add( gap );
 
-    cout << endl << "  [INFO] Done!" << endl << endl;
+        if ( gap > getOption( "maxGap", 0.5 ) )
+            sensor.N_largeGaps++;
+    }
 
-    return 1;
+    it->second = obs->timestamp;
 }
 
-int CDepthInfoAnalyzer::processScene(vector<double> &results)
+void CTimingGapsAnalyzer::merge( const CAnalyzer &other )
 {
-    // TODO (under request)
-    return 1;
+    const CTimingGapsAnalyzer &accumulator = static_cast<const CTimingGapsAnalyzer&>(other);
+    map<string,TSensorGaps>::const_iterator it;
+
+    for ( it = accumulator.m_sensors.begin(); it != accumulator.m_sensors.end(); it++ )
+    {
+        TSensorGaps &sensor = m_sensors[it->first];
+
+        sensor.gaps.merge( it->second.gaps );
+        sensor.N_largeGaps += it->second.N_largeGaps;
+        sensor.N_backwards += it->second.N_backwards;
+    }
+}
+
+// Number of large gaps, of timestamps going backwards, and the longest gap
+
+void CTimingGapsAnalyzer::getResults( vector<double> &results ) const
+{
+    size_t N_largeGaps = 0, N_backwards = 0;
+    double maxGap = 0;
+
+    map<string,TSensorGaps>::const_iterator it;
+
+    for ( it = m_sensors.begin(); it != m_sensors.end(); it++ )
+    {
+        N_largeGaps += it->second.N_largeGaps;
+        N_backwards += it->second.N_backwards;
+
+        if ( !it->second.gaps.empty() )
+            maxGap = std::max( maxGap, it->second.gaps.getMax() );
+    }
+
+    results.push_back( N_largeGaps );
+    results.push_back( N_backwards );
+    results.push_back( maxGap );
+}
+
+void CTimingGapsAnalyzer::report( ostream &stream ) const
+{
+    map<string,TSensorGaps>::const_iterator it;
+
+    for ( it = m_sensors.begin(); it != m_sensors.end(); it++ )
+    {
+        const CQuantileSketch &gaps = it->second.gaps;
+
+        stream << "         " << it->first << " : gaps (50/95%/max) "
+               << gaps.getQuantile(0.5) << " / " << gaps.getQuantile(0.95) << " / "
+               << ( gaps.empty() ? 0 : gaps.getMax() ) << " s, "
+               << it->second.N_largeGaps << " over " << getOption( "maxGap", 0.5 ) << " s, "
+               << it->second.N_backwards << " backwards" << endl;
+    }
+}
+
+
+//-----------------------------------------------------------
+//
+//                  CSensorRatesAnalyzer
+//
+//-----------------------------------------------------------
+
+double CSensorRatesAnalyzer::TSensorRate::getDuration() const
+{
+    if ( first == INVALID_TIMESTAMP )
+        return duration;
+
+    return duration + timeDifference( first, last );
 }
 
+CAnalyzer* CSensorRatesAnalyzer::createAccumulator() const
+{
+    CSensorRatesAnalyzer *accumulator = new CSensorRatesAnalyzer();
+    accumulator->copyOptions( *this );
+
+    return accumulator;
+}
+
+void CSensorRatesAnalyzer::startSequence()
+{
+    map<string,TSensorRate>::iterator it;
+
+    for ( it = m_sensors.begin(); it != m_sensors.end(); it++ )
+    {
+        it->second.duration = it->second.getDuration();
+        it->second.first = it->second.last = INVALID_TIMESTAMP;
+    }
+}
+
+void CSensorRatesAnalyzer::processObservation( CObservationPtr obs )
+{
+    TSensorRate &sensor = m_sensors[obs->sensorLabel];
+
+    sensor.N_observations++;
+
+    if ( obs->timestamp == INVALID_TIMESTAMP )
+        return;
+
+    if ( sensor.first == INVALID_TIMESTAMP )
+        sensor.first = obs->timestamp;
+    else
+        sensor.N_intervals++;
+
+    sensor.last = obs->timestamp;
+}
+
+void CSensorRatesAnalyzer::merge( const CAnalyzer &other )
+{
+    const CSensorRatesAnalyzer &accumulator = static_cast<const CSensorRatesAnalyzer&>(other);
+    map<string,TSensorRate>::const_iterator it;
+
+    for ( it = accumulator.m_sensors.begin(); it != accumulator.m_sensors.end(); it++ )
+    {
+        TSensorRate &sensor = m_sensors[it->first];
+
+        sensor.N_observations += it->second.N_observations;
+        sensor.N_intervals    += it->second.N_intervals;
+        sensor.duration        = sensor.getDuration() + it->second.getDuration();
+        sensor.first = sensor.last = INVALID_TIMESTAMP;
+    }
+}
+
+// Rate of each sensor, in the order of their labels
+
+void CSensorRatesAnalyzer::getResults( vector<double> &results ) const
+{
+    map<string,TSensorRate>::const_iterator it;
+
+    for ( it = m_sensors.begin(); it != m_sensors.end(); it++ )
+    {
+        const double duration = it->second.getDuration();
+        results.push_back( ( duration > 0 ) ? it->second.N_intervals / duration : 0 );
+    }
+}
+
+void CSensorRatesAnalyzer::report( ostream &stream ) const
+{
+    map<string,TSensorRate>::const_iterator it;
+
+    for ( it = m_sensors.begin(); it != m_sensors.end(); it++ )
+    {
+        const double duration = it->second.getDuration();
+
+        stream << "         " << it->first << " : " << it->second.N_observations
+               << " observations in " << duration << " s, "
+               << ( ( duration > 0 ) ? it->second.N_intervals / duration : 0 ) << " Hz" << endl;
+    }
+}
+
+
+//-----------------------------------------------------------
+//
+//                  CSceneDensityAnalyzer
+//
+//-----------------------------------------------------------
+
+// Count the points within each box of a scene
+
+struct TCountBoxPoints
+{
+    const TSceneData    &scene;
+    vector<size_t>      &N_points;
+
+    TCountBoxPoints( const TSceneData &s, vector<size_t> &n ) : scene(s), N_points(n)
+    {}
+
+    void operator()( size_t i_box )
+    {
+        const TBoxAnnotation &box = scene.boxes[i_box];
+
+        N_points[i_box] = scene.index.countPointsInBox( CPose3D(box.pose),
+                                                        box.corner1, box.corner2 );
+    }
+};
+
+CSceneDensityAnalyzer::CSceneDensityAnalyzer() : m_N_points(0), m_occupiedVolume(0)
+{
+}
+
+CAnalyzer* CSceneDensityAnalyzer::createAccumulator() const
+{
+    CSceneDensityAnalyzer *accumulator = new CSceneDensityAnalyzer();
+    accumulator->copyOptions( *this );
+
+    return accumulator;
+}
+
+void CSceneDensityAnalyzer::processScene( const TSceneData &scene )
+{
+    const double cellSize   = scene.index.getCellSize();
+    const double cellVolume = cellSize*cellSize*cellSize;
+    const size_t N_cells    = scene.index.getNumberOfCells();
+
+    m_N_points       += scene.index.size();
+    m_occupiedVolume += N_cells*cellVolume;
+
+    for ( size_t cell = 0; cell < N_cells; cell++ )
+        m_cellDensity.add( scene.index.getNumberOfPointsInCell(cell) / cellVolume );
+
+    // Points within the boxes
+
+    const size_t N_boxes = scene.boxes.size();
+    vector<size_t> N_points( N_boxes, 0 );
+
+    TCountBoxPoints countBoxPoints( scene, N_points );
+    parallelFor( 0, N_boxes, countBoxPoints );
+
+    for ( size_t i_box = 0; i_box < N_boxes; i_box++ )
+    {
+        const TBoxAnnotation &box = scene.boxes[i_box];
+
+        m_boxLabels.push_back( box.label );
+        m_boxPoints.push_back( N_points[i_box] );
+        m_boxVolumes.push_back( fabs( ( box.corner2.x - box.corner1.x )
+                                      *( box.corner2.y - box.corner1.y )
+                                      *( box.corner2.z - box.corner1.z ) ) );
+    }
+}
+
+void CSceneDensityAnalyzer::merge( const CAnalyzer &other )
+{
+    const CSceneDensityAnalyzer &accumulator = static_cast<const CSceneDensityAnalyzer&>(other);
+
+    m_N_points       += accumulator.m_N_points;
+    m_occupiedVolume += accumulator.m_occupiedVolume;
+    m_cellDensity.merge( accumulator.m_cellDensity );
+
+    m_boxLabels.insert( m_boxLabels.end(), accumulator.m_boxLabels.begin(), accumulator.m_boxLabels.end() );
+    m_boxPoints.insert( m_boxPoints.end(), accumulator.m_boxPoints.begin(), accumulator.m_boxPoints.end() );
+    m_boxVolumes.insert( m_boxVolumes.end(), accumulator.m_boxVolumes.begin(), accumulator.m_boxVolumes.end() );
+}
+
+// Number of points, occupied volume, median density of the occupied cells,
+// and number of boxes and of boxes without points
+
+void CSceneDensityAnalyzer::getResults( vector<double> &results ) const
+{
+    results.push_back( m_N_points );
+    results.push_back( m_occupiedVolume );
+    results.push_back( m_cellDensity.getQuantile(0.5) );
+    results.push_back( m_boxPoints.size() );
+    results.push_back( count( m_boxPoints.begin(), m_boxPoints.end(), (size_t)0 ) );
+}
+
+void CSceneDensityAnalyzer::report( ostream &stream ) const
+{
+    stream << "         Points           = " << m_N_points << endl;
+    stream << "         Occupied volume  = " << m_occupiedVolume << " m^3" << endl;
+    stream << "         Density (5/50/95%) = " << m_cellDensity.getQuantile(0.05)
+           << " / " << m_cellDensity.getQuantile(0.5)
+           << " / " << m_cellDensity.getQuantile(0.95) << " points/m^3" << endl;
+
+    for ( size_t i_box = 0; i_box < m_boxPoints.size(); i_box++ )
+    {
+        stream << "         " << m_boxLabels[i_box] << " : " << m_boxPoints[i_box] << " points";
+
+        if ( m_boxVolumes[i_box] > 0 )
+            stream << ", " << m_boxPoints[i_box] / m_boxVolumes[i_box] << " points/m^3";
+
+        stream << endl;
+    }
+}
@@ -24,15 +24,39 @@
 #define _OLT_ANALYZER_
 
 #include "core.hpp"
+#include "CBoxAnnotations.hpp"
+#include "CPointGridIndex.hpp"
+#include "CQuantileSketch.hpp"
+#include "CRawlogStatistics.hpp"
 
 #include "map"
+#include <mrpt/obs/CObservation.h>
 #include <mrpt/utils/CFileGZInputStream.h>
+#include <mrpt/system/datetime.h>
 #include <mrpt/system/filesystem.h>
 #include <mrpt/opengl/C3DSScene.h>
 
 
 namespace OLT
 {
+    /** Points and labelled boxes of a scene given to the analyzers, with a
+      * spatial index of the points to query them. */
+
+    struct TSceneData
+    {
+        std::vector<float>              x, y, z;
+        CPointGridIndex                 index;
+        std::vector<TBoxAnnotation>     boxes;
+    };
+
+    /** Base of the analyzers of rawlogs and scenes. Analyzers are run by
+      * CAnalyzerEngine, which takes several of them through a single pass
+      * over a rawlog or a scene. Observations are distributed among
+      * accumulators created with createAccumulator(), one per thread, that
+      * are merged back into the analyzer at the end. Sequential analyzers,
+      * which need the observations in order (e.g. to look at timestamps),
+      * get them all from the thread reading the rawlog instead. */
+
     class CAnalyzer
     {
 
@@ -40,11 +64,26 @@ namespace OLT
 
         mrpt::utils::CFileGZInputStream   m_iRawlog;
         mrpt::opengl::COpenGLScene        m_scene;
+        std::string                       m_sceneName;
         std::map<std::string,double>      m_optionsD;
         std::map<std::string,std::string> m_optionsS;
 
+        double getOption( const std::string &option, const double &defaultValue ) const
+        {
+            std::map<std::string,double>::const_iterator it = m_optionsD.find(option);
+            return ( it == m_optionsD.end() ) ? defaultValue : it->second;
+        }
+
+        void copyOptions( const CAnalyzer &other )
+        {
+            m_optionsD = other.m_optionsD;
+            m_optionsS = other.m_optionsS;
+        }
+
     public:
 
+        virtual ~CAnalyzer() {}
+
         int setInputRawlog(const std::string &i_rawlogName)
         {
             if (!mrpt::system::fileExists(i_rawlogName))
@@ -78,6 +117,8 @@ namespace OLT
                 return 0;
             }
 
+            m_sceneName = i_sceneName;
+
             return 1;
         }
 
@@ -89,17 +130,198 @@ namespace OLT
             m_optionsS[option] = value;
         }
 
-        virtual int process(std::vector<double> &results) = 0;
+        /** Run this analyzer alone over the rawlog or scene set as input. */
+        virtual int process(std::vector<double> &results);
+
+        virtual std::string getName() const = 0;
+
+        /** New analyzer with the same options and nothing accumulated. */
+        virtual CAnalyzer* createAccumulator() const = 0;
+
+        virtual bool isSequential() const { return false; }
+
+        /** Called before the observations of a new rawlog or a new scene. */
+        virtual void startSequence() {}
+
+        /** Observations are already loaded, except for sequential analyzers. */
+        virtual void processObservation( mrpt::obs::CObservationPtr obs ) {}
+
+        virtual void processScene( const TSceneData &scene ) {}
+
+        /** Add the results of an accumulator created by this analyzer. */
+        virtual void merge( const CAnalyzer &other ) = 0;
+
+        virtual void getResults( std::vector<double> &results ) const = 0;
+
+        virtual void report( std::ostream &stream ) const = 0;
     };
 
 
+    /** Depth of the observations (max, min and mean of the mean depths), or
+      * distance of the points of a scene to its origin (max, min, mean). */
+
     class CDepthInfoAnalyzer : public CAnalyzer
     {
+        double  m_maxDepth;
+        double  m_minDepth;
+        double  m_sumMeanDepth;
+        size_t  m_N_observations;
+
     public:
-        int process(std::vector<double> &results);
-    private:
-        int processRawlog(std::vector<double> &results);
-        int processScene(std::vector<double> &results);
+
+        CDepthInfoAnalyzer();
+
+        std::string getName() const { return "depth info"; }
+        CAnalyzer* createAccumulator() const;
+
+        void processObservation( mrpt::obs::CObservationPtr obs );
+        void processScene( const TSceneData &scene );
+        void merge( const CAnalyzer &other );
+        void getResults( std::vector<double> &results ) const;
+        void report( std::ostream &stream ) const;
+    };
+
+
+    /** Labels of the observations, per sensor (see CRawlogStatistics), and
+      * number of boxes of each label in scenes. */
+
+    class CLabelAnalyzer : public CAnalyzer
+    {
+        CRawlogStatistics               m_statistics;
+        std::map<std::string,size_t>    m_sceneBoxes; // <label,n_boxes>
+
+    public:
+
+        std::string getName() const { return "labels"; }
+        CAnalyzer* createAccumulator() const;
+
+        void processObservation( mrpt::obs::CObservationPtr obs );
+        void processScene( const TSceneData &scene );
+        void merge( const CAnalyzer &other );
+        void getResults( std::vector<double> &results ) const;
+        void report( std::ostream &stream ) const;
+
+        const CRawlogStatistics& getStatistics() const { return m_statistics; }
+    };
+
+
+    /** Quality of the 3D observations: missing images, and fractions of
+      * pixels with a valid depth and with some label. */
+
+    class CQualityAnalyzer : public CAnalyzer
+    {
+        size_t          m_N_observations;
+        size_t          m_N_withoutDepth;
+        size_t          m_N_withoutIntensity;
+        size_t          m_N_withoutLabels;
+        CQuantileSketch m_validDepthRatio;
+        CQuantileSketch m_labelledRatio;
+
+    public:
+
+        CQualityAnalyzer();
+
+        std::string getName() const { return "quality"; }
+        CAnalyzer* createAccumulator() const;
+
+        void processObservation( mrpt::obs::CObservationPtr obs );
+        void merge( const CAnalyzer &other );
+        void getResults( std::vector<double> &results ) const;
+        void report( std::ostream &stream ) const;
+    };
+
+
+    /** Gaps between consecutive observations of each sensor. Gaps longer
+      * than the option "maxGap" (in seconds, 0.5 by default) are counted, as
+      * well as timestamps going backwards. */
+
+    class CTimingGapsAnalyzer : public CAnalyzer
+    {
+        struct TSensorGaps
+        {
+            CQuantileSketch gaps;
+            size_t          N_largeGaps;
+            size_t          N_backwards;
+
+            TSensorGaps() : N_largeGaps(0), N_backwards(0) {}
+        };
+
+        std::map<std::string,TSensorGaps>               m_sensors;
+        std::map<std::string,mrpt::system::TTimeStamp>  m_lastTimestamps;
+
+    public:
+
+        std::string getName() const { return "timing gaps"; }
+        CAnalyzer* createAccumulator() const;
+
+        bool isSequential() const { return true; }
+        void startSequence() { m_lastTimestamps.clear(); }
+
+        void processObservation( mrpt::obs::CObservationPtr obs );
+        void merge( const CAnalyzer &other );
+        void getResults( std::vector<double> &results ) const;
+        void report( std::ostream &stream ) const;
+    };
+
+
+    /** Number of observations and rate of each sensor, in Hz. */
+
+    class CSensorRatesAnalyzer : public CAnalyzer
+    {
+        struct TSensorRate
+        {
+            size_t                      N_observations;
+            size_t                      N_intervals;
+            double                      duration;   // Of the finished sequences
+            mrpt::system::TTimeStamp    first, last;// Of the current sequence
+
+            TSensorRate() : N_observations(0), N_intervals(0), duration(0),
+                first(INVALID_TIMESTAMP), last(INVALID_TIMESTAMP) {}
+
+            double getDuration() const;
+        };
+
+        std::map<std::string,TSensorRate>   m_sensors;
+
+    public:
+
+        std::string getName() const { return "sensor rates"; }
+        CAnalyzer* createAccumulator() const;
+
+        bool isSequential() const { return true; }
+        void startSequence();
+
+        void processObservation( mrpt::obs::CObservationPtr obs );
+        void merge( const CAnalyzer &other );
+        void getResults( std::vector<double> &results ) const;
+        void report( std::ostream &stream ) const;
+    };
+
+
+    /** Point density of scenes, from the number of points of the occupied
+      * cells of the spatial index, and number of points within each box. */
+
+    class CSceneDensityAnalyzer : public CAnalyzer
+    {
+        size_t                      m_N_points;
+        double                      m_occupiedVolume;
+        CQuantileSketch             m_cellDensity;  // Points per m^3
+
+        std::vector<std::string>    m_boxLabels;
+        std::vector<size_t>         m_boxPoints;
+        std::vector<double>         m_boxVolumes;
+
+    public:
+
+        CSceneDensityAnalyzer();
+
+        std::string getName() const { return "scene density"; }
+        CAnalyzer* createAccumulator() const;
+
+        void processScene( const TSceneData &scene );
+        void merge( const CAnalyzer &other );
+        void getResults( std::vector<double> &results ) const;
+        void report( std::ostream &stream ) const;
     };
 }
 
@@ -0,0 +1,305 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#include "CAnalyzerEngine.hpp"
+
+#include <mrpt/obs/CRawlog.h>
+#include <mrpt/obs/CSensoryFrame.h>
+#include <mrpt/opengl/CPointCloudColoured.h>
+
+
+using namespace OLT;
+using namespace std;
+
+using namespace mrpt;
+using namespace mrpt::obs;
+using namespace mrpt::utils;
+using namespace mrpt::opengl;
+
+
+//-----------------------------------------------------------
+//
+//                     TProcessBatch
+//
+//-----------------------------------------------------------
+
+// Process the chunk of a batch of observations of a slot with its accumulators
+
+struct TProcessBatch
+{
+    const vector<CObservationPtr>       &batch;
+    vector< vector<CAnalyzer*> >        &accumulators; // [slot][analyzer], NULL if sequential
+
+    TProcessBatch( const vector<CObservationPtr> &b,
+                   vector< vector<CAnalyzer*> > &a ) : batch(b), accumulators(a)
+    {}
+
+    void operator()( size_t slot )
+    {
+        const size_t N_slots = accumulators.size();
+        const size_t begin   = batch.size()*slot/N_slots;
+        const size_t end     = batch.size()*(slot+1)/N_slots;
+
+        vector<CAnalyzer*> &slotAccumulators = accumulators[slot];
+
+        for ( size_t i = begin; i < end; i++ )
+        {
+            batch[i]->load();
+
+            for ( size_t i_analyzer = 0; i_analyzer < slotAccumulators.size(); i_analyzer++ )
+                if ( slotAccumulators[i_analyzer] )
+                    slotAccumulators[i_analyzer]->processObservation( batch[i] );
+        }
+    }
+};
+
+
+//-----------------------------------------------------------
+//
+//                     CAnalyzerEngine
+//
+//-----------------------------------------------------------
+
+CAnalyzerEngine::CAnalyzerEngine() : m_observationsPerThread(8), m_cellSize(0.05)
+{
+}
+
+bool CAnalyzerEngine::useSensor( const string &sensorLabel ) const
+{
+    return m_sensors.empty()
+            || ( find( m_sensors.begin(), m_sensors.end(), sensorLabel ) != m_sensors.end() );
+}
+
+int CAnalyzerEngine::processRawlog( const string &rawlogFile )
+{
+    if ( !mrpt::system::fileExists(rawlogFile) )
+    {
+        cerr << "  [ERROR] A rawlog file with name " << rawlogFile;
+        cerr << " doesn't exist." << endl;
+        return -1;
+    }
+
+    cout << "  [INFO] Processing rawlog " << rawlogFile << endl;
+
+    CFileGZInputStream rawlogStream( rawlogFile );
+
+    return processRawlog( rawlogStream );
+}
+
+int CAnalyzerEngine::processRawlog( CStream &rawlog )
+{
+    const size_t N_analyzers = m_analyzers.size();
+    const size_t N_slots     = std::max<size_t>( 1, CTaskScheduler::getNumThreads() );
+
+    cout << "  [INFO] Analyzing:";
+    for ( size_t i_analyzer = 0; i_analyzer < N_analyzers; i_analyzer++ )
+        cout << ( i_analyzer ? ", " : " " ) << m_analyzers[i_analyzer]->getName();
+    cout << endl;
+
+    // Accumulators of the non sequential analyzers for each slot
+
+    vector< vector<CAnalyzer*> > accumulators( N_slots, vector<CAnalyzer*>( N_analyzers, (CAnalyzer*)NULL ) );
+    bool parallelAnalyzers = false;
+
+    for ( size_t i_analyzer = 0; i_analyzer < N_analyzers; i_analyzer++ )
+    {
+        m_analyzers[i_analyzer]->startSequence();
+
+        if ( m_analyzers[i_analyzer]->isSequential() )
+            continue;
+
+        parallelAnalyzers = true;
+
+        for ( size_t slot = 0; slot < N_slots; slot++ )
+            accumulators[slot][i_analyzer] = m_analyzers[i_analyzer]->createAccumulator();
+    }
+
+    //
+    // Process rawlog
+    //
+
+    const size_t batchSize = N_slots*m_observationsPerThread;
+
+    vector<CObservationPtr> batch;
+    batch.reserve( batchSize );
+
+    TProcessBatch processBatch( batch, accumulators );
+
+    CActionCollectionPtr action;
+    CSensoryFramePtr observations;
+    CObservationPtr obs;
+    size_t obsIndex = 0;
+    size_t N_read = 0;
+
+    cout << "    Process: ";
+    cout.flush();
+
+    while ( CRawlog::getActionObservationPairOrObservation(rawlog,action,observations,obs,obsIndex) )
+    {
+        // Rawlogs in the old format come as sensory frames
+
+        vector<CObservationPtr> readObs;
+
+        if ( !obs.null() )
+            readObs.push_back( obs );
+        else if ( !observations.null() )
+            for ( CSensoryFrame::iterator it = observations->begin(); it != observations->end(); ++it )
+                readObs.push_back( *it );
+
+        for ( size_t i_obs = 0; i_obs < readObs.size(); i_obs++ )
+        {
+            if ( !useSensor( readObs[i_obs]->sensorLabel ) )
+                continue;
+
+            // Show progress as dots
+
+            if ( !(N_read % 200) )
+            {
+                if ( !(N_read % 1000) ) cout << "+ "; else cout << ". ";
+                cout.flush();
+            }
+
+            N_read++;
+
+            for ( size_t i_analyzer = 0; i_analyzer < N_analyzers; i_analyzer++ )
+                if ( m_analyzers[i_analyzer]->isSequential() )
+                    m_analyzers[i_analyzer]->processObservation( readObs[i_obs] );
+
+            if ( !parallelAnalyzers )
+                continue;
+
+            batch.push_back( readObs[i_obs] );
+
+            if ( batch.size() == batchSize )
+            {
+                parallelFor( 0, N_slots, processBatch );
+                batch.clear();
+            }
+        }
+    }
+
+    if ( !batch.empty() )
+        parallelFor( 0, N_slots, processBatch );
+
+    // Merge the accumulators in slot order
+
+    for ( size_t slot = 0; slot < N_slots; slot++ )
+        for ( size_t i_analyzer = 0; i_analyzer < N_analyzers; i_analyzer++ )
+            if ( accumulators[slot][i_analyzer] )
+            {
+                m_analyzers[i_analyzer]->merge( *accumulators[slot][i_analyzer] );
+                delete accumulators[slot][i_analyzer];
+            }
+
+    cout << endl << "  [INFO] " << N_read << " observations analyzed." << endl;
+
+    return 0;
+}
+
+int CAnalyzerEngine::processScene( const string &sceneFile )
+{
+    if ( !mrpt::system::fileExists(sceneFile) )
+    {
+        cerr << "  [ERROR] A scene file with name " << sceneFile;
+        cerr << " doesn't exist." << endl;
+        return -1;
+    }
+
+    cout << "  [INFO] Processing scene " << sceneFile << endl;
+
+    COpenGLScene scene;
+
+    if ( !scene.loadFromFile( sceneFile ) )
+    {
+        cerr << "  [ERROR] Can't open scene file " << sceneFile << endl;
+        return -1;
+    }
+
+    // The boxes file prevails over the boxes of the scene
+
+    vector<TBoxAnnotation> boxes;
+
+    if ( CBoxAnnotations::exists( sceneFile ) )
+    {
+        if ( CBoxAnnotations::load( sceneFile, boxes ) )
+            return -1;
+    }
+    else
+        CBoxAnnotations::getFromScene( scene, boxes );
+
+    return processScene( scene, boxes );
+}
+
+int CAnalyzerEngine::processScene( const COpenGLScene &scene,
+                                   const vector<TBoxAnnotation> &boxes )
+{
+    CPointCloudColouredPtr cloud = scene.getByClass<CPointCloudColoured>(0);
+
+    if ( cloud.null() )
+    {
+        cerr << "  [ERROR] The scene has no point cloud." << endl;
+        return -1;
+    }
+
+    TSceneData data;
+    const size_t N_points = cloud->size();
+
+    data.x.resize( N_points );
+    data.y.resize( N_points );
+    data.z.resize( N_points );
+
+    data.index.reset( m_cellSize );
+    data.index.reserve( N_points );
+
+    for ( size_t i = 0; i < N_points; i++ )
+    {
+        const CPointCloudColoured::TPointColour &point = cloud->getPoint(i);
+
+        data.x[i] = point.x;
+        data.y[i] = point.y;
+        data.z[i] = point.z;
+
+        data.index.addPoint( point.x, point.y, point.z );
+    }
+
+    data.index.finalize();
+    data.boxes = boxes;
+
+    cout << "  [INFO] Analyzing " << N_points << " points and " << boxes.size() << " boxes." << endl;
+
+    for ( size_t i_analyzer = 0; i_analyzer < m_analyzers.size(); i_analyzer++ )
+    {
+        m_analyzers[i_analyzer]->startSequence();
+        m_analyzers[i_analyzer]->processScene( data );
+    }
+
+    return 0;
+}
+
+void CAnalyzerEngine::report( ostream &stream ) const
+{
+    for ( size_t i_analyzer = 0; i_analyzer < m_analyzers.size(); i_analyzer++ )
+    {
+        stream << "  [INFO] Results of " << m_analyzers[i_analyzer]->getName() << ":" << endl;
+        m_analyzers[i_analyzer]->report( stream );
+    }
+}
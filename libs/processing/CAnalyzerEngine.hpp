@@ -0,0 +1,90 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+#ifndef _OLT_ANALYZER_ENGINE_
+#define _OLT_ANALYZER_ENGINE_
+
+#include "CAnalyzer.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <mrpt/utils/CStream.h>
+
+
+namespace OLT
+{
+    /** Runs a set of analyzers in a single pass over rawlogs or scenes.
+      *
+      * Rawlogs are read in the calling thread, which gives each observation
+      * to the sequential analyzers right away and gathers the rest in
+      * batches. Every batch is split into as many consecutive chunks as
+      * threads, each one loaded and processed by the accumulators of its
+      * chunk slot, so the observations of a slot are always processed in
+      * order by the same accumulators. They are merged into the analyzers in
+      * slot order when the rawlog ends, making the results independent of
+      * the scheduling of the threads.
+      *
+      * Scenes are analyzed through their points and labelled boxes, with the
+      * points indexed in a grid (see CPointGridIndex).
+      *
+      * Analyzers are not owned by the engine, and keep accumulating results
+      * through several rawlogs or scenes. */
+
+    class CAnalyzerEngine
+    {
+        std::vector<CAnalyzer*>     m_analyzers;
+        std::vector<std::string>    m_sensors;  // Sensors to consider, all if empty
+        size_t                      m_observationsPerThread;
+        float                       m_cellSize;
+
+        bool useSensor( const std::string &sensorLabel ) const;
+
+    public:
+
+        CAnalyzerEngine();
+
+        void addAnalyzer( CAnalyzer *analyzer ) { m_analyzers.push_back( analyzer ); }
+
+        void setSensors( const std::vector<std::string> &sensors ) { m_sensors = sensors; }
+
+        /** Observations of each thread per batch. */
+        void setObservationsPerThread( size_t N_observations )
+        { m_observationsPerThread = std::max<size_t>( 1, N_observations ); }
+
+        /** Cell size (in meters) of the index of the points of scenes. */
+        void setCellSize( float cellSize ) { m_cellSize = cellSize; }
+
+        int processRawlog( const std::string &rawlogFile );
+        int processRawlog( mrpt::utils::CStream &rawlog );
+
+        /** Analyze a scene file and its labelled boxes (see CBoxAnnotations). */
+        int processScene( const std::string &sceneFile );
+        int processScene( const mrpt::opengl::COpenGLScene &scene,
+                          const std::vector<TBoxAnnotation> &boxes );
+
+        /** Results of all the analyzers. */
+        void report( std::ostream &stream ) const;
+    };
+}
+
+
+#endif
@@ -340,43 +340,35 @@ int CSaveAsPlainText::processScene()
     vector<vector<TPoint3D> > v_corners;
     vector<CPose3D> v_poses;
 
-    // Load previously inserted boxes
-    bool keepLoading = true;
-    size_t boxes_inserted = 0;
+    // Load the labelled boxes, from the boxes file of the scene if any
 
-    while ( keepLoading )
-    {
-        CText3DPtr text = m_scene.getByClass<CText3D>(boxes_inserted);
+    vector<TBoxAnnotation> v_boxes;
 
-        if ( !text.null() )
-            v_labels.push_back(text->getString());
-        else
-            v_labels.push_back("none");
+    if ( !CBoxAnnotations::exists(m_sceneFile) ||
+         CBoxAnnotations::load(m_sceneFile,v_boxes) )
+        CBoxAnnotations::getFromScene(m_scene,v_boxes);
 
-        CBoxPtr box = m_scene.getByClass<CBox>(boxes_inserted);
+    for ( size_t box_index = 0; box_index < v_boxes.size(); box_index++ )
+    {
+        const TBoxAnnotation &box = v_boxes[box_index];
 
-        if ( box.null() )
-            keepLoading = false;
-        else
-        {
-            CPose3D pose = box->getPose();
+        v_labels.push_back(box.label.empty() ? "none" : box.label);
 
-            TPoint3D c1,c2;
-            box->getBoxCorners(c1,c2);
+        CPose3D pose(box.pose);
 
-            TPoint3D C111 ( pose + static_cast<TPose3D>(TPoint3D(c1.x,c1.y,c1.z)) );
-            TPoint3D C222 ( pose + static_cast<TPose3D>(TPoint3D(c2.x,c2.y,c2.z)) );
+        const TPoint3D &c1 = box.corner1;
+        const TPoint3D &c2 = box.corner2;
 
-            vector<TPoint3D> v;
-            v.push_back(C111);
-            v.push_back(C222);
+        TPoint3D C111 ( pose + static_cast<TPose3D>(TPoint3D(c1.x,c1.y,c1.z)) );
+        TPoint3D C222 ( pose + static_cast<TPose3D>(TPoint3D(c2.x,c2.y,c2.z)) );
 
-            v_corners.push_back(v);
+        vector<TPoint3D> v;
+        v.push_back(C111);
+        v.push_back(C222);
 
-            v_poses.push_back(pose);
-        }
+        v_corners.push_back(v);
 
-        boxes_inserted++;
+        v_poses.push_back(pose);
     }
 
     size_t N_corners = v_corners.size();
@@ -24,6 +24,7 @@
 #define _OLT_EDITOR_
 
 #include "core.hpp"
+#include "CBoxAnnotations.hpp"
 
 #include "map"
 #include <mrpt/utils/CFileGZInputStream.h>
@@ -40,6 +41,7 @@ namespace OLT
 
         mrpt::utils::CFileGZInputStream   m_iRawlog;
         mrpt::opengl::COpenGLScene        m_scene;
+        std::string                       m_sceneFile;
         std::map<std::string,double>      m_optionsD;
         std::map<std::string,std::string> m_optionsS;
 
@@ -78,6 +80,8 @@ namespace OLT
                 return 0;
             }
 
+            m_sceneFile = i_sceneName;
+
             return 1;
         }
 
@@ -0,0 +1,523 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+
+#include "CRawlogStatistics.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <vector>
+#include <mrpt/obs/CRawlog.h>
+#include <mrpt/utils/CFileGZInputStream.h>
+#include <mrpt/system/filesystem.h>
+
+using namespace OLT;
+using namespace mrpt::obs;
+using namespace mrpt::utils;
+using namespace std;
+
+
+//-----------------------------------------------------------
+//
+//                   TLabelDistributions
+//
+//-----------------------------------------------------------
+
+void TLabelDistributions::merge( const TLabelDistributions &other )
+{
+    distance.merge( other.distance );
+    area.merge( other.area );
+    extent.merge( other.extent );
+}
+
+
+//-----------------------------------------------------------
+//
+//                    TSensorStatistics
+//
+//-----------------------------------------------------------
+
+TSensorStatistics::TSensorStatistics() : N_observations(0),
+    N_depthObservations(0), N_depthPixels(0),
+    minDepth(std::numeric_limits<double>::max()), maxDepth(0), sumDepth(0)
+{
+}
+
+void TSensorStatistics::merge( const TSensorStatistics &other )
+{
+    N_observations      += other.N_observations;
+    N_depthObservations += other.N_depthObservations;
+    N_depthPixels       += other.N_depthPixels;
+    minDepth             = std::min( minDepth, other.minDepth );
+    maxDepth             = std::max( maxDepth, other.maxDepth );
+    sumDepth            += other.sumDepth;
+
+    map<string,size_t>::const_iterator it;
+
+    for ( it = other.labelOccurrences.begin(); it != other.labelOccurrences.end(); it++ )
+        labelOccurrences[it->first] += it->second;
+
+    for ( it = other.labelNumOfPixels.begin(); it != other.labelNumOfPixels.end(); it++ )
+        labelNumOfPixels[it->first] += it->second;
+
+    map<string,TLabelDistributions>::const_iterator dist_it;
+
+    for ( dist_it = other.labelDistributions.begin(); dist_it != other.labelDistributions.end(); dist_it++ )
+        labelDistributions[dist_it->first].merge( dist_it->second );
+}
+
+
+//-----------------------------------------------------------
+//
+//                      TLabelPixels
+//
+//-----------------------------------------------------------
+
+// Pixels of a label index in an observation, and their 3D points.
+
+struct TLabelPixels
+{
+    size_t  N_pixels;
+    size_t  N_depthPixels;
+    double  sumDepth;
+    float   min[3], max[3];
+
+    TLabelPixels() : N_pixels(0), N_depthPixels(0), sumDepth(0)
+    {
+        for ( size_t axis = 0; axis < 3; axis++ )
+        {
+            min[axis] = std::numeric_limits<float>::max();
+            max[axis] = -std::numeric_limits<float>::max();
+        }
+    }
+
+    void addPoint( float x, float y, float z )
+    {
+        const float point[3] = { x, y, z };
+
+        for ( size_t axis = 0; axis < 3; axis++ )
+        {
+            min[axis] = std::min( min[axis], point[axis] );
+            max[axis] = std::max( max[axis], point[axis] );
+        }
+
+        sumDepth += z;
+        N_depthPixels++;
+    }
+
+    double getExtent() const
+    {
+        double sqrExtent = 0;
+
+        for ( size_t axis = 0; axis < 3; axis++ )
+            sqrExtent += ( max[axis] - min[axis] )*( max[axis] - min[axis] );
+
+        return sqrt( sqrExtent );
+    }
+};
+
+
+//-----------------------------------------------------------
+//
+//                    CRawlogStatistics
+//
+//-----------------------------------------------------------
+
+void CRawlogStatistics::addObservation( CObservation3DRangeScanPtr obs )
+{
+    TSensorStatistics &stats = sensors[obs->sensorLabel];
+
+    stats.N_observations++;
+
+    // Depth, ignoring pixels without a valid measurement
+
+    if ( obs->hasRangeImage )
+    {
+        const size_t N_pixels = obs->rangeImage.rows()*obs->rangeImage.cols();
+        const float *depths = obs->rangeImage.data();
+
+        for ( size_t i = 0; i < N_pixels; i++ )
+            if ( depths[i] > 0 )
+            {
+                stats.minDepth = std::min( stats.minDepth, (double)depths[i] );
+                stats.maxDepth = std::max( stats.maxDepth, (double)depths[i] );
+                stats.sumDepth += depths[i];
+                stats.N_depthPixels++;
+            }
+
+        stats.N_depthObservations++;
+    }
+
+    if ( !obs->hasPixelLabels() )
+        return;
+
+    // Gather the pixels of every label index at once, reading the labels of
+    // each pixel a single time and visiting only its set bits. Pixels with a
+    // valid depth are back-projected to get the extent of the labels.
+
+    TLabelPixels labelPixels[64];
+
+    int N_rows, N_cols;
+    obs->pixelLabels->getSize(N_rows,N_cols);
+
+    const bool withDepth = obs->hasRangeImage
+            && ( obs->rangeImage.rows() == N_rows ) && ( obs->rangeImage.cols() == N_cols );
+
+    const float cx = obs->cameraParams.cx(), cy = obs->cameraParams.cy();
+    const float fx = obs->cameraParams.fx(), fy = obs->cameraParams.fy();
+
+    for ( int row = 0; row < N_rows; row++ )
+        for ( int col = 0; col < N_cols; col++ )
+        {
+            uint64_t labels;
+            obs->pixelLabels->getLabels(row,col,labels);
+
+            if ( !labels )
+                continue;
+
+            const float depth = ( withDepth ) ? obs->rangeImage(row,col) : 0;
+            const float x = ( col - cx )*depth/fx;
+            const float y = ( row - cy )*depth/fy;
+
+            while ( labels )
+            {
+                TLabelPixels &pixels = labelPixels[__builtin_ctzll(labels)];
+                labels &= labels-1;
+
+                pixels.N_pixels++;
+
+                if ( depth > 0 )
+                    pixels.addPoint( x, y, depth );
+            }
+        }
+
+    std::map<uint32_t,std::string>::iterator it;
+
+    for ( it = obs->pixelLabels->pixelLabelNames.begin();
+          it != obs->pixelLabels->pixelLabelNames.end();
+          it++ )
+    {
+        stats.labelOccurrences[it->second]++;
+
+        if ( it->first >= 64 )
+            continue;
+
+        const TLabelPixels &pixels = labelPixels[it->first];
+        TLabelDistributions &distributions = stats.labelDistributions[it->second];
+
+        stats.labelNumOfPixels[it->second] += pixels.N_pixels;
+
+        if ( !pixels.N_pixels )
+            continue;
+
+        distributions.area.add( pixels.N_pixels );
+
+        if ( pixels.N_depthPixels )
+        {
+            distributions.distance.add( pixels.sumDepth / pixels.N_depthPixels );
+            distributions.extent.add( pixels.getExtent() );
+        }
+    }
+}
+
+void CRawlogStatistics::merge( const CRawlogStatistics &other )
+{
+    map<string,TSensorStatistics>::const_iterator it;
+
+    for ( it = other.sensors.begin(); it != other.sensors.end(); it++ )
+        sensors[it->first].merge( it->second );
+}
+
+int CRawlogStatistics::compute( const string &rawlogFile )
+{
+    clear();
+
+    if ( !mrpt::system::fileExists(rawlogFile) )
+    {
+        cerr << "  [ERROR] A rawlog file with name " << rawlogFile;
+        cerr << " doesn't exist." << endl;
+        return -1;
+    }
+
+    CFileGZInputStream rawlogStream( rawlogFile );
+
+    CActionCollectionPtr action;
+    CSensoryFramePtr observations;
+    CObservationPtr obs;
+    size_t obsIndex = 0;
+
+    while ( CRawlog::getActionObservationPairOrObservation(rawlogStream,action,observations,obs,obsIndex) )
+    {
+        if ( obs.null() || !IS_CLASS(obs, CObservation3DRangeScan) )
+            continue;
+
+        CObservation3DRangeScanPtr obs3D = CObservation3DRangeScanPtr(obs);
+        obs3D->load();
+
+        addObservation( obs3D );
+    }
+
+    return 0;
+}
+
+int CRawlogStatistics::computeOrLoad( const string &rawlogFile, bool &fromCache,
+                                      bool useCache )
+{
+    fromCache = false;
+
+    uint64_t fingerprint;
+
+    if ( computeFingerprint( rawlogFile, fingerprint ) )
+        return -1;
+
+    if ( useCache && !load( rawlogFile, fingerprint ) )
+    {
+        fromCache = true;
+        return 0;
+    }
+
+    if ( compute( rawlogFile ) )
+        return -1;
+
+    save( rawlogFile, fingerprint );
+
+    return 0;
+}
+
+int CRawlogStatistics::computeFingerprint( const string &fileName, uint64_t &fingerprint )
+{
+    ifstream file( fileName.c_str(), ios::binary );
+
+    if ( !file.is_open() )
+    {
+        cerr << "  [ERROR] Couldn't open " << fileName << endl;
+        return -1;
+    }
+
+    // Words of 8 bytes are mixed into the hash one after another, reading the
+    // file in big chunks, so it is limited by the disk
+
+    vector<char> buffer( ( 1 << 20 ) + 8 );
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t size = 0;
+
+    while ( file )
+    {
+        file.read( &buffer[0], buffer.size() - 8 );
+        const size_t N_read = file.gcount();
+
+        if ( !N_read )
+            break;
+
+        // Pad the last chunk up to a whole word
+        const size_t N_words = ( N_read + 7 ) / 8;
+        memset( &buffer[N_read], 0, N_words*8 - N_read );
+
+        for ( size_t w = 0; w < N_words; w++ )
+        {
+            uint64_t word;
+            memcpy( &word, &buffer[w*8], 8 );
+
+            hash = ( hash ^ word ) * 0x9e3779b97f4a7c15ULL;
+            hash ^= hash >> 29;
+        }
+
+        size += N_read;
+    }
+
+    fingerprint = ( hash ^ size ) * 0x100000001b3ULL;
+
+    return 0;
+}
+
+
+//-----------------------------------------------------------
+//
+//                     Sidecar file
+//
+//-----------------------------------------------------------
+
+// Format of the file, after the header lines starting with '#':
+//   [version] [fingerprint]
+//   [number_of_sensors]
+//   [sensor_1_label]
+//   [observations] [depth_observations] [depth_pixels] [min] [max] [sum]
+//   [number_of_labels]
+//   [label_1]
+//   [occurrences] [pixels]
+//   [distance sketch]
+//   [area sketch]
+//   [extent sketch]
+//   ...
+
+static const int STATS_FILE_VERSION = 2;
+
+string CRawlogStatistics::getFileName( const string &rawlogFile )
+{
+    return mrpt::system::fileNameChangeExtension( rawlogFile, "stats" );
+}
+
+int CRawlogStatistics::save( const string &rawlogFile, uint64_t fingerprint ) const
+{
+    const string fileName = getFileName( rawlogFile );
+    const string tmpFileName = fileName + ".tmp";
+
+    ofstream file( tmpFileName.c_str() );
+
+    if ( !file.is_open() )
+    {
+        cerr << "  [ERROR] Couldn't create the statistics file " << fileName << endl;
+        return -1;
+    }
+
+    file << "# Statistics of " << mrpt::system::extractFileName(rawlogFile) << endl;
+    file << "# [version] [fingerprint], then per sensor [label] [observations] [depth observations]" << endl;
+    file << "# [depth pixels] [min depth] [max depth] [sum of depths] and its labels with their distributions" << endl;
+    file << STATS_FILE_VERSION << " " << hex << fingerprint << dec << endl;
+    file << sensors.size() << endl;
+
+    file << setprecision(17);
+
+    map<string,TSensorStatistics>::const_iterator it;
+
+    for ( it = sensors.begin(); it != sensors.end(); it++ )
+    {
+        const TSensorStatistics &stats = it->second;
+
+        file << it->first << endl;
+        file << stats.N_observations << " " << stats.N_depthObservations << " "
+             << stats.N_depthPixels << " " << stats.minDepth << " "
+             << stats.maxDepth << " " << stats.sumDepth << endl;
+
+        // Labels in the occurrences map are the same as in the pixels one
+        file << stats.labelOccurrences.size() << endl;
+
+        map<string,size_t>::const_iterator label_it;
+
+        for ( label_it = stats.labelOccurrences.begin();
+              label_it != stats.labelOccurrences.end();
+              label_it++ )
+        {
+            map<string,size_t>::const_iterator pixels_it = stats.labelNumOfPixels.find( label_it->first );
+
+            file << label_it->first << endl;
+            file << label_it->second << " "
+                 << ( ( pixels_it != stats.labelNumOfPixels.end() ) ? pixels_it->second : 0 ) << endl;
+
+            map<string,TLabelDistributions>::const_iterator dist_it = stats.labelDistributions.find( label_it->first );
+            const TLabelDistributions distributions = ( dist_it != stats.labelDistributions.end() ) ?
+                        dist_it->second : TLabelDistributions();
+
+            distributions.distance.save( file ); file << endl;
+            distributions.area.save( file ); file << endl;
+            distributions.extent.save( file ); file << endl;
+        }
+    }
+
+    file.close();
+
+    if ( file.fail() || rename( tmpFileName.c_str(), fileName.c_str() ) )
+    {
+        cerr << "  [ERROR] While writing the statistics file " << fileName << endl;
+        remove( tmpFileName.c_str() );
+        return -1;
+    }
+
+    return 0;
+}
+
+int CRawlogStatistics::load( const string &rawlogFile, uint64_t fingerprint )
+{
+    clear();
+
+    const string fileName = getFileName( rawlogFile );
+
+    ifstream file( fileName.c_str() );
+
+    if ( !file.is_open() )
+        return -1;
+
+    string line;
+
+    while ( ( file >> ws ) && ( file.peek() == '#' ) )
+        getline( file, line );
+
+    int version;
+    uint64_t fileFingerprint;
+    size_t N_sensors;
+
+    if ( !( file >> version >> hex >> fileFingerprint >> dec >> N_sensors ) )
+    {
+        cerr << "  [ERROR] Invalid statistics file " << fileName << endl;
+        return -1;
+    }
+
+    // Outdated, computed with a previous rawlog or version
+    if ( ( version != STATS_FILE_VERSION ) || ( fileFingerprint != fingerprint ) )
+        return -1;
+
+    for ( size_t sensor_index = 0; sensor_index < N_sensors; sensor_index++ )
+    {
+        string sensorLabel;
+        size_t N_labels;
+
+        file >> ws;
+        getline( file, sensorLabel );
+
+        TSensorStatistics &stats = sensors[sensorLabel];
+
+        if ( !( file >> stats.N_observations >> stats.N_depthObservations
+                     >> stats.N_depthPixels >> stats.minDepth >> stats.maxDepth
+                     >> stats.sumDepth >> N_labels ) )
+        {
+            cerr << "  [ERROR] Invalid sensor " << sensor_index << " in the statistics file " << fileName << endl;
+            clear();
+            return -1;
+        }
+
+        for ( size_t label_index = 0; label_index < N_labels; label_index++ )
+        {
+            string label;
+
+            file >> ws;
+            getline( file, label );
+
+            TLabelDistributions &distributions = stats.labelDistributions[label];
+
+            if ( !( file >> stats.labelOccurrences[label] >> stats.labelNumOfPixels[label] )
+                 || distributions.distance.load( file ) || distributions.area.load( file )
+                 || distributions.extent.load( file ) )
+            {
+                cerr << "  [ERROR] Invalid label " << label_index << " in the statistics file " << fileName << endl;
+                clear();
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*---------------------------------------------------------------------------*
+ |                         Object Labeling Toolkit                           |
+ |            A set of software components for the management and            |
+ |                      labeling of RGB-D datasets                           |
+ |                                                                           |
+ |            Copyright (C) 2015-2016 Jose Raul Ruiz Sarmiento               |
+ |                 University of Malaga <jotaraul@uma.es>                    |
+ |             MAPIR Group: <http://http://mapir.isa.uma.es/>                |
+ |                                                                           |
+ |   This program is free software: you can redistribute it and/or modify    |
+ |   it under the terms of the GNU General Public License as published by    |
+ |   the Free Software Foundation, either version 3 of the License, or       |
+ |   (at your option) any later version.                                     |
+ |                                                                           |
+ |   This program is distributed in the hope that it will be useful,         |
+ |   but WITHOUT ANY WARRANTY; without even the implied warranty of          |
+ |   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the            |
+ |   GNU General Public License for more details.                            |
+ |   <http://www.gnu.org/licenses/>                                          |
+ |                                                                           |
+ *---------------------------------------------------------------------------*/
+
+
+
+#ifndef _OLT_RAWLOG_STATISTICS_
+#define _OLT_RAWLOG_STATISTICS_
+
+#include "core.hpp"
+#include "CQuantileSketch.hpp"
+
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <mrpt/obs/CObservation3DRangeScan.h>
+
+
+namespace OLT
+{
+    /** Distributions of the occurrences of a label: mean distance of its
+      * pixels to the sensor, number of pixels, and diagonal of the box
+      * enclosing its 3D points (in the sensor frame). */
+
+    struct TLabelDistributions
+    {
+        CQuantileSketch distance;
+        CQuantileSketch area;
+        CQuantileSketch extent;
+
+        void merge( const TLabelDistributions &other );
+    };
+
+    /** Statistics of the 3D observations of a sensor. Labels are kept with
+      * their names in the rawlog (e.g. instances like table_1), so reports
+      * can group them as they need. */
+
+    struct TSensorStatistics
+    {
+        size_t  N_observations;
+        size_t  N_depthObservations;    // Observations with a range image
+        size_t  N_depthPixels;          // Pixels with a valid depth
+        double  minDepth, maxDepth, sumDepth;
+
+        std::map<std::string,size_t> labelOccurrences; // <label,n_occurrences>
+        std::map<std::string,size_t> labelNumOfPixels; // <label,n_pixels>
+        std::map<std::string,TLabelDistributions> labelDistributions;
+
+        TSensorStatistics();
+
+        void merge( const TSensorStatistics &other );
+    };
+
+    /** Statistics of a rawlog, per sensor. They are stored in a sidecar file
+      * next to the rawlog (<rawlog>.stats) along with a fingerprint of its
+      * content, so they are only recomputed if the rawlog changes. Since
+      * they are counts and mergeable sketches, statistics of several
+      * rawlogs or sensors are merged without going back to the observations. */
+
+    class CRawlogStatistics
+    {
+    public:
+
+        std::map<std::string,TSensorStatistics> sensors; // <sensor label,stats>
+
+        void clear() { sensors.clear(); }
+
+        /** Update the statistics of the sensor of an observation. */
+        void addObservation( mrpt::obs::CObservation3DRangeScanPtr obs );
+
+        void merge( const CRawlogStatistics &other );
+
+        /** Statistics of a rawlog, streaming its observations. */
+        int compute( const std::string &rawlogFile );
+
+        /** Statistics of a rawlog from its sidecar if it is up to date with
+          * the rawlog, otherwise computed and stored in the sidecar. */
+        int computeOrLoad( const std::string &rawlogFile, bool &fromCache,
+                           bool useCache = true );
+
+        /** Hash of the size and the bytes of a file. */
+        static int computeFingerprint( const std::string &fileName, uint64_t &fingerprint );
+
+        static std::string getFileName( const std::string &rawlogFile );
+
+        int save( const std::string &rawlogFile, uint64_t fingerprint ) const;
+
+        /** Load the sidecar of a rawlog. Fails if it doesn't exist or it was
+          * computed from a rawlog with another fingerprint. */
+        int load( const std::string &rawlogFile, uint64_t fingerprint );
+    };
+}
+
+
+#endif
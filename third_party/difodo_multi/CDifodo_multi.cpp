@@ -11,6 +11,7 @@
 #include <mrpt/utils/utils_defs.h>
 #include <mrpt/utils/CTicTac.h>
 #include <mrpt/utils/round.h>
+#include "CTaskScheduler.hpp"
 
 using namespace mrpt;
 using namespace mrpt::math;
@@ -520,16 +521,24 @@ void CDifodo::calculateCoord()
 
 void CDifodo::calculateDepthDerivatives()
 {
-	for (unsigned int c=0; c<NC; c++)
+	TPerCameraCall perCamera(this, &CDifodo::calculateDepthDerivatives);
+	OLT::parallelFor(0, NC, perCamera);
+}
+
+void CDifodo::calculateDepthDerivatives(unsigned int c)
+{
 	{
 		dt[c].resize(rows_i,cols_i); dt[c].assign(0.f);
 		du[c].resize(rows_i,cols_i); du[c].assign(0.f);
 		dv[c].resize(rows_i,cols_i); dv[c].assign(0.f);
 
-		//Compute connectivity
-		MatrixXf rx_ninv(rows_i,cols_i);
-		MatrixXf ry_ninv(rows_i,cols_i);
-		rx_ninv.assign(1.f); ry_ninv.assign(1.f);
+		//Compute connectivity (temporary buffers from the scratch arena of the thread)
+		OLT::CScratchArena &arena = OLT::CTaskScheduler::getScratchArena();
+		OLT::CScratchScope scope(arena);
+
+		Map<MatrixXf> rx_ninv(arena.allocate<float>(rows_i*cols_i), rows_i, cols_i);
+		Map<MatrixXf> ry_ninv(arena.allocate<float>(rows_i*cols_i), rows_i, cols_i);
+		rx_ninv.fill(1.f); ry_ninv.fill(1.f);
 
 		for (unsigned int u = 0; u < cols_i-1; u++)
 			for (unsigned int v = 0; v < rows_i; v++)
@@ -579,7 +588,25 @@ void CDifodo::calculateDepthDerivatives()
 
 void CDifodo::computeWeights()
 {
+	TPerCameraCall perCamera(this, &CDifodo::computeWeights);
+	OLT::parallelFor(0, NC, perCamera);
+
+	//Normalize weights in the range [0,1]
+	float max_weight = 0.f;
+
 	for (unsigned int c=0; c<NC; c++)
+	{
+		if (weights[c].maximum() > max_weight)
+			max_weight = weights[c].maximum();
+	}
+
+	const float inv_max = 1.f/max_weight;
+	for (unsigned int c=0; c<NC; c++)
+		weights[c] *= inv_max;
+}
+
+void CDifodo::computeWeights(unsigned int c)
+{
 	{
 		weights[c].resize(rows_i, cols_i);
 		weights[c].assign(0.f);
@@ -622,19 +649,6 @@ void CDifodo::computeWeights()
 				
 				}
 	}
-	
-	//Normalize weights in the range [0,1]
-	float max_weight = 0.f;
-
-	for (unsigned int c=0; c<NC; c++)
-	{
-		if (weights[c].maximum() > max_weight)
-			max_weight = weights[c].maximum();
-	}
-
-	const float inv_max = 1.f/max_weight;
-	for (unsigned int c=0; c<NC; c++)
-		weights[c] *= inv_max;
 }
 
 void CDifodo::solveOneLevel()
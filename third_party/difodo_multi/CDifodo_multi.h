@@ -152,9 +152,21 @@ protected:
 
 	/** Calculates the depth derivatives respect to u,v (rows and cols) and t (time) */
 	void calculateDepthDerivatives();
+	void calculateDepthDerivatives(unsigned int c);
 
 	/** This method computes the weighting fuction associated to measurement and linearization errors */
 	void computeWeights();
+	void computeWeights(unsigned int c);
+
+	/** Calls a per camera method, so the cameras can be processed in parallel by the OLT task scheduler */
+	struct TPerCameraCall
+	{
+		CDifodo *difodo;
+		void (CDifodo::*method)(unsigned int);
+
+		TPerCameraCall(CDifodo *difodo, void (CDifodo::*method)(unsigned int)) : difodo(difodo), method(method) {}
+		void operator()(size_t c) const { (difodo->*method)(c); }
+	};
 
 	/** The Solver. It buils the overdetermined system and gets the least-square solution.
 		* It also calculates the least-square covariance matrix */